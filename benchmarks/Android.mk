@@ -63,6 +63,7 @@ endif
 # Benchmarks.
 # -----------------------------------------------------------------------------
 benchmark_src_files := \
+    malloc_benchmark.cpp \
     math_benchmark.cpp \
     property_benchmark.cpp \
     pthread_benchmark.cpp \
@@ -86,6 +87,21 @@ LOCAL_SRC_FILES := $(benchmark_src_files)
 LOCAL_STATIC_LIBRARIES := libbenchmark libbase
 include $(BUILD_EXECUTABLE)
 
+# Replays the allocation traces written by the malloc debug
+# record_allocs option. Run with:
+#   adb shell malloc-replay32 TRACE_FILE
+#   adb shell malloc-replay64 TRACE_FILE
+include $(CLEAR_VARS)
+LOCAL_MODULE := malloc-replay
+LOCAL_MODULE_STEM_32 := malloc-replay32
+LOCAL_MODULE_STEM_64 := malloc-replay64
+LOCAL_MULTILIB := both
+LOCAL_CFLAGS := $(benchmark_cflags)
+LOCAL_CPPFLAGS := $(benchmark_cppflags)
+LOCAL_SRC_FILES := malloc_replay.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../libc/malloc_debug
+include $(BUILD_EXECUTABLE)
+
 # We don't build a static benchmark executable because it's not usually
 # useful. If you're trying to run the current benchmarks on an older
 # release, it's (so far at least) always because you want to measure the
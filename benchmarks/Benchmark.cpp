@@ -119,6 +119,7 @@ void BenchmarkT<T>::RunWithArg(T arg) {
     bytes_processed_ = 0;
     total_time_ns_ = 0;
     start_time_ns_ = 0;
+    label_.clear();
 
     iterations = new_iterations;
     RunIterations(iterations, arg);
@@ -145,6 +146,9 @@ void BenchmarkT<T>::RunWithArg(T arg) {
     double seconds = static_cast<double>(total_time_ns_)/1e9;
     printf(" %8.3f GiB/s", gib_processed/seconds);
   }
+  if (!label_.empty()) {
+    printf(" %s", label_.c_str());
+  }
   printf("\n");
   fflush(stdout);
 }
@@ -37,6 +37,8 @@ public:
   virtual size_t RunAllArgs(std::vector<regex_t*>&) = 0;
 
   void SetBenchmarkBytesProcessed(uint64_t bytes) { bytes_processed_ += bytes; }
+  // Extra information printed after the result, such as a memory usage.
+  void SetBenchmarkLabel(const std::string& label) { label_ = label; }
   void StopBenchmarkTiming();
   void StartBenchmarkTiming();
 
@@ -53,6 +55,7 @@ protected:
   uint64_t bytes_processed_;
   uint64_t total_time_ns_;
   uint64_t start_time_ns_;
+  std::string label_;
 
   static bool header_printed_;
 
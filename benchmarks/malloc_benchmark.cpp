@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <malloc.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <base/stringprintf.h>
+#include <benchmark/Benchmark.h>
+
+#include "utils.h"
+
+#define KB 1024
+#define MB 1024*KB
+
+// These only use the public allocation functions, so they measure whichever
+// backend libc was built with, and everything in malloc_common.cpp. To
+// measure malloc_debug, enable it for the benchmark program, for example:
+//   adb shell setprop libc.debug.malloc.program bionic-benchmarks
+//   adb shell setprop libc.debug.malloc.options backtrace
+// and compare against a run with the options property cleared.
+
+// Writes one byte in every page, the way a caller filling the buffer
+// would fault it in.
+static void TouchPages(uint8_t* data, size_t start, size_t end) {
+  size_t page_size = getpagesize();
+  for (size_t i = start; i < end; i += page_size) {
+    data[i] = 1;
+  }
+}
+
+// A small fast generator, so that picking sizes doesn't cost more than
+// the allocations being measured.
+static uint32_t NextRandom(uint32_t* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+static size_t GetRss() {
+  FILE* fp = fopen("/proc/self/statm", "re");
+  if (fp == nullptr) {
+    return 0;
+  }
+  size_t size;
+  size_t resident = 0;
+  if (fscanf(fp, "%zu %zu", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(fp);
+  return resident * getpagesize();
+}
+
+static void FreeAll(void** ptrs, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    free(ptrs[i]);
+    ptrs[i] = nullptr;
+  }
+}
+
+// A malloc immediately followed by a free, the best case for every cache
+// in the allocator.
+static void MallocFree(int iters, size_t size) {
+  for (int i = 0; i < iters; ++i) {
+    void* ptr = malloc(size);
+    if (ptr == nullptr) {
+      abort();
+    }
+    free(ptr);
+  }
+}
+
+BENCHMARK_WITH_ARG(BM_malloc_free, int)->Arg(8)->Arg(16)->Arg(64)->Arg(256)->Arg(1*KB)
+    ->Arg(4*KB)->Arg(64*KB)->Arg(1*MB);
+void BM_malloc_free::Run(int iters, int size) {
+  StartBenchmarkTiming();
+  MallocFree(iters, size);
+  StopBenchmarkTiming();
+}
+
+// Sizes just past a size class, which round up to the next one.
+BENCHMARK_WITH_ARG(BM_malloc_free_odd, int)->Arg(9)->Arg(24)->Arg(100)->Arg(1000)->Arg(3000)
+    ->Arg(5000)->Arg(100000);
+void BM_malloc_free_odd::Run(int iters, int size) {
+  StartBenchmarkTiming();
+  MallocFree(iters, size);
+  StopBenchmarkTiming();
+}
+
+// Allocates a set of blocks of random sizes up to the given size, then
+// frees them in a different order, so that the allocator has to split
+// and coalesce rather than reuse the block it just freed.
+BENCHMARK_WITH_ARG(BM_malloc_free_batch, int)->Arg(64)->Arg(1*KB)->Arg(16*KB);
+void BM_malloc_free_batch::Run(int iters, int max_size) {
+  const size_t batch = 256;
+  void* ptrs[batch];
+  uint32_t seed = 1;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (size_t j = 0; j < batch; ++j) {
+      ptrs[j] = malloc(1 + NextRandom(&seed) % max_size);
+      if (ptrs[j] == nullptr) {
+        abort();
+      }
+    }
+    // 97 is coprime to the batch size, so this visits every pointer once.
+    for (size_t j = 0; j < batch; ++j) {
+      free(ptrs[(j * 97) % batch]);
+    }
+  }
+  StopBenchmarkTiming();
+}
+
+// Large calloc calls, including touching the pages, since an allocator
+// that gets fresh zero pages from the kernel only pays when they fault in.
+BENCHMARK_WITH_ARG(BM_malloc_calloc_large, int)->Arg(64*KB)->Arg(1*MB)->Arg(16*MB);
+void BM_malloc_calloc_large::Run(int iters, int size) {
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    uint8_t* data = reinterpret_cast<uint8_t*>(calloc(1, size));
+    if (data == nullptr) {
+      abort();
+    }
+    TouchPages(data, 0, size);
+    free(data);
+  }
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(static_cast<uint64_t>(iters) * size);
+}
+
+// Grows a buffer from 1MB to the given size by doubling it, as a growing
+// vector or string builder would. The pages are faulted in as the buffer
+// grows, so the time that is left to the allocator is the cost of moving
+// the buffer: a copy of everything so far, or a remap of the pages.
+BENCHMARK_WITH_ARG(BM_malloc_realloc_grow, int)->Arg(16*MB)->Arg(256*MB)->Arg(1024*MB);
+void BM_malloc_realloc_grow::Run(int iters, int max_bytes) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    size_t size = 1*MB;
+    uint8_t* data = reinterpret_cast<uint8_t*>(malloc(size));
+    if (data == nullptr) {
+      abort();
+    }
+    TouchPages(data, 0, size);
+
+    while (size < static_cast<size_t>(max_bytes)) {
+      uint8_t* new_data = reinterpret_cast<uint8_t*>(realloc(data, size * 2));
+      if (new_data == nullptr) {
+        // Not enough address space, on 32 bit for example.
+        break;
+      }
+      data = new_data;
+      TouchPages(data, size, size * 2);
+      size *= 2;
+    }
+    free(data);
+  }
+
+  StopBenchmarkTiming();
+}
+
+BENCHMARK_WITH_ARG(BM_malloc_memalign, int)->Arg(16)->Arg(64)->Arg(256)->Arg(4*KB)
+    ->Arg(64*KB);
+void BM_malloc_memalign::Run(int iters, int alignment) {
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    void* ptr = memalign(alignment, 200);
+    if (ptr == nullptr) {
+      abort();
+    }
+    free(ptr);
+  }
+  StopBenchmarkTiming();
+}
+
+// Batches of pointers handed from the allocating thread to the freeing
+// thread. A batch with a count of 0 tells the consumer to stop.
+struct CrossThreadQueue {
+  static constexpr size_t kBatches = 4;
+  static constexpr size_t kBatchSize = 256;
+
+  sem_t full;
+  sem_t empty;
+  size_t counts[kBatches];
+  void* ptrs[kBatches][kBatchSize];
+};
+
+static void* CrossThreadConsumer(void* arg) {
+  CrossThreadQueue* queue = reinterpret_cast<CrossThreadQueue*>(arg);
+  for (size_t idx = 0; ; idx = (idx + 1) % CrossThreadQueue::kBatches) {
+    sem_wait(&queue->full);
+    size_t count = queue->counts[idx];
+    FreeAll(queue->ptrs[idx], count);
+    sem_post(&queue->empty);
+    if (count == 0) {
+      return nullptr;
+    }
+  }
+}
+
+// A producer/consumer pair, where every allocation is freed by another
+// thread. This is the worst case for thread caches, which have to hand
+// the memory back to the arena of the allocating thread.
+BENCHMARK_WITH_ARG(BM_malloc_cross_thread_free, int)->Arg(16)->Arg(256)->Arg(4*KB);
+void BM_malloc_cross_thread_free::Run(int iters, int size) {
+  CrossThreadQueue* queue = new CrossThreadQueue;
+  sem_init(&queue->full, 0, 0);
+  sem_init(&queue->empty, 0, CrossThreadQueue::kBatches);
+  pthread_t consumer;
+  pthread_create(&consumer, nullptr, CrossThreadConsumer, queue);
+
+  StartBenchmarkTiming();
+  size_t idx = 0;
+  for (int done = 0; done < iters; idx = (idx + 1) % CrossThreadQueue::kBatches) {
+    size_t count = std::min<size_t>(iters - done, CrossThreadQueue::kBatchSize);
+    sem_wait(&queue->empty);
+    for (size_t j = 0; j < count; ++j) {
+      queue->ptrs[idx][j] = malloc(size);
+      if (queue->ptrs[idx][j] == nullptr) {
+        abort();
+      }
+    }
+    queue->counts[idx] = count;
+    sem_post(&queue->full);
+    done += count;
+  }
+  sem_wait(&queue->empty);
+  queue->counts[idx] = 0;
+  sem_post(&queue->full);
+  pthread_join(consumer, nullptr);
+  StopBenchmarkTiming();
+
+  sem_destroy(&queue->full);
+  sem_destroy(&queue->empty);
+  delete queue;
+}
+
+struct ScalingArgs {
+  int iters;
+  StartGate* start;
+};
+
+// Each thread keeps a small working set of mixed size allocations and
+// replaces one of them at random on every iteration.
+static void* ScalingThread(void* arg) {
+  ScalingArgs* args = reinterpret_cast<ScalingArgs*>(arg);
+  const size_t working_set = 64;
+  void* ptrs[working_set] = {};
+  uint32_t seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&seed));
+
+  StartGateWait(args->start);
+  for (int i = 0; i < args->iters; ++i) {
+    uint32_t r = NextRandom(&seed);
+    size_t slot = r % working_set;
+    free(ptrs[slot]);
+    ptrs[slot] = malloc(16 + (r >> 6) % 1024);
+    if (ptrs[slot] == nullptr) {
+      abort();
+    }
+  }
+  FreeAll(ptrs, working_set);
+  return nullptr;
+}
+
+// The same work on N threads at once. The time is per iteration of one
+// thread, so an allocator that scales perfectly reports the same time
+// for every thread count, on a device with at least that many cores.
+BENCHMARK_WITH_ARG(BM_malloc_thread_scaling, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+void BM_malloc_thread_scaling::Run(int iters, int nthreads) {
+  StartGate start = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false };
+  ScalingArgs args = { iters, &start };
+  std::vector<pthread_t> threads(nthreads);
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_create(&threads[i], nullptr, ScalingThread, &args);
+  }
+
+  StartGateOpen(&start, nthreads);
+  StartBenchmarkTiming();
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_join(threads[i], nullptr);
+  }
+  StopBenchmarkTiming();
+}
+
+// Fills the given number of bytes with small allocations, frees three out
+// of four of them, then allocates larger blocks that don't fit in the
+// holes. The label shows the live bytes against the resident size of the
+// process at the end, the difference being the memory lost to
+// fragmentation (and everything else in the process).
+BENCHMARK_WITH_ARG(BM_malloc_fragmentation, int)->Arg(16*MB)->Arg(64*MB);
+void BM_malloc_fragmentation::Run(int iters, int total_bytes) {
+  size_t nsmall = total_bytes / 128;
+  size_t nlarge = total_bytes / 4 / (8*KB);
+  void** small_ptrs = reinterpret_cast<void**>(calloc(nsmall, sizeof(void*)));
+  void** large_ptrs = reinterpret_cast<void**>(calloc(nlarge, sizeof(void*)));
+  if (small_ptrs == nullptr || large_ptrs == nullptr) {
+    abort();
+  }
+  uint32_t seed = 1;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    size_t live = 0;
+    for (size_t j = 0; j < nsmall; ++j) {
+      size_t size = 16 + NextRandom(&seed) % 224;
+      small_ptrs[j] = malloc(size);
+      if (small_ptrs[j] == nullptr) {
+        abort();
+      }
+      memset(small_ptrs[j], 1, size);
+    }
+    for (size_t j = 0; j < nsmall; ++j) {
+      if (j % 4 != 0) {
+        free(small_ptrs[j]);
+        small_ptrs[j] = nullptr;
+      } else {
+        live += malloc_usable_size(small_ptrs[j]);
+      }
+    }
+    for (size_t j = 0; j < nlarge; ++j) {
+      size_t size = 4*KB + NextRandom(&seed) % (8*KB);
+      large_ptrs[j] = malloc(size);
+      if (large_ptrs[j] == nullptr) {
+        abort();
+      }
+      memset(large_ptrs[j], 1, size);
+      live += malloc_usable_size(large_ptrs[j]);
+    }
+
+    if (i == iters - 1) {
+      StopBenchmarkTiming();
+      SetBenchmarkLabel(android::base::StringPrintf("live %zuKiB rss %zuKiB",
+                                                    live / KB, GetRss() / KB));
+      StartBenchmarkTiming();
+    }
+    FreeAll(small_ptrs, nsmall);
+    FreeAll(large_ptrs, nlarge);
+  }
+  StopBenchmarkTiming();
+
+  free(small_ptrs);
+  free(large_ptrs);
+}
+
+// Reads random words from a heap of the given size made of 4KB blocks.
+// Every read is likely to miss the TLB, so this measures how well the heap
+// is covered by huge pages. Run it once as is and once with
+// LIBC_MALLOC_HUGE_PAGES=1 in the environment to compare.
+BENCHMARK_WITH_ARG(BM_malloc_random_access, int)->Arg(64*MB)->Arg(256*MB);
+void BM_malloc_random_access::Run(int iters, int heap_bytes) {
+  const size_t block_size = 4*KB;
+  const size_t words_per_block = block_size / sizeof(uint64_t);
+  size_t nblocks = heap_bytes / block_size;
+  uint64_t** blocks = reinterpret_cast<uint64_t**>(malloc(nblocks * sizeof(uint64_t*)));
+  if (blocks == nullptr) {
+    abort();
+  }
+  for (size_t i = 0; i < nblocks; ++i) {
+    blocks[i] = reinterpret_cast<uint64_t*>(malloc(block_size));
+    if (blocks[i] == nullptr) {
+      abort();
+    }
+    memset(blocks[i], static_cast<int>(i), block_size);
+  }
+
+  uint64_t sum = 0;
+  uint32_t seed = 1;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (size_t j = 0; j < 64*KB; ++j) {
+      seed = seed * 1103515245 + 12345;
+      uint64_t* block = blocks[seed % nblocks];
+      sum += block[(seed >> 16) % words_per_block];
+    }
+  }
+  StopBenchmarkTiming();
+
+  // Keep the reads from being optimized away.
+  if (sum == 1) {
+    blocks[0][0] = sum;
+  }
+  for (size_t i = 0; i < nblocks; ++i) {
+    free(blocks[i]);
+  }
+  free(blocks);
+}
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Replays an allocation trace written by the malloc debug record_allocs
+// option, and reports how long the allocator took, the peak RSS and the
+// fragmentation of the heap. Every thread of the trace gets a replay
+// thread, and the threads replay their calls concurrently. A call that
+// frees or reallocs an allocation made by another thread waits until that
+// allocation has been replayed; nothing else orders the threads. Run with:
+//   adb shell malloc-replay64 /data/local/tmp/record_allocs.<pid>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "record_format.h"
+
+static constexpr size_t NO_SLOT = SIZE_MAX;
+
+// The trace is converted before the replay so that the replay only
+// indexes an array; pointers from the trace are mapped to slots, one per
+// allocation.
+struct ReplayOp {
+  uint32_t op;
+  uint32_t thread;
+  size_t slot;
+  size_t old_slot;
+  size_t size;
+  size_t extra;
+};
+
+static bool ReadTrace(const char* path, std::vector<RecordEntry>* entries) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  RecordFileHeader header;
+  if (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) != sizeof(header) ||
+      memcmp(header.magic, RECORD_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RECORD_FILE_VERSION || header.entry_size != sizeof(RecordEntry)) {
+    fprintf(stderr, "%s is not a record_allocs trace of this version\n", path);
+    close(fd);
+    return false;
+  }
+
+  RecordEntry buffer[1024];
+  ssize_t bytes;
+  while ((bytes = TEMP_FAILURE_RETRY(read(fd, buffer, sizeof(buffer)))) > 0) {
+    entries->insert(entries->end(), buffer, buffer + bytes / sizeof(RecordEntry));
+  }
+  close(fd);
+
+  std::sort(entries->begin(), entries->end(),
+            [](const RecordEntry& a, const RecordEntry& b) { return a.sequence < b.sequence; });
+  return true;
+}
+
+// Returns the number of slots, and sets num_threads to the number of
+// threads in the trace.
+static size_t ConvertTrace(const std::vector<RecordEntry>& entries, std::vector<ReplayOp>* ops,
+                           size_t* num_threads) {
+  std::unordered_map<uint64_t, size_t> live;
+  std::unordered_map<uint32_t, uint32_t> threads;
+  size_t num_slots = 0;
+  uint32_t thread = 0;
+
+  auto free_pointer = [&](uint64_t pointer) {
+    auto it = live.find(pointer);
+    if (it == live.end()) {
+      return NO_SLOT;
+    }
+    size_t slot = it->second;
+    live.erase(it);
+    return slot;
+  };
+  auto new_slot = [&](uint64_t pointer) {
+    // Entries of racing threads can show an address being reused before it
+    // was freed, free the old allocation first.
+    size_t slot = free_pointer(pointer);
+    if (slot != NO_SLOT) {
+      ops->push_back(ReplayOp{RECORD_OP_FREE, thread, slot, NO_SLOT, 0, 0});
+    }
+    live[pointer] = num_slots;
+    return num_slots++;
+  };
+
+  for (const auto& entry : entries) {
+    auto it = threads.find(entry.tid);
+    if (it == threads.end()) {
+      it = threads.emplace(entry.tid, threads.size()).first;
+    }
+    thread = it->second;
+
+    switch (entry.op) {
+      case RECORD_OP_MALLOC:
+      case RECORD_OP_CALLOC:
+      case RECORD_OP_MEMALIGN:
+        if (entry.pointer != 0) {
+          ops->push_back(ReplayOp{entry.op, thread, new_slot(entry.pointer), NO_SLOT,
+                                  entry.size, entry.extra});
+        }
+        break;
+      case RECORD_OP_REALLOC: {
+        if (entry.pointer == 0 && entry.size != 0) {
+          // The realloc failed and did not change the old allocation.
+          break;
+        }
+        size_t old_slot = (entry.extra != 0) ? free_pointer(entry.extra) : NO_SLOT;
+        size_t slot = (entry.pointer != 0) ? new_slot(entry.pointer) : NO_SLOT;
+        if (old_slot == NO_SLOT && slot == NO_SLOT) {
+          break;
+        }
+        ops->push_back(ReplayOp{entry.op, thread, slot, old_slot, entry.size, 0});
+        break;
+      }
+      case RECORD_OP_FREE: {
+        // Frees of allocations made before the trace started are skipped.
+        size_t slot = free_pointer(entry.pointer);
+        if (slot != NO_SLOT) {
+          ops->push_back(ReplayOp{entry.op, thread, slot, NO_SLOT, 0, 0});
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  *num_threads = threads.size();
+  return num_slots;
+}
+
+// Reads a "Name:  value kB" line from /proc/self/status.
+static size_t ReadStatusKb(const char* name) {
+  FILE* fp = fopen("/proc/self/status", "re");
+  if (fp == nullptr) {
+    return 0;
+  }
+  size_t name_len = strlen(name);
+  size_t value = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != nullptr) {
+    if (strncmp(line, name, name_len) == 0 && line[name_len] == ':') {
+      value = strtoull(&line[name_len + 1], nullptr, 10);
+      break;
+    }
+  }
+  fclose(fp);
+  return value;
+}
+
+// Resets the peak RSS of the process to the current RSS.
+static void ResetPeakRss() {
+  int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd != -1) {
+    TEMP_FAILURE_RETRY(write(fd, "5", 1));
+    close(fd);
+  }
+}
+
+// The allocations are touched once per page so that they count in the RSS
+// the way they would in the traced program.
+static void Touch(void* pointer, size_t size) {
+  uint8_t* data = reinterpret_cast<uint8_t*>(pointer);
+  size_t page_size = getpagesize();
+  for (size_t i = 0; i < size; i += page_size) {
+    data[i] = 1;
+  }
+  if (size > 0) {
+    data[size - 1] = 1;
+  }
+}
+
+static uint64_t NanoTime() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+static size_t Percent(size_t part, size_t total) {
+  return (total == 0) ? 0 : part * 100 / total;
+}
+
+// State shared by the replay threads. Every slot is set by the call that
+// makes its allocation and then used by the call that frees it, possibly on
+// another thread; the ready flag of the slot orders the two.
+struct Replay {
+  std::vector<ReplayOp> ops;
+  std::vector<void*> slots;
+  std::vector<size_t> slot_sizes;
+  std::unique_ptr<std::atomic<bool>[]> slot_ready;
+  std::atomic<size_t> live_bytes;
+  std::atomic<size_t> peak_live_bytes;
+};
+
+struct ReplayThread {
+  Replay* replay;
+  std::vector<size_t> ops;
+  uint64_t total_ns = 0;
+  pthread_t thread;
+};
+
+static void WaitForSlot(Replay* replay, size_t slot) {
+  for (size_t spins = 0; !replay->slot_ready[slot].load(std::memory_order_acquire); spins++) {
+    if (spins >= 100) {
+      sched_yield();
+    }
+  }
+}
+
+static void SetSlot(Replay* replay, size_t slot, void* pointer, size_t size) {
+  replay->slots[slot] = pointer;
+  replay->slot_sizes[slot] = size;
+  replay->slot_ready[slot].store(true, std::memory_order_release);
+}
+
+static void AddLiveBytes(Replay* replay, size_t size) {
+  size_t live_bytes = replay->live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  size_t peak = replay->peak_live_bytes.load(std::memory_order_relaxed);
+  while (live_bytes > peak &&
+         !replay->peak_live_bytes.compare_exchange_weak(peak, live_bytes,
+                                                        std::memory_order_relaxed)) {
+  }
+}
+
+static void ReplayOne(ReplayThread* thread, const ReplayOp& op) {
+  Replay* replay = thread->replay;
+  std::vector<void*>& slots = replay->slots;
+  std::vector<size_t>& slot_sizes = replay->slot_sizes;
+
+  // Only the allocation being freed can come from another thread.
+  if (op.op == RECORD_OP_FREE) {
+    WaitForSlot(replay, op.slot);
+  } else if (op.old_slot != NO_SLOT) {
+    WaitForSlot(replay, op.old_slot);
+  }
+
+  void* pointer = nullptr;
+  uint64_t start_ns = NanoTime();
+  switch (op.op) {
+    case RECORD_OP_MALLOC:
+      pointer = malloc(op.size);
+      break;
+    case RECORD_OP_CALLOC:
+      pointer = calloc(op.extra, op.size);
+      break;
+    case RECORD_OP_MEMALIGN:
+      pointer = memalign(op.extra, op.size);
+      break;
+    case RECORD_OP_REALLOC:
+      pointer = realloc((op.old_slot != NO_SLOT) ? slots[op.old_slot] : nullptr, op.size);
+      break;
+    case RECORD_OP_FREE:
+      free(slots[op.slot]);
+      break;
+  }
+  thread->total_ns += NanoTime() - start_ns;
+
+  if (op.op == RECORD_OP_REALLOC && pointer == nullptr && op.size != 0 &&
+      op.old_slot != NO_SLOT) {
+    // The realloc failed and left the old allocation alone, the trace
+    // refers to it by the new slot from now on.
+    if (op.slot != NO_SLOT) {
+      SetSlot(replay, op.slot, slots[op.old_slot], slot_sizes[op.old_slot]);
+      slots[op.old_slot] = nullptr;
+      slot_sizes[op.old_slot] = 0;
+    }
+    return;
+  }
+  if (op.op == RECORD_OP_FREE || op.old_slot != NO_SLOT) {
+    size_t slot = (op.op == RECORD_OP_FREE) ? op.slot : op.old_slot;
+    replay->live_bytes.fetch_sub(slot_sizes[slot], std::memory_order_relaxed);
+    slots[slot] = nullptr;
+    slot_sizes[slot] = 0;
+  }
+  if (op.op != RECORD_OP_FREE && op.slot != NO_SLOT) {
+    size_t size = (op.op == RECORD_OP_CALLOC) ? op.size * op.extra : op.size;
+    if (pointer != nullptr) {
+      Touch(pointer, size);
+      AddLiveBytes(replay, size);
+    } else {
+      size = 0;
+    }
+    // A failed call still marks the slot, so that its free doesn't wait forever.
+    SetSlot(replay, op.slot, pointer, size);
+  }
+}
+
+static void* ReplayThreadMain(void* data) {
+  ReplayThread* thread = reinterpret_cast<ReplayThread*>(data);
+  Replay* replay = thread->replay;
+  for (size_t index : thread->ops) {
+    ReplayOne(thread, replay->ops[index]);
+  }
+  return nullptr;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s TRACE_FILE\n", argv[0]);
+    return 1;
+  }
+
+  Replay replay;
+  size_t num_slots;
+  size_t num_threads;
+  {
+    std::vector<RecordEntry> entries;
+    if (!ReadTrace(argv[1], &entries)) {
+      return 1;
+    }
+    printf("%zu entries in trace\n", entries.size());
+    num_slots = ConvertTrace(entries, &replay.ops, &num_threads);
+  }
+  replay.slots.resize(num_slots, nullptr);
+  replay.slot_sizes.resize(num_slots, 0);
+  replay.slot_ready.reset(new std::atomic<bool>[num_slots]());
+  replay.live_bytes = 0;
+  replay.peak_live_bytes = 0;
+
+  std::vector<ReplayThread> threads(num_threads);
+  for (size_t i = 0; i < replay.ops.size(); i++) {
+    threads[replay.ops[i].thread].ops.push_back(i);
+  }
+
+  ResetPeakRss();
+  size_t start_rss_kb = ReadStatusKb("VmRSS");
+  uint64_t start_ns = NanoTime();
+
+  for (auto& thread : threads) {
+    thread.replay = &replay;
+    int error = pthread_create(&thread.thread, nullptr, ReplayThreadMain, &thread);
+    if (error != 0) {
+      fprintf(stderr, "Cannot create a replay thread: %s\n", strerror(error));
+      return 1;
+    }
+  }
+  for (auto& thread : threads) {
+    pthread_join(thread.thread, nullptr);
+  }
+  uint64_t wall_ns = NanoTime() - start_ns;
+  uint64_t total_ns = 0;
+  for (const auto& thread : threads) {
+    total_ns += thread.total_ns;
+  }
+
+  size_t end_rss_kb = ReadStatusKb("VmRSS");
+  size_t peak_rss_kb = ReadStatusKb("VmHWM");
+  struct mallinfo info = mallinfo();
+
+  size_t peak_heap_bytes = (peak_rss_kb - std::min(peak_rss_kb, start_rss_kb)) * 1024;
+  size_t end_heap_bytes = (end_rss_kb - std::min(end_rss_kb, start_rss_kb)) * 1024;
+  size_t in_use_bytes = info.uordblks;
+
+  size_t num_ops = replay.ops.size();
+  printf("%zu calls replayed on %zu threads in %" PRIu64 " ns (%" PRIu64 " ns per call)\n",
+         num_ops, num_threads, total_ns, (num_ops == 0) ? 0 : total_ns / num_ops);
+  printf("replay wall time: %" PRIu64 " ns\n", wall_ns);
+  printf("peak RSS: %zu kB, %zu kB above the start of the replay\n", peak_rss_kb,
+         peak_heap_bytes / 1024);
+  size_t live_bytes = replay.live_bytes;
+  size_t peak_live_bytes = replay.peak_live_bytes;
+  printf("peak live bytes: %zu, %zu%% of the peak RSS growth\n", peak_live_bytes,
+         Percent(peak_live_bytes, peak_heap_bytes));
+  printf("end live bytes: %zu, allocator in use bytes: %zu, RSS growth: %zu\n",
+         live_bytes, in_use_bytes, end_heap_bytes);
+  printf("end fragmentation: %zu%% of the allocator in use bytes, %zu%% of the RSS growth\n",
+         100 - std::min<size_t>(100, Percent(live_bytes, in_use_bytes)),
+         100 - std::min<size_t>(100, Percent(live_bytes, end_heap_bytes)));
+
+  for (auto pointer : replay.slots) {
+    free(pointer);
+  }
+  return 0;
+}
@@ -14,10 +14,20 @@
  * limitations under the License.
  */
 
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
 
 #include <benchmark/Benchmark.h>
 
+#include "utils.h"
+
 // Stop GCC optimizing out our pure function.
 /* Must not be static! */ pthread_t (*pthread_self_fp)() = pthread_self;
 
@@ -107,6 +117,40 @@ void BM_pthread_mutex_lock_ERRORCHECK::Run(int iters) {
   StopBenchmarkTiming();
 }
 
+BENCHMARK_NO_ARG(BM_pthread_mutex_lock_ADAPTIVE);
+void BM_pthread_mutex_lock_ADAPTIVE::Run(int iters) {
+  StopBenchmarkTiming();
+  pthread_mutex_t mutex = PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_mutex_lock(&mutex);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  StopBenchmarkTiming();
+}
+
+BENCHMARK_NO_ARG(BM_pthread_mutex_lock_PI);
+void BM_pthread_mutex_lock_PI::Run(int iters) {
+  StopBenchmarkTiming();
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+  pthread_mutex_t mutex;
+  pthread_mutex_init(&mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_mutex_lock(&mutex);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  StopBenchmarkTiming();
+  pthread_mutex_destroy(&mutex);
+}
+
 BENCHMARK_NO_ARG(BM_pthread_mutex_lock_RECURSIVE);
 void BM_pthread_mutex_lock_RECURSIVE::Run(int iters) {
   StopBenchmarkTiming();
@@ -121,6 +165,207 @@ void BM_pthread_mutex_lock_RECURSIVE::Run(int iters) {
   StopBenchmarkTiming();
 }
 
+struct ContendedMutexArgs {
+  pthread_mutex_t* mutex;
+  StartGate* start;
+  int iters;
+  int* counter;
+};
+
+// A short critical section, the case where sleeping costs more than waiting.
+static void* ContendedMutexThread(void* arg) {
+  ContendedMutexArgs* args = reinterpret_cast<ContendedMutexArgs*>(arg);
+  StartGateWait(args->start);
+  for (int i = 0; i < args->iters; ++i) {
+    pthread_mutex_lock(args->mutex);
+    for (int j = 0; j < 16; ++j) {
+      ++*args->counter;
+    }
+    pthread_mutex_unlock(args->mutex);
+  }
+  return NULL;
+}
+
+// All the threads take turns locking the mutex. The time is per lock and
+// unlock on one thread.
+static void RunContendedMutex(::testing::Benchmark* benchmark, int iters, int nthreads,
+                              int type) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, type);
+  pthread_mutex_t mutex;
+  pthread_mutex_init(&mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  StartGate start = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false };
+  int counter = 0;
+  ContendedMutexArgs args = { &mutex, &start, iters, &counter };
+  std::vector<pthread_t> threads(nthreads);
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_create(&threads[i], NULL, ContendedMutexThread, &args);
+  }
+
+  StartGateOpen(&start, nthreads);
+  benchmark->StartBenchmarkTiming();
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  benchmark->StopBenchmarkTiming();
+
+  pthread_mutex_destroy(&mutex);
+}
+
+BENCHMARK_WITH_ARG(BM_pthread_mutex_lock_contended, int)->Arg(2)->Arg(4)->Arg(8);
+void BM_pthread_mutex_lock_contended::Run(int iters, int nthreads) {
+  RunContendedMutex(this, iters, nthreads, PTHREAD_MUTEX_NORMAL);
+}
+
+BENCHMARK_WITH_ARG(BM_pthread_mutex_lock_contended_ADAPTIVE, int)->Arg(2)->Arg(4)->Arg(8);
+void BM_pthread_mutex_lock_contended_ADAPTIVE::Run(int iters, int nthreads) {
+  RunContendedMutex(this, iters, nthreads, PTHREAD_MUTEX_ADAPTIVE_NP);
+}
+
+// Spins for the given time, or until *stop is set.
+static void BusyWait(int64_t ns, std::atomic<bool>* stop = NULL) {
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  timespec now;
+  do {
+    if (stop != NULL && *stop) {
+      return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while ((now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec) < ns);
+}
+
+struct InversionArgs {
+  pthread_mutex_t mutex;
+  sem_t low_start;
+  sem_t low_locked;
+  sem_t medium_start;
+  sem_t medium_done;
+  std::atomic<bool> high_locked;
+  bool done;
+};
+
+// Holds the mutex for 50us each time it is told to.
+static void* InversionLowThread(void* arg) {
+  InversionArgs* args = reinterpret_cast<InversionArgs*>(arg);
+  while (true) {
+    sem_wait(&args->low_start);
+    if (args->done) {
+      return NULL;
+    }
+    pthread_mutex_lock(&args->mutex);
+    sem_post(&args->low_locked);
+    BusyWait(50000);
+    pthread_mutex_unlock(&args->mutex);
+  }
+}
+
+// Keeps the CPU busy for 2ms each time it is told to, without the mutex,
+// or until the high priority thread got the mutex.
+static void* InversionMediumThread(void* arg) {
+  InversionArgs* args = reinterpret_cast<InversionArgs*>(arg);
+  while (true) {
+    sem_wait(&args->medium_start);
+    if (args->done) {
+      return NULL;
+    }
+    BusyWait(2000000, &args->high_locked);
+    sem_post(&args->medium_done);
+  }
+}
+
+static bool StartFifoThread(pthread_t* thread, void* (*fn)(void*), void* arg, int priority) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+#if !defined(__BIONIC__)
+  // bionic always uses the policy in the attributes, and has no pthread_attr_setinheritsched.
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+#endif
+  pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+  sched_param param = { priority };
+  pthread_attr_setschedparam(&attr, &param);
+  bool result = pthread_create(thread, &attr, fn, arg) == 0;
+  pthread_attr_destroy(&attr);
+  return result;
+}
+
+// The classic priority inversion, with all the threads on one CPU: a high
+// priority thread (this one) waits for a mutex held by a low priority
+// thread, while a medium priority thread hogs the CPU. Without priority
+// inheritance, the time to get the mutex includes the 2ms of the medium
+// thread. With it, the low priority thread is boosted, and the time is
+// close to the remaining 50us critical section. Needs to run as root, for
+// SCHED_FIFO; otherwise it does nothing.
+BENCHMARK_WITH_ARG(BM_pthread_mutex_priority_inversion, int)->Arg(PTHREAD_PRIO_NONE)
+    ->Arg(PTHREAD_PRIO_INHERIT);
+void BM_pthread_mutex_priority_inversion::Run(int iters, int protocol) {
+  cpu_set_t old_cpus;
+  sched_getaffinity(0, sizeof(old_cpus), &old_cpus);
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(sched_getcpu(), &cpus);
+  sched_setaffinity(0, sizeof(cpus), &cpus);
+
+  int old_policy;
+  sched_param old_param;
+  pthread_getschedparam(pthread_self(), &old_policy, &old_param);
+  sched_param param = { 3 };
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+    sched_setaffinity(0, sizeof(old_cpus), &old_cpus);
+    return;
+  }
+
+  InversionArgs* args = new InversionArgs;
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setprotocol(&attr, protocol);
+  pthread_mutex_init(&args->mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  sem_init(&args->low_start, 0, 0);
+  sem_init(&args->low_locked, 0, 0);
+  sem_init(&args->medium_start, 0, 0);
+  sem_init(&args->medium_done, 0, 0);
+  args->done = false;
+
+  // New threads inherit the affinity of this one.
+  pthread_t low;
+  pthread_t medium;
+  StartFifoThread(&low, InversionLowThread, args, 1);
+  StartFifoThread(&medium, InversionMediumThread, args, 2);
+
+  for (int i = 0; i < iters; ++i) {
+    args->high_locked = false;
+    sem_post(&args->low_start);
+    sem_wait(&args->low_locked);
+    sem_post(&args->medium_start);
+
+    StartBenchmarkTiming();
+    pthread_mutex_lock(&args->mutex);
+    StopBenchmarkTiming();
+    args->high_locked = true;
+    pthread_mutex_unlock(&args->mutex);
+    sem_wait(&args->medium_done);
+  }
+
+  args->done = true;
+  sem_post(&args->low_start);
+  sem_post(&args->medium_start);
+  pthread_join(low, NULL);
+  pthread_join(medium, NULL);
+  pthread_mutex_destroy(&args->mutex);
+  sem_destroy(&args->low_start);
+  sem_destroy(&args->low_locked);
+  sem_destroy(&args->medium_start);
+  sem_destroy(&args->medium_done);
+  delete args;
+
+  pthread_setschedparam(pthread_self(), old_policy, &old_param);
+  sched_setaffinity(0, sizeof(old_cpus), &old_cpus);
+}
+
 BENCHMARK_NO_ARG(BM_pthread_rwlock_read);
 void BM_pthread_rwlock_read::Run(int iters) {
   StopBenchmarkTiming();
@@ -137,6 +382,65 @@ void BM_pthread_rwlock_read::Run(int iters) {
   pthread_rwlock_destroy(&lock);
 }
 
+struct ContendedRwlockArgs {
+  pthread_rwlock_t* lock;
+  pthread_barrier_t* start;
+  int iters;
+};
+
+static void* ContendedRwlockReadThread(void* arg) {
+  ContendedRwlockArgs* args = reinterpret_cast<ContendedRwlockArgs*>(arg);
+  pthread_barrier_wait(args->start);
+  for (int i = 0; i < args->iters; ++i) {
+    pthread_rwlock_rdlock(args->lock);
+    pthread_rwlock_unlock(args->lock);
+  }
+  return NULL;
+}
+
+// All the threads read-lock the rwlock at once. The time is per read lock and
+// unlock on one thread, so a rwlock whose readers scale stays flat as threads
+// are added.
+static void RunContendedRwlockRead(::testing::Benchmark* benchmark, int iters, int nthreads,
+                                   int kind) {
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr, kind);
+  pthread_rwlock_t lock;
+  pthread_rwlock_init(&lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, nthreads + 1);
+  ContendedRwlockArgs args = { &lock, &start, iters };
+  std::vector<pthread_t> threads(nthreads);
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_create(&threads[i], NULL, ContendedRwlockReadThread, &args);
+  }
+
+  pthread_barrier_wait(&start);
+  benchmark->StartBenchmarkTiming();
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  benchmark->StopBenchmarkTiming();
+
+  pthread_barrier_destroy(&start);
+  pthread_rwlock_destroy(&lock);
+}
+
+BENCHMARK_WITH_ARG(BM_pthread_rwlock_read_contended, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->Arg(32);
+void BM_pthread_rwlock_read_contended::Run(int iters, int nthreads) {
+  RunContendedRwlockRead(this, iters, nthreads, PTHREAD_RWLOCK_PREFER_READER_NP);
+}
+
+#if defined(__BIONIC__)
+BENCHMARK_WITH_ARG(BM_pthread_rwlock_read_contended_READER_MOSTLY, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->Arg(32);
+void BM_pthread_rwlock_read_contended_READER_MOSTLY::Run(int iters, int nthreads) {
+  RunContendedRwlockRead(this, iters, nthreads, PTHREAD_RWLOCK_READER_MOSTLY_NP);
+}
+#endif
+
 BENCHMARK_NO_ARG(BM_pthread_rwlock_write);
 void BM_pthread_rwlock_write::Run(int iters) {
   StopBenchmarkTiming();
@@ -153,6 +457,250 @@ void BM_pthread_rwlock_write::Run(int iters) {
   pthread_rwlock_destroy(&lock);
 }
 
+BENCHMARK_NO_ARG(BM_pthread_spin_lock);
+void BM_pthread_spin_lock::Run(int iters) {
+  StopBenchmarkTiming();
+  pthread_spinlock_t lock;
+  pthread_spin_init(&lock, PTHREAD_PROCESS_PRIVATE);
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_spin_lock(&lock);
+    pthread_spin_unlock(&lock);
+  }
+
+  StopBenchmarkTiming();
+  pthread_spin_destroy(&lock);
+}
+
+// The mutex and condition variable barrier that code without
+// pthread_barrier_t has to use, for comparison.
+struct CondvarBarrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int count;
+  int waiting;
+  unsigned generation;
+
+  void Init(int n) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+    count = n;
+    waiting = 0;
+    generation = 0;
+  }
+
+  void Wait() {
+    pthread_mutex_lock(&mutex);
+    unsigned my_generation = generation;
+    if (++waiting == count) {
+      waiting = 0;
+      ++generation;
+      pthread_cond_broadcast(&cond);
+    } else {
+      while (generation == my_generation) {
+        pthread_cond_wait(&cond, &mutex);
+      }
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void Destroy() {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+};
+
+struct BarrierArgs {
+  pthread_barrier_t barrier;
+  CondvarBarrier condvar_barrier;
+  bool use_condvar;
+  int iters;
+};
+
+static void* BarrierThread(void* arg) {
+  BarrierArgs* args = reinterpret_cast<BarrierArgs*>(arg);
+  for (int i = 0; i < args->iters; ++i) {
+    if (args->use_condvar) {
+      args->condvar_barrier.Wait();
+    } else {
+      pthread_barrier_wait(&args->barrier);
+    }
+  }
+  return NULL;
+}
+
+// Measures the time for nthreads threads to all get through a barrier,
+// with the calling thread as one of them.
+static void RunBarrier(::testing::Benchmark* benchmark, int iters, int nthreads,
+                       bool use_condvar) {
+  benchmark->StopBenchmarkTiming();
+  BarrierArgs args;
+  pthread_barrier_init(&args.barrier, NULL, nthreads);
+  args.condvar_barrier.Init(nthreads);
+  args.use_condvar = use_condvar;
+  args.iters = iters;
+
+  std::vector<pthread_t> threads(nthreads - 1);
+  for (auto& thread : threads) {
+    pthread_create(&thread, NULL, BarrierThread, &args);
+  }
+
+  benchmark->StartBenchmarkTiming();
+  BarrierThread(&args);
+  benchmark->StopBenchmarkTiming();
+
+  for (auto& thread : threads) {
+    pthread_join(thread, NULL);
+  }
+  args.condvar_barrier.Destroy();
+  pthread_barrier_destroy(&args.barrier);
+}
+
+BENCHMARK_WITH_ARG(BM_pthread_barrier_wait, int)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64);
+void BM_pthread_barrier_wait::Run(int iters, int nthreads) {
+  RunBarrier(this, iters, nthreads, false);
+}
+
+BENCHMARK_WITH_ARG(BM_pthread_barrier_wait_condvar, int)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64);
+void BM_pthread_barrier_wait_condvar::Run(int iters, int nthreads) {
+  RunBarrier(this, iters, nthreads, true);
+}
+
+struct CondBroadcastArgs {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_cond_t idle_cond;
+  int nthreads;
+  int waiting;
+  int resumed;
+  unsigned generation;
+  int iters;
+};
+
+static void* CondBroadcastThread(void* arg) {
+  CondBroadcastArgs* args = reinterpret_cast<CondBroadcastArgs*>(arg);
+  pthread_mutex_lock(&args->mutex);
+  for (int i = 0; i < args->iters; ++i) {
+    unsigned my_generation = args->generation;
+    if (++args->waiting == args->nthreads) {
+      pthread_cond_signal(&args->idle_cond);
+    }
+    while (args->generation == my_generation) {
+      pthread_cond_wait(&args->cond, &args->mutex);
+    }
+    if (++args->resumed == args->nthreads) {
+      pthread_cond_signal(&args->idle_cond);
+    }
+  }
+  pthread_mutex_unlock(&args->mutex);
+  return NULL;
+}
+
+// Measures the time from a broadcast to all nthreads waiters having woken and
+// got through the mutex, the case that FUTEX_CMP_REQUEUE helps.
+BENCHMARK_WITH_ARG(BM_pthread_cond_broadcast, int)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64);
+void BM_pthread_cond_broadcast::Run(int iters, int nthreads) {
+  StopBenchmarkTiming();
+  CondBroadcastArgs args;
+  pthread_mutex_init(&args.mutex, NULL);
+  pthread_cond_init(&args.cond, NULL);
+  pthread_cond_init(&args.idle_cond, NULL);
+  args.nthreads = nthreads;
+  args.waiting = 0;
+  args.resumed = 0;
+  args.generation = 0;
+  args.iters = iters;
+
+  std::vector<pthread_t> threads(nthreads);
+  for (auto& thread : threads) {
+    pthread_create(&thread, NULL, CondBroadcastThread, &args);
+  }
+
+  pthread_mutex_lock(&args.mutex);
+  for (int i = 0; i < iters; ++i) {
+    while (args.waiting < nthreads) {
+      pthread_cond_wait(&args.idle_cond, &args.mutex);
+    }
+    args.waiting = 0;
+    args.resumed = 0;
+    ++args.generation;
+    StartBenchmarkTiming();
+    pthread_cond_broadcast(&args.cond);
+    while (args.resumed < nthreads) {
+      pthread_cond_wait(&args.idle_cond, &args.mutex);
+    }
+    StopBenchmarkTiming();
+  }
+  pthread_mutex_unlock(&args.mutex);
+
+  for (auto& thread : threads) {
+    pthread_join(thread, NULL);
+  }
+  pthread_cond_destroy(&args.idle_cond);
+  pthread_cond_destroy(&args.cond);
+  pthread_mutex_destroy(&args.mutex);
+}
+
+// A counter sharded by cpu, the way bionic's private PerCpuCounter is, so that
+// threads on different cpus don't bounce the same cache line between them.
+#define COUNTER_SHARD_COUNT 32
+
+struct CounterShard {
+  std::atomic<uint64_t> value;
+  char pad[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+struct ContendedCounterArgs {
+  pthread_barrier_t* start;
+  int iters;
+  bool per_cpu;
+  CounterShard* shards;
+};
+
+static void* ContendedCounterThread(void* arg) {
+  ContendedCounterArgs* args = reinterpret_cast<ContendedCounterArgs*>(arg);
+  pthread_barrier_wait(args->start);
+  for (int i = 0; i < args->iters; ++i) {
+    size_t shard = args->per_cpu ? (sched_getcpu() & (COUNTER_SHARD_COUNT - 1)) : 0;
+    args->shards[shard].value.fetch_add(1, std::memory_order_relaxed);
+  }
+  return NULL;
+}
+
+// Every thread increments the counter iters times. The time is per increment
+// on one thread.
+static void RunContendedCounter(::testing::Benchmark* benchmark, int iters, int nthreads,
+                                bool per_cpu) {
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, nthreads + 1);
+  std::vector<CounterShard> shards(COUNTER_SHARD_COUNT);
+  ContendedCounterArgs args = { &start, iters, per_cpu, shards.data() };
+  std::vector<pthread_t> threads(nthreads);
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_create(&threads[i], NULL, ContendedCounterThread, &args);
+  }
+
+  pthread_barrier_wait(&start);
+  benchmark->StartBenchmarkTiming();
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  benchmark->StopBenchmarkTiming();
+
+  pthread_barrier_destroy(&start);
+}
+
+BENCHMARK_WITH_ARG(BM_counter_atomic_contended, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+void BM_counter_atomic_contended::Run(int iters, int nthreads) {
+  RunContendedCounter(this, iters, nthreads, false);
+}
+
+BENCHMARK_WITH_ARG(BM_counter_percpu_contended, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+void BM_counter_percpu_contended::Run(int iters, int nthreads) {
+  RunContendedCounter(this, iters, nthreads, true);
+}
+
 static void* IdleThread(void*) {
   return NULL;
 }
@@ -176,6 +724,9 @@ static void* RunThread(void* arg) {
   return NULL;
 }
 
+// Threads after the first reuse the mapped space of the one before from the
+// stack cache. Run with LIBC_THREAD_STACK_CACHE=0 to compare with mapping new
+// space for each thread.
 BENCHMARK_NO_ARG(BM_pthread_create_and_run);
 void BM_pthread_create_and_run::Run(int iters) {
   StopBenchmarkTiming();
@@ -206,6 +757,42 @@ void BM_pthread_exit_and_join::Run(int iters) {
   }
 }
 
+static void* BlockedThread(void* arg) {
+  pthread_mutex_t* mutex = reinterpret_cast<pthread_mutex_t*>(arg);
+  pthread_mutex_lock(mutex);
+  pthread_mutex_unlock(mutex);
+  return NULL;
+}
+
+// Looks up the oldest of nthreads live threads, as a pthread_kill-based sampling
+// profiler does. Every pthread_t argument is validated the same way.
+BENCHMARK_WITH_ARG(BM_pthread_kill_zero, int)->Arg(1)->Arg(16)->Arg(256)->Arg(2048);
+void BM_pthread_kill_zero::Run(int iters, int nthreads) {
+  StopBenchmarkTiming();
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&mutex);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN);
+  std::vector<pthread_t> threads(nthreads);
+  for (auto& thread : threads) {
+    pthread_create(&thread, &attr, BlockedThread, &mutex);
+  }
+  pthread_attr_destroy(&attr);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    pthread_kill(threads[0], 0);
+  }
+  StopBenchmarkTiming();
+
+  pthread_mutex_unlock(&mutex);
+  for (auto& thread : threads) {
+    pthread_join(thread, NULL);
+  }
+}
+
 BENCHMARK_NO_ARG(BM_pthread_key_create);
 void BM_pthread_key_create::Run(int iters) {
   StopBenchmarkTiming();
@@ -14,11 +14,14 @@
  * limitations under the License.
  */
 
+#include <pthread.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <vector>
+
 #include <benchmark/Benchmark.h>
 
 BENCHMARK_NO_ARG(BM_time_clock_gettime);
@@ -79,3 +82,111 @@ void BM_time_time::Run(int iters) {
 
   StopBenchmarkTiming();
 }
+
+#if defined(__NR_time)
+BENCHMARK_NO_ARG(BM_time_time_syscall);
+void BM_time_time_syscall::Run(int iters) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    syscall(__NR_time, NULL);
+  }
+
+  StopBenchmarkTiming();
+}
+#endif
+
+BENCHMARK_NO_ARG(BM_time_clock_getres);
+void BM_time_clock_getres::Run(int iters) {
+  StartBenchmarkTiming();
+
+  timespec t;
+  for (int i = 0; i < iters; ++i) {
+    clock_getres(CLOCK_MONOTONIC, &t);
+  }
+
+  StopBenchmarkTiming();
+}
+
+BENCHMARK_NO_ARG(BM_time_clock_getres_syscall);
+void BM_time_clock_getres_syscall::Run(int iters) {
+  StartBenchmarkTiming();
+
+  timespec t;
+  for (int i = 0; i < iters; ++i) {
+    syscall(__NR_clock_getres, CLOCK_MONOTONIC, &t);
+  }
+
+  StopBenchmarkTiming();
+}
+
+BENCHMARK_NO_ARG(BM_time_localtime_r);
+void BM_time_localtime_r::Run(int iters) {
+  StartBenchmarkTiming();
+
+  time_t t = time(NULL);
+  tm result;
+  for (int i = 0; i < iters; ++i) {
+    localtime_r(&t, &result);
+  }
+
+  StopBenchmarkTiming();
+}
+
+BENCHMARK_NO_ARG(BM_time_mktime);
+void BM_time_mktime::Run(int iters) {
+  StopBenchmarkTiming();
+  time_t t = time(NULL);
+  tm broken_down;
+  localtime_r(&t, &broken_down);
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    tm copy = broken_down;
+    mktime(&copy);
+  }
+
+  StopBenchmarkTiming();
+}
+
+struct ContendedLocaltimeArgs {
+  pthread_barrier_t* start;
+  int iters;
+};
+
+static void* ContendedLocaltimeThread(void* arg) {
+  ContendedLocaltimeArgs* args = reinterpret_cast<ContendedLocaltimeArgs*>(arg);
+  time_t t = time(NULL);
+  tm result;
+  pthread_barrier_wait(args->start);
+  for (int i = 0; i < args->iters; ++i) {
+    localtime_r(&t, &result);
+  }
+  return NULL;
+}
+
+// All the threads call localtime_r at once, as log formatting does. The time is per call on
+// one thread, so it stays flat as threads are added if localtime_r doesn't serialize them.
+BENCHMARK_WITH_ARG(BM_time_localtime_r_contended, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->Arg(64);
+void BM_time_localtime_r_contended::Run(int iters, int nthreads) {
+  StopBenchmarkTiming();
+  // Load the time zone before the clock starts.
+  tzset();
+
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, nthreads + 1);
+  ContendedLocaltimeArgs args = { &start, iters };
+  std::vector<pthread_t> threads(nthreads);
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_create(&threads[i], NULL, ContendedLocaltimeThread, &args);
+  }
+
+  pthread_barrier_wait(&start);
+  StartBenchmarkTiming();
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  StopBenchmarkTiming();
+
+  pthread_barrier_destroy(&start);
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <sched.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
@@ -69,3 +70,26 @@ void BM_unistd_gettid_syscall::Run(int iters) {
 
   StopBenchmarkTiming();
 }
+
+BENCHMARK_NO_ARG(BM_unistd_sched_getcpu);
+void BM_unistd_sched_getcpu::Run(int iters) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    sched_getcpu();
+  }
+
+  StopBenchmarkTiming();
+}
+
+BENCHMARK_NO_ARG(BM_unistd_getcpu_syscall);
+void BM_unistd_getcpu_syscall::Run(int iters) {
+  StartBenchmarkTiming();
+
+  unsigned cpu;
+  for (int i = 0; i < iters; ++i) {
+    syscall(__NR_getcpu, &cpu, NULL, NULL);
+  }
+
+  StopBenchmarkTiming();
+}
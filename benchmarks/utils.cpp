@@ -79,3 +79,23 @@ std::string PrettyInt(long value, size_t base) {
   free(s);
   return result;
 }
+
+void StartGateWait(StartGate* gate) {
+  pthread_mutex_lock(&gate->mutex);
+  ++gate->waiting;
+  pthread_cond_broadcast(&gate->cond);
+  while (!gate->open) {
+    pthread_cond_wait(&gate->cond, &gate->mutex);
+  }
+  pthread_mutex_unlock(&gate->mutex);
+}
+
+void StartGateOpen(StartGate* gate, int nthreads) {
+  pthread_mutex_lock(&gate->mutex);
+  while (gate->waiting < nthreads) {
+    pthread_cond_wait(&gate->cond, &gate->mutex);
+  }
+  gate->open = true;
+  pthread_cond_broadcast(&gate->cond);
+  pthread_mutex_unlock(&gate->mutex);
+}
@@ -17,10 +17,27 @@
 #ifndef BENCHMARKS_UTILS_H
 #define BENCHMARKS_UTILS_H
 
+#include <pthread.h>
 #include <stddef.h>
 #include <string>
 
 int Round(int n);
 std::string PrettyInt(long value, size_t base);
 
+// Holds the threads of a multi-threaded benchmark until they have all
+// started, so that they all begin at the same time. Initialize with
+// { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false }.
+struct StartGate {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int waiting;
+  bool open;
+};
+
+// Called by each thread before it starts; returns once the gate is open.
+void StartGateWait(StartGate* gate);
+
+// Waits for the given number of threads to reach the gate, then lets them all through.
+void StartGateOpen(StartGate* gate, int nthreads);
+
 #endif  // BENCHMARKS_UTILS_H
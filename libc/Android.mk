@@ -159,6 +159,7 @@ libc_bionic_ndk_src_files := \
     bionic/link.cpp \
     bionic/locale.cpp \
     bionic/lstat.cpp \
+    bionic/malloc_huge_pages.cpp \
     bionic/malloc_info.cpp \
     bionic/mbrtoc16.cpp \
     bionic/mbrtoc32.cpp \
@@ -256,6 +257,10 @@ libc_bionic_src_files += bionic/sysconf.cpp
 libc_bionic_src_files += bionic/vdso.cpp
 libc_bionic_src_files += bionic/setjmp_cookie.cpp
 
+# libc_ndk.a's syscall versions of what vdso.cpp provides on these architectures.
+libc_ndk_vdso_src_files_arm64 := bionic/vdso_ndk.cpp
+libc_ndk_vdso_src_files_x86_64 := bionic/vdso_ndk.cpp
+
 libc_cxa_src_files := \
     bionic/__cxa_guard.cpp \
     bionic/__cxa_pure_virtual.cpp \
@@ -364,7 +369,6 @@ libc_upstream_openbsd_ndk_src_files := \
     upstream-openbsd/lib/libc/gen/getprogname.c \
     upstream-openbsd/lib/libc/gen/isctype.c \
     upstream-openbsd/lib/libc/gen/setprogname.c \
-    upstream-openbsd/lib/libc/gen/time.c \
     upstream-openbsd/lib/libc/gen/tolower_.c \
     upstream-openbsd/lib/libc/gen/toupper_.c \
     upstream-openbsd/lib/libc/gen/verr.c \
@@ -528,13 +532,17 @@ libc_upstream_openbsd_ndk_src_files := \
     upstream-openbsd/lib/libc/string/wcswidth.c \
 
 libc_pthread_src_files := \
+    bionic/bionic_lock_profile.cpp \
+    bionic/bionic_rseq.cpp \
     bionic/pthread_atfork.cpp \
     bionic/pthread_attr.cpp \
+    bionic/pthread_barrier.cpp \
     bionic/pthread_cond.cpp \
     bionic/pthread_create.cpp \
     bionic/pthread_detach.cpp \
     bionic/pthread_equal.cpp \
     bionic/pthread_exit.cpp \
+    bionic/pthread_getaffinity_np.cpp \
     bionic/pthread_getcpuclockid.cpp \
     bionic/pthread_getschedparam.cpp \
     bionic/pthread_gettid_np.cpp \
@@ -546,9 +554,11 @@ libc_pthread_src_files := \
     bionic/pthread_once.cpp \
     bionic/pthread_rwlock.cpp \
     bionic/pthread_self.cpp \
+    bionic/pthread_setaffinity_np.cpp \
     bionic/pthread_setname_np.cpp \
     bionic/pthread_setschedparam.cpp \
     bionic/pthread_sigmask.cpp \
+    bionic/pthread_spinlock.cpp \
     bionic/safestack.cpp \
 
 libc_thread_atexit_impl_src_files := \
@@ -575,6 +585,10 @@ libc_netbsd_src_files_32 += \
 libc_openbsd_src_files_32 += \
     upstream-openbsd/lib/libc/stdio/putw.c \
 
+# On arm64 and x86_64, time is in vdso.cpp instead.
+libc_openbsd_ndk_src_files_32 += \
+    upstream-openbsd/lib/libc/gen/time.c \
+
 
 # Define some common cflags
 # ========================================================
@@ -909,6 +923,7 @@ LOCAL_NATIVE_COVERAGE := $(bionic_coverage)
 LOCAL_ARM_MODE := arm
 
 $(eval $(call patch-up-arch-specific-flags,LOCAL_CFLAGS,libc_common_cflags))
+$(eval $(call patch-up-arch-specific-flags,LOCAL_SRC_FILES,libc_openbsd_ndk_src_files))
 include $(BUILD_STATIC_LIBRARY)
 
 
@@ -1233,6 +1248,7 @@ endif
 $(eval $(call patch-up-arch-specific-flags,LOCAL_CFLAGS,libc_common_cflags))
 $(eval $(call patch-up-arch-specific-flags,LOCAL_SRC_FILES,libc_common_src_files))
 $(eval $(call patch-up-arch-specific-flags,LOCAL_SRC_FILES,libc_arch_dynamic_src_files))
+$(eval $(call patch-up-arch-specific-flags,LOCAL_SRC_FILES,libc_ndk_vdso_src_files))
 $(eval $(call patch-up-arch-specific-flags,LOCAL_ASFLAGS,LOCAL_CFLAGS))
 
 LOCAL_ADDITIONAL_DEPENDENCIES := $(libc_common_additional_dependencies)
@@ -30,6 +30,9 @@ libc_freebsd_src_files_mips64 += \
     upstream-freebsd/lib/libc/string/wmemcmp.c \
     upstream-freebsd/lib/libc/string/wmemmove.c \
 
+libc_openbsd_ndk_src_files_mips64 += \
+    upstream-openbsd/lib/libc/gen/time.c \
+
 libc_openbsd_src_files_mips64 += \
     upstream-openbsd/lib/libc/string/memchr.c \
     upstream-openbsd/lib/libc/string/memmove.c \
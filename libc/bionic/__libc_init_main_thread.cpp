@@ -81,6 +81,7 @@ void __libc_init_main_thread(KernelArgumentBlock& args) {
 
   __init_thread(&main_thread);
   __init_tls(&main_thread);
+  __rseq_register(&main_thread.rseq);
 
   // Store a pointer to the kernel argument block in a TLS slot to be
   // picked up by the libc constructor.
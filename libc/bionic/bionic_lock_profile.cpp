@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unwind.h>
+
+#include "pthread_internal.h"
+#include "private/bionic_constants.h"
+#include "private/bionic_futex.h"
+#include "private/bionic_lock_profile.h"
+#include "private/kernel_sigset_t.h"
+#include "private/libc_logging.h"
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+
+static const char* LOCK_PROFILE_ENV = "LIBC_LOCK_PROFILE";
+static const char* LOCK_PROFILE_PROPERTY = "libc.debug.lock_profile";
+static const char* LOCK_PROFILE_PROPERTY_PROGRAM = "libc.debug.lock_profile.program";
+
+#define LOCK_PROFILE_DUMP_SIGNAL (SIGRTMIN + 13)
+
+#define LOCK_PROFILE_FRAMES 6
+#define LOCK_PROFILE_ENTRIES 4096  // A power of 2.
+#define LOCK_PROFILE_MAX_PROBES 32
+
+// One entry per lock and waiter backtrace. An entry is claimed by a CAS on key, and then
+// published by setting ready once lock and frames are filled in. The counters may be
+// updated by other waiters before that, which is fine as the dump skips entries that
+// aren't ready.
+struct lock_profile_entry_t {
+  atomic_uint_least64_t key;
+  atomic_bool ready;
+  uintptr_t lock;
+  uintptr_t frames[LOCK_PROFILE_FRAMES];
+  atomic_uint_least64_t wait_count;
+  atomic_uint_least64_t total_wait_ns;
+  atomic_uint_least64_t max_wait_ns;
+};
+
+bool __lock_profile_enabled = false;
+
+static lock_profile_entry_t* g_lock_profile_table;
+static atomic_uint_least64_t g_lock_profile_dropped;
+static atomic_bool g_lock_profile_dump_requested;
+// The dump thread waits on this, and the dump signal increments it.
+static atomic_uint g_lock_profile_dump_serial;
+// The process that the dump thread belongs to, as a forked child doesn't have one.
+static pid_t g_lock_profile_dump_thread_pid;
+
+static uint64_t __lock_profile_now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * NS_PER_S + ts.tv_nsec;
+}
+
+uint64_t __lock_profile_start() {
+  return __lock_profile_now();
+}
+
+struct lock_profile_backtrace_t {
+  uintptr_t* frames;
+  size_t frame_count;
+  size_t skip;
+};
+
+static _Unwind_Reason_Code __lock_profile_unwind(struct _Unwind_Context* context, void* arg) {
+  lock_profile_backtrace_t* backtrace = reinterpret_cast<lock_profile_backtrace_t*>(arg);
+  uintptr_t ip = _Unwind_GetIP(context);
+  if (ip == 0) {
+    return _URC_END_OF_STACK;
+  }
+  if (backtrace->skip > 0) {
+    --backtrace->skip;
+    return _URC_NO_REASON;
+  }
+  backtrace->frames[backtrace->frame_count++] = ip;
+  return (backtrace->frame_count == LOCK_PROFILE_FRAMES) ? _URC_END_OF_STACK : _URC_NO_REASON;
+}
+
+static void __lock_profile_update_max(atomic_uint_least64_t* max, uint64_t value) {
+  uint64_t old_max = atomic_load_explicit(max, memory_order_relaxed);
+  while (value > old_max &&
+         !atomic_compare_exchange_weak_explicit(max, &old_max, value, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+typedef void (*lock_profile_writer_t)(const char* line);
+
+static void __lock_profile_log_line(const char* line) {
+  __libc_format_log(ANDROID_LOG_INFO, "libc", "%s", line);
+}
+
+// Writes the table one line at a time. Must not be called from a signal handler.
+static void __lock_profile_dump(lock_profile_writer_t write_line) {
+  char line[128];
+  __libc_format_buffer(line, sizeof(line), "lock contention profile (%llu waits dropped):",
+                       static_cast<unsigned long long>(
+                           atomic_load_explicit(&g_lock_profile_dropped, memory_order_relaxed)));
+  write_line(line);
+  for (size_t i = 0; i < LOCK_PROFILE_ENTRIES; ++i) {
+    lock_profile_entry_t* entry = &g_lock_profile_table[i];
+    if (!atomic_load_explicit(&entry->ready, memory_order_acquire)) {
+      continue;
+    }
+    uint64_t wait_count = atomic_load_explicit(&entry->wait_count, memory_order_relaxed);
+    uint64_t total_wait_ns = atomic_load_explicit(&entry->total_wait_ns, memory_order_relaxed);
+    uint64_t max_wait_ns = atomic_load_explicit(&entry->max_wait_ns, memory_order_relaxed);
+    __libc_format_buffer(line, sizeof(line), "lock %p: %llu waits, %llu us total, %llu us max",
+                         reinterpret_cast<void*>(entry->lock),
+                         static_cast<unsigned long long>(wait_count),
+                         static_cast<unsigned long long>(total_wait_ns / 1000),
+                         static_cast<unsigned long long>(max_wait_ns / 1000));
+    write_line(line);
+    for (size_t j = 0; j < LOCK_PROFILE_FRAMES && entry->frames[j] != 0; ++j) {
+      __libc_format_buffer(line, sizeof(line), "  #%02zu pc %p", j,
+                           reinterpret_cast<void*>(entry->frames[j]));
+      write_line(line);
+    }
+  }
+}
+
+void __lock_profile_record(const volatile void* lock, uint64_t start_ns) {
+  uint64_t wait_ns = __lock_profile_now() - start_ns;
+
+  // The unwinder may take locks of its own, and those waits aren't interesting.
+  pthread_internal_t* thread = __get_thread();
+  if (thread->in_lock_profile) {
+    return;
+  }
+  thread->in_lock_profile = true;
+
+  uintptr_t frames[LOCK_PROFILE_FRAMES] = {};
+  lock_profile_backtrace_t backtrace = { frames, 0, 1 };  // Skip this function.
+  _Unwind_Backtrace(__lock_profile_unwind, &backtrace);
+
+  uint64_t key = reinterpret_cast<uintptr_t>(lock);
+  for (size_t i = 0; i < LOCK_PROFILE_FRAMES; ++i) {
+    key = (key ^ frames[i]) * 0x100000001b3ULL;
+  }
+  key |= 1;  // 0 marks an empty entry.
+
+  lock_profile_entry_t* entry = NULL;
+  for (size_t i = 0; i < LOCK_PROFILE_MAX_PROBES; ++i) {
+    lock_profile_entry_t* candidate =
+        &g_lock_profile_table[(key + i) & (LOCK_PROFILE_ENTRIES - 1)];
+    uint64_t old_key = atomic_load_explicit(&candidate->key, memory_order_relaxed);
+    if (old_key == 0 &&
+        atomic_compare_exchange_strong_explicit(&candidate->key, &old_key, key,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+      candidate->lock = reinterpret_cast<uintptr_t>(lock);
+      memcpy(candidate->frames, frames, sizeof(frames));
+      atomic_store_explicit(&candidate->ready, true, memory_order_release);
+      entry = candidate;
+      break;
+    }
+    if (old_key == key) {
+      entry = candidate;
+      break;
+    }
+  }
+
+  if (entry != NULL) {
+    atomic_fetch_add_explicit(&entry->wait_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&entry->total_wait_ns, wait_ns, memory_order_relaxed);
+    __lock_profile_update_max(&entry->max_wait_ns, wait_ns);
+  } else {
+    atomic_fetch_add_explicit(&g_lock_profile_dropped, 1, memory_order_relaxed);
+  }
+
+  // A forked child has no dump thread, so its waits write the dumps it's asked for.
+  if (__predict_false(atomic_load_explicit(&g_lock_profile_dump_requested, memory_order_relaxed)) &&
+      g_lock_profile_dump_thread_pid != getpid() &&
+      atomic_exchange_explicit(&g_lock_profile_dump_requested, false, memory_order_relaxed)) {
+    __lock_profile_dump(__lock_profile_log_line);
+  }
+
+  thread->in_lock_profile = false;
+}
+
+// Logging isn't async-signal-safe, so the signal only asks for a dump and wakes the dump
+// thread to write it.
+static void __lock_profile_request_dump(int) {
+  int saved_errno = errno;
+  atomic_store_explicit(&g_lock_profile_dump_requested, true, memory_order_relaxed);
+  atomic_fetch_add_explicit(&g_lock_profile_dump_serial, 1, memory_order_release);
+  __futex_wake(&g_lock_profile_dump_serial, 1);
+  errno = saved_errno;
+}
+
+// Waits until a dump is asked for, and writes it.
+static void __lock_profile_dump_on_request(lock_profile_writer_t write_line) {
+  while (true) {
+    unsigned old_serial = atomic_load_explicit(&g_lock_profile_dump_serial, memory_order_acquire);
+    if (atomic_exchange_explicit(&g_lock_profile_dump_requested, false, memory_order_relaxed)) {
+      __lock_profile_dump(write_line);
+      return;
+    }
+    __futex_wait(&g_lock_profile_dump_serial, old_serial, NULL);
+  }
+}
+
+static void* __lock_profile_dump_thread_start(void*) {
+  // Logging may wait for locks, and those waits aren't interesting.
+  __get_thread()->in_lock_profile = true;
+  while (true) {
+    __lock_profile_dump_on_request(__lock_profile_log_line);
+  }
+  return NULL;
+}
+
+static void __lock_profile_start_dump_thread() {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  // The thread inherits all signals blocked, so it doesn't run the application's handlers.
+  kernel_sigset_t sigset;
+  sigfillset(sigset.get());
+  kernel_sigset_t old_sigset;
+  pthread_sigmask(SIG_SETMASK, sigset.get(), old_sigset.get());
+
+  pthread_t thread;
+  int rc = pthread_create(&thread, &attr, __lock_profile_dump_thread_start, NULL);
+
+  pthread_sigmask(SIG_SETMASK, old_sigset.get(), NULL);
+
+  if (rc != 0) {
+    __libc_format_log(ANDROID_LOG_WARN, "libc", "%s: unable to start lock profile dump thread: %s",
+                      getprogname(), strerror(rc));
+    return;
+  }
+  pthread_setname_np(thread, "lock profile");
+  g_lock_profile_dump_thread_pid = getpid();
+}
+
+// Enables profiling when either the environment variable or the property is set to a
+// non-zero value. The property can be limited to one program, like libc.debug.malloc.
+void __lock_profile_init() {
+  char value[PROP_VALUE_MAX];
+  const char* env = getenv(LOCK_PROFILE_ENV);
+  if (env != NULL) {
+    if (env[0] == '\0' || strcmp(env, "0") == 0) {
+      return;
+    }
+  } else if (__system_property_get(LOCK_PROFILE_PROPERTY, value) == 0 ||
+             strcmp(value, "0") == 0) {
+    return;
+  } else if (__system_property_get(LOCK_PROFILE_PROPERTY_PROGRAM, value) != 0 &&
+             strstr(getprogname(), value) == NULL) {
+    return;
+  }
+
+  void* table = mmap(NULL, LOCK_PROFILE_ENTRIES * sizeof(lock_profile_entry_t),
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (table == MAP_FAILED) {
+    __libc_format_log(ANDROID_LOG_WARN, "libc", "%s: unable to allocate lock profile table",
+                      getprogname());
+    return;
+  }
+  g_lock_profile_table = reinterpret_cast<lock_profile_entry_t*>(table);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = __lock_profile_request_dump;
+  sa.sa_flags = SA_RESTART;
+  sigaction(LOCK_PROFILE_DUMP_SIGNAL, &sa, NULL);
+
+  __lock_profile_enabled = true;
+
+  __lock_profile_start_dump_thread();
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "private/bionic_rseq.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pthread_internal.h"
+
+// The kernel only takes one rseq registration per thread, so code that wants its own critical
+// sections would get EBUSY. These are the symbols glibc exports for that: when __rseq_size
+// isn't 0, every thread's registered area is at __rseq_offset bytes from its thread pointer.
+// __rseq_size only covers the fields in bionic_rseq, as the kernel may not fill in later ones.
+extern "C" {
+ptrdiff_t __rseq_offset;
+unsigned int __rseq_size;
+unsigned int __rseq_flags;
+}
+
+// Set by LIBC_RSEQ=0, for programs that register rseq areas of their own.
+static bool g_rseq_disabled;
+
+void __rseq_register(bionic_rseq* rseq) {
+  rseq->cpu_id_start = 0;
+  rseq->cpu_id = BIONIC_RSEQ_CPU_ID_UNINITIALIZED;
+  rseq->rseq_cs = 0;
+  rseq->flags = 0;
+  // Kernels before 4.18 don't have rseq. Callers then fall back to asking with getcpu.
+  if (g_rseq_disabled ||
+      syscall(__NR_rseq, rseq, sizeof(*rseq), 0, BIONIC_RSEQ_SIG) == -1) {
+    rseq->cpu_id = BIONIC_RSEQ_CPU_ID_REGISTRATION_FAILED;
+  }
+}
+
+void __rseq_unregister(bionic_rseq* rseq) {
+  if (__rseq_cpu_id(rseq) >= 0) {
+    syscall(__NR_rseq, rseq, sizeof(*rseq), BIONIC_RSEQ_FLAG_UNREGISTER, BIONIC_RSEQ_SIG);
+    rseq->cpu_id = BIONIC_RSEQ_CPU_ID_UNINITIALIZED;
+  }
+}
+
+// The main thread registered before libc could look at the environment, so it's dealt with here.
+void __rseq_init() {
+  bionic_rseq* rseq = &__get_thread()->rseq;
+  const char* value = getenv("LIBC_RSEQ");
+  if (value != NULL && strcmp(value, "0") == 0) {
+    g_rseq_disabled = true;
+    __rseq_unregister(rseq);
+    rseq->cpu_id = BIONIC_RSEQ_CPU_ID_REGISTRATION_FAILED;
+    return;
+  }
+  if (__rseq_cpu_id(rseq) >= 0) {
+    __rseq_offset = reinterpret_cast<uintptr_t>(rseq) - reinterpret_cast<uintptr_t>(__get_tls());
+    __rseq_size = offsetof(bionic_rseq, flags) + sizeof(rseq->flags);
+  }
+}
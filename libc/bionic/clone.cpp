@@ -75,6 +75,11 @@ int clone(int (*fn)(void*), void* child_stack, int flags, void* arg, ...) {
   pthread_internal_t* self = __get_thread();
   pid_t parent_pid = self->invalidate_cached_pid();
 
+  // A child that shares our memory but not our TLS shares our pthread_internal_t too, so
+  // sched_getcpu there reads our rseq area and may answer with our cpu. We leave the area
+  // registered anyway: the answer is only ever a hint, and code using rseq through __rseq_offset
+  // must keep working here. Such a child already shares our errno and cached tid.
+
   // Actually do the clone.
   int clone_result;
   if (fn != nullptr) {
@@ -17,6 +17,8 @@
 #include "dlmalloc.h"
 
 #include "malloc.h"
+#include "malloc_huge_pages.h"
+#include "malloc_info.h"
 #include "private/bionic_prctl.h"
 #include "private/libc_logging.h"
 
@@ -32,6 +34,14 @@ static void* named_anonymous_mmap(size_t length);
 #define MMAP(s) named_anonymous_mmap(s)
 #define DIRECT_MMAP(s) named_anonymous_mmap(s)
 
+// Grow the brk heap through a wrapper so that it can be marked for huge pages.
+static void* bionic_morecore(intptr_t increment);
+#define MORECORE bionic_morecore
+
+// dlmalloc passes a "can move" boolean as the mremap flags, translate it
+// rather than depending on MREMAP_MAYMOVE being 1.
+#define MREMAP(addr, osz, nsz, mv) mremap((addr), (osz), (nsz), (mv) ? MREMAP_MAYMOVE : 0)
+
 // Ugly inclusion of C file so that bionic specific #defines configure dlmalloc.
 #include "../upstream-dlmalloc/malloc.c"
 
@@ -48,6 +58,9 @@ static void __bionic_heap_usage_error(const char* function, void* address) {
 }
 
 static void* named_anonymous_mmap(size_t length) {
+  if (__malloc_huge_pages && length >= MALLOC_HUGE_PAGE_SIZE) {
+    return __malloc_huge_mmap(length);
+  }
   void* map = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
   if (map == MAP_FAILED) {
     return map;
@@ -56,24 +69,129 @@ static void* named_anonymous_mmap(size_t length) {
   return map;
 }
 
-// Since dlmalloc isn't the default, we'll leave this unimplemented for now. If
-// we decide we need it later, we can fill it in.
+static void* bionic_morecore(intptr_t increment) {
+  void* p = sbrk(increment);
+  if (__malloc_huge_pages && increment > 0 && p != (void*) -1) {
+    __malloc_huge_madvise(p, increment);
+  }
+  return p;
+}
+
+// Only the mappings of at least a huge page are aligned to one, see
+// named_anonymous_mmap, so small heaps don't grow in 2MB steps. Keep a
+// few free huge pages at the top of the heap rather than splitting them
+// every time a free leaves the top chunk above the default 2MB threshold.
+bool __malloc_backend_enable_huge_pages() {
+  return dlmallopt(M_TRIM_THRESHOLD, 4 * MALLOC_HUGE_PAGE_SIZE) == 1;
+}
+
+// dlmalloc has a single heap. Its bins are the 32 small bins followed by the
+// 32 tree bins, and are reported using the chunk size rather than the
+// requested size. dlmalloc doesn't keep any cumulative counters, so only
+// the current usage is reported.
 size_t __mallinfo_narenas() {
-  return 0;
+  return 1;
 }
 
 size_t __mallinfo_nbins() {
-  return 0;
+  return NSMALLBINS + NTREEBINS;
+}
+
+static size_t __mallinfo_bin_index(size_t chunk_size) {
+  if (is_small(chunk_size)) {
+    return small_index(chunk_size);
+  }
+  bindex_t idx;
+  compute_tree_index(chunk_size, idx);
+  return NSMALLBINS + idx;
+}
+
+static size_t __mallinfo_bin_size(size_t bidx) {
+  if (bidx < NSMALLBINS) {
+    return small_index2size(bidx);
+  }
+  return minsize_for_tree_index(bidx - NSMALLBINS);
+}
+
+// Walks every chunk in the heap segments with the heap lock held. Any
+// footprint that is not covered by a segment belongs to chunks that were
+// mapped directly. bins may be NULL.
+static void __mallinfo_walk(struct mallinfo* mi, struct mallinfo_bin_stats* bins) {
+  memset(mi, 0, sizeof(*mi));
+  if (bins != NULL) {
+    memset(bins, 0, sizeof(*bins) * __mallinfo_nbins());
+    for (size_t j = 0; j < __mallinfo_nbins(); j++) {
+      bins[j].size = __mallinfo_bin_size(j);
+    }
+  }
+
+  ensure_initialization();
+  if (PREACTION(gm)) {
+    return;
+  }
+  if (is_initialized(gm)) {
+    size_t sum = gm->topsize + TOP_FOOT_SIZE;
+    for (msegmentptr s = &gm->seg; s != 0; s = s->next) {
+      mchunkptr q = align_as_chunk(s->base);
+      while (segment_holds(s, q) && q != gm->top && q->head != FENCEPOST_HEAD) {
+        size_t sz = chunksize(q);
+        sum += sz;
+        if (is_inuse(q)) {
+          if (is_small(sz)) {
+            mi->fsmblks += sz;
+          } else {
+            mi->ordblks += sz;
+          }
+          if (bins != NULL) {
+            struct mallinfo_bin_stats* bin = &bins[__mallinfo_bin_index(sz)];
+            bin->current++;
+            bin->allocated += sz;
+          }
+        }
+        q = next_chunk(q);
+      }
+    }
+    mi->hblkhd = gm->footprint;
+    mi->uordblks = gm->footprint - sum;
+  }
+  POSTACTION(gm);
+}
+
+const char* __mallinfo_backend() {
+  return "dlmalloc";
+}
+
+void __mallinfo_heap_stats(struct mallinfo_heap_stats* stats) {
+  struct mallinfo mi = dlmallinfo();
+  stats->allocated = mi.uordblks;
+  stats->active = mi.uordblks;
+  // dlmalloc never releases pages in the middle of the heap, so every
+  // mapped page is assumed to be resident.
+  stats->resident = mi.usmblks;
+  stats->mapped = mi.usmblks;
+  stats->has_counters = 0;
 }
 
 struct mallinfo __mallinfo_arena_info(size_t aidx __unused) {
   struct mallinfo mi;
-  memset(&mi, 0, sizeof(mi));
+  __mallinfo_walk(&mi, NULL);
   return mi;
 }
 
-struct mallinfo __mallinfo_bin_info(size_t aidx __unused, size_t bidx __unused) {
+void __mallinfo_arena_stats(size_t aidx __unused, struct mallinfo_arena_stats* stats) {
+  struct mallinfo mi = dlmallinfo();
+  memset(stats, 0, sizeof(*stats));
+  stats->active = mi.uordblks;
+  // Free space that has not been trimmed is the closest dlmalloc has to
+  // jemalloc's dirty pages.
+  stats->dirty = mi.fordblks;
+}
+
+void __mallinfo_bin_stats(size_t aidx __unused, struct mallinfo_bin_stats* bins) {
   struct mallinfo mi;
-  memset(&mi, 0, sizeof(mi));
-  return mi;
+  __mallinfo_walk(&mi, bins);
+}
+
+void __mallinfo_thread_stats(struct mallinfo_thread_stats* stats) {
+  memset(stats, 0, sizeof(*stats));
 }
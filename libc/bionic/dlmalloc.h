@@ -31,6 +31,11 @@
 #define USE_RECURSIVE_LOCK 0
 #define USE_SPIN_LOCKS 0
 #define DEFAULT_MMAP_THRESHOLD (64U * 1024U)
+/* Grow and shrink mmapped chunks with mremap, so that a realloc of a large
+ * block moves page table entries instead of copying the data. Don't rely
+ * on the non-standard "linux" macro that upstream checks for this.
+ */
+#define HAVE_MREMAP 1
 
 #define malloc_getpagesize getpagesize()
 
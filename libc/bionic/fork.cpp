@@ -48,6 +48,8 @@ int fork() {
                      &(self->tid));
   if (result == 0) {
     self->set_cached_pid(gettid());
+    __pthread_internal_stack_cache_forked_child();
+    __posix_timers_forked_child();
     __bionic_atfork_run_child();
   } else {
     self->set_cached_pid(parent_pid);
@@ -14,10 +14,15 @@
  * limitations under the License.
  */
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 #include <unistd.h>
 
 #include "jemalloc.h"
+#include "malloc_huge_pages.h"
+#include "malloc_info.h"
 #include "private/bionic_macros.h"
 
 void* je_pvalloc(size_t bytes) {
@@ -46,3 +51,126 @@ void* je_memalign_round_up_boundary(size_t boundary, size_t size) {
   }
   return je_memalign(boundary, size);
 }
+
+// =============================================================================
+// Statistics for malloc_info(3), read through the jemalloc mallctl interface.
+// =============================================================================
+template <typename T>
+static T mallctl_read(const char* fmt, ...) __printflike(1, 2);
+
+template <typename T>
+static T mallctl_read(const char* fmt, ...) {
+  char name[128];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(name, sizeof(name), fmt, args);
+  va_end(args);
+
+  T value = 0;
+  size_t len = sizeof(value);
+  if (je_mallctl(name, &value, &len, nullptr, 0) != 0) {
+    return 0;
+  }
+  return value;
+}
+
+const char* __mallinfo_backend() {
+  return "jemalloc";
+}
+
+void __mallinfo_heap_stats(mallinfo_heap_stats* stats) {
+  // Writing the epoch makes jemalloc refresh its cached statistics.
+  uint64_t epoch = 1;
+  je_mallctl("epoch", nullptr, nullptr, &epoch, sizeof(epoch));
+
+  stats->allocated = mallctl_read<size_t>("stats.allocated");
+  stats->active = mallctl_read<size_t>("stats.active");
+  stats->resident = mallctl_read<size_t>("stats.resident");
+  stats->mapped = mallctl_read<size_t>("stats.mapped");
+  stats->has_counters = 1;
+}
+
+void __mallinfo_arena_stats(size_t aidx, mallinfo_arena_stats* stats) {
+  size_t page_size = getpagesize();
+  stats->active = mallctl_read<size_t>("stats.arenas.%zu.pactive", aidx) * page_size;
+  stats->dirty = mallctl_read<size_t>("stats.arenas.%zu.pdirty", aidx) * page_size;
+  stats->large_nmalloc = mallctl_read<uint64_t>("stats.arenas.%zu.large.nmalloc", aidx);
+  stats->large_ndalloc = mallctl_read<uint64_t>("stats.arenas.%zu.large.ndalloc", aidx);
+  stats->huge_nmalloc = mallctl_read<uint64_t>("stats.arenas.%zu.huge.nmalloc", aidx);
+  stats->huge_ndalloc = mallctl_read<uint64_t>("stats.arenas.%zu.huge.ndalloc", aidx);
+}
+
+void __mallinfo_bin_stats(size_t aidx, mallinfo_bin_stats* bins) {
+  size_t nbins = __mallinfo_nbins();
+  for (size_t j = 0; j < nbins; j++) {
+    mallinfo_bin_stats* bin = &bins[j];
+    bin->size = mallctl_read<size_t>("arenas.bin.%zu.size", j);
+    bin->current = mallctl_read<size_t>("stats.arenas.%zu.bins.%zu.curregs", aidx, j);
+    bin->allocated = bin->size * bin->current;
+    bin->nmalloc = mallctl_read<uint64_t>("stats.arenas.%zu.bins.%zu.nmalloc", aidx, j);
+    bin->ndalloc = mallctl_read<uint64_t>("stats.arenas.%zu.bins.%zu.ndalloc", aidx, j);
+    bin->nrequests = mallctl_read<uint64_t>("stats.arenas.%zu.bins.%zu.nrequests", aidx, j);
+    bin->nfills = mallctl_read<uint64_t>("stats.arenas.%zu.bins.%zu.nfills", aidx, j);
+    bin->nflushes = mallctl_read<uint64_t>("stats.arenas.%zu.bins.%zu.nflushes", aidx, j);
+  }
+}
+
+void __mallinfo_thread_stats(mallinfo_thread_stats* stats) {
+  stats->tcache_enabled = mallctl_read<bool>("thread.tcache.enabled");
+  stats->allocated = mallctl_read<uint64_t>("thread.allocated");
+  stats->deallocated = mallctl_read<uint64_t>("thread.deallocated");
+}
+
+// =============================================================================
+// Huge page support, implemented with the jemalloc chunk hooks.
+// =============================================================================
+static chunk_hooks_t g_default_chunk_hooks;
+
+// Chunks that can hold a huge page are aligned to one, so that all of
+// the chunk except for the tail can be backed by huge pages.
+static void* huge_chunk_alloc(void* new_addr, size_t size, size_t alignment, bool* zero,
+                              bool* commit, unsigned arena_ind) {
+  if (new_addr == nullptr && size >= MALLOC_HUGE_PAGE_SIZE) {
+    alignment = MAX(alignment, MALLOC_HUGE_PAGE_SIZE);
+  }
+  void* chunk = g_default_chunk_hooks.alloc(new_addr, size, alignment, zero, commit, arena_ind);
+  if (chunk != nullptr && size >= MALLOC_HUGE_PAGE_SIZE) {
+    __malloc_huge_madvise(chunk, size);
+  }
+  return chunk;
+}
+
+bool __malloc_backend_enable_huge_pages() {
+  size_t len = sizeof(g_default_chunk_hooks);
+  if (je_mallctl("arena.0.chunk_hooks", &g_default_chunk_hooks, &len, nullptr, 0) != 0) {
+    return false;
+  }
+  chunk_hooks_t hooks = g_default_chunk_hooks;
+  // Purging keeps the default hook: it releases the whole range, even
+  // if that splits a huge page. The kernel can collapse the pages again
+  // once they are used.
+  hooks.alloc = huge_chunk_alloc;
+
+  // jemalloc has no setting for the hooks a new arena starts with: every
+  // arena is created with its built-in defaults. So the hooks are set on
+  // every arena the process can have before any other thread runs.
+  // - Automatic arenas are created the first time a thread is assigned to
+  //   one. Moving this thread through each of them creates them all now.
+  // - "arenas.extend" is the only other way to create an arena, and it is
+  //   only reachable through je_mallctl, which libc doesn't export.
+  unsigned original_arena;
+  size_t arena_len = sizeof(original_arena);
+  if (je_mallctl("thread.arena", &original_arena, &arena_len, nullptr, 0) != 0) {
+    return false;
+  }
+  bool installed = true;
+  unsigned narenas = mallctl_read<unsigned>("arenas.narenas");
+  for (unsigned i = 0; installed && i < narenas; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "arena.%u.chunk_hooks", i);
+    installed = je_mallctl("thread.arena", nullptr, nullptr, &i, sizeof(i)) == 0 &&
+        je_mallctl(name, nullptr, nullptr, &hooks, sizeof(hooks)) == 0;
+  }
+  je_mallctl("thread.arena", nullptr, nullptr, &original_arena, sizeof(original_arena));
+  return installed;
+}
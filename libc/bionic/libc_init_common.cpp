@@ -43,6 +43,7 @@
 
 #include "private/bionic_auxv.h"
 #include "private/bionic_globals.h"
+#include "private/bionic_lock_profile.h"
 #include "private/bionic_ssp.h"
 #include "private/bionic_tls.h"
 #include "private/KernelArgumentBlock.h"
@@ -95,6 +96,10 @@ void __libc_init_common(KernelArgumentBlock& args) {
   __pthread_internal_add(main_thread);
 
   __system_properties_init(); // Requires 'environ'.
+  __pthread_mutex_init_spin_default(); // Requires 'environ'.
+  __pthread_internal_init_stack_cache(); // Requires 'environ'.
+  __lock_profile_init(); // Requires 'environ'.
+  __rseq_init(); // Requires 'environ'.
 }
 
 __noreturn static void __early_abort(int line) {
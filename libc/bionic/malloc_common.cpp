@@ -162,10 +162,13 @@ extern "C" void* valloc(size_t bytes) {
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <private/libc_logging.h>
 #include <sys/system_properties.h>
 
+#include "malloc_huge_pages.h"
+
 extern "C" int __cxa_atexit(void (*func)(void *), void *arg, void *dso);
 
 static const char* DEBUG_SHARED_LIB = "libc_malloc_debug.so";
@@ -173,6 +176,8 @@ static const char* DEBUG_MALLOC_PROPERTY_OPTIONS = "libc.debug.malloc.options";
 static const char* DEBUG_MALLOC_PROPERTY_PROGRAM = "libc.debug.malloc.program";
 static const char* DEBUG_MALLOC_PROPERTY_ENV_ENABLED = "libc.debug.malloc.env_enabled";
 static const char* DEBUG_MALLOC_ENV_ENABLE = "LIBC_DEBUG_MALLOC_ENABLE";
+static const char* HUGE_PAGES_PROPERTY = "libc.malloc.huge_pages";
+static const char* HUGE_PAGES_ENV = "LIBC_MALLOC_HUGE_PAGES";
 
 static void* libc_malloc_impl_handle = nullptr;
 
@@ -288,8 +293,31 @@ static void malloc_fini_impl(void*) {
   g_debug_finalize_func();
 }
 
+// Back large allocator regions with transparent huge pages when either
+// the property or the environment variable is set to a non-zero value.
+static void malloc_init_huge_pages() {
+  char value[PROP_VALUE_MAX];
+  const char* env = getenv(HUGE_PAGES_ENV);
+  if (env != nullptr) {
+    if (env[0] == '\0' || strcmp(env, "0") == 0) {
+      return;
+    }
+  } else if (__system_property_get(HUGE_PAGES_PROPERTY, value) == 0 ||
+             strcmp(value, "0") == 0) {
+    return;
+  }
+
+  if (!__malloc_backend_enable_huge_pages()) {
+    error_log("%s: Unable to enable huge pages for the native heap", getprogname());
+    return;
+  }
+  __malloc_huge_pages = true;
+}
+
 // Initializes memory allocation framework once per process.
 static void malloc_init_impl(libc_globals* globals) {
+  malloc_init_huge_pages();
+
   char value[PROP_VALUE_MAX];
   if (__system_property_get(DEBUG_MALLOC_PROPERTY_OPTIONS, value) == 0 || value[0] == '\0') {
     return;
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "malloc_huge_pages.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/user.h>
+
+#include "private/bionic_macros.h"
+#include "private/bionic_prctl.h"
+
+bool __malloc_huge_pages = false;
+
+void __malloc_huge_madvise(void* addr, size_t size) {
+  // The flag is kept per mapping, and khugepaged collapses any aligned huge
+  // page inside it, so there's no need to trim to huge page boundaries.
+  uintptr_t start = reinterpret_cast<uintptr_t>(addr) & ~(PAGE_SIZE - 1);
+  uintptr_t end = BIONIC_ALIGN(reinterpret_cast<uintptr_t>(addr) + size, PAGE_SIZE);
+  madvise(reinterpret_cast<void*>(start), end - start, MADV_HUGEPAGE);
+}
+
+void* __malloc_huge_mmap(size_t size) {
+  // The size is not rounded up, callers unmap exactly what they mapped.
+  if (size + MALLOC_HUGE_PAGE_SIZE < size) {
+    return MAP_FAILED;
+  }
+
+  // Over map, then cut off the parts outside of the aligned region.
+  size_t map_size = size + MALLOC_HUGE_PAGE_SIZE;
+  void* map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return map;
+  }
+  uintptr_t map_start = reinterpret_cast<uintptr_t>(map);
+  uintptr_t start = BIONIC_ALIGN(map_start, MALLOC_HUGE_PAGE_SIZE);
+  if (start != map_start) {
+    munmap(map, start - map_start);
+  }
+  uintptr_t end = start + size;
+  if (end != map_start + map_size) {
+    munmap(reinterpret_cast<void*>(end), map_start + map_size - end);
+  }
+
+  void* region = reinterpret_cast<void*>(start);
+  __malloc_huge_madvise(region, size);
+  prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, region, size, "libc_malloc");
+  return region;
+}
+
+void __malloc_huge_pages_usage(size_t* resident, size_t* huge) {
+  *resident = 0;
+  *huge = 0;
+
+  FILE* fp = fopen("/proc/self/smaps", "re");
+  if (fp == nullptr) {
+    return;
+  }
+  bool in_heap = false;
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != nullptr) {
+    size_t kb;
+    if (sscanf(line, "Rss: %zu kB", &kb) == 1) {
+      if (in_heap) *resident += kb * 1024;
+    } else if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+      if (in_heap) *huge += kb * 1024;
+    } else if ((line[0] >= '0' && line[0] <= '9') || (line[0] >= 'a' && line[0] <= 'f')) {
+      // Field names are capitalized, so this is the start of a new mapping.
+      // The allocator regions are named [anon:libc_malloc], or are the brk
+      // heap for dlmalloc.
+      in_heap = strstr(line, "[anon:libc_malloc]") != nullptr || strstr(line, "[heap]") != nullptr;
+    }
+  }
+  fclose(fp);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBC_BIONIC_MALLOC_HUGE_PAGES_H_
+#define LIBC_BIONIC_MALLOC_HUGE_PAGES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Size of a transparent huge page on every architecture bionic supports.
+#define MALLOC_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Set by malloc_init_impl when the heap should use huge pages, either
+// through the libc.malloc.huge_pages property or the
+// LIBC_MALLOC_HUGE_PAGES environment variable.
+__LIBC_HIDDEN__ extern bool __malloc_huge_pages;
+
+// Maps a named allocator region aligned to MALLOC_HUGE_PAGE_SIZE and
+// marked MADV_HUGEPAGE. Returns MAP_FAILED on error.
+__LIBC_HIDDEN__ void* __malloc_huge_mmap(size_t size);
+
+// Marks the pages covering an existing allocator region MADV_HUGEPAGE.
+__LIBC_HIDDEN__ void __malloc_huge_madvise(void* addr, size_t size);
+
+// Resident bytes of the allocator regions, and how many of those are
+// backed by huge pages, read from /proc/self/smaps.
+__LIBC_HIDDEN__ void __malloc_huge_pages_usage(size_t* resident, size_t* huge);
+
+// Implemented by the backend. Changes how the backend maps and purges
+// its memory so that large regions can be backed by huge pages. Returns
+// false if the backend could not be set up.
+__LIBC_HIDDEN__ bool __malloc_backend_enable_huge_pages(void);
+
+__END_DECLS
+
+#endif  // LIBC_BIONIC_MALLOC_HUGE_PAGES_H_
@@ -15,8 +15,12 @@
  */
 
 #include "malloc_info.h"
+#include "malloc_huge_pages.h"
 
 #include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
 #include "private/bionic_macros.h"
 
 class __LIBC_HIDDEN__ Elem {
@@ -56,33 +60,107 @@ private:
   DISALLOW_COPY_AND_ASSIGN(Elem);
 };
 
+// Version of the XML layout documented in <malloc.h>. Bump this whenever an
+// element is removed or changes meaning; adding elements does not need it.
+static constexpr int MALLOC_INFO_VERSION = 2;
+
 int malloc_info(int options, FILE* fp) {
   if (options != 0) {
     errno = EINVAL;
     return -1;
   }
 
-  Elem root(fp, "malloc", "version=\"jemalloc-1\"");
+  // The heap stats must be read first, they refresh the backend snapshot.
+  mallinfo_heap_stats heap;
+  __mallinfo_heap_stats(&heap);
+
+  size_t nbins = __mallinfo_nbins();
+  mallinfo_bin_stats* bins = nullptr;
+  if (nbins != 0) {
+    bins = reinterpret_cast<mallinfo_bin_stats*>(calloc(nbins, sizeof(mallinfo_bin_stats)));
+    if (bins == nullptr) {
+      return -1;
+    }
+  }
+
+  Elem root(fp, "malloc", "version=\"%s-%d\"", __mallinfo_backend(), MALLOC_INFO_VERSION);
+
+  {
+    Elem total_elem(fp, "total");
+    Elem(fp, "allocated").contents("%zu", heap.allocated);
+    Elem(fp, "active").contents("%zu", heap.active);
+    Elem(fp, "resident").contents("%zu", heap.resident);
+    Elem(fp, "mapped").contents("%zu", heap.mapped);
+  }
+
+  if (heap.has_counters) {
+    mallinfo_thread_stats thread;
+    __mallinfo_thread_stats(&thread);
+
+    Elem thread_elem(fp, "thread");
+    Elem(fp, "tcache-enabled").contents("%d", thread.tcache_enabled);
+    Elem(fp, "allocated").contents("%" PRIu64, thread.allocated);
+    Elem(fp, "deallocated").contents("%" PRIu64, thread.deallocated);
+  }
+
+  {
+    size_t resident;
+    size_t huge;
+    __malloc_huge_pages_usage(&resident, &huge);
+
+    Elem huge_pages_elem(fp, "huge-pages", "enabled=\"%d\"", __malloc_huge_pages);
+    Elem(fp, "resident").contents("%zu", resident);
+    Elem(fp, "huge").contents("%zu", huge);
+  }
 
   // Dump all of the large allocations in the arenas.
   for (size_t i = 0; i < __mallinfo_narenas(); i++) {
     struct mallinfo mi = __mallinfo_arena_info(i);
     if (mi.hblkhd != 0) {
-      Elem arena_elem(fp, "heap", "nr=\"%d\"", i);
+      mallinfo_arena_stats arena;
+      __mallinfo_arena_stats(i, &arena);
+
+      Elem arena_elem(fp, "heap", "nr=\"%zu\"", i);
       {
         Elem(fp, "allocated-large").contents("%zu", mi.ordblks);
         Elem(fp, "allocated-huge").contents("%zu", mi.uordblks);
         Elem(fp, "allocated-bins").contents("%zu", mi.fsmblks);
+        Elem(fp, "active").contents("%zu", arena.active);
+        Elem(fp, "dirty").contents("%zu", arena.dirty);
+        Elem(fp, "mapped").contents("%zu", mi.hblkhd);
+
+        if (heap.has_counters) {
+          {
+            Elem large_elem(fp, "large");
+            Elem(fp, "nmalloc").contents("%" PRIu64, arena.large_nmalloc);
+            Elem(fp, "ndalloc").contents("%" PRIu64, arena.large_ndalloc);
+          }
+          {
+            Elem huge_elem(fp, "huge");
+            Elem(fp, "nmalloc").contents("%" PRIu64, arena.huge_nmalloc);
+            Elem(fp, "ndalloc").contents("%" PRIu64, arena.huge_ndalloc);
+          }
+        }
 
         size_t total = 0;
-        for (size_t j = 0; j < __mallinfo_nbins(); j++) {
-          struct mallinfo mi = __mallinfo_bin_info(i, j);
-          if (mi.ordblks != 0) {
-            Elem bin_elem(fp, "bin", "nr=\"%d\"", j);
-            Elem(fp, "allocated").contents("%zu", mi.ordblks);
-            Elem(fp, "nmalloc").contents("%zu", mi.uordblks);
-            Elem(fp, "ndalloc").contents("%zu", mi.fordblks);
-            total += mi.ordblks;
+        if (bins != nullptr) {
+          __mallinfo_bin_stats(i, bins);
+        }
+        for (size_t j = 0; j < nbins; j++) {
+          const mallinfo_bin_stats& bin = bins[j];
+          if (bin.current != 0 || bin.nmalloc != 0) {
+            Elem bin_elem(fp, "bin", "nr=\"%zu\"", j);
+            Elem(fp, "size").contents("%zu", bin.size);
+            Elem(fp, "allocated").contents("%zu", bin.allocated);
+            Elem(fp, "current").contents("%zu", bin.current);
+            if (heap.has_counters) {
+              Elem(fp, "nmalloc").contents("%" PRIu64, bin.nmalloc);
+              Elem(fp, "ndalloc").contents("%" PRIu64, bin.ndalloc);
+              Elem(fp, "nrequests").contents("%" PRIu64, bin.nrequests);
+              Elem(fp, "nfills").contents("%" PRIu64, bin.nfills);
+              Elem(fp, "nflushes").contents("%" PRIu64, bin.nflushes);
+            }
+            total += bin.allocated;
           }
         }
         Elem(fp, "bins-total").contents("%zu", total);
@@ -90,5 +168,6 @@ int malloc_info(int options, FILE* fp) {
     }
   }
 
+  free(bins);
   return 0;
 }
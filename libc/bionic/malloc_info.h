@@ -18,14 +18,64 @@
 #define LIBC_BIONIC_MALLOC_INFO_H_
 
 #include <malloc.h>
+#include <stdint.h>
 #include <sys/cdefs.h>
 
 __BEGIN_DECLS
 
+// Process wide heap totals, used to compute fragmentation.
+struct mallinfo_heap_stats {
+  size_t allocated;  // Bytes in live allocations.
+  size_t active;     // Bytes in pages backing live allocations.
+  size_t resident;   // Bytes of allocator memory resident in RAM.
+  size_t mapped;     // Bytes of address space mapped by the allocator.
+  // Non-zero if the backend maintains the cumulative nmalloc/ndalloc counters
+  // and the per-thread statistics.
+  int has_counters;
+};
+
+// Per arena counters for allocations too big to be served from a bin.
+struct mallinfo_arena_stats {
+  size_t active;           // Bytes in pages backing live allocations.
+  size_t dirty;            // Bytes in unused pages that have not been purged.
+  uint64_t large_nmalloc;
+  uint64_t large_ndalloc;
+  uint64_t huge_nmalloc;
+  uint64_t huge_ndalloc;
+};
+
+// Per size class counters.
+struct mallinfo_bin_stats {
+  size_t size;         // Size of the objects held by this bin.
+  size_t current;      // Objects currently allocated.
+  size_t allocated;    // Bytes currently allocated.
+  uint64_t nmalloc;    // Objects handed out by the arena (including to thread caches).
+  uint64_t ndalloc;    // Objects returned to the arena.
+  uint64_t nrequests;  // Allocation requests, including those served by a thread cache.
+  uint64_t nfills;     // Thread cache refills from this bin.
+  uint64_t nflushes;   // Thread cache flushes back into this bin.
+};
+
+// Statistics for the calling thread.
+struct mallinfo_thread_stats {
+  int tcache_enabled;
+  uint64_t allocated;    // Bytes allocated by this thread.
+  uint64_t deallocated;  // Bytes freed by this thread.
+};
+
 __LIBC_HIDDEN__ size_t __mallinfo_narenas();
 __LIBC_HIDDEN__ size_t __mallinfo_nbins();
 __LIBC_HIDDEN__ struct mallinfo __mallinfo_arena_info(size_t);
-__LIBC_HIDDEN__ struct mallinfo __mallinfo_bin_info(size_t, size_t);
+
+// Name of the native allocator, used in the malloc_info(3) version string.
+__LIBC_HIDDEN__ const char* __mallinfo_backend();
+// Must be called before the other __mallinfo_*_stats functions, it
+// refreshes any statistics the backend caches.
+__LIBC_HIDDEN__ void __mallinfo_heap_stats(struct mallinfo_heap_stats*);
+__LIBC_HIDDEN__ void __mallinfo_arena_stats(size_t, struct mallinfo_arena_stats*);
+// Fills in __mallinfo_nbins() entries for the given arena in a single pass.
+__LIBC_HIDDEN__ void __mallinfo_bin_stats(size_t, struct mallinfo_bin_stats*);
+__LIBC_HIDDEN__ void __mallinfo_thread_stats(struct mallinfo_thread_stats*);
 
 __END_DECLS
 
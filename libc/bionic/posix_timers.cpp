@@ -33,11 +33,17 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "pthread_internal.h"
+#include "private/ErrnoRestorer.h"
 
 // System calls.
 extern "C" int __rt_sigtimedwait(const sigset_t*, siginfo_t*, const timespec*, size_t);
+extern "C" int __rt_tgsigqueueinfo(pid_t, pid_t, int, siginfo_t*);
 extern "C" int __timer_create(clockid_t, sigevent*, __kernel_timer_t*);
 extern "C" int __timer_delete(__kernel_timer_t);
 extern "C" int __timer_getoverrun(__kernel_timer_t);
@@ -55,6 +61,8 @@ extern "C" int __timer_settime(__kernel_timer_t, int, const itimerspec*, itimers
 // reason to use anything else, we use that too.
 static const int TIMER_SIGNAL = (__SIGRTMIN + 0);
 
+struct TimerDispatcher;
+
 struct PosixTimer {
   __kernel_timer_t kernel_timer_id;
 
@@ -65,12 +73,58 @@ struct PosixTimer {
   void (*callback)(sigval_t);
   sigval_t callback_argument;
   atomic_bool deleted;  // Set when the timer is deleted, to prevent further calling of callback.
+  // Set when the callback deletes its own timer, so the timer's thread frees it and exits once
+  // the callback returns.
+  bool deleted_by_callback;
+  // Set when timer_delete couldn't signal the thread that serves the timer, so that thread frees
+  // the timer the next time it wakes up instead. timer_delete doesn't touch the timer after this.
+  atomic_bool orphaned;
+
+  // Non-NULL if the callback runs on a shared dispatcher thread rather than a thread of its own.
+  TimerDispatcher* dispatcher;
+  PosixTimer* next_pending;  // Links the dispatcher's list of timers pending deletion.
+};
+
+// With LIBC_TIMER_THREADS=n, SIGEV_THREAD timers that don't ask for particular thread attributes
+// share n dispatcher threads instead of each getting a thread of its own. Each timer is still a
+// SIGEV_THREAD_ID timer in the kernel, so expirations, overruns and timer_gettime all behave as
+// before; the kernel just puts the PosixTimer in si_value so the dispatcher knows which callback
+// to run. Callbacks sharing a dispatcher run one at a time, so a slow one delays the others.
+struct TimerDispatcher {
+  pthread_t thread;
+  pid_t tid;
+  Lock lock;
+  // Deleted timers the dispatcher hasn't freed yet. Only timers on this list are ever freed by
+  // the dispatcher, whatever a queued signal claims.
+  PosixTimer* pending;
 };
 
+static Lock g_dispatchers_lock;
+static bool g_dispatcher_max_read;
+static size_t g_dispatcher_max;
+static TimerDispatcher* g_dispatchers;
+static size_t g_dispatchers_allocated;
+static size_t g_dispatcher_count;
+static size_t g_next_dispatcher;
+
+// How many times timer_delete retries a full signal queue, a millisecond apart, before orphaning
+// the timer instead.
+static const int TIMER_HANDOFF_RETRIES = 10;
+
 static __kernel_timer_t to_kernel_timer_id(timer_t timer) {
   return reinterpret_cast<PosixTimer*>(timer)->kernel_timer_id;
 }
 
+// Leaves a deleted timer for the thread that serves it, when that thread couldn't be signaled
+// because the per-user limit on queued signals has been reached. A timer's own expirations don't
+// count against that limit, so the kernel timer is rearmed to keep waking the thread until it
+// notices, deletes the kernel timer and frees the timer. We don't touch the timer after this.
+static void __timer_orphan(PosixTimer* timer) {
+  itimerspec wakeup = { { 0, 1000000 }, { 0, 1000000 } };
+  __timer_settime(timer->kernel_timer_id, 0, &wakeup, NULL);
+  atomic_store(&timer->orphaned, true);
+}
+
 static void* __timer_thread_start(void* arg) {
   PosixTimer* timer = reinterpret_cast<PosixTimer*>(arg);
 
@@ -91,10 +145,21 @@ static void* __timer_thread_start(void* arg) {
 
       // All events to the callback will be ignored when the timer is deleted.
       if (atomic_load(&timer->deleted) == true) {
+        if (atomic_load(&timer->orphaned)) {
+          // timer_delete couldn't tell us to exit, so it left us the kernel timer to delete.
+          __timer_delete(timer->kernel_timer_id);
+          free(timer);
+          return NULL;
+        }
         continue;
       }
       timer->callback(timer->callback_argument);
-    } else if (si.si_code == SI_TKILL) {
+      if (timer->deleted_by_callback) {
+        // Any expirations still queued for this thread go away with it.
+        free(timer);
+        return NULL;
+      }
+    } else if (si.si_code == SI_TKILL && atomic_load(&timer->deleted)) {
       // This signal was sent because someone wants us to exit.
       free(timer);
       return NULL;
@@ -102,9 +167,225 @@ static void* __timer_thread_start(void* arg) {
   }
 }
 
-static void __timer_thread_stop(PosixTimer* timer) {
+// Tells the timer's thread to exit and free the timer. Returns false if the thread couldn't be
+// told because the signal queue is full.
+static bool __timer_thread_stop(PosixTimer* timer) {
+  pthread_t thread = timer->callback_thread;
+  atomic_store(&timer->deleted, true);
+  if (pthread_equal(thread, pthread_self())) {
+    timer->deleted_by_callback = true;
+    return true;
+  }
+  for (int i = 0; pthread_kill(thread, TIMER_SIGNAL) == EAGAIN; ++i) {
+    if (i == TIMER_HANDOFF_RETRIES) {
+      return false;
+    }
+    usleep(1000);
+  }
+  return true;
+}
+
+// Removes the given timer from the dispatcher's pending list, returning false if it isn't there.
+static bool __timer_dispatcher_take_pending(TimerDispatcher* dispatcher, PosixTimer* timer) {
+  bool found = false;
+  dispatcher->lock.lock();
+  for (PosixTimer** p = &dispatcher->pending; *p != NULL; p = &(*p)->next_pending) {
+    if (*p == timer) {
+      *p = timer->next_pending;
+      found = true;
+      break;
+    }
+  }
+  dispatcher->lock.unlock();
+  return found;
+}
+
+// Removes and returns the orphaned timers on the dispatcher's pending list.
+static PosixTimer* __timer_dispatcher_take_orphans(TimerDispatcher* dispatcher) {
+  PosixTimer* orphans = NULL;
+  dispatcher->lock.lock();
+  PosixTimer** p = &dispatcher->pending;
+  while (*p != NULL) {
+    PosixTimer* timer = *p;
+    if (atomic_load(&timer->orphaned)) {
+      *p = timer->next_pending;
+      timer->next_pending = orphans;
+      orphans = timer;
+    } else {
+      p = &timer->next_pending;
+    }
+  }
+  dispatcher->lock.unlock();
+  return orphans;
+}
+
+static void __timer_dispatcher_handle(TimerDispatcher* dispatcher, const siginfo_t& si) {
+  PosixTimer* timer = reinterpret_cast<PosixTimer*>(si.si_value.sival_ptr);
+  if (si.si_code == SI_TIMER) {
+    if (atomic_load(&timer->deleted) == false) {
+      timer->callback(timer->callback_argument);
+    }
+  } else if (si.si_code == SI_QUEUE && si.si_pid == getpid()) {
+    // timer_delete has told us nothing more is queued for this timer. Anyone can queue us a
+    // signal, though, so only free what timer_delete actually gave us.
+    if (__timer_dispatcher_take_pending(dispatcher, timer)) {
+      free(timer);
+    }
+  }
+}
+
+static void* __timer_dispatcher_start(void* arg) {
+  TimerDispatcher* dispatcher = reinterpret_cast<TimerDispatcher*>(arg);
+
+  kernel_sigset_t sigset;
+  sigaddset(sigset.get(), TIMER_SIGNAL);
+
+  while (true) {
+    siginfo_t si;
+    memset(&si, 0, sizeof(si));
+    int rc = __rt_sigtimedwait(sigset.get(), &si, NULL, sizeof(sigset));
+    if (rc == -1) {
+      continue;
+    }
+    __timer_dispatcher_handle(dispatcher, si);
+
+    // Orphaned timers have no message behind their last expiration, so once their kernel timers
+    // are gone, handle everything that's queued, after which nothing refers to them. Callbacks
+    // run while doing so can orphan more timers.
+    PosixTimer* orphans;
+    while ((orphans = __timer_dispatcher_take_orphans(dispatcher)) != NULL) {
+      for (PosixTimer* timer = orphans; timer != NULL; timer = timer->next_pending) {
+        __timer_delete(timer->kernel_timer_id);
+      }
+      timespec zero = {};
+      while (true) {
+        memset(&si, 0, sizeof(si));
+        rc = __rt_sigtimedwait(sigset.get(), &si, &zero, sizeof(sigset));
+        if (rc == -1 && errno == EAGAIN) {
+          break;
+        }
+        if (rc != -1) {
+          __timer_dispatcher_handle(dispatcher, si);
+        }
+      }
+      while (orphans != NULL) {
+        PosixTimer* timer = orphans;
+        orphans = timer->next_pending;
+        free(timer);
+      }
+    }
+  }
+}
+
+// Hands the timer to its dispatcher to free. Returns false if the dispatcher will delete the
+// kernel timer too.
+static bool __timer_dispatcher_free(PosixTimer* timer) {
+  TimerDispatcher* dispatcher = timer->dispatcher;
+  pid_t tid = dispatcher->tid;
   atomic_store(&timer->deleted, true);
-  pthread_kill(timer->callback_thread, TIMER_SIGNAL);
+
+  // A callback deleting a timer can't wait for its own thread to make room in the signal queue,
+  // so the timer is orphaned straight away and freed once the callback returns.
+  bool orphaned = pthread_equal(dispatcher->thread, pthread_self());
+  atomic_store(&timer->orphaned, orphaned);
+  dispatcher->lock.lock();
+  timer->next_pending = dispatcher->pending;
+  dispatcher->pending = timer;
+  dispatcher->lock.unlock();
+  if (orphaned) {
+    return false;
+  }
+
+  // Tell the dispatcher it can free the timer, with a queued signal that carries the timer.
+  // Real-time signals are delivered in the order they were queued, so by the time the dispatcher
+  // gets this one it has handled every expiration of the timer, which is already disarmed.
+  ErrnoRestorer errno_restorer;
+  siginfo_t info;
+  memset(&info, 0, sizeof(info));
+  info.si_signo = TIMER_SIGNAL;
+  info.si_code = SI_QUEUE;
+  info.si_pid = getpid();
+  info.si_uid = getuid();
+  info.si_value.sival_ptr = timer;
+  for (int i = 0; __rt_tgsigqueueinfo(getpid(), tid, TIMER_SIGNAL, &info) == -1; ++i) {
+    if (errno != EAGAIN || i == TIMER_HANDOFF_RETRIES) {
+      __timer_orphan(timer);
+      return false;
+    }
+    usleep(1000);
+  }
+  return true;
+}
+
+void __posix_timers_forked_child() {
+  // Only the forking thread exists in the child, so the lock may have been left held and the
+  // dispatchers are gone. Timers aren't inherited either, so there's nothing left to free.
+  g_dispatchers_lock.init(false);
+  g_dispatcher_max_read = false;
+  g_dispatcher_count = 0;
+}
+
+// Returns the dispatcher a new SIGEV_THREAD timer should use, starting the dispatcher threads
+// on first use, or NULL if the timer should get a thread of its own.
+static TimerDispatcher* __timer_get_dispatcher() {
+  TimerDispatcher* dispatcher = NULL;
+  g_dispatchers_lock.lock();
+
+  // LIBC_TIMER_THREADS sets the number of shared dispatcher threads. Zero, the default, gives
+  // every SIGEV_THREAD timer its own thread. It's read when the first SIGEV_THREAD timer is
+  // created, and again in a forked child.
+  if (!g_dispatcher_max_read) {
+    g_dispatcher_max = 0;
+    const char* value = getenv("LIBC_TIMER_THREADS");
+    if (value != NULL) {
+      char* end;
+      unsigned long count = strtoul(value, &end, 10);
+      if (*value != '\0' && *end == '\0') {
+        g_dispatcher_max = count;
+      }
+    }
+    g_dispatcher_max_read = true;
+  }
+
+  if (g_dispatcher_max != 0 && g_dispatcher_count == 0) {
+    if (g_dispatchers_allocated < g_dispatcher_max) {
+      free(g_dispatchers);
+      g_dispatchers = reinterpret_cast<TimerDispatcher*>(calloc(g_dispatcher_max,
+                                                               sizeof(TimerDispatcher)));
+      g_dispatchers_allocated = (g_dispatchers != NULL) ? g_dispatcher_max : 0;
+    }
+    if (g_dispatchers != NULL) {
+      pthread_attr_t thread_attributes;
+      pthread_attr_init(&thread_attributes);
+      pthread_attr_setdetachstate(&thread_attributes, PTHREAD_CREATE_DETACHED);
+
+      // As in timer_create, the threads inherit TIMER_SIGNAL blocked.
+      kernel_sigset_t sigset;
+      sigaddset(sigset.get(), TIMER_SIGNAL);
+      kernel_sigset_t old_sigset;
+      pthread_sigmask(SIG_BLOCK, sigset.get(), old_sigset.get());
+
+      while (g_dispatcher_count < g_dispatcher_max) {
+        TimerDispatcher* new_dispatcher = &g_dispatchers[g_dispatcher_count];
+        new_dispatcher->lock.init(false);
+        new_dispatcher->pending = NULL;
+        if (pthread_create(&new_dispatcher->thread, &thread_attributes, __timer_dispatcher_start,
+                           new_dispatcher) != 0) {
+          break;
+        }
+        new_dispatcher->tid = pthread_gettid_np(new_dispatcher->thread);
+        pthread_setname_np(new_dispatcher->thread, "POSIX timers");
+        ++g_dispatcher_count;
+      }
+
+      pthread_sigmask(SIG_SETMASK, old_sigset.get(), NULL);
+    }
+  }
+  if (g_dispatcher_count != 0) {
+    dispatcher = &g_dispatchers[g_next_dispatcher++ % g_dispatcher_count];
+  }
+  g_dispatchers_lock.unlock();
+  return dispatcher;
 }
 
 // http://pubs.opengroup.org/onlinepubs/9699919799/functions/timer_create.html
@@ -131,6 +412,10 @@ int timer_create(clockid_t clock_id, sigevent* evp, timer_t* timer_id) {
   timer->callback = evp->sigev_notify_function;
   timer->callback_argument = evp->sigev_value;
   atomic_init(&timer->deleted, false);
+  timer->deleted_by_callback = false;
+  atomic_init(&timer->orphaned, false);
+  timer->dispatcher = NULL;
+  timer->next_pending = NULL;
 
   // Check arguments that the kernel doesn't care about but we do.
   if (timer->callback == NULL) {
@@ -139,6 +424,27 @@ int timer_create(clockid_t clock_id, sigevent* evp, timer_t* timer_id) {
     return -1;
   }
 
+  // Timers that want particular thread attributes still get a thread of their own.
+  if (evp->sigev_notify_attributes == NULL) {
+    timer->dispatcher = __timer_get_dispatcher();
+  }
+  if (timer->dispatcher != NULL) {
+    timer->callback_thread = timer->dispatcher->thread;
+
+    sigevent se = *evp;
+    se.sigev_signo = TIMER_SIGNAL;
+    se.sigev_notify = SIGEV_THREAD_ID;
+    se.sigev_notify_thread_id = timer->dispatcher->tid;
+    se.sigev_value.sival_ptr = timer;
+    if (__timer_create(clock_id, &se, &timer->kernel_timer_id) == -1) {
+      free(timer);
+      return -1;
+    }
+
+    *timer_id = timer;
+    return 0;
+  }
+
   // Create this timer's thread.
   pthread_attr_t thread_attributes;
   if (evp->sigev_notify_attributes == NULL) {
@@ -170,6 +476,7 @@ int timer_create(clockid_t clock_id, sigevent* evp, timer_t* timer_id) {
   se.sigev_notify = SIGEV_THREAD_ID;
   se.sigev_notify_thread_id = pthread_gettid_np(timer->callback_thread);
   if (__timer_create(clock_id, &se, &timer->kernel_timer_id) == -1) {
+    // With no kernel timer to wake it, the thread is leaked if it can't be told to exit.
     __timer_thread_stop(timer);
     return -1;
   }
@@ -186,20 +493,38 @@ int timer_create(clockid_t clock_id, sigevent* evp, timer_t* timer_id) {
 
 // http://pubs.opengroup.org/onlinepubs/9699919799/functions/timer_delete.html
 int timer_delete(timer_t id) {
-  int rc = __timer_delete(to_kernel_timer_id(id));
-  if (rc == -1) {
-    return -1;
-  }
-
   PosixTimer* timer = reinterpret_cast<PosixTimer*>(id);
-  if (timer->sigev_notify == SIGEV_THREAD) {
-    // Stopping the timer's thread frees the timer data when it's safe.
-    __timer_thread_stop(timer);
-  } else {
+  __kernel_timer_t kernel_timer_id = timer->kernel_timer_id;
+
+  if (timer->sigev_notify != SIGEV_THREAD) {
+    if (__timer_delete(kernel_timer_id) == -1) {
+      return -1;
+    }
     // For timers without threads, we can just free right away.
     free(timer);
+    return 0;
+  }
+
+  // The timer's thread may need the kernel timer to wake it up if it can't be signaled, so at
+  // first the kernel timer is only disarmed. This also checks that it exists.
+  itimerspec disarm = {};
+  if (__timer_settime(kernel_timer_id, 0, &disarm, NULL) == -1) {
+    return -1;
   }
 
+  if (timer->dispatcher != NULL) {
+    // The dispatcher frees the timer once it can no longer be running its callback.
+    if (!__timer_dispatcher_free(timer)) {
+      return 0;
+    }
+  } else {
+    // Stopping the timer's thread frees the timer data when it's safe.
+    if (!__timer_thread_stop(timer)) {
+      __timer_orphan(timer);
+      return 0;
+    }
+  }
+  __timer_delete(kernel_timer_id);
   return 0;
 }
 
@@ -29,7 +29,9 @@
 #include <pthread.h>
 
 #include <inttypes.h>
+#include <sched.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
@@ -183,6 +185,50 @@ int pthread_getattr_np(pthread_t t, pthread_attr_t* attr) {
   return 0;
 }
 
+int pthread_attr_setaffinity_np(pthread_attr_t* attr, size_t cpu_set_size, const cpu_set_t* cpu_set) {
+  if (cpu_set == NULL || cpu_set_size == 0) {
+    attr->flags &= ~PTHREAD_ATTR_FLAG_AFFINITY;
+    return 0;
+  }
+#if defined(__LP64__)
+  // The mask lives in __reserved, which has room for cpus 0 to 127.
+  const char* bytes = reinterpret_cast<const char*>(cpu_set);
+  size_t size = (cpu_set_size < sizeof(attr->__reserved)) ? cpu_set_size : sizeof(attr->__reserved);
+  for (size_t i = size; i < cpu_set_size; ++i) {
+    if (bytes[i] != 0) {
+      return EINVAL;
+    }
+  }
+  memset(attr->__reserved, 0, sizeof(attr->__reserved));
+  memcpy(attr->__reserved, bytes, size);
+  attr->flags |= PTHREAD_ATTR_FLAG_AFFINITY;
+  return 0;
+#else
+  // There's no room in the LP32 pthread_attr_t. Use pthread_setaffinity_np once the thread runs.
+  return ENOTSUP;
+#endif
+}
+
+int pthread_attr_getaffinity_np(const pthread_attr_t* attr, size_t cpu_set_size, cpu_set_t* cpu_set) {
+  char* bytes = reinterpret_cast<char*>(cpu_set);
+  if ((attr->flags & PTHREAD_ATTR_FLAG_AFFINITY) == 0) {
+    // No mask means the thread can run anywhere.
+    memset(bytes, 0xff, cpu_set_size);
+    return 0;
+  }
+#if defined(__LP64__)
+  size_t size = (cpu_set_size < sizeof(attr->__reserved)) ? cpu_set_size : sizeof(attr->__reserved);
+  for (size_t i = size; i < sizeof(attr->__reserved); ++i) {
+    if (attr->__reserved[i] != 0) {
+      return EINVAL;
+    }
+  }
+  memset(bytes, 0, cpu_set_size);
+  memcpy(bytes, attr->__reserved, size);
+#endif
+  return 0;
+}
+
 int pthread_attr_setscope(pthread_attr_t*, int scope) {
   if (scope == PTHREAD_SCOPE_SYSTEM) {
     return 0;
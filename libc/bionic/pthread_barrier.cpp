@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "private/bionic_futex.h"
+
+int pthread_barrierattr_init(pthread_barrierattr_t* attr) {
+  *attr = 0;
+  return 0;
+}
+
+int pthread_barrierattr_destroy(pthread_barrierattr_t* attr) {
+  *attr = 0;
+  return 0;
+}
+
+int pthread_barrierattr_getpshared(const pthread_barrierattr_t* attr, int* pshared) {
+  *pshared = (*attr & 1) ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE;
+  return 0;
+}
+
+int pthread_barrierattr_setpshared(pthread_barrierattr_t* attr, int pshared) {
+  switch (pshared) {
+    case PTHREAD_PROCESS_PRIVATE:
+      *attr &= ~1;
+      return 0;
+    case PTHREAD_PROCESS_SHARED:
+      *attr |= 1;
+      return 0;
+    default:
+      return EINVAL;
+  }
+}
+
+// Threads arriving at the barrier increment wait_count and sleep on generation.
+// The last arriver resets wait_count, bumps generation and wakes everyone with a
+// single FUTEX_WAKE. Waiters only compare generation with the value they saw on
+// arrival, so a thread that re-enters the barrier for the next round before a
+// slow waiter of the previous round has woken up can't confuse it.
+struct pthread_barrier_internal_t {
+  uint32_t init_count;
+  atomic_uint wait_count;
+  atomic_uint generation;
+  // Count of threads still inside pthread_barrier_wait, so that
+  // pthread_barrier_destroy can wait for them to stop touching the barrier.
+  atomic_uint waiters;
+  bool pshared;
+  char __reserved[15];
+};
+
+static_assert(sizeof(pthread_barrier_t) == sizeof(pthread_barrier_internal_t),
+              "pthread_barrier_t should actually be pthread_barrier_internal_t in implementation.");
+
+static_assert(alignof(pthread_barrier_t) >= 4,
+              "pthread_barrier_t should fulfill the alignment requirement of pthread_barrier_internal_t.");
+
+static inline __always_inline pthread_barrier_internal_t* __get_internal_barrier(pthread_barrier_t* barrier) {
+  return reinterpret_cast<pthread_barrier_internal_t*>(barrier);
+}
+
+int pthread_barrier_init(pthread_barrier_t* barrier_interface, const pthread_barrierattr_t* attr,
+                         unsigned count) {
+  pthread_barrier_internal_t* barrier = __get_internal_barrier(barrier_interface);
+  if (count == 0) {
+    return EINVAL;
+  }
+  memset(barrier, 0, sizeof(pthread_barrier_internal_t));
+  barrier->init_count = count;
+  atomic_init(&barrier->wait_count, 0);
+  atomic_init(&barrier->generation, 0);
+  atomic_init(&barrier->waiters, 0);
+  barrier->pshared = (attr != NULL) && (*attr & 1);
+  return 0;
+}
+
+int pthread_barrier_wait(pthread_barrier_t* barrier_interface) {
+  pthread_barrier_internal_t* barrier = __get_internal_barrier(barrier_interface);
+  if (barrier->init_count == 0) {
+    return EINVAL;
+  }
+
+  atomic_fetch_add_explicit(&barrier->waiters, 1, memory_order_relaxed);
+  // The generation can't change before we arrive, because this round can't
+  // finish without us.
+  unsigned generation = atomic_load_explicit(&barrier->generation, memory_order_relaxed);
+  unsigned arrived = atomic_fetch_add_explicit(&barrier->wait_count, 1, memory_order_acq_rel) + 1;
+
+  int result = 0;
+  if (arrived == barrier->init_count) {
+    atomic_store_explicit(&barrier->wait_count, 0, memory_order_relaxed);
+    atomic_store_explicit(&barrier->generation, generation + 1, memory_order_release);
+    __futex_wake_ex(&barrier->generation, barrier->pshared, INT_MAX);
+    result = PTHREAD_BARRIER_SERIAL_THREAD;
+  } else {
+    while (atomic_load_explicit(&barrier->generation, memory_order_acquire) == generation) {
+      __futex_wait_ex(&barrier->generation, barrier->pshared, generation, NULL);
+    }
+  }
+
+  atomic_fetch_sub_explicit(&barrier->waiters, 1, memory_order_release);
+  return result;
+}
+
+int pthread_barrier_destroy(pthread_barrier_t* barrier_interface) {
+  pthread_barrier_internal_t* barrier = __get_internal_barrier(barrier_interface);
+  if (barrier->init_count == 0) {
+    return EINVAL;
+  }
+  if (atomic_load_explicit(&barrier->wait_count, memory_order_relaxed) != 0) {
+    return EBUSY;
+  }
+  // Threads released by the last round may not have returned yet. They are
+  // already runnable, so this wait is short.
+  while (atomic_load_explicit(&barrier->waiters, memory_order_acquire) != 0) {
+    sched_yield();
+  }
+  barrier->init_count = 0;
+  return 0;
+}
@@ -104,6 +104,13 @@ int pthread_condattr_destroy(pthread_condattr_t* attr) {
   return 0;
 }
 
+// On LP64, waiters record the mutex they use in the condition variable, so that
+// pthread_cond_broadcast can wake one of them and requeue the rest onto the mutex futex,
+// where they are woken one at a time as the mutex is unlocked. COND_MUTEX_MISMATCHED
+// means that waiters used different mutexes, or a mutex that can't take requeued waiters,
+// and broadcast wakes everyone.
+#define COND_MUTEX_MISMATCHED 1
+
 struct pthread_cond_internal_t {
   atomic_uint state;
 
@@ -116,6 +123,13 @@ struct pthread_cond_internal_t {
   }
 
 #if defined(__LP64__)
+  // The waiters' mutex needs 8-byte alignment to be accessed atomically, but pthread_cond_t
+  // may only be 4-byte aligned, so it is at whichever of the first two reserved words is.
+  atomic_uintptr_t* waiter_mutex() {
+    uintptr_t address = reinterpret_cast<uintptr_t>(__reserved);
+    return reinterpret_cast<atomic_uintptr_t*>((address + 7) & ~7);
+  }
+
   char __reserved[44];
 #endif
 };
@@ -140,6 +154,9 @@ int pthread_cond_init(pthread_cond_t* cond_interface, const pthread_condattr_t*
     init_state = (*attr & COND_FLAGS_MASK);
   }
   atomic_init(&cond->state, init_state);
+#if defined(__LP64__)
+  atomic_init(cond->waiter_mutex(), 0);
+#endif
 
   return 0;
 }
@@ -164,19 +181,83 @@ static int __pthread_cond_pulse(pthread_cond_internal_t* cond, int thread_count)
   // synchronization. And it doesn't help even if we use any fence here.
 
   // The increase of value should leave flags alone, even if the value can overflows.
+#if defined(__LP64__)
+  unsigned int new_state = atomic_fetch_add_explicit(&cond->state, COND_COUNTER_STEP,
+                                                     memory_order_seq_cst) + COND_COUNTER_STEP;
+
+  // Waking all the waiters of a broadcast would just have all but one of them block again
+  // on the mutex. So wake one and move the rest onto the mutex futex instead. If a waiter
+  // changed the recorded mutex since we bumped the counter, the requeue fails and we fall
+  // back to waking everyone.
+  if (thread_count == INT_MAX && !COND_IS_SHARED(new_state)) {
+    uintptr_t mutex = atomic_load_explicit(cond->waiter_mutex(), memory_order_seq_cst);
+    if (mutex != 0 && mutex != COND_MUTEX_MISMATCHED &&
+        __futex_cmp_requeue_ex(&cond->state, false, 1, INT_MAX,
+                               reinterpret_cast<void*>(mutex), new_state) >= 0) {
+      return 0;
+    }
+  }
+#else
   atomic_fetch_add_explicit(&cond->state, COND_COUNTER_STEP, memory_order_relaxed);
+#endif
 
   __futex_wake_ex(&cond->state, cond->process_shared(), thread_count);
   return 0;
 }
 
+#if defined(__LP64__)
+// Records the mutex of a waiter, and returns true if broadcasts may requeue it onto the mutex.
+static bool __pthread_cond_set_waiter_mutex(pthread_cond_internal_t* cond, pthread_mutex_t* mutex) {
+  if (cond->process_shared()) {
+    return false;
+  }
+  uintptr_t new_mutex = COND_MUTEX_MISMATCHED;
+  if (__pthread_mutex_can_requeue(mutex)) {
+    new_mutex = reinterpret_cast<uintptr_t>(mutex);
+  }
+
+  atomic_uintptr_t* waiter_mutex = cond->waiter_mutex();
+  uintptr_t old_mutex = atomic_load_explicit(waiter_mutex, memory_order_relaxed);
+  if (old_mutex == new_mutex) {
+    return new_mutex != COND_MUTEX_MISMATCHED;
+  }
+  // Different mutexes mean we can't requeue for now, until the condition is initialized again.
+  if (old_mutex != 0 ||
+      !atomic_compare_exchange_strong_explicit(waiter_mutex, &old_mutex, new_mutex,
+                                               memory_order_seq_cst, memory_order_relaxed)) {
+    if (old_mutex == new_mutex) {
+      return new_mutex != COND_MUTEX_MISMATCHED;
+    }
+    new_mutex = COND_MUTEX_MISMATCHED;
+    atomic_store_explicit(waiter_mutex, new_mutex, memory_order_seq_cst);
+  }
+  // A broadcast may have read the old mutex after bumping the counter. Bump it again, so that
+  // its requeue fails rather than move us onto the wrong futex.
+  atomic_fetch_add_explicit(&cond->state, COND_COUNTER_STEP, memory_order_seq_cst);
+  return new_mutex != COND_MUTEX_MISMATCHED;
+}
+#endif
+
 static int __pthread_cond_timedwait_relative(pthread_cond_internal_t* cond, pthread_mutex_t* mutex,
                                              const timespec* rel_timeout_or_null) {
+#if defined(__LP64__)
+  bool may_requeue = __pthread_cond_set_waiter_mutex(cond, mutex);
+#endif
   unsigned int old_state = atomic_load_explicit(&cond->state, memory_order_relaxed);
 
   pthread_mutex_unlock(mutex);
   int status = __futex_wait_ex(&cond->state, cond->process_shared(), old_state, rel_timeout_or_null);
+#if defined(__LP64__)
+  // If we were woken, we may have been the waiter that a broadcast woke, or a waiter it
+  // requeued, so we have to pass the wakeup on when we unlock the mutex.
+  if (may_requeue && status == 0) {
+    __pthread_mutex_lock_contended(mutex);
+  } else {
+    pthread_mutex_lock(mutex);
+  }
+#else
   pthread_mutex_lock(mutex);
+#endif
 
   if (status == -ETIMEDOUT) {
     return ETIMEDOUT;
@@ -60,6 +60,7 @@ void __init_tls(pthread_internal_t* thread) {
     // So assume the worst and zero the TLS area.
     memset(thread->tls, 0, sizeof(thread->tls));
     memset(thread->key_data, 0, sizeof(thread->key_data));
+    memset(thread->key_data_bitmap, 0, sizeof(thread->key_data_bitmap));
   }
 
   // Slot 0 must point to itself. The x86 Linux kernel reads the TLS from %fs:0.
@@ -71,12 +72,17 @@ void __init_tls(pthread_internal_t* thread) {
 
 void __init_alternate_signal_stack(pthread_internal_t* thread, char* buf,
                                    size_t buf_size) {
-  // Create and set an alternate signal stack.
-  void* stack_base = mmap(NULL, SIGNAL_STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  // Create and set an alternate signal stack, unless the thread's mapped space came from the
+  // stack cache with one.
+  void* stack_base = thread->alternate_signal_stack;
+  bool reused = (stack_base != NULL);
+  if (!reused) {
+    stack_base = mmap(NULL, SIGNAL_STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  }
   if (stack_base != MAP_FAILED) {
 
     // Create a guard page to catch stack overflows in signal handlers.
-    if (mprotect(stack_base, PAGE_SIZE, PROT_NONE) == -1) {
+    if (!reused && mprotect(stack_base, PAGE_SIZE, PROT_NONE) == -1) {
       munmap(stack_base, SIGNAL_STACK_SIZE);
       return;
     }
@@ -100,13 +106,18 @@ void __init_alternate_signal_stack(pthread_internal_t* thread, char* buf,
     // We can only use const static allocated string for mapped region name, as Android kernel
     // uses the string pointer directly when dumping /proc/pid/maps.
     prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, ss.ss_sp, ss.ss_size, name);
-    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, stack_base, PAGE_SIZE, "thread signal stack guard page");
+    if (!reused) {
+      prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, stack_base, PAGE_SIZE, "thread signal stack guard page");
+    }
   }
 }
 
 int __init_thread(pthread_internal_t* thread) {
   int error = 0;
 
+  // Zeroed memory would look like a registered rseq area on cpu 0.
+  thread->rseq.cpu_id = BIONIC_RSEQ_CPU_ID_UNINITIALIZED;
+
   if (__predict_true((thread->attr.flags & PTHREAD_ATTR_FLAG_DETACHED) == 0)) {
     atomic_init(&thread->join_state, THREAD_NOT_JOINED);
   } else {
@@ -127,6 +138,19 @@ int __init_thread(pthread_internal_t* thread) {
     }
   }
 
+#if defined(__LP64__)
+  // Pin the thread while it's still waiting on startup_handshake_lock, so even its first
+  // instructions run on the requested cpus.
+  if ((thread->attr.flags & PTHREAD_ATTR_FLAG_AFFINITY) != 0) {
+    if (sched_setaffinity(thread->tid, sizeof(thread->attr.__reserved),
+                          reinterpret_cast<const cpu_set_t*>(thread->attr.__reserved)) == -1) {
+      error = errno;
+      __libc_format_log(ANDROID_LOG_WARN, "libc",
+                        "pthread_create sched_setaffinity call failed: %s", strerror(errno));
+    }
+  }
+#endif
+
   thread->cleanup_stack = NULL;
 
   return error;
@@ -162,15 +186,21 @@ static void* __create_thread_mapped_space(size_t mmap_size, size_t stack_guard_s
 static int __allocate_thread(pthread_attr_t* attr, pthread_internal_t** threadp, void** child_stack) {
   size_t mmap_size;
   uint8_t* stack_top;
+  pthread_internal_t* cached = NULL;
 
   if (attr->stack_base == NULL) {
     // The caller didn't provide a stack, so allocate one.
     // Make sure the stack size and guard size are multiples of PAGE_SIZE.
     mmap_size = BIONIC_ALIGN(attr->stack_size + sizeof(pthread_internal_t), PAGE_SIZE);
     attr->guard_size = BIONIC_ALIGN(attr->guard_size, PAGE_SIZE);
-    attr->stack_base = __create_thread_mapped_space(mmap_size, attr->guard_size);
-    if (attr->stack_base == NULL) {
-      return EAGAIN;
+    cached = __pthread_internal_stack_cache_get(mmap_size, attr->guard_size);
+    if (cached != NULL) {
+      attr->stack_base = cached->attr.stack_base;
+    } else {
+      attr->stack_base = __create_thread_mapped_space(mmap_size, attr->guard_size);
+      if (attr->stack_base == NULL) {
+        return EAGAIN;
+      }
     }
     stack_top = reinterpret_cast<uint8_t*>(attr->stack_base) + mmap_size;
   } else {
@@ -183,18 +213,39 @@ static int __allocate_thread(pthread_attr_t* attr, pthread_internal_t** threadp,
   //   pthread_internal_t
   //   thread stack (including guard page)
 
-  // To safely access the pthread_internal_t and thread stack, we need to find a 16-byte aligned boundary.
+  // To safely access the pthread_internal_t and thread stack, we need to find a boundary aligned
+  // for pthread_internal_t, which is at least 16 bytes and more for its rseq area.
   stack_top = reinterpret_cast<uint8_t*>(
-                (reinterpret_cast<uintptr_t>(stack_top) - sizeof(pthread_internal_t)) & ~0xf);
+                (reinterpret_cast<uintptr_t>(stack_top) - sizeof(pthread_internal_t)) &
+                ~(alignof(pthread_internal_t) - 1));
 
   pthread_internal_t* thread = reinterpret_cast<pthread_internal_t*>(stack_top);
   attr->stack_size = stack_top - reinterpret_cast<uint8_t*>(attr->stack_base);
 
+  if (cached != NULL) {
+    // The same mapped space gives the same pthread_internal_t address. Unlike fresh mmap()ed
+    // space it isn't zeroed, but we keep the signal stack and unsafe stack that came with it.
+    void* alternate_signal_stack = cached->alternate_signal_stack;
+    void* unsafe_stack_start = cached->unsafe_stack_start;
+    size_t unsafe_stack_size = cached->unsafe_stack_size;
+    size_t unsafe_stack_gap_size = cached->unsafe_stack_gap_size;
+    memset(thread, 0, sizeof(pthread_internal_t));
+    thread->alternate_signal_stack = alternate_signal_stack;
+    thread->unsafe_stack_start = unsafe_stack_start;
+    thread->unsafe_stack_size = unsafe_stack_size;
+    thread->unsafe_stack_gap_size = unsafe_stack_gap_size;
+  }
+
   thread->mmap_size = mmap_size;
   thread->attr = *attr;
   __init_tls(thread);
 
-  int rc = __unsafe_stack_alloc(thread, attr->stack_size, PAGE_SIZE);
+  int rc;
+  if (thread->unsafe_stack_start != NULL) {
+    rc = __unsafe_stack_reuse(thread);
+  } else {
+    rc = __unsafe_stack_alloc(thread, attr->stack_size, PAGE_SIZE);
+  }
   if (rc != 0) {
     if (thread->mmap_size != 0) {
       munmap(attr->stack_base, thread->mmap_size);
@@ -216,6 +267,8 @@ static int __pthread_start(void* arg) {
   // accesses previously made by the creating thread are visible to us.
   thread->startup_handshake_lock.lock();
 
+  __rseq_register(&thread->rseq);
+
   // Persistent buffer for the alternate signal stack vma name (found in
   // /proc/$PID/maps).
   char alternate_signal_stack_vma_name[27];
@@ -295,9 +348,7 @@ int pthread_create(pthread_t* thread_out, pthread_attr_t const* attr,
     // be unblocked, but we're about to unmap the memory the mutex is stored in, so this serves as a
     // reminder that you can't rewrite this function to use a ScopedPthreadMutexLocker.
     thread->startup_handshake_lock.unlock();
-    if (thread->mmap_size != 0) {
-      munmap(thread->attr.stack_base, thread->mmap_size);
-    }
+    __pthread_internal_free(thread);
     __libc_format_log(ANDROID_LOG_WARN, "libc", "pthread_create failed: clone failed: %s", strerror(errno));
     return clone_errno;
   }
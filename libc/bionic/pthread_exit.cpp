@@ -88,9 +88,7 @@ void pthread_exit(void* return_value) {
     ss.ss_flags = SS_DISABLE;
     sigaltstack(&ss, NULL);
 
-    // Free it.
-    munmap(thread->alternate_signal_stack, SIGNAL_STACK_SIZE);
-    thread->alternate_signal_stack = NULL;
+    // It is freed or cached with the rest of the thread's mapped space.
   }
 
   ThreadJoinState old_state = THREAD_NOT_JOINED;
@@ -101,23 +99,39 @@ void pthread_exit(void* return_value) {
   if (old_state == THREAD_DETACHED) {
     // The thread is detached, no one will use pthread_internal_t after pthread_exit.
     // So we can free mapped space, which includes pthread_internal_t and thread stack.
-    // First make sure that the kernel does not try to clear the tid field
-    // because we'll have freed the memory before the thread actually exits.
-    __set_tid_address(NULL);
 
     // pthread_internal_t is freed below with stack, not here.
     __pthread_internal_remove(thread);
 
     if (thread->mmap_size != 0) {
-      // We need to free mapped space for detached threads when they exit.
-      // That's not something we can do in C.
-
       // We don't want to take a signal after we've unmapped the stack.
       // That's one last thing we can handle in C.
       sigset_t mask;
       sigfillset(&mask);
       sigprocmask(SIG_SETMASK, &mask, NULL);
 
+      // If there's room in the stack cache, leave our mapped space there. The
+      // kernel clears thread->tid once we've exited, which is what tells
+      // pthread_create that the space can be reused.
+      if (__pthread_internal_stack_cache_put(thread)) {
+        __exit(0);
+      }
+    }
+
+    // Make sure that the kernel does not try to clear the tid field
+    // because we'll have freed the memory before the thread actually exits.
+    __set_tid_address(NULL);
+    // For the same reason, stop the kernel updating our rseq area.
+    __rseq_unregister(&thread->rseq);
+
+    if (thread->alternate_signal_stack != NULL) {
+      munmap(thread->alternate_signal_stack, SIGNAL_STACK_SIZE);
+      thread->alternate_signal_stack = NULL;
+    }
+
+    if (thread->mmap_size != 0) {
+      // We need to free mapped space for detached threads when they exit.
+      // That's not something we can do in C.
       __unsafe_stack_free(thread);
       _exit_with_stack_teardown(thread->attr.stack_base, thread->mmap_size);
     }
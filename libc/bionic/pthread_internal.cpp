@@ -37,26 +37,50 @@
 #include "private/bionic_safestack.h"
 #include "private/bionic_tls.h"
 #include "private/libc_logging.h"
-#include "private/ScopedPthreadMutexLocker.h"
 
-static pthread_internal_t* g_thread_list = NULL;
-static pthread_mutex_t g_thread_list_lock = PTHREAD_MUTEX_INITIALIZER;
+// Live threads are kept in a hash table keyed by their pthread_internal_t address, so
+// validating a pthread_t costs a short chain walk rather than a scan of every thread.
+// Each group of buckets shares a rwlock, so lookups run in parallel with each other and
+// only wait for a thread being added to or removed from the same group.
+#define THREAD_HASH_SHIFT 10
+#define THREAD_HASH_BUCKET_COUNT (1 << THREAD_HASH_SHIFT)
+#define THREAD_HASH_LOCK_COUNT 64
+
+static pthread_internal_t* g_thread_hash[THREAD_HASH_BUCKET_COUNT];
+// Zero-initialized, which is what PTHREAD_RWLOCK_INITIALIZER is.
+static pthread_rwlock_t g_thread_hash_locks[THREAD_HASH_LOCK_COUNT];
+
+static inline size_t __thread_hash(pthread_internal_t* thread) {
+  // pthread_internal_t sits at the top of its mapping, so the low bits say little.
+  uint32_t key = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(thread) / 16);
+  return (key * 0x9e3779b1u) >> (32 - THREAD_HASH_SHIFT);
+}
+
+static inline pthread_rwlock_t* __thread_hash_lock(size_t bucket) {
+  return &g_thread_hash_locks[bucket % THREAD_HASH_LOCK_COUNT];
+}
 
 pthread_t __pthread_internal_add(pthread_internal_t* thread) {
-  ScopedPthreadMutexLocker locker(&g_thread_list_lock);
+  size_t bucket = __thread_hash(thread);
+  pthread_rwlock_t* lock = __thread_hash_lock(bucket);
+  pthread_rwlock_wrlock(lock);
 
   // We insert at the head.
-  thread->next = g_thread_list;
+  thread->next = g_thread_hash[bucket];
   thread->prev = NULL;
   if (thread->next != NULL) {
     thread->next->prev = thread;
   }
-  g_thread_list = thread;
+  g_thread_hash[bucket] = thread;
+
+  pthread_rwlock_unlock(lock);
   return reinterpret_cast<pthread_t>(thread);
 }
 
 void __pthread_internal_remove(pthread_internal_t* thread) {
-  ScopedPthreadMutexLocker locker(&g_thread_list_lock);
+  size_t bucket = __thread_hash(thread);
+  pthread_rwlock_t* lock = __thread_hash_lock(bucket);
+  pthread_rwlock_wrlock(lock);
 
   if (thread->next != NULL) {
     thread->next->prev = thread->prev;
@@ -64,11 +88,98 @@ void __pthread_internal_remove(pthread_internal_t* thread) {
   if (thread->prev != NULL) {
     thread->prev->next = thread->next;
   } else {
-    g_thread_list = thread->next;
+    g_thread_hash[bucket] = thread->next;
+  }
+
+  pthread_rwlock_unlock(lock);
+}
+
+// The default number of exited threads whose mapped space we keep for reuse.
+#define STACK_CACHE_SIZE_DEFAULT 8
+
+static Lock g_stack_cache_lock;
+static pthread_internal_t* g_stack_cache = NULL;
+static size_t g_stack_cache_count = 0;
+static size_t g_stack_cache_max = STACK_CACHE_SIZE_DEFAULT;
+
+void __pthread_internal_init_stack_cache() {
+  g_stack_cache_lock.init(false);
+  // LIBC_THREAD_STACK_CACHE sets the number of cached threads. Zero turns the cache off.
+  const char* value = getenv("LIBC_THREAD_STACK_CACHE");
+  if (value != NULL) {
+    char* end;
+    unsigned long count = strtoul(value, &end, 10);
+    if (*value != '\0' && *end == '\0') {
+      g_stack_cache_max = count;
+    }
   }
 }
 
-static void __pthread_internal_free(pthread_internal_t* thread) {
+// Only threads with the default stack and guard size are cached. Other sizes are seldom
+// created repeatedly, and would fill the cache with entries that nothing can reuse.
+static bool __is_default_mapped_space(size_t mmap_size, size_t guard_size) {
+  return mmap_size == BIONIC_ALIGN(PTHREAD_STACK_SIZE_DEFAULT + sizeof(pthread_internal_t),
+                                   PAGE_SIZE) &&
+      guard_size == PAGE_SIZE;
+}
+
+pthread_internal_t* __pthread_internal_stack_cache_get(size_t mmap_size, size_t guard_size) {
+  if (g_stack_cache_max == 0 || !__is_default_mapped_space(mmap_size, guard_size)) {
+    return NULL;
+  }
+
+  g_stack_cache_lock.lock();
+  for (pthread_internal_t** prev = &g_stack_cache; *prev != NULL; prev = &(*prev)->next) {
+    pthread_internal_t* thread = *prev;
+    // A detached thread puts itself in the cache just before it exits, so it may still be
+    // running on its stack. The kernel clears its tid once it is really gone.
+    volatile int* tid_ptr = &thread->tid;
+    if (*tid_ptr == 0) {
+      *prev = thread->next;
+      --g_stack_cache_count;
+      g_stack_cache_lock.unlock();
+      return thread;
+    }
+  }
+  g_stack_cache_lock.unlock();
+  return NULL;
+}
+
+bool __pthread_internal_stack_cache_put(pthread_internal_t* thread) {
+  if (!__is_default_mapped_space(thread->mmap_size, thread->attr.guard_size)) {
+    return false;
+  }
+
+  g_stack_cache_lock.lock();
+  if (g_stack_cache_count >= g_stack_cache_max) {
+    g_stack_cache_lock.unlock();
+    return false;
+  }
+  thread->next = g_stack_cache;
+  g_stack_cache = thread;
+  ++g_stack_cache_count;
+  g_stack_cache_lock.unlock();
+  return true;
+}
+
+void __pthread_internal_stack_cache_forked_child() {
+  // Only the forking thread exists in the child, so the lock may have been left held and no
+  // cached thread is still exiting.
+  g_stack_cache_lock.init(false);
+  for (pthread_internal_t* thread = g_stack_cache; thread != NULL; thread = thread->next) {
+    thread->tid = 0;
+  }
+}
+
+void __pthread_internal_free(pthread_internal_t* thread) {
+  if (thread->mmap_size != 0 && __pthread_internal_stack_cache_put(thread)) {
+    return;
+  }
+
+  if (thread->alternate_signal_stack != NULL) {
+    munmap(thread->alternate_signal_stack, SIGNAL_STACK_SIZE);
+  }
+  __unsafe_stack_free(thread);
   if (thread->mmap_size != 0) {
     // Free mapped space, including thread stack and pthread_internal_t.
     munmap(thread->attr.stack_base, thread->mmap_size);
@@ -77,7 +188,6 @@ static void __pthread_internal_free(pthread_internal_t* thread) {
 
 void __pthread_internal_remove_and_free(pthread_internal_t* thread) {
   __pthread_internal_remove(thread);
-  __unsafe_stack_free(thread);
   __pthread_internal_free(thread);
 }
 
@@ -89,12 +199,18 @@ pthread_internal_t* __pthread_internal_find(pthread_t thread_id) {
     return thread;
   }
 
-  ScopedPthreadMutexLocker locker(&g_thread_list_lock);
+  size_t bucket = __thread_hash(thread);
+  pthread_rwlock_t* lock = __thread_hash_lock(bucket);
+  pthread_rwlock_rdlock(lock);
 
-  for (pthread_internal_t* t = g_thread_list; t != NULL; t = t->next) {
+  pthread_internal_t* result = NULL;
+  for (pthread_internal_t* t = g_thread_hash[bucket]; t != NULL; t = t->next) {
     if (t == thread) {
-      return thread;
+      result = thread;
+      break;
     }
   }
-  return NULL;
+
+  pthread_rwlock_unlock(lock);
+  return result;
 }
@@ -32,6 +32,7 @@
 #include <stdatomic.h>
 
 #include "private/bionic_lock.h"
+#include "private/bionic_rseq.h"
 #include "private/bionic_tls.h"
 
 /* Has the thread been detached by a pthread_join or pthread_detach call? */
@@ -40,6 +41,11 @@
 /* Has the thread been joined by another thread? */
 #define PTHREAD_ATTR_FLAG_JOINED 0x00000002
 
+/* Has the thread been given a cpu affinity mask? It's kept in __reserved, so LP64 only. */
+#define PTHREAD_ATTR_FLAG_AFFINITY 0x00000004
+
+#define BIONIC_PTHREAD_KEY_BITMAP_WORDS ((BIONIC_PTHREAD_KEY_COUNT + 31) / 32)
+
 class pthread_key_data_t {
  public:
   uintptr_t seq; // Use uintptr_t just for alignment, as we use pointer below.
@@ -55,6 +61,14 @@ enum ThreadJoinState {
 
 class thread_local_dtor;
 
+// A PTHREAD_RWLOCK_READER_MOSTLY_NP rwlock read-locked by a thread through its reader slots.
+struct rwlock_read_hold_t {
+  void* rwlock;
+  uint32_t count;
+};
+
+#define PTHREAD_RWLOCK_READ_HOLDS 4
+
 class pthread_internal_t {
  public:
   class pthread_internal_t* next;
@@ -102,12 +116,24 @@ class pthread_internal_t {
 
   size_t mmap_size;
 
+  // Set while the lock contention profiler is recording, so it doesn't record itself.
+  bool in_lock_profile;
+
   thread_local_dtor* thread_local_dtors;
 
+  // Read locks beyond these are counted in the rwlock's state instead.
+  rwlock_read_hold_t rwlock_read_holds[PTHREAD_RWLOCK_READ_HOLDS];
+
   void* tls[BIONIC_TLS_SLOTS];
 
   pthread_key_data_t key_data[BIONIC_PTHREAD_KEY_COUNT];
 
+  // Bit i is set when key_data[i].data may be non-NULL, so thread exit only visits those slots.
+  uint32_t key_data_bitmap[BIONIC_PTHREAD_KEY_BITMAP_WORDS];
+
+  // Registered with the kernel by the thread itself once it starts running.
+  bionic_rseq rseq;
+
   /*
    * The dynamic linker implements dlerror(3), which makes it hard for us to implement this
    * per-thread buffer by simply using malloc(3) and free(3).
@@ -125,6 +151,19 @@ __LIBC_HIDDEN__ pthread_t           __pthread_internal_add(pthread_internal_t* t
 __LIBC_HIDDEN__ pthread_internal_t* __pthread_internal_find(pthread_t pthread_id);
 __LIBC_HIDDEN__ void                __pthread_internal_remove(pthread_internal_t* thread);
 __LIBC_HIDDEN__ void                __pthread_internal_remove_and_free(pthread_internal_t* thread);
+__LIBC_HIDDEN__ void                __pthread_internal_free(pthread_internal_t* thread);
+
+// Exited threads' mapped space (stack, guard page, pthread_internal_t, alternate signal stack and
+// unsafe stack) is kept in a small cache so that pthread_create can reuse it instead of mapping
+// new space. A cached thread can only be reused once the kernel has cleared its tid.
+__LIBC_HIDDEN__ void                __pthread_internal_init_stack_cache();
+__LIBC_HIDDEN__ pthread_internal_t* __pthread_internal_stack_cache_get(size_t mmap_size, size_t guard_size);
+__LIBC_HIDDEN__ bool                __pthread_internal_stack_cache_put(pthread_internal_t* thread);
+__LIBC_HIDDEN__ void                __pthread_internal_stack_cache_forked_child();
+
+// SIGEV_THREAD timers can share a few dispatcher threads rather than having one each. See
+// posix_timers.cpp.
+__LIBC_HIDDEN__ void                __posix_timers_forked_child();
 
 // Make __get_thread() inlined for performance reason. See http://b/19825434.
 static inline __always_inline pthread_internal_t* __get_thread() {
@@ -133,6 +172,15 @@ static inline __always_inline pthread_internal_t* __get_thread() {
 
 __LIBC_HIDDEN__ void pthread_key_clean_all(void);
 
+// Reads the process-wide mutex spinning default from the environment.
+__LIBC_HIDDEN__ void __pthread_mutex_init_spin_default();
+
+#if defined(__LP64__)
+// Used by pthread_cond_broadcast to requeue waiters onto their mutex.
+__LIBC_HIDDEN__ bool __pthread_mutex_can_requeue(pthread_mutex_t* mutex);
+__LIBC_HIDDEN__ void __pthread_mutex_lock_contended(pthread_mutex_t* mutex);
+#endif
+
 #if defined(__LP64__)
 // SIGSTKSZ is not big enough for 64-bit arch. See http://b/23041777.
 #define SIGNAL_STACK_SIZE_WITHOUT_GUARD_PAGE (16 * 1024)
@@ -53,6 +53,16 @@ struct pthread_key_internal_t {
 
 static pthread_key_internal_t key_map[BIONIC_PTHREAD_KEY_COUNT];
 
+// Bit i is set while key_map[i] is allocated. pthread_key_create() claims a slot here before
+// marking its seq in use, and pthread_key_delete() releases it after marking its seq unused.
+static atomic_uint key_used_bitmap[BIONIC_PTHREAD_KEY_BITMAP_WORDS];
+
+// Returns the bits of key_used_bitmap[word] that correspond to real key slots.
+static inline uint32_t KeyBitmapValidBits(size_t word) {
+  size_t count = BIONIC_PTHREAD_KEY_COUNT - word * 32;
+  return (count >= 32) ? ~0u : ((1u << count) - 1);
+}
+
 static inline bool SeqOfKeyInUse(uintptr_t seq) {
   return seq & (1 << SEQ_KEY_IN_USE_BIT);
 }
@@ -73,38 +83,48 @@ static inline bool KeyInValidRange(pthread_key_t key) {
 __LIBC_HIDDEN__ void pthread_key_clean_all() {
   // Because destructors can do funky things like deleting/creating other keys,
   // we need to implement this in a loop.
-  pthread_key_data_t* key_data = __get_thread()->key_data;
+  pthread_internal_t* thread = __get_thread();
+  pthread_key_data_t* key_data = thread->key_data;
   for (size_t rounds = PTHREAD_DESTRUCTOR_ITERATIONS; rounds > 0; --rounds) {
     size_t called_destructor_count = 0;
-    for (size_t i = 0; i < BIONIC_PTHREAD_KEY_COUNT; ++i) {
-      uintptr_t seq = atomic_load_explicit(&key_map[i].seq, memory_order_relaxed);
-      if (SeqOfKeyInUse(seq) && seq == key_data[i].seq && key_data[i].data != NULL) {
-        // Other threads may be calling pthread_key_delete/pthread_key_create while current thread
-        // is exiting. So we need to ensure we read the right key_destructor.
-        // We can rely on a user-established happens-before relationship between the creation and
-        // use of pthread key to ensure that we're not getting an earlier key_destructor.
-        // To avoid using the key_destructor of the newly created key in the same slot, we need to
-        // recheck the sequence number after reading key_destructor. As a result, we either see the
-        // right key_destructor, or the sequence number must have changed when we reread it below.
-        key_destructor_t key_destructor = reinterpret_cast<key_destructor_t>(
-          atomic_load_explicit(&key_map[i].key_destructor, memory_order_relaxed));
-        if (key_destructor == NULL) {
-          continue;
-        }
-        atomic_thread_fence(memory_order_acquire);
-        if (atomic_load_explicit(&key_map[i].seq, memory_order_relaxed) != seq) {
-           continue;
+    for (size_t word = 0; word < BIONIC_PTHREAD_KEY_BITMAP_WORDS; ++word) {
+      // Only visit the slots pthread_setspecific() stored a non-NULL value in. The bits are
+      // cleared as we go; a destructor that calls pthread_setspecific() sets them again, and
+      // the next round picks those slots up.
+      uint32_t bits = thread->key_data_bitmap[word];
+      thread->key_data_bitmap[word] = 0;
+      while (bits != 0) {
+        size_t i = word * 32 + __builtin_ctz(bits);
+        bits &= bits - 1;
+        uintptr_t seq = atomic_load_explicit(&key_map[i].seq, memory_order_relaxed);
+        if (SeqOfKeyInUse(seq) && seq == key_data[i].seq && key_data[i].data != NULL) {
+          // Other threads may be calling pthread_key_delete/pthread_key_create while current thread
+          // is exiting. So we need to ensure we read the right key_destructor.
+          // We can rely on a user-established happens-before relationship between the creation and
+          // use of pthread key to ensure that we're not getting an earlier key_destructor.
+          // To avoid using the key_destructor of the newly created key in the same slot, we need to
+          // recheck the sequence number after reading key_destructor. As a result, we either see the
+          // right key_destructor, or the sequence number must have changed when we reread it below.
+          key_destructor_t key_destructor = reinterpret_cast<key_destructor_t>(
+            atomic_load_explicit(&key_map[i].key_destructor, memory_order_relaxed));
+          if (key_destructor == NULL) {
+            continue;
+          }
+          atomic_thread_fence(memory_order_acquire);
+          if (atomic_load_explicit(&key_map[i].seq, memory_order_relaxed) != seq) {
+             continue;
+          }
+
+          // We need to clear the key data now, this will prevent the destructor (or a later one)
+          // from seeing the old value if it calls pthread_getspecific().
+          // We don't do this if 'key_destructor == NULL' just in case another destructor
+          // function is responsible for manually releasing the corresponding data.
+          void* data = key_data[i].data;
+          key_data[i].data = NULL;
+
+          (*key_destructor)(data);
+          ++called_destructor_count;
         }
-
-        // We need to clear the key data now, this will prevent the destructor (or a later one)
-        // from seeing the old value if it calls pthread_getspecific().
-        // We don't do this if 'key_destructor == NULL' just in case another destructor
-        // function is responsible for manually releasing the corresponding data.
-        void* data = key_data[i].data;
-        key_data[i].data = NULL;
-
-        (*key_destructor)(data);
-        ++called_destructor_count;
       }
     }
 
@@ -116,10 +136,18 @@ __LIBC_HIDDEN__ void pthread_key_clean_all() {
 }
 
 int pthread_key_create(pthread_key_t* key, void (*key_destructor)(void*)) {
-  for (size_t i = 0; i < BIONIC_PTHREAD_KEY_COUNT; ++i) {
-    uintptr_t seq = atomic_load_explicit(&key_map[i].seq, memory_order_relaxed);
-    while (!SeqOfKeyInUse(seq)) {
-      if (atomic_compare_exchange_weak(&key_map[i].seq, &seq, seq + SEQ_INCREMENT_STEP)) {
+  // Claim a slot in key_used_bitmap first: the lowest clear bit of each word is one
+  // __builtin_ctz away, so we never touch the seq of slots that are already taken.
+  for (size_t word = 0; word < BIONIC_PTHREAD_KEY_BITMAP_WORDS; ++word) {
+    uint32_t valid_bits = KeyBitmapValidBits(word);
+    uint32_t used = atomic_load_explicit(&key_used_bitmap[word], memory_order_relaxed);
+    while ((~used & valid_bits) != 0) {
+      uint32_t bit = 1u << __builtin_ctz(~used & valid_bits);
+      if (atomic_compare_exchange_weak(&key_used_bitmap[word], &used, used | bit)) {
+        size_t i = word * 32 + __builtin_ctz(bit);
+        // The slot was released by pthread_key_delete() only after its seq was made unused,
+        // so this makes it in use again.
+        atomic_fetch_add(&key_map[i].seq, SEQ_INCREMENT_STEP);
         atomic_store(&key_map[i].key_destructor, reinterpret_cast<uintptr_t>(key_destructor));
         *key = i | KEY_VALID_FLAG;
         return 0;
@@ -142,6 +170,8 @@ int pthread_key_delete(pthread_key_t key) {
   uintptr_t seq = atomic_load_explicit(&key_map[key].seq, memory_order_relaxed);
   if (SeqOfKeyInUse(seq)) {
     if (atomic_compare_exchange_strong(&key_map[key].seq, &seq, seq + SEQ_INCREMENT_STEP)) {
+      atomic_fetch_and_explicit(&key_used_bitmap[key / 32], ~(1u << (key % 32)),
+                                memory_order_release);
       return 0;
     }
   }
@@ -173,9 +203,13 @@ int pthread_setspecific(pthread_key_t key, const void* ptr) {
   key &= ~KEY_VALID_FLAG;
   uintptr_t seq = atomic_load_explicit(&key_map[key].seq, memory_order_relaxed);
   if (__predict_true(SeqOfKeyInUse(seq))) {
-    pthread_key_data_t* data = &(__get_thread()->key_data[key]);
+    pthread_internal_t* thread = __get_thread();
+    pthread_key_data_t* data = &(thread->key_data[key]);
     data->seq = seq;
     data->data = const_cast<void*>(ptr);
+    if (ptr != NULL) {
+      thread->key_data_bitmap[key / 32] |= 1u << (key % 32);
+    }
     return 0;
   }
   return EINVAL;
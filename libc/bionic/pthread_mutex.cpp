@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdatomic.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
 #include <sys/mman.h>
@@ -39,7 +40,10 @@
 #include "pthread_internal.h"
 
 #include "private/bionic_constants.h"
+#include "private/bionic_cpu_relax.h"
 #include "private/bionic_futex.h"
+#include "private/bionic_lock.h"
+#include "private/bionic_lock_profile.h"
 #include "private/bionic_systrace.h"
 #include "private/bionic_time_conversions.h"
 #include "private/bionic_tls.h"
@@ -49,9 +53,11 @@
  * bits:     name       description
  * 0-3       type       type of mutex
  * 4         shared     process-shared flag
+ * 5         protocol   whether it is a priority inheritance mutex
  */
-#define  MUTEXATTR_TYPE_MASK   0x000f
-#define  MUTEXATTR_SHARED_MASK 0x0010
+#define  MUTEXATTR_TYPE_MASK     0x000f
+#define  MUTEXATTR_SHARED_MASK   0x0010
+#define  MUTEXATTR_PROTOCOL_MASK 0x0020
 
 int pthread_mutexattr_init(pthread_mutexattr_t *attr)
 {
@@ -69,7 +75,7 @@ int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type_p)
 {
     int type = (*attr & MUTEXATTR_TYPE_MASK);
 
-    if (type < PTHREAD_MUTEX_NORMAL || type > PTHREAD_MUTEX_ERRORCHECK) {
+    if (type < PTHREAD_MUTEX_NORMAL || type > PTHREAD_MUTEX_ADAPTIVE_NP) {
         return EINVAL;
     }
 
@@ -79,7 +85,7 @@ int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type_p)
 
 int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type)
 {
-    if (type < PTHREAD_MUTEX_NORMAL || type > PTHREAD_MUTEX_ERRORCHECK ) {
+    if (type < PTHREAD_MUTEX_NORMAL || type > PTHREAD_MUTEX_ADAPTIVE_NP) {
         return EINVAL;
     }
 
@@ -113,6 +119,23 @@ int pthread_mutexattr_getpshared(const pthread_mutexattr_t* attr, int* pshared)
     return 0;
 }
 
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t* attr, int protocol) {
+    switch (protocol) {
+    case PTHREAD_PRIO_NONE:
+        *attr &= ~MUTEXATTR_PROTOCOL_MASK;
+        return 0;
+    case PTHREAD_PRIO_INHERIT:
+        *attr |= MUTEXATTR_PROTOCOL_MASK;
+        return 0;
+    }
+    return EINVAL;
+}
+
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t* attr, int* protocol) {
+    *protocol = (*attr & MUTEXATTR_PROTOCOL_MASK) ? PTHREAD_PRIO_INHERIT : PTHREAD_PRIO_NONE;
+    return 0;
+}
+
 /* a mutex contains a state value and a owner_tid.
  * The value is implemented as a 16-bit integer holding the following fields:
  *
@@ -123,6 +146,7 @@ int pthread_mutexattr_getpshared(const pthread_mutexattr_t* attr, int* pshared)
  * 1-0       state    lock state (0, 1 or 2)
  *
  * The owner_tid is used only in recursive and errorcheck mutex to hold the mutex owner thread tid.
+ * Adaptive mutexes use it to hold their spin estimate instead.
  */
 
 /* Convenience macro, creates a mask of 'bits' bits that starts from
@@ -203,7 +227,7 @@ int pthread_mutexattr_getpshared(const pthread_mutexattr_t* attr, int* pshared)
 #define  MUTEX_SHARED_MASK     FIELD_MASK(MUTEX_SHARED_SHIFT,1)
 
 /* Mutex type:
- * We support normal, recursive and errorcheck mutexes.
+ * We support normal, recursive, errorcheck and adaptive mutexes.
  */
 #define  MUTEX_TYPE_SHIFT      14
 #define  MUTEX_TYPE_LEN        2
@@ -214,14 +238,38 @@ int pthread_mutexattr_getpshared(const pthread_mutexattr_t* attr, int* pshared)
 #define  MUTEX_TYPE_BITS_NORMAL      MUTEX_TYPE_TO_BITS(PTHREAD_MUTEX_NORMAL)
 #define  MUTEX_TYPE_BITS_RECURSIVE   MUTEX_TYPE_TO_BITS(PTHREAD_MUTEX_RECURSIVE)
 #define  MUTEX_TYPE_BITS_ERRORCHECK  MUTEX_TYPE_TO_BITS(PTHREAD_MUTEX_ERRORCHECK)
+#define  MUTEX_TYPE_BITS_ADAPTIVE    MUTEX_TYPE_TO_BITS(PTHREAD_MUTEX_ADAPTIVE_NP)
+
+/* Priority inheritance mutexes:
+ * The kernel needs the owner's tid in a 32-bit futex word to know which
+ * thread to boost, which the 16-bit state can't hold. So the state of a
+ * PI mutex lives in a PIMutex, and the mutex state only marks it as one,
+ * with the adaptive type and the lock state 3 that no other mutex uses
+ * (a destroyed mutex also has a counter, it is 0xffff).
+ */
+#define  MUTEX_STATE_BITS_PI        (MUTEX_TYPE_BITS_ADAPTIVE | MUTEX_STATE_TO_BITS(3))
+#define  MUTEX_STATE_BITS_IS_PI(v)  (((v) & ~MUTEX_SHARED_MASK) == MUTEX_STATE_BITS_PI)
+
+struct PIMutex {
+  // PTHREAD_MUTEX_NORMAL, PTHREAD_MUTEX_RECURSIVE or PTHREAD_MUTEX_ERRORCHECK.
+  uint8_t type;
+  bool shared;
+  // How many more times a recursive mutex was locked by its owner.
+  uint16_t counter;
+  // 0 when unlocked, otherwise the owner's tid, with FUTEX_WAITERS set by
+  // the kernel when there are threads waiting for the mutex.
+  atomic_int owner_tid;
+};
 
 struct pthread_mutex_internal_t {
   _Atomic(uint16_t) state;
 #if defined(__LP64__)
   uint16_t __pad;
   atomic_int owner_tid;
-  char __reserved[32];
+  PIMutex pi_mutex;
+  char __reserved[24];
 #else
+  // For PI mutexes, this is the id of their PIMutex.
   _Atomic(uint16_t) owner_tid;
 #endif
 } __attribute__((aligned(4)));
@@ -238,6 +286,213 @@ static inline pthread_mutex_internal_t* __get_internal_mutex(pthread_mutex_t* mu
   return reinterpret_cast<pthread_mutex_internal_t*>(mutex_interface);
 }
 
+#if !defined(__LP64__)
+// 32-bit mutexes are too small to hold a PIMutex, so they are allocated in
+// pages of their own, and are referred to by a 16-bit id. Each page keeps
+// a list of its freed entries, linked through their owner_tid, and is
+// unmapped when none of its entries are in use. With ids being 16 bits,
+// at most 65535 PI mutexes can exist at once; pthread_mutex_init returns
+// ENOMEM after that, until some are destroyed.
+static constexpr size_t kPIMutexesPerPage = PAGE_SIZE / sizeof(PIMutex);
+static constexpr size_t kMaxPIMutexes = 65536;
+static constexpr size_t kPIMutexPages = kMaxPIMutexes / kPIMutexesPerPage;
+
+struct PIMutexPage {
+  PIMutex* entries;
+  uint16_t used;       // Entries handed out and not freed yet.
+  uint16_t next;       // Entries past this one have never been handed out.
+  uint16_t free_list;  // Id of the first freed entry, or 0.
+};
+
+static Lock g_pi_mutex_lock;
+static PIMutexPage g_pi_mutex_pages[kPIMutexPages];
+
+static inline PIMutex& __pi_mutex_from_id(uint16_t id) {
+    return g_pi_mutex_pages[id / kPIMutexesPerPage].entries[id % kPIMutexesPerPage];
+}
+
+// Returns 0 if there is no room for another PIMutex.
+static uint16_t __pi_mutex_alloc_id() {
+    g_pi_mutex_lock.lock();
+    uint16_t id = 0;
+    PIMutexPage* unmapped = NULL;
+    for (size_t i = 0; i < kPIMutexPages && id == 0; ++i) {
+        PIMutexPage& page = g_pi_mutex_pages[i];
+        if (page.entries == NULL) {
+            if (unmapped == NULL) {
+                unmapped = &page;
+            }
+        } else if (page.free_list != 0) {
+            id = page.free_list;
+            page.free_list = atomic_load_explicit(&__pi_mutex_from_id(id).owner_tid,
+                                                  memory_order_relaxed);
+            ++page.used;
+        } else if (page.next < kPIMutexesPerPage) {
+            id = i * kPIMutexesPerPage + page.next++;
+            ++page.used;
+        }
+    }
+    if (id == 0 && unmapped != NULL) {
+        void* p = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+        if (p != MAP_FAILED) {
+            size_t i = unmapped - g_pi_mutex_pages;
+            unmapped->entries = reinterpret_cast<PIMutex*>(p);
+            unmapped->free_list = 0;
+            // Id 0 is never used, so it can end the free lists.
+            unmapped->next = (i == 0) ? 1 : 0;
+            id = i * kPIMutexesPerPage + unmapped->next++;
+            unmapped->used = 1;
+        }
+    }
+    g_pi_mutex_lock.unlock();
+    return id;
+}
+
+static void __pi_mutex_free_id(uint16_t id) {
+    g_pi_mutex_lock.lock();
+    PIMutexPage& page = g_pi_mutex_pages[id / kPIMutexesPerPage];
+    if (--page.used == 0) {
+        munmap(page.entries, PAGE_SIZE);
+        page.entries = NULL;
+    } else {
+        atomic_store_explicit(&__pi_mutex_from_id(id).owner_tid, page.free_list,
+                              memory_order_relaxed);
+        page.free_list = id;
+    }
+    g_pi_mutex_lock.unlock();
+}
+#endif
+
+static inline PIMutex& __get_pi_mutex(pthread_mutex_internal_t* mutex) {
+#if defined(__LP64__)
+    return mutex->pi_mutex;
+#else
+    return __pi_mutex_from_id(atomic_load_explicit(&mutex->owner_tid, memory_order_relaxed));
+#endif
+}
+
+static int __pthread_pi_mutex_init(pthread_mutex_internal_t* mutex, int type, bool shared) {
+#if defined(__LP64__)
+    PIMutex& pi_mutex = mutex->pi_mutex;
+#else
+    // The PIMutex table is private to this process.
+    if (shared) {
+        return ENOTSUP;
+    }
+    uint16_t id = __pi_mutex_alloc_id();
+    if (id == 0) {
+        return ENOMEM;
+    }
+    atomic_init(&mutex->owner_tid, id);
+    PIMutex& pi_mutex = __pi_mutex_from_id(id);
+#endif
+    // Spinning before sleeping makes no sense when the kernel boosts the owner.
+    pi_mutex.type = (type == PTHREAD_MUTEX_ADAPTIVE_NP) ? PTHREAD_MUTEX_NORMAL : type;
+    pi_mutex.shared = shared;
+    pi_mutex.counter = 0;
+    atomic_init(&pi_mutex.owner_tid, 0);
+    atomic_init(&mutex->state, MUTEX_STATE_BITS_PI | (shared ? MUTEX_SHARED_MASK : 0));
+    return 0;
+}
+
+// Returns 0 if the mutex was locked, EBUSY if another thread owns it, and
+// for a mutex the calling thread already owns, the result of locking it again.
+static inline __always_inline int __pthread_pi_mutex_trylock(PIMutex& mutex) {
+    pid_t tid = __get_thread()->tid;
+    // Handle the uncontended case first, with a single compare_exchange.
+    // If exchanged successfully, an acquire fence is required to make
+    // all memory accesses made by other threads visible to the current CPU.
+    int old_owner = 0;
+    if (__predict_true(atomic_compare_exchange_strong_explicit(&mutex.owner_tid, &old_owner, tid,
+                                                               memory_order_acquire,
+                                                               memory_order_relaxed))) {
+        return 0;
+    }
+    if ((old_owner & FUTEX_TID_MASK) == tid) {
+        if (mutex.type == PTHREAD_MUTEX_ERRORCHECK) {
+            return EDEADLK;
+        }
+        if (mutex.type == PTHREAD_MUTEX_RECURSIVE) {
+            if (mutex.counter == 0xffff) {
+                return EAGAIN;
+            }
+            mutex.counter++;
+            return 0;
+        }
+    }
+    return EBUSY;
+}
+
+static int __pthread_pi_mutex_lock(pthread_mutex_internal_t* mutex_internal,
+                                   const timespec* abs_timeout_or_null, clockid_t clock) {
+    PIMutex& mutex = __get_pi_mutex(mutex_internal);
+    int result = __pthread_pi_mutex_trylock(mutex);
+    if (__predict_true(result != EBUSY)) {
+        return result;
+    }
+
+    ScopedTrace trace("Contending for pthread mutex");
+
+    // FUTEX_LOCK_PI only takes an absolute CLOCK_REALTIME timeout.
+    timespec ts;
+    const timespec* realtime_timeout = abs_timeout_or_null;
+    if (abs_timeout_or_null != NULL && clock != CLOCK_REALTIME) {
+        timespec rel_timeout;
+        if (!timespec_from_absolute_timespec(rel_timeout, *abs_timeout_or_null, clock)) {
+            return ETIMEDOUT;
+        }
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += rel_timeout.tv_sec;
+        ts.tv_nsec += rel_timeout.tv_nsec;
+        if (ts.tv_nsec >= NS_PER_S) {
+            ts.tv_sec++;
+            ts.tv_nsec -= NS_PER_S;
+        }
+        realtime_timeout = &ts;
+    }
+
+    // The kernel either gives us the mutex, or boosts the owner and puts
+    // us to sleep until the owner hands it over in FUTEX_UNLOCK_PI. Locking
+    // a normal mutex we already own fails with EDEADLK instead of hanging.
+    ScopedLockProfile profile(mutex_internal);
+    return -__futex_pi_lock_ex(&mutex.owner_tid, mutex.shared, realtime_timeout);
+}
+
+static int __pthread_pi_mutex_unlock(PIMutex& mutex) {
+    pid_t tid = __get_thread()->tid;
+    int old_owner = tid;
+    // Handle the common case of no waiters first, with a single compare_exchange.
+    // A release fence is required to make previous stores visible to next
+    // lock owner threads.
+    if (__predict_true(mutex.type != PTHREAD_MUTEX_RECURSIVE)) {
+        if (__predict_true(atomic_compare_exchange_strong_explicit(&mutex.owner_tid, &old_owner, 0,
+                                                                   memory_order_release,
+                                                                   memory_order_relaxed))) {
+            return 0;
+        }
+    } else {
+        old_owner = atomic_load_explicit(&mutex.owner_tid, memory_order_relaxed);
+    }
+    if ((old_owner & FUTEX_TID_MASK) != tid) {
+        return EPERM;
+    }
+    if (mutex.type == PTHREAD_MUTEX_RECURSIVE) {
+        if (mutex.counter != 0) {
+            mutex.counter--;
+            return 0;
+        }
+        old_owner = tid;
+        if (atomic_compare_exchange_strong_explicit(&mutex.owner_tid, &old_owner, 0,
+                                                    memory_order_release, memory_order_relaxed)) {
+            return 0;
+        }
+    }
+    // FUTEX_WAITERS is set, let the kernel hand the mutex to the highest
+    // priority waiter.
+    return -__futex_pi_unlock(&mutex.owner_tid, mutex.shared);
+}
+
 int pthread_mutex_init(pthread_mutex_t* mutex_interface, const pthread_mutexattr_t* attr) {
     pthread_mutex_internal_t* mutex = __get_internal_mutex(mutex_interface);
 
@@ -248,6 +503,14 @@ int pthread_mutex_init(pthread_mutex_t* mutex_interface, const pthread_mutexattr
         return 0;
     }
 
+    if ((*attr & MUTEXATTR_PROTOCOL_MASK) != 0) {
+        int type = (*attr & MUTEXATTR_TYPE_MASK);
+        if (type > PTHREAD_MUTEX_ADAPTIVE_NP) {
+            return EINVAL;
+        }
+        return __pthread_pi_mutex_init(mutex, type, (*attr & MUTEXATTR_SHARED_MASK) != 0);
+    }
+
     uint16_t state = 0;
     if ((*attr & MUTEXATTR_SHARED_MASK) != 0) {
         state |= MUTEX_SHARED_MASK;
@@ -263,6 +526,9 @@ int pthread_mutex_init(pthread_mutex_t* mutex_interface, const pthread_mutexattr
     case PTHREAD_MUTEX_ERRORCHECK:
       state |= MUTEX_TYPE_BITS_ERRORCHECK;
       break;
+    case PTHREAD_MUTEX_ADAPTIVE_NP:
+      state |= MUTEX_TYPE_BITS_ADAPTIVE;
+      break;
     default:
         return EINVAL;
     }
@@ -272,6 +538,55 @@ int pthread_mutex_init(pthread_mutex_t* mutex_interface, const pthread_mutexattr
     return 0;
 }
 
+/*
+ * Spinning before sleeping.
+ *
+ * When a mutex protects a short critical section, its owner is likely to
+ * release it before a contending thread would even have gone to sleep in
+ * the kernel, so it is cheaper to spin for a while first. Adaptive mutexes
+ * keep an estimate of how many spins it took to get the lock recently, and
+ * spin for up to twice that. Lock attempts that fail to get the lock by
+ * spinning shrink the estimate, so that a mutex held for a long time ends
+ * up spinning only MUTEX_SPIN_MIN times. The estimate is kept in units of
+ * 1/16 of a spin, so that it moves by even small differences: in whole
+ * spins, an eighth of a difference below 8 would always round to 0.
+ *
+ * Setting LIBC_MUTEX_ADAPTIVE=1 in the environment makes normal mutexes,
+ * including statically initialized ones, spin too. They have no room for
+ * an estimate, so they spin a fixed number of times.
+ */
+#define  MUTEX_SPIN_MIN      10
+#define  MUTEX_SPIN_MAX      100
+#define  MUTEX_SPIN_DEFAULT  50
+#define  MUTEX_SPIN_ESTIMATE_SHIFT  4
+
+static bool __pthread_mutex_spin_by_default = false;
+
+void __pthread_mutex_init_spin_default() {
+    const char* value = getenv("LIBC_MUTEX_ADAPTIVE");
+    __pthread_mutex_spin_by_default = (value != NULL && strcmp(value, "1") == 0);
+}
+
+// Spins until the mutex is unlocked and we manage to lock it, or until max_spins.
+// Returns the number of spins it took to get the lock, or -1.
+static inline __always_inline int __pthread_mutex_spin_trylock(pthread_mutex_internal_t* mutex,
+                                                               uint16_t unlocked,
+                                                               uint16_t locked_uncontended,
+                                                               int max_spins) {
+    for (int spins = 0; spins < max_spins; ++spins) {
+        __bionic_cpu_relax();
+        uint16_t old_state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+        // If exchanged successfully, an acquire fence is required to make
+        // all memory accesses made by other threads visible to the current CPU.
+        if (old_state == unlocked &&
+            atomic_compare_exchange_weak_explicit(&mutex->state, &old_state, locked_uncontended,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return spins;
+        }
+    }
+    return -1;
+}
+
 static inline __always_inline int __pthread_normal_mutex_trylock(pthread_mutex_internal_t* mutex,
                                                                  uint16_t shared) {
     const uint16_t unlocked           = shared | MUTEX_STATE_BITS_UNLOCKED;
@@ -305,10 +620,17 @@ static inline __always_inline int __pthread_normal_mutex_lock(pthread_mutex_inte
         return 0;
     }
 
-    ScopedTrace trace("Contending for pthread mutex");
-
     const uint16_t unlocked           = shared | MUTEX_STATE_BITS_UNLOCKED;
-    const uint16_t locked_contended = shared | MUTEX_STATE_BITS_LOCKED_CONTENDED;
+    const uint16_t locked_uncontended = shared | MUTEX_STATE_BITS_LOCKED_UNCONTENDED;
+    const uint16_t locked_contended   = shared | MUTEX_STATE_BITS_LOCKED_CONTENDED;
+
+    if (__predict_false(__pthread_mutex_spin_by_default) &&
+        __pthread_mutex_spin_trylock(mutex, unlocked, locked_uncontended,
+                                     MUTEX_SPIN_DEFAULT) >= 0) {
+        return 0;
+    }
+
+    ScopedTrace trace("Contending for pthread mutex");
 
     // We want to go to sleep until the mutex is available, which requires
     // promoting it to locked_contended. We need to swap in the new state
@@ -328,6 +650,7 @@ static inline __always_inline int __pthread_normal_mutex_lock(pthread_mutex_inte
                 return ETIMEDOUT;
             }
         }
+        ScopedLockProfile profile(mutex);
         if (__futex_wait_ex(&mutex->state, shared, locked_contended, rel_timeout) == -ETIMEDOUT) {
             return ETIMEDOUT;
         }
@@ -419,6 +742,63 @@ static inline __always_inline int __recursive_or_errorcheck_mutex_wait(
 #endif
 }
 
+/*
+ * Lock a mutex of type ADAPTIVE.
+ *
+ * This is the same as a normal mutex, except for the type bits and for
+ * spinning before sleeping.
+ */
+static int __pthread_adaptive_mutex_lock(pthread_mutex_internal_t* mutex, uint16_t shared,
+                                         const timespec* abs_timeout_or_null, clockid_t clock) {
+    const uint16_t unlocked           = MUTEX_TYPE_BITS_ADAPTIVE | shared | MUTEX_STATE_BITS_UNLOCKED;
+    const uint16_t locked_uncontended = MUTEX_TYPE_BITS_ADAPTIVE | shared | MUTEX_STATE_BITS_LOCKED_UNCONTENDED;
+    const uint16_t locked_contended   = MUTEX_TYPE_BITS_ADAPTIVE | shared | MUTEX_STATE_BITS_LOCKED_CONTENDED;
+
+    uint16_t old_state = unlocked;
+    if (__predict_true(atomic_compare_exchange_strong_explicit(&mutex->state, &old_state,
+                         locked_uncontended, memory_order_acquire, memory_order_relaxed))) {
+        return 0;
+    }
+
+    // The estimate is only written by threads that just got the lock, but
+    // spinning threads racing to update it can only make it a bit off.
+    int estimate = atomic_load_explicit(&mutex->owner_tid, memory_order_relaxed);
+    int max_spins = ((estimate * 2) >> MUTEX_SPIN_ESTIMATE_SHIFT) + MUTEX_SPIN_MIN;
+    if (max_spins > MUTEX_SPIN_MAX) {
+        max_spins = MUTEX_SPIN_MAX;
+    }
+    int spins = __pthread_mutex_spin_trylock(mutex, unlocked, locked_uncontended, max_spins);
+    if (spins >= 0) {
+        int target = spins << MUTEX_SPIN_ESTIMATE_SHIFT;
+        atomic_store_explicit(&mutex->owner_tid, estimate + (target - estimate) / 8,
+                              memory_order_relaxed);
+        return 0;
+    }
+
+    ScopedTrace trace("Contending for pthread mutex");
+
+    // Same as a normal mutex from here on.
+    while (atomic_exchange_explicit(&mutex->state, locked_contended,
+                                    memory_order_acquire) != unlocked) {
+        timespec ts;
+        timespec* rel_timeout = NULL;
+        if (abs_timeout_or_null != NULL) {
+            rel_timeout = &ts;
+            if (!timespec_from_absolute_timespec(*rel_timeout, *abs_timeout_or_null, clock)) {
+                return ETIMEDOUT;
+            }
+        }
+        // On 32-bit, the estimate shares the futex word with the state.
+        ScopedLockProfile profile(mutex);
+        if (__recursive_or_errorcheck_mutex_wait(mutex, shared, locked_contended,
+                                                 rel_timeout) == -ETIMEDOUT) {
+            return ETIMEDOUT;
+        }
+    }
+    atomic_store_explicit(&mutex->owner_tid, estimate - estimate / 8, memory_order_relaxed);
+    return 0;
+}
+
 static int __pthread_mutex_lock_with_timeout(pthread_mutex_internal_t* mutex,
                                            const timespec* abs_timeout_or_null, clockid_t clock) {
     uint16_t old_state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
@@ -429,6 +809,12 @@ static int __pthread_mutex_lock_with_timeout(pthread_mutex_internal_t* mutex,
     if ( __predict_true(mtype == MUTEX_TYPE_BITS_NORMAL) ) {
         return __pthread_normal_mutex_lock(mutex, shared, abs_timeout_or_null, clock);
     }
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_STATE_BITS_IS_PI(old_state)) {
+            return __pthread_pi_mutex_lock(mutex, abs_timeout_or_null, clock);
+        }
+        return __pthread_adaptive_mutex_lock(mutex, shared, abs_timeout_or_null, clock);
+    }
 
     // Do we already own this recursive or error-check mutex?
     pid_t tid = __get_thread()->tid;
@@ -496,6 +882,7 @@ static int __pthread_mutex_lock_with_timeout(pthread_mutex_internal_t* mutex,
                 return ETIMEDOUT;
             }
         }
+        ScopedLockProfile profile(mutex);
         if (__recursive_or_errorcheck_mutex_wait(mutex, shared, old_state, rel_timeout) == -ETIMEDOUT) {
             return ETIMEDOUT;
         }
@@ -542,6 +929,19 @@ int pthread_mutex_unlock(pthread_mutex_t* mutex_interface) {
         __pthread_normal_mutex_unlock(mutex, shared);
         return 0;
     }
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_STATE_BITS_IS_PI(old_state)) {
+            return __pthread_pi_mutex_unlock(__get_pi_mutex(mutex));
+        }
+        // Same as __pthread_normal_mutex_unlock, with the type bits.
+        const uint16_t unlocked         = mtype | shared | MUTEX_STATE_BITS_UNLOCKED;
+        const uint16_t locked_contended = mtype | shared | MUTEX_STATE_BITS_LOCKED_CONTENDED;
+        if (atomic_exchange_explicit(&mutex->state, unlocked,
+                                     memory_order_release) == locked_contended) {
+            __futex_wake_ex(&mutex->state, shared, 1);
+        }
+        return 0;
+    }
 
     // Do we already own this recursive or error-check mutex?
     pid_t tid = __get_thread()->tid;
@@ -588,6 +988,18 @@ int pthread_mutex_trylock(pthread_mutex_t* mutex_interface) {
     if (__predict_true(mtype == MUTEX_TYPE_BITS_NORMAL)) {
         return __pthread_normal_mutex_trylock(mutex, shared);
     }
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_STATE_BITS_IS_PI(old_state)) {
+            int result = __pthread_pi_mutex_trylock(__get_pi_mutex(mutex));
+            return (result == EDEADLK) ? EBUSY : result;
+        }
+        old_state = unlocked;
+        if (__predict_true(atomic_compare_exchange_strong_explicit(&mutex->state, &old_state,
+                             locked_uncontended, memory_order_acquire, memory_order_relaxed))) {
+            return 0;
+        }
+        return EBUSY;
+    }
 
     // Do we already own this recursive or error-check mutex?
     pid_t tid = __get_thread()->tid;
@@ -639,9 +1051,53 @@ int pthread_mutex_timedlock(pthread_mutex_t* mutex_interface, const timespec* ab
                                              abs_timeout, CLOCK_REALTIME);
 }
 
+#if defined(__LP64__)
+// pthread_cond_broadcast can requeue its waiters onto the futex of private normal and
+// adaptive mutexes, because their waiters sleep on the mutex state with FUTEX_WAIT.
+bool __pthread_mutex_can_requeue(pthread_mutex_t* mutex_interface) {
+    pthread_mutex_internal_t* mutex = __get_internal_mutex(mutex_interface);
+    uint16_t old_state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+    uint16_t mtype = (old_state & MUTEX_TYPE_MASK);
+    if ((old_state & MUTEX_SHARED_MASK) != 0 || MUTEX_STATE_BITS_IS_PI(old_state) ||
+        old_state == 0xffff) {
+        return false;
+    }
+    return mtype == MUTEX_TYPE_BITS_NORMAL || mtype == MUTEX_TYPE_BITS_ADAPTIVE;
+}
+
+// Locks a mutex that __pthread_mutex_can_requeue accepted, leaving it locked_contended.
+// A condition variable waiter that was woken by a broadcast uses this, because other
+// waiters may have been requeued onto the mutex futex without marking it contended, and
+// they must be woken when we unlock it.
+void __pthread_mutex_lock_contended(pthread_mutex_t* mutex_interface) {
+    pthread_mutex_internal_t* mutex = __get_internal_mutex(mutex_interface);
+    uint16_t mtype = (atomic_load_explicit(&mutex->state, memory_order_relaxed) & MUTEX_TYPE_MASK);
+    const uint16_t unlocked         = mtype | MUTEX_STATE_BITS_UNLOCKED;
+    const uint16_t locked_contended = mtype | MUTEX_STATE_BITS_LOCKED_CONTENDED;
+
+    while (atomic_exchange_explicit(&mutex->state, locked_contended,
+                                    memory_order_acquire) != unlocked) {
+        ScopedLockProfile profile(mutex);
+        __futex_wait_ex(&mutex->state, false, locked_contended, NULL);
+    }
+}
+#endif
+
 int pthread_mutex_destroy(pthread_mutex_t* mutex_interface) {
     pthread_mutex_internal_t* mutex = __get_internal_mutex(mutex_interface);
     uint16_t old_state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+    if (MUTEX_STATE_BITS_IS_PI(old_state)) {
+        PIMutex& pi_mutex = __get_pi_mutex(mutex);
+        if (atomic_load_explicit(&pi_mutex.owner_tid, memory_order_relaxed) != 0) {
+            return EBUSY;
+        }
+#if !defined(__LP64__)
+        __pi_mutex_free_id(atomic_load_explicit(&mutex->owner_tid, memory_order_relaxed));
+        atomic_store_explicit(&mutex->owner_tid, 0, memory_order_relaxed);
+#endif
+        atomic_store_explicit(&mutex->state, 0xffff, memory_order_relaxed);
+        return 0;
+    }
     // Store 0xffff to make the mutex unusable. Although POSIX standard says it is undefined
     // behavior to destroy a locked mutex, we prefer not to change mutex->state in that situation.
     if (MUTEX_STATE_BITS_IS_UNLOCKED(old_state) &&
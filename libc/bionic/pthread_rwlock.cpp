@@ -29,10 +29,12 @@
 #include <errno.h>
 #include <stdatomic.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "pthread_internal.h"
 #include "private/bionic_futex.h"
 #include "private/bionic_lock.h"
+#include "private/bionic_lock_profile.h"
 #include "private/bionic_time_conversions.h"
 
 /* Technical note:
@@ -59,15 +61,15 @@
 
 // A rwlockattr is implemented as a 32-bit integer which has following fields:
 //  bits    name              description
-//   1     rwlock_kind       have rwlock preference like PTHREAD_RWLOCK_PREFER_READER_NP.
+//  2-1    rwlock_kind       have rwlock preference like PTHREAD_RWLOCK_PREFER_READER_NP.
 //   0      process_shared    set to 1 if the rwlock is shared between processes.
 
 #define RWLOCKATTR_PSHARED_SHIFT 0
 #define RWLOCKATTR_KIND_SHIFT    1
 
 #define RWLOCKATTR_PSHARED_MASK  1
-#define RWLOCKATTR_KIND_MASK     2
-#define RWLOCKATTR_RESERVED_MASK (~3)
+#define RWLOCKATTR_KIND_MASK     6
+#define RWLOCKATTR_RESERVED_MASK (~7)
 
 static inline __always_inline __always_inline bool __rwlockattr_getpshared(const pthread_rwlockattr_t* attr) {
   return (*attr & RWLOCKATTR_PSHARED_MASK) >> RWLOCKATTR_PSHARED_SHIFT;
@@ -126,7 +128,8 @@ int pthread_rwlockattr_getkind_np(const pthread_rwlockattr_t* attr, int* pref) {
 int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t* attr, int pref) {
   switch (pref) {
     case PTHREAD_RWLOCK_PREFER_READER_NP:   // Fall through.
-    case PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP:
+    case PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP:  // Fall through.
+    case PTHREAD_RWLOCK_READER_MOSTLY_NP:
       __rwlockattr_setkind(attr, pref);
       return 0;
     default:
@@ -154,13 +157,58 @@ int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t* attr, int pref) {
 #define STATE_HAVE_PENDING_READERS_OR_WRITERS_FLAG \
           (STATE_HAVE_PENDING_READERS_FLAG | STATE_HAVE_PENDING_WRITERS_FLAG)
 
+// A PTHREAD_RWLOCK_READER_MOSTLY_NP rwlock doesn't count its readers in state. Each reader
+// increments the counter of the reader slot picked by its thread instead, and then backs off if
+// state shows a writer. A writer sets owned_by_writer_flag in state as usual, and then waits for
+// the reader slots to drain. So readers on different slots never write to the same cache line,
+// and only writers pay for looking at all of them.
+//
+// The reader slots come from a bounded pool, and a rwlock only takes them when it's first
+// read-locked. A rwlock that can't get them, because the pool is used up, counts its readers in
+// state like any other writer-preferred rwlock. So do readers whose thread already tracks as many
+// reader-mostly read locks as it can (see pthread_internal_t::rwlock_read_holds): unlock has to
+// know whether the caller took its read lock through the slots, because a slot is shared by all
+// the threads that hash to it.
+
+#define RWLOCK_READER_SLOT_SHIFT 5
+#define RWLOCK_READER_SLOT_COUNT (1 << RWLOCK_READER_SLOT_SHIFT)
+#define RWLOCK_READER_SLOT_SIZE  64  // A cache line.
+
+struct rwlock_reader_slot_t {
+  atomic_uint reader_count;
+  char __pad[RWLOCK_READER_SLOT_SIZE - sizeof(atomic_uint)];
+};
+
+struct rwlock_reader_slots_t {
+  rwlock_reader_slot_t slots[RWLOCK_READER_SLOT_COUNT];
+  // A writer waiting for the slots to drain waits on this, and readers leaving while a writer
+  // owns the rwlock increment it.
+  atomic_uint drain_serial;
+};
+
+static_assert(sizeof(rwlock_reader_slots_t) <= PAGE_SIZE,
+              "rwlock_reader_slots_t should fit in one page.");
+
+// Pages are mapped the first time they're needed and then kept for reuse, so rwlocks that are
+// never destroyed cost at most RWLOCK_READER_SLOTS_POOL_SIZE pages between them.
+#define RWLOCK_READER_SLOTS_POOL_SIZE 64
+
+// reader_slots_index is 0 until the first reader, then 1 + the pool index of the reader slots,
+// or RWLOCK_NO_READER_SLOTS if the pool was used up.
+#define RWLOCK_NO_READER_SLOTS (~0u)
+
+static Lock g_reader_slots_pool_lock;
+static rwlock_reader_slots_t* g_reader_slots_pool[RWLOCK_READER_SLOTS_POOL_SIZE];
+static bool g_reader_slots_pool_busy[RWLOCK_READER_SLOTS_POOL_SIZE];
+
 struct pthread_rwlock_internal_t {
   atomic_int state;
   atomic_int writer_tid;
 
   bool pshared;
   bool writer_nonrecursive_preferred;
-  uint16_t __pad;
+  bool reader_mostly;
+  uint8_t __pad;
 
 // When a reader thread plans to suspend on the rwlock, it will add STATE_HAVE_PENDING_READERS_FLAG
 // in state, increase pending_reader_count, and wait on pending_reader_wakeup_serial. After woken
@@ -175,10 +223,10 @@ struct pthread_rwlock_internal_t {
   uint32_t pending_writer_wakeup_serial;  // Pending writer threads wait on this address by futex_wait.
 
 #if defined(__LP64__)
-  char __reserved[20];
-#else
-  char __reserved[4];
+  char __reserved[16];
 #endif
+
+  atomic_uint reader_slots_index;  // See RWLOCK_NO_READER_SLOTS.
 };
 
 static inline __always_inline bool __state_owned_by_writer(int state) {
@@ -223,6 +271,87 @@ static inline __always_inline pthread_rwlock_internal_t* __get_internal_rwlock(p
   return reinterpret_cast<pthread_rwlock_internal_t*>(rwlock_interface);
 }
 
+// Returns NULL if the rwlock has no reader slots, so all its readers are counted in state.
+static inline __always_inline rwlock_reader_slots_t* __get_reader_slots(
+    pthread_rwlock_internal_t* rwlock) {
+  unsigned index = atomic_load_explicit(&rwlock->reader_slots_index, memory_order_acquire);
+  if (index == 0 || index == RWLOCK_NO_READER_SLOTS) {
+    return NULL;
+  }
+  return g_reader_slots_pool[index - 1];
+}
+
+// Gives the rwlock reader slots from the pool, unless it already has them or the pool is used up.
+static rwlock_reader_slots_t* __alloc_reader_slots(pthread_rwlock_internal_t* rwlock) {
+  unsigned index = RWLOCK_NO_READER_SLOTS;
+  g_reader_slots_pool_lock.lock();
+  for (size_t i = 0; i < RWLOCK_READER_SLOTS_POOL_SIZE; ++i) {
+    if (g_reader_slots_pool_busy[i]) {
+      continue;
+    }
+    if (g_reader_slots_pool[i] == NULL) {
+      void* page = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+      if (page == MAP_FAILED) {
+        break;
+      }
+      g_reader_slots_pool[i] = reinterpret_cast<rwlock_reader_slots_t*>(page);
+    }
+    g_reader_slots_pool_busy[i] = true;
+    index = i + 1;
+    break;
+  }
+  g_reader_slots_pool_lock.unlock();
+
+  // Publishing the index is seq_cst for the same reason as the reader slot updates: a writer that
+  // sees no reader slots after setting its flag mustn't miss a reader that uses them.
+  unsigned expected = 0;
+  if (!atomic_compare_exchange_strong_explicit(&rwlock->reader_slots_index, &expected, index,
+                                               memory_order_seq_cst, memory_order_acquire)) {
+    // Another reader got there first.
+    if (index != RWLOCK_NO_READER_SLOTS) {
+      g_reader_slots_pool_lock.lock();
+      g_reader_slots_pool_busy[index - 1] = false;
+      g_reader_slots_pool_lock.unlock();
+    }
+    index = expected;
+  }
+  return (index == RWLOCK_NO_READER_SLOTS) ? NULL : g_reader_slots_pool[index - 1];
+}
+
+// Returns the thread's record of its read locks on the rwlock. If it holds none, returns a free
+// record when create is true and there is one, or NULL otherwise.
+static inline __always_inline rwlock_read_hold_t* __get_read_hold(
+    pthread_internal_t* thread, pthread_rwlock_internal_t* rwlock, bool create) {
+  rwlock_read_hold_t* free_hold = NULL;
+  for (size_t i = 0; i < PTHREAD_RWLOCK_READ_HOLDS; ++i) {
+    rwlock_read_hold_t* hold = &thread->rwlock_read_holds[i];
+    if (hold->rwlock == rwlock) {
+      return hold;
+    }
+    if (hold->rwlock == NULL && free_hold == NULL) {
+      free_hold = hold;
+    }
+  }
+  return create ? free_hold : NULL;
+}
+
+// Threads are spread over the slots by hashing their pthread_internal_t address, which unlike
+// the tid stays the same across fork.
+static inline __always_inline atomic_uint* __get_reader_slot(rwlock_reader_slots_t* slots) {
+  uint32_t key = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(__get_thread()) / PAGE_SIZE);
+  return &slots->slots[(key * 0x9e3779b1u) >> (32 - RWLOCK_READER_SLOT_SHIFT)].reader_count;
+}
+
+static bool __reader_slots_empty(rwlock_reader_slots_t* slots) {
+  for (size_t i = 0; i < RWLOCK_READER_SLOT_COUNT; ++i) {
+    if (atomic_load_explicit(&slots->slots[i].reader_count, memory_order_acquire) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
 int pthread_rwlock_init(pthread_rwlock_t* rwlock_interface, const pthread_rwlockattr_t* attr) {
   pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
 
@@ -238,6 +367,16 @@ int pthread_rwlock_init(pthread_rwlock_t* rwlock_interface, const pthread_rwlock
       case PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP:
         rwlock->writer_nonrecursive_preferred = true;
         break;
+      case PTHREAD_RWLOCK_READER_MOSTLY_NP:
+        // The reader slots are private memory.
+        if (rwlock->pshared) {
+          return EINVAL;
+        }
+        // Writers have to be preferred, or a steady stream of readers would never let the
+        // reader slots drain.
+        rwlock->writer_nonrecursive_preferred = true;
+        rwlock->reader_mostly = true;
+        break;
       default:
         return EINVAL;
     }
@@ -257,9 +396,45 @@ int pthread_rwlock_destroy(pthread_rwlock_t* rwlock_interface) {
   if (atomic_load_explicit(&rwlock->state, memory_order_relaxed) != 0) {
     return EBUSY;
   }
+  if (rwlock->reader_mostly) {
+    rwlock_reader_slots_t* slots = __get_reader_slots(rwlock);
+    if (slots != NULL) {
+      if (!__reader_slots_empty(slots)) {
+        return EBUSY;
+      }
+      // The slots are all zero again, so the next rwlock can have them as they are.
+      unsigned index = atomic_load_explicit(&rwlock->reader_slots_index, memory_order_relaxed);
+      g_reader_slots_pool_lock.lock();
+      g_reader_slots_pool_busy[index - 1] = false;
+      g_reader_slots_pool_lock.unlock();
+    }
+    atomic_store_explicit(&rwlock->reader_slots_index, 0, memory_order_relaxed);
+    rwlock->reader_mostly = false;
+  }
   return 0;
 }
 
+// Wakes up pending readers or writers, after the last owner leaves.
+static void __pthread_rwlock_wake_pending(pthread_rwlock_internal_t* rwlock) {
+  rwlock->pending_lock.lock();
+  if (rwlock->pending_writer_count != 0) {
+    rwlock->pending_writer_wakeup_serial++;
+    rwlock->pending_lock.unlock();
+
+    __futex_wake_ex(&rwlock->pending_writer_wakeup_serial, rwlock->pshared, 1);
+
+  } else if (rwlock->pending_reader_count != 0) {
+    rwlock->pending_reader_wakeup_serial++;
+    rwlock->pending_lock.unlock();
+
+    __futex_wake_ex(&rwlock->pending_reader_wakeup_serial, rwlock->pshared, INT_MAX);
+
+  } else {
+    // It happens when waiters are woken up by timeout.
+    rwlock->pending_lock.unlock();
+  }
+}
+
 static inline __always_inline bool __can_acquire_read_lock(int old_state,
                                                              bool writer_nonrecursive_preferred) {
   // If writer is preferred with nonrecursive reader, we prevent further readers from acquiring
@@ -269,7 +444,53 @@ static inline __always_inline bool __can_acquire_read_lock(int old_state,
   return !cannot_apply;
 }
 
+static void __pthread_rwlock_reader_mostly_leave(pthread_rwlock_internal_t* rwlock,
+                                                 rwlock_reader_slots_t* slots, atomic_uint* slot) {
+  atomic_fetch_sub_explicit(slot, 1, memory_order_seq_cst);
+  // Either this sees the writer flag, or the writer sees the decremented slot.
+  if (__state_owned_by_writer(atomic_load_explicit(&rwlock->state, memory_order_seq_cst))) {
+    atomic_fetch_add_explicit(&slots->drain_serial, 1, memory_order_release);
+    __futex_wake_ex(&slots->drain_serial, false, 1);
+  }
+}
+
+// Returns -1 if the read lock has to be counted in state instead.
+static inline __always_inline int __pthread_rwlock_reader_mostly_tryrdlock(
+    pthread_rwlock_internal_t* rwlock) {
+  rwlock_reader_slots_t* slots = __get_reader_slots(rwlock);
+  if (__predict_false(slots == NULL)) {
+    if (atomic_load_explicit(&rwlock->reader_slots_index, memory_order_relaxed) != 0 ||
+        (slots = __alloc_reader_slots(rwlock)) == NULL) {
+      return -1;
+    }
+  }
+  rwlock_read_hold_t* hold = __get_read_hold(__get_thread(), rwlock, true);
+  if (__predict_false(hold == NULL)) {
+    return -1;
+  }
+  atomic_uint* slot = __get_reader_slot(slots);
+
+  // Publish the reader before looking for a writer. A writer sets its flag before looking at
+  // the slots, so at least one of the two sees the other.
+  atomic_fetch_add_explicit(slot, 1, memory_order_seq_cst);
+  int state = atomic_load_explicit(&rwlock->state, memory_order_seq_cst);
+  if (__predict_true(__can_acquire_read_lock(state, true))) {
+    hold->rwlock = rwlock;
+    hold->count++;
+    return 0;
+  }
+  __pthread_rwlock_reader_mostly_leave(rwlock, slots, slot);
+  return EBUSY;
+}
+
 static inline __always_inline int __pthread_rwlock_tryrdlock(pthread_rwlock_internal_t* rwlock) {
+  if (__predict_false(rwlock->reader_mostly)) {
+    int ret = __pthread_rwlock_reader_mostly_tryrdlock(rwlock);
+    if (ret != -1) {
+      return ret;
+    }
+  }
+
   int old_state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
 
   while (__predict_true(__can_acquire_read_lock(old_state, rwlock->writer_nonrecursive_preferred))) {
@@ -329,6 +550,7 @@ static int __pthread_rwlock_timedrdlock(pthread_rwlock_internal_t* rwlock,
 
     int futex_ret = 0;
     if (!__can_acquire_read_lock(old_state, rwlock->writer_nonrecursive_preferred)) {
+      ScopedLockProfile profile(rwlock);
       futex_ret = __futex_wait_ex(&rwlock->pending_reader_wakeup_serial, rwlock->pshared,
                                   old_serial, rel_timeout);
     }
@@ -351,18 +573,76 @@ static inline __always_inline bool __can_acquire_write_lock(int old_state) {
   return !__state_owned_by_readers_or_writer(old_state);
 }
 
-static inline __always_inline int __pthread_rwlock_trywrlock(pthread_rwlock_internal_t* rwlock) {
+static inline __always_inline bool __pthread_rwlock_try_set_writer_flag(
+    pthread_rwlock_internal_t* rwlock) {
   int old_state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
 
   while (__predict_true(__can_acquire_write_lock(old_state))) {
     if (__predict_true(atomic_compare_exchange_weak_explicit(&rwlock->state, &old_state,
           __state_add_writer_flag(old_state), memory_order_acquire, memory_order_relaxed))) {
+      return true;
+    }
+  }
+  return false;
+}
 
-      atomic_store_explicit(&rwlock->writer_tid, __get_thread()->tid, memory_order_relaxed);
+static void __pthread_rwlock_clear_writer_flag(pthread_rwlock_internal_t* rwlock) {
+  int old_state = atomic_fetch_and_explicit(&rwlock->state, ~STATE_OWNED_BY_WRITER_FLAG,
+                                            memory_order_release);
+  if (__state_have_pending_readers_or_writers(old_state)) {
+    __pthread_rwlock_wake_pending(rwlock);
+  }
+}
+
+// Called by a writer of a reader-mostly rwlock that has set the writer flag. New readers back
+// off from now on, so this only has to wait for the ones that are already in.
+static int __pthread_rwlock_wait_for_readers(pthread_rwlock_internal_t* rwlock,
+                                             const timespec* abs_timeout_or_null) {
+  // Pairs with the seq_cst reader slot updates; see __pthread_rwlock_reader_mostly_tryrdlock.
+  atomic_thread_fence(memory_order_seq_cst);
+  rwlock_reader_slots_t* slots = __get_reader_slots(rwlock);
+  if (slots == NULL) {
+    return 0;
+  }
+
+  while (true) {
+    unsigned old_serial = atomic_load_explicit(&slots->drain_serial, memory_order_acquire);
+    if (__reader_slots_empty(slots)) {
       return 0;
     }
+
+    timespec ts;
+    timespec* rel_timeout = NULL;
+
+    if (abs_timeout_or_null != NULL) {
+      rel_timeout = &ts;
+      if (!timespec_from_absolute_timespec(*rel_timeout, *abs_timeout_or_null, CLOCK_REALTIME)) {
+        return ETIMEDOUT;
+      }
+    }
+
+    ScopedLockProfile profile(rwlock);
+    if (__futex_wait_ex(&slots->drain_serial, false, old_serial, rel_timeout) == -ETIMEDOUT) {
+      return ETIMEDOUT;
+    }
   }
-  return EBUSY;
+}
+
+static inline __always_inline int __pthread_rwlock_trywrlock(pthread_rwlock_internal_t* rwlock) {
+  if (!__pthread_rwlock_try_set_writer_flag(rwlock)) {
+    return EBUSY;
+  }
+  if (__predict_false(rwlock->reader_mostly)) {
+    // See __pthread_rwlock_wait_for_readers.
+    atomic_thread_fence(memory_order_seq_cst);
+    rwlock_reader_slots_t* slots = __get_reader_slots(rwlock);
+    if (slots != NULL && !__reader_slots_empty(slots)) {
+      __pthread_rwlock_clear_writer_flag(rwlock);
+      return EBUSY;
+    }
+  }
+  atomic_store_explicit(&rwlock->writer_tid, __get_thread()->tid, memory_order_relaxed);
+  return 0;
 }
 
 static int __pthread_rwlock_timedwrlock(pthread_rwlock_internal_t* rwlock,
@@ -372,9 +652,16 @@ static int __pthread_rwlock_timedwrlock(pthread_rwlock_internal_t* rwlock,
     return EDEADLK;
   }
   while (true) {
-    int ret = __pthread_rwlock_trywrlock(rwlock);
-    if (ret == 0) {
-      return ret;
+    if (__pthread_rwlock_try_set_writer_flag(rwlock)) {
+      if (__predict_false(rwlock->reader_mostly)) {
+        int ret = __pthread_rwlock_wait_for_readers(rwlock, abs_timeout_or_null);
+        if (ret != 0) {
+          __pthread_rwlock_clear_writer_flag(rwlock);
+          return ret;
+        }
+      }
+      atomic_store_explicit(&rwlock->writer_tid, __get_thread()->tid, memory_order_relaxed);
+      return 0;
     }
 
     int old_state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
@@ -403,6 +690,7 @@ static int __pthread_rwlock_timedwrlock(pthread_rwlock_internal_t* rwlock,
 
     int futex_ret = 0;
     if (!__can_acquire_write_lock(old_state)) {
+      ScopedLockProfile profile(rwlock);
       futex_ret = __futex_wait_ex(&rwlock->pending_writer_wakeup_serial, rwlock->pshared,
                                   old_serial, rel_timeout);
     }
@@ -462,17 +750,28 @@ int pthread_rwlock_trywrlock(pthread_rwlock_t* rwlock_interface) {
 int pthread_rwlock_unlock(pthread_rwlock_t* rwlock_interface) {
   pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
 
+  if (__predict_false(rwlock->reader_mostly)) {
+    // A reader that took its read lock through the reader slots. The writer flag may be set by a
+    // writer waiting for it to leave. Anyone else goes through state as usual.
+    rwlock_read_hold_t* hold = __get_read_hold(__get_thread(), rwlock, false);
+    if (hold != NULL) {
+      if (--hold->count == 0) {
+        hold->rwlock = NULL;
+      }
+      rwlock_reader_slots_t* slots = __get_reader_slots(rwlock);
+      __pthread_rwlock_reader_mostly_leave(rwlock, slots, __get_reader_slot(slots));
+      return 0;
+    }
+  }
+
   int old_state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
   if (__state_owned_by_writer(old_state)) {
     if (atomic_load_explicit(&rwlock->writer_tid, memory_order_relaxed) != __get_thread()->tid) {
       return EPERM;
     }
     atomic_store_explicit(&rwlock->writer_tid, 0, memory_order_relaxed);
-    old_state = atomic_fetch_and_explicit(&rwlock->state, ~STATE_OWNED_BY_WRITER_FLAG,
-                                          memory_order_release);
-    if (!__state_have_pending_readers_or_writers(old_state)) {
-      return 0;
-    }
+    __pthread_rwlock_clear_writer_flag(rwlock);
+    return 0;
 
   } else if (__state_owned_by_readers(old_state)) {
     old_state = atomic_fetch_sub_explicit(&rwlock->state, STATE_READER_COUNT_CHANGE_STEP,
@@ -485,23 +784,6 @@ int pthread_rwlock_unlock(pthread_rwlock_t* rwlock_interface) {
     return EPERM;
   }
 
-  // Wake up pending readers or writers.
-  rwlock->pending_lock.lock();
-  if (rwlock->pending_writer_count != 0) {
-    rwlock->pending_writer_wakeup_serial++;
-    rwlock->pending_lock.unlock();
-
-    __futex_wake_ex(&rwlock->pending_writer_wakeup_serial, rwlock->pshared, 1);
-
-  } else if (rwlock->pending_reader_count != 0) {
-    rwlock->pending_reader_wakeup_serial++;
-    rwlock->pending_lock.unlock();
-
-    __futex_wake_ex(&rwlock->pending_reader_wakeup_serial, rwlock->pshared, INT_MAX);
-
-  } else {
-    // It happens when waiters are woken up by timeout.
-    rwlock->pending_lock.unlock();
-  }
+  __pthread_rwlock_wake_pending(rwlock);
   return 0;
 }
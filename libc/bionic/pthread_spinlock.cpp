@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "private/bionic_cpu_relax.h"
+
+// The longest a contended spinlock backs off between looks at the lock word,
+// in __bionic_cpu_relax() calls. Once the backoff reaches it, we also yield the
+// CPU in case the owner was preempted.
+#define SPIN_BACKOFF_MAX 1024
+
+struct pthread_spinlock_internal_t {
+  atomic_int lock;
+};
+
+static_assert(sizeof(pthread_spinlock_t) >= sizeof(pthread_spinlock_internal_t),
+              "pthread_spinlock_t should be able to hold pthread_spinlock_internal_t.");
+
+static inline __always_inline pthread_spinlock_internal_t* __get_internal_spinlock(pthread_spinlock_t* lock) {
+  return reinterpret_cast<pthread_spinlock_internal_t*>(lock);
+}
+
+int pthread_spin_init(pthread_spinlock_t* lock_interface, int pshared) {
+  if (pshared != PTHREAD_PROCESS_PRIVATE && pshared != PTHREAD_PROCESS_SHARED) {
+    return EINVAL;
+  }
+  // A spinlock never sleeps in the kernel, so it works the same whether it is
+  // shared or not.
+  atomic_init(&__get_internal_spinlock(lock_interface)->lock, 0);
+  return 0;
+}
+
+int pthread_spin_destroy(pthread_spinlock_t* lock_interface) {
+  pthread_spinlock_internal_t* lock = __get_internal_spinlock(lock_interface);
+  if (atomic_load_explicit(&lock->lock, memory_order_relaxed) != 0) {
+    return EBUSY;
+  }
+  return 0;
+}
+
+int pthread_spin_trylock(pthread_spinlock_t* lock_interface) {
+  pthread_spinlock_internal_t* lock = __get_internal_spinlock(lock_interface);
+  int old_value = 0;
+  if (atomic_compare_exchange_strong_explicit(&lock->lock, &old_value, 1,
+                                              memory_order_acquire, memory_order_relaxed)) {
+    return 0;
+  }
+  return EBUSY;
+}
+
+int pthread_spin_lock(pthread_spinlock_t* lock_interface) {
+  pthread_spinlock_internal_t* lock = __get_internal_spinlock(lock_interface);
+  if (__predict_true(atomic_exchange_explicit(&lock->lock, 1, memory_order_acquire) == 0)) {
+    return 0;
+  }
+
+  // Wait for the lock to look free with plain loads, so that waiters don't
+  // keep stealing the cache line from the owner, and back off exponentially
+  // so that many waiters don't all retry at the same moment.
+  int backoff = 1;
+  while (true) {
+    while (atomic_load_explicit(&lock->lock, memory_order_relaxed) != 0) {
+      for (int i = 0; i < backoff; ++i) {
+        __bionic_cpu_relax();
+      }
+      if (backoff < SPIN_BACKOFF_MAX) {
+        backoff *= 2;
+      } else {
+        sched_yield();
+      }
+    }
+    if (atomic_exchange_explicit(&lock->lock, 1, memory_order_acquire) == 0) {
+      return 0;
+    }
+  }
+}
+
+int pthread_spin_unlock(pthread_spinlock_t* lock_interface) {
+  atomic_store_explicit(&__get_internal_spinlock(lock_interface)->lock, 0, memory_order_release);
+  return 0;
+}
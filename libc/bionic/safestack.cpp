@@ -101,6 +101,19 @@ int __unsafe_stack_alloc(pthread_internal_t* thr, size_t stack_size,
     return rc;
   }
 
+  thr->unsafe_stack_start = space;
+  thr->unsafe_stack_size = stack_size;
+  thr->unsafe_stack_gap_size = gap_size;
+
+  return __unsafe_stack_reuse(thr);
+}
+
+// Points a thread's TLS at an unsafe stack that is already mapped, with a new
+// random top.
+int __unsafe_stack_reuse(pthread_internal_t* thr) {
+  size_t stack_size = thr->unsafe_stack_size;
+  char* stack_top = reinterpret_cast<char*>(thr->unsafe_stack_start) + stack_size;
+
   // Randomize the stack top.
   size_t max_top_offset = stack_size / 100;
   if (max_top_offset > PAGE_SIZE - 1) {
@@ -110,10 +123,6 @@ int __unsafe_stack_alloc(pthread_internal_t* thr, size_t stack_size,
   top_offset &= ~0xFUL;
   stack_top -= top_offset;
 
-  thr->unsafe_stack_start = space;
-  thr->unsafe_stack_size = stack_size;
-  thr->unsafe_stack_gap_size = gap_size;
-
   thr->tls[TLS_SLOT_SAFESTACK] = stack_top;
 
   return 0;
@@ -29,11 +29,23 @@
 #define _GNU_SOURCE 1
 #include <sched.h>
 
-extern "C" int __getcpu(unsigned*, unsigned*, void*);
+#include "pthread_internal.h"
+#include "private/bionic_globals.h"
+#include "private/bionic_vdso.h"
 
 int sched_getcpu() {
+  // The kernel keeps this up to date for threads that registered their rseq area.
+  int rseq_cpu = __rseq_cpu_id(&__get_thread()->rseq);
+  if (__predict_true(rseq_cpu >= 0)) {
+    return rseq_cpu;
+  }
+
+  auto vdso_getcpu = reinterpret_cast<decltype(&__getcpu)>(__libc_globals->vdso[VDSO_GETCPU].fn);
+  if (vdso_getcpu == NULL) {
+    vdso_getcpu = __getcpu;
+  }
   unsigned cpu;
-  int rc = __getcpu(&cpu, NULL, NULL);
+  int rc = vdso_getcpu(&cpu, NULL, NULL);
   if (rc == -1) {
     return -1; // errno is already set.
   }
@@ -47,12 +47,42 @@ int gettimeofday(timeval* tv, struct timezone* tz) {
   return __gettimeofday(tv, tz);
 }
 
+int clock_getres(int clock_id, timespec* tp) {
+  auto vdso_clock_getres = reinterpret_cast<decltype(&clock_getres)>(
+    __libc_globals->vdso[VDSO_CLOCK_GETRES].fn);
+  if (__predict_true(vdso_clock_getres)) {
+    return vdso_clock_getres(clock_id, tp);
+  }
+  return __clock_getres(clock_id, tp);
+}
+
+time_t time(time_t* t) {
+  auto vdso_time = reinterpret_cast<decltype(&time)>(__libc_globals->vdso[VDSO_TIME].fn);
+  if (__predict_true(vdso_time)) {
+    return vdso_time(t);
+  }
+  // There's no time(2) on arm64, so use gettimeofday, which is in the vdso there.
+  timeval tv;
+  if (gettimeofday(&tv, NULL) == -1) {
+    return -1;
+  }
+  if (t != NULL) {
+    *t = tv.tv_sec;
+  }
+  return tv.tv_sec;
+}
+
 void __libc_init_vdso(libc_globals* globals, KernelArgumentBlock& args) {
   auto&& vdso = globals->vdso;
   vdso[VDSO_CLOCK_GETTIME] = { VDSO_CLOCK_GETTIME_SYMBOL,
                                reinterpret_cast<void*>(__clock_gettime) };
   vdso[VDSO_GETTIMEOFDAY] = { VDSO_GETTIMEOFDAY_SYMBOL,
                               reinterpret_cast<void*>(__gettimeofday) };
+  vdso[VDSO_CLOCK_GETRES] = { VDSO_CLOCK_GETRES_SYMBOL,
+                              reinterpret_cast<void*>(__clock_getres) };
+  vdso[VDSO_GETCPU] = { VDSO_GETCPU_SYMBOL, reinterpret_cast<void*>(__getcpu) };
+  // Not every architecture has a time(2) to fall back to, so time() handles a missing one.
+  vdso[VDSO_TIME] = { VDSO_TIME_SYMBOL, nullptr };
 
   // Do we have a vdso?
   uintptr_t vdso_ehdr_addr = args.getauxval(AT_SYSINFO_EHDR);
@@ -105,7 +135,7 @@ void __libc_init_vdso(libc_globals* globals, KernelArgumentBlock& args) {
   // Are there any symbols we want?
   for (size_t i = 0; i < symbol_count; ++i) {
     for (size_t j = 0; j < VDSO_END; ++j) {
-      if (strcmp(vdso[j].name, strtab + symtab[i].st_name) == 0) {
+      if (vdso[j].name != nullptr && strcmp(vdso[j].name, strtab + symtab[i].st_name) == 0) {
         vdso[j].fn = reinterpret_cast<void*>(vdso_addr + symtab[i].st_value);
       }
     }
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// libc_ndk.a can't have vdso.cpp (it needs getauxval), but on these
+// architectures that's where libc.so's time and clock_getres live. These are
+// the plain syscall versions for libc_ndk.a.
+#if defined(__aarch64__) || defined(__x86_64__)
+
+#include <stddef.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "private/bionic_vdso.h"
+
+int clock_getres(int clock_id, timespec* tp) {
+  return __clock_getres(clock_id, tp);
+}
+
+time_t time(time_t* t) {
+  timeval tv;
+  if (__gettimeofday(&tv, NULL) == -1) {
+    return -1;
+  }
+  if (t != NULL) {
+    *t = tv.tv_sec;
+  }
+  return tv.tv_sec;
+}
+
+#endif
@@ -57,21 +57,81 @@ extern struct mallinfo mallinfo(void);
 /*
  * XML structure for malloc_info(3) is in the following format:
  *
- * <malloc version="jemalloc-1">
+ * <malloc version="BACKEND-2">
+ *   <total>
+ *     <allocated>INT</allocated>
+ *     <active>INT</active>
+ *     <resident>INT</resident>
+ *     <mapped>INT</mapped>
+ *   </total>
+ *   <thread>
+ *     <tcache-enabled>INT</tcache-enabled>
+ *     <allocated>INT</allocated>
+ *     <deallocated>INT</deallocated>
+ *   </thread>
+ *   <huge-pages enabled="INT">
+ *     <resident>INT</resident>
+ *     <huge>INT</huge>
+ *   </huge-pages>
  *   <heap nr="INT">
  *     <allocated-large>INT</allocated-large>
  *     <allocated-huge>INT</allocated-huge>
  *     <allocated-bins>INT</allocated-bins>
- *     <bins-total>INT</bins-total>
+ *     <active>INT</active>
+ *     <dirty>INT</dirty>
+ *     <mapped>INT</mapped>
+ *     <large>
+ *       <nmalloc>INT</nmalloc>
+ *       <ndalloc>INT</ndalloc>
+ *     </large>
+ *     <huge>
+ *       <nmalloc>INT</nmalloc>
+ *       <ndalloc>INT</ndalloc>
+ *     </huge>
  *     <bin nr="INT">
+ *       <size>INT</size>
  *       <allocated>INT</allocated>
+ *       <current>INT</current>
  *       <nmalloc>INT</nmalloc>
  *       <ndalloc>INT</ndalloc>
+ *       <nrequests>INT</nrequests>
+ *       <nfills>INT</nfills>
+ *       <nflushes>INT</nflushes>
  *     </bin>
  *     <!-- more bins -->
+ *     <bins-total>INT</bins-total>
  *   </heap>
  *   <!-- more heaps -->
  * </malloc>
+ *
+ * BACKEND is "jemalloc" or "dlmalloc", and the number after it is the
+ * format version. All sizes are in bytes.
+ *
+ * total: allocated is the sum of the live allocations, active the pages
+ * backing them, resident the allocator pages in RAM and mapped all of the
+ * allocator's address space. resident - allocated is the fragmentation.
+ *
+ * thread: counters for the calling thread and its thread cache.
+ *
+ * huge-pages: enabled is 1 when the libc.malloc.huge_pages property or the
+ * LIBC_MALLOC_HUGE_PAGES environment variable turned on huge pages for the
+ * heap. resident is the allocator memory in RAM, and huge how much of it
+ * is backed by transparent huge pages.
+ *
+ * heap: one per arena. active and dirty are the pages in use and the
+ * unused pages not yet returned to the kernel. large and huge count the
+ * allocations too big for a bin, huge ones being mapped directly.
+ *
+ * bin: one per size class with any allocations. size is the object size
+ * of the class, allocated the bytes and current the number of objects in
+ * use. nmalloc and ndalloc count objects moving between the arena and
+ * the program or the thread caches, nrequests counts every allocation
+ * including the ones served by a thread cache, and nfills and nflushes
+ * count thread cache refills from and flushes to the bin.
+ *
+ * The thread element and the large, huge, nmalloc, ndalloc, nrequests,
+ * nfills and nflushes elements are only present when the backend keeps
+ * those counters, which dlmalloc does not.
  */
 extern int malloc_info(int, FILE *);
 
@@ -50,6 +50,7 @@ enum {
     PTHREAD_MUTEX_NORMAL = 0,
     PTHREAD_MUTEX_RECURSIVE = 1,
     PTHREAD_MUTEX_ERRORCHECK = 2,
+    PTHREAD_MUTEX_ADAPTIVE_NP = 3,
 
     PTHREAD_MUTEX_ERRORCHECK_NP = PTHREAD_MUTEX_ERRORCHECK,
     PTHREAD_MUTEX_RECURSIVE_NP  = PTHREAD_MUTEX_RECURSIVE,
@@ -60,6 +61,12 @@ enum {
 #define PTHREAD_MUTEX_INITIALIZER { { ((PTHREAD_MUTEX_NORMAL & 3) << 14) } }
 #define PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP { { ((PTHREAD_MUTEX_RECURSIVE & 3) << 14) } }
 #define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP { { ((PTHREAD_MUTEX_ERRORCHECK & 3) << 14) } }
+#define PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP { { ((PTHREAD_MUTEX_ADAPTIVE_NP & 3) << 14) } }
+
+enum {
+  PTHREAD_PRIO_NONE = 0,
+  PTHREAD_PRIO_INHERIT = 1,
+};
 
 typedef struct {
 #if defined(__LP64__)
@@ -88,8 +95,30 @@ typedef long pthread_rwlockattr_t;
 enum {
   PTHREAD_RWLOCK_PREFER_READER_NP = 0,
   PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP = 1,
+  /* Readers scale across cores; writers are preferred but slower. Not process-shared. */
+  PTHREAD_RWLOCK_READER_MOSTLY_NP = 2,
 };
 
+typedef int pthread_barrierattr_t;
+
+typedef struct {
+#if defined(__LP64__)
+  int64_t __private[4];
+#else
+  int32_t __private[8];
+#endif
+} pthread_barrier_t;
+
+#define PTHREAD_BARRIER_SERIAL_THREAD (-1)
+
+typedef struct {
+#if defined(__LP64__)
+  int64_t __private;
+#else
+  int32_t __private[2];
+#endif
+} pthread_spinlock_t;
+
 typedef int pthread_key_t;
 
 typedef int pthread_once_t;
@@ -132,6 +161,21 @@ int pthread_attr_setscope(pthread_attr_t*, int) __nonnull((1));
 int pthread_attr_setstack(pthread_attr_t*, void*, size_t) __nonnull((1));
 int pthread_attr_setstacksize(pthread_attr_t*, size_t stack_size) __nonnull((1));
 
+#if defined(__USE_GNU)
+/* The mask is applied before the new thread runs. LP32 has no room to store one, so ENOTSUP. */
+int pthread_attr_getaffinity_np(const pthread_attr_t*, size_t, cpu_set_t*) __nonnull((1, 3));
+int pthread_attr_setaffinity_np(pthread_attr_t*, size_t, const cpu_set_t*) __nonnull((1));
+#endif
+
+int pthread_barrierattr_destroy(pthread_barrierattr_t*) __nonnull((1));
+int pthread_barrierattr_getpshared(const pthread_barrierattr_t*, int*) __nonnull((1, 2));
+int pthread_barrierattr_init(pthread_barrierattr_t*) __nonnull((1));
+int pthread_barrierattr_setpshared(pthread_barrierattr_t*, int) __nonnull((1));
+
+int pthread_barrier_destroy(pthread_barrier_t*) __nonnull((1));
+int pthread_barrier_init(pthread_barrier_t*, const pthread_barrierattr_t*, unsigned) __nonnull((1));
+int pthread_barrier_wait(pthread_barrier_t*) __nonnull((1));
+
 int pthread_condattr_destroy(pthread_condattr_t*) __nonnull((1));
 int pthread_condattr_getclock(const pthread_condattr_t*, clockid_t*) __nonnull((1, 2));
 int pthread_condattr_getpshared(const pthread_condattr_t*, int*) __nonnull((1, 2));
@@ -154,6 +198,11 @@ int pthread_equal(pthread_t, pthread_t);
 
 int pthread_getattr_np(pthread_t, pthread_attr_t*) __nonnull((2));
 
+#if defined(__USE_GNU)
+int pthread_getaffinity_np(pthread_t, size_t, cpu_set_t*) __nonnull((3));
+int pthread_setaffinity_np(pthread_t, size_t, const cpu_set_t*) __nonnull((3));
+#endif
+
 int pthread_getcpuclockid(pthread_t, clockid_t*) __nonnull((2));
 
 int pthread_getschedparam(pthread_t, int*, struct sched_param*) __nonnull((2, 3));
@@ -168,9 +217,11 @@ int pthread_key_create(pthread_key_t*, void (*)(void*)) __nonnull((1));
 int pthread_key_delete(pthread_key_t);
 
 int pthread_mutexattr_destroy(pthread_mutexattr_t*) __nonnull((1));
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t*, int*) __nonnull((1, 2));
 int pthread_mutexattr_getpshared(const pthread_mutexattr_t*, int*) __nonnull((1, 2));
 int pthread_mutexattr_gettype(const pthread_mutexattr_t*, int*) __nonnull((1, 2));
 int pthread_mutexattr_init(pthread_mutexattr_t*) __nonnull((1));
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t*, int) __nonnull((1));
 int pthread_mutexattr_setpshared(pthread_mutexattr_t*, int) __nonnull((1));
 int pthread_mutexattr_settype(pthread_mutexattr_t*, int) __nonnull((1));
 
@@ -216,6 +267,12 @@ int pthread_setschedparam(pthread_t, int, const struct sched_param*) __nonnull((
 
 int pthread_setspecific(pthread_key_t, const void*);
 
+int pthread_spin_destroy(pthread_spinlock_t*) __nonnull((1));
+int pthread_spin_init(pthread_spinlock_t*, int) __nonnull((1));
+int pthread_spin_lock(pthread_spinlock_t*) __nonnull((1));
+int pthread_spin_trylock(pthread_spinlock_t*) __nonnull((1));
+int pthread_spin_unlock(pthread_spinlock_t*) __nonnull((1));
+
 typedef void (*__pthread_cleanup_func_t)(void*);
 
 typedef struct __pthread_cleanup_t {
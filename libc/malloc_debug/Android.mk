@@ -8,6 +8,10 @@ libc_malloc_debug_src_files := \
     FreeTrackData.cpp \
     GuardData.cpp \
     malloc_debug.cpp \
+    RecordData.cpp \
+    SampleData.cpp \
+    SnapshotData.cpp \
+    ThreadData.cpp \
     TrackData.cpp \
 
 # ==============================================================
@@ -61,8 +65,10 @@ LOCAL_SRC_FILES := \
     tests/libc_fake.cpp \
     tests/property_fake.cpp \
     tests/malloc_debug_config_tests.cpp \
+    tests/malloc_debug_map_data_tests.cpp \
     tests/malloc_debug_unit_tests.cpp \
     $(libc_malloc_debug_src_files) \
+    MapData.cpp \
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/tests
 LOCAL_C_INCLUDES += bionic/libc
@@ -75,3 +81,34 @@ LOCAL_CFLAGS := \
     -Wno-error=format-zero-length \
 
 include $(BUILD_NATIVE_TEST)
+
+# ==============================================================
+# Benchmarks
+# ==============================================================
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := malloc_debug_benchmarks
+LOCAL_MODULE_STEM_32 := $(LOCAL_MODULE)32
+LOCAL_MODULE_STEM_64 := $(LOCAL_MODULE)64
+LOCAL_MULTILIB := both
+
+LOCAL_SRC_FILES := \
+    tests/backtrace_fake.cpp \
+    tests/log_fake.cpp \
+    tests/libc_fake.cpp \
+    tests/property_fake.cpp \
+    tests/malloc_debug_benchmark.cpp \
+    $(libc_malloc_debug_src_files) \
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/tests
+LOCAL_C_INCLUDES += bionic/libc bionic/benchmarks
+
+LOCAL_STATIC_LIBRARIES := libbenchmark libbase
+
+LOCAL_CFLAGS := \
+    -O2 \
+    -Wall \
+    -Werror \
+    -Wno-error=format-zero-length \
+
+include $(BUILD_EXECUTABLE)
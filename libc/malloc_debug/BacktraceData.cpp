@@ -30,21 +30,113 @@
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <private/bionic_macros.h>
+#include <private/ScopedPthreadMutexLocker.h>
 
 #include "BacktraceData.h"
 #include "Config.h"
 #include "DebugData.h"
+#include "debug_disable.h"
 #include "debug_log.h"
 #include "malloc_debug.h"
 
-BacktraceData::BacktraceData(const Config& config, size_t* offset) {
-  size_t hdr_len = sizeof(BacktraceHeader) + sizeof(uintptr_t) * config.backtrace_frames;
+BacktraceData::BacktraceData(const Config&, size_t* offset) {
+  // Only the id of the interned stack is kept in the header.
   alloc_offset_ = *offset;
-  *offset += BIONIC_ALIGN(hdr_len, MINIMUM_ALIGNMENT_BYTES);
+  *offset += BIONIC_ALIGN(sizeof(uint32_t), MINIMUM_ALIGNMENT_BYTES);
+}
+
+BacktraceData::~BacktraceData() {
+  ScopedDisableDebugCalls disable;
+
+  for (auto entry : entries_) {
+    g_dispatch->free(entry);
+  }
+  stacks_.clear();
+  entries_.clear();
+  free_ids_.clear();
+}
+
+bool BacktraceData::StackKey::operator==(const StackKey& other) const {
+  return hash == other.hash && num_frames == other.num_frames &&
+      memcmp(frames, other.frames, num_frames * sizeof(uintptr_t)) == 0;
+}
+
+uint32_t BacktraceData::AddStack(const uintptr_t* frames, size_t num_frames) {
+  // Make sure the stl calls below don't call the debug_XXX functions.
+  ScopedDisableDebugCalls disable;
+
+  size_t hash = num_frames;
+  for (size_t i = 0; i < num_frames; i++) {
+    hash ^= frames[i] + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  }
+  StackKey key = { hash, num_frames, frames };
+
+  ScopedPthreadMutexLocker scoped(&mutex_);
+  auto iter = stacks_.find(key);
+  if (iter != stacks_.end()) {
+    entries_[iter->second - 1]->ref_count++;
+    return iter->second;
+  }
+
+  StackEntry* entry = reinterpret_cast<StackEntry*>(
+      g_dispatch->malloc(sizeof(StackEntry) + num_frames * sizeof(uintptr_t)));
+  if (entry == nullptr) {
+    return 0;
+  }
+  entry->hash = hash;
+  entry->ref_count = 1;
+  entry->num_frames = num_frames;
+  memcpy(&entry->frames[0], frames, num_frames * sizeof(uintptr_t));
+
+  uint32_t id;
+  if (!free_ids_.empty()) {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+    entries_[id - 1] = entry;
+  } else if (entries_.size() < UINT32_MAX) {
+    entries_.push_back(entry);
+    id = entries_.size();
+  } else {
+    g_dispatch->free(entry);
+    return 0;
+  }
+
+  key.frames = &entry->frames[0];
+  stacks_[key] = id;
+  return id;
+}
+
+void BacktraceData::AcquireStack(uint32_t id) {
+  ScopedPthreadMutexLocker scoped(&mutex_);
+  entries_[id - 1]->ref_count++;
+}
+
+void BacktraceData::RemoveStack(uint32_t id) {
+  ScopedDisableDebugCalls disable;
+
+  ScopedPthreadMutexLocker scoped(&mutex_);
+  StackEntry* entry = entries_[id - 1];
+  if (--entry->ref_count > 0) {
+    return;
+  }
+
+  StackKey key = { entry->hash, entry->num_frames, &entry->frames[0] };
+  stacks_.erase(key);
+  entries_[id - 1] = nullptr;
+  free_ids_.push_back(id);
+  g_dispatch->free(entry);
+}
+
+const uintptr_t* BacktraceData::GetFrames(uint32_t id, size_t* num_frames) {
+  ScopedPthreadMutexLocker scoped(&mutex_);
+  StackEntry* entry = entries_[id - 1];
+  *num_frames = entry->num_frames;
+  return &entry->frames[0];
 }
 
 static BacktraceData* g_backtrace_data = nullptr;
@@ -29,17 +29,24 @@
 #ifndef DEBUG_MALLOC_BACKTRACEDATA_H
 #define DEBUG_MALLOC_BACKTRACEDATA_H
 
+#include <pthread.h>
 #include <stdint.h>
 
+#include <unordered_map>
+#include <vector>
+
 #include <private/bionic_macros.h>
 
 // Forward declarations.
 struct Config;
 
+// Allocation backtraces are interned: every distinct stack is stored once
+// in a refcounted entry, and each allocation header only holds the 32 bit
+// id of its entry. An id of zero means no backtrace.
 class BacktraceData {
  public:
   BacktraceData(const Config& config, size_t* offset);
-  virtual ~BacktraceData() = default;
+  virtual ~BacktraceData();
 
   bool Initialize(const Config& config);
 
@@ -48,11 +55,48 @@ class BacktraceData {
   bool enabled() { return enabled_; }
   void set_enabled(bool enabled) { enabled_ = enabled; }
 
+  // Returns the id of the stack with a reference taken, or zero if no
+  // entry could be created.
+  uint32_t AddStack(const uintptr_t* frames, size_t num_frames);
+
+  // Takes another reference to an entry that is known to be alive.
+  void AcquireStack(uint32_t id);
+
+  // Drops a reference, the entry is freed when the last one goes away.
+  void RemoveStack(uint32_t id);
+
+  // The returned frames are only valid while a reference to id is held.
+  const uintptr_t* GetFrames(uint32_t id, size_t* num_frames);
+
  private:
+  struct StackEntry {
+    size_t hash;
+    size_t ref_count;
+    size_t num_frames;
+    uintptr_t frames[0];
+  };
+
+  struct StackKey {
+    size_t hash;
+    size_t num_frames;
+    const uintptr_t* frames;
+    bool operator==(const StackKey& other) const;
+  };
+
+  struct StackKeyHash {
+    size_t operator()(const StackKey& key) const { return key.hash; }
+  };
+
   size_t alloc_offset_ = 0;
 
   volatile bool enabled_ = false;
 
+  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  std::unordered_map<StackKey, uint32_t, StackKeyHash> stacks_;
+  // Indexed by id - 1.
+  std::vector<StackEntry*> entries_;
+  std::vector<uint32_t> free_ids_;
+
   DISALLOW_COPY_AND_ASSIGN(BacktraceData);
 };
 
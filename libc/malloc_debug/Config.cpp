@@ -34,6 +34,7 @@
 #include <string.h>
 #include <sys/cdefs.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -49,6 +50,10 @@ struct Feature {
           uint64_t option, size_t* value, bool* config, bool combo_option)
       : name(name), default_value(default_value), min_value(min_value), max_value(max_value),
         option(option), value(value), config(config), combo_option(combo_option) {}
+  Feature(std::string name, std::string default_str_value, uint64_t option,
+          std::string* str_value)
+      : name(name), option(option), default_str_value(default_str_value),
+        str_value(str_value) {}
   std::string name;
   size_t default_value = 0;
   size_t min_value = 0;
@@ -57,6 +62,9 @@ struct Feature {
   uint64_t option = 0;
   size_t* value = nullptr;
   bool* config = nullptr;
+  // Options that take a string, such as a file name, instead of a number.
+  std::string default_str_value;
+  std::string* str_value = nullptr;
   // If set to true, then all of the options following are set on until
   // for which the combo_option value is set.
   bool combo_option = false;
@@ -66,7 +74,9 @@ class PropertyParser {
  public:
   PropertyParser(const char* property) : cur_(property) {}
 
-  bool Get(std::string* property, size_t* value, bool* value_set);
+  bool Get(std::string* property, size_t* value, std::string* str_value, bool* value_set);
+
+  void AddStringOption(const std::string& name) { string_options_.push_back(name); }
 
   bool Done() { return done_; }
 
@@ -78,15 +88,21 @@ class PropertyParser {
   static constexpr uint8_t DEFAULT_FRONT_GUARD_VALUE = 0xaa;
   static constexpr uint8_t DEFAULT_REAR_GUARD_VALUE = 0xbb;
 
+  static constexpr const char* DEFAULT_RECORD_ALLOCS_FILE = "/data/local/tmp/record_allocs";
+  static constexpr const char* DEFAULT_HEAP_SNAPSHOT_FILE = "/data/local/tmp/heap_snapshot";
+
  private:
   const char* cur_ = nullptr;
 
   bool done_ = false;
 
+  std::vector<std::string> string_options_;
+
   DISALLOW_COPY_AND_ASSIGN(PropertyParser);
 };
 
-bool PropertyParser::Get(std::string* property, size_t* value, bool* value_set) {
+bool PropertyParser::Get(std::string* property, size_t* value, std::string* str_value,
+                         bool* value_set) {
   // Process each property name we can find.
   while (isspace(*cur_))
     ++cur_;
@@ -108,8 +124,21 @@ bool PropertyParser::Get(std::string* property, size_t* value, bool* value_set)
 
   if (*cur_ == '=') {
     ++cur_;
-    errno = 0;
     *value_set = true;
+    if (std::find(string_options_.begin(), string_options_.end(), *property) !=
+        string_options_.end()) {
+      const char* value_start = cur_;
+      while (!isspace(*cur_) && *cur_ != '\0')
+        ++cur_;
+      if (cur_ == value_start) {
+        error_log("%s: bad value for option '%s'", getprogname(), property->c_str());
+        return false;
+      }
+      *str_value = std::string(value_start, cur_ - value_start);
+      return true;
+    }
+
+    errno = 0;
     char* end;
     long read_value = strtol(cur_, const_cast<char**>(&end), 10);
     if (errno != 0) {
@@ -192,9 +221,10 @@ void PropertyParser::LogUsage() {
   error_log("");
   error_log("  free_track[=XX]");
   error_log("    When a pointer is freed, do not free the memory right away.");
-  error_log("    Instead, keep XX of these allocations around and then verify");
-  error_log("    that they have not been modified when the total number of freed");
-  error_log("    allocations exceeds the XX amount. When the program terminates,");
+  error_log("    Instead, each thread keeps XX of these allocations around and then");
+  error_log("    verifies that they have not been modified when the number of");
+  error_log("    allocations freed by the thread exceeds the XX amount. When a");
+  error_log("    thread exits, its allocations are verified. When the program terminates,");
   error_log("    the rest of these allocations are verified. When this option is");
   error_log("    enabled, it automatically records the backtrace at the time of the free.");
   error_log("    The default is to record 100 allocations.");
@@ -208,14 +238,52 @@ void PropertyParser::LogUsage() {
   error_log("");
   error_log("  leak_track");
   error_log("    Enable the leak tracking of memory allocations.");
+  error_log("");
+  error_log("  sample_bytes[=XX]");
+  error_log("    Only capture the backtrace of, and track, a random sample of");
+  error_log("    the allocations, on average one for every XX allocated bytes.");
+  error_log("    Allocations that are not sampled only pay the cost of a counter");
+  error_log("    update. The default is 524288 bytes. Sending the process the");
+  error_log("    signal SIGRTMIN + 11 dumps the live sampled allocations to the log.");
+  error_log("");
+  error_log("  record_allocs[=XX]");
+  error_log("    Record every malloc, calloc, realloc, memalign and free call in a");
+  error_log("    binary trace that can be replayed offline. Each thread buffers XX");
+  error_log("    entries before appending them to the trace file. The default is");
+  error_log("    4096 entries.");
+  error_log("");
+  error_log("  record_allocs_file[=FILE]");
+  error_log("    This option only has meaning if record_allocs is set. It is the");
+  error_log("    name of the trace file, the pid of the process is appended to it.");
+  error_log("    The default is %s.", DEFAULT_RECORD_ALLOCS_FILE);
+  error_log("");
+  error_log("  heap_snapshot");
+  error_log("    Enable capturing the backtrace at the point of allocation, and");
+  error_log("    write the live allocations, grouped by backtrace, along with the");
+  error_log("    maps of the process to a file when the process receives the");
+  error_log("    heap_snapshot_signal. The snapshot is written using a bounded amount");
+  error_log("    of memory, by the next thread that allocates.");
+  error_log("");
+  error_log("  heap_snapshot_signal[=XX]");
+  error_log("    This option only has meaning if heap_snapshot is set. It is the");
+  error_log("    number of the real-time signal that triggers a snapshot. The");
+  error_log("    default is SIGRTMIN + 12.");
+  error_log("");
+  error_log("  heap_snapshot_file[=FILE]");
+  error_log("    This option only has meaning if heap_snapshot is set. It is the");
+  error_log("    name of the snapshot files, the pid of the process and the number");
+  error_log("    of the snapshot are appended to it. The default is");
+  error_log("    %s.", DEFAULT_HEAP_SNAPSHOT_FILE);
 }
 
-static bool SetFeature(
-    const std::string name, const Feature& feature, size_t value, bool value_set) {
+static bool SetFeature(const std::string name, const Feature& feature, size_t value,
+                       const std::string& str_value, bool value_set) {
   if (feature.config) {
     *feature.config = true;
   }
-  if (feature.value != nullptr) {
+  if (feature.str_value != nullptr) {
+    *feature.str_value = value_set ? str_value : feature.default_str_value;
+  } else if (feature.value != nullptr) {
     if (value_set) {
       if (value < feature.min_value) {
         error_log("%s: bad value for option '%s', value must be >= %zu: %zu",
@@ -254,6 +322,8 @@ bool Config::SetFromProperties() {
   rear_guard_value = PropertyParser::DEFAULT_REAR_GUARD_VALUE;
   backtrace_signal = SIGRTMIN + 10;
   free_track_backtrace_num_frames = 16;
+  sample_dump_signal = SIGRTMIN + 11;
+  size_t snapshot_signal = SIGRTMIN + 12;
 
   // Parse the options are of the format:
   //   option_name or option_name=XX
@@ -268,10 +338,10 @@ bool Config::SetFromProperties() {
 
     // Enable logging the backtrace on allocation. Value is the total
     // number of frames to log.
-    Feature("backtrace", 16, 1, 256, BACKTRACE | TRACK_ALLOCS, &this->backtrace_frames,
+    Feature("backtrace", 16, 1, MAX_BACKTRACE_FRAMES, BACKTRACE | TRACK_ALLOCS, &this->backtrace_frames,
             &this->backtrace_enabled, false),
     // Enable gathering backtrace values on a signal.
-    Feature("backtrace_enable_on_signal", 16, 1, 256, BACKTRACE | TRACK_ALLOCS,
+    Feature("backtrace_enable_on_signal", 16, 1, MAX_BACKTRACE_FRAMES, BACKTRACE | TRACK_ALLOCS,
             &this->backtrace_frames, &this->backtrace_enable_on_signal, false),
 
     Feature("fill", SIZE_MAX, 1, SIZE_MAX, 0, nullptr, nullptr, true),
@@ -302,22 +372,51 @@ bool Config::SetFromProperties() {
 
     // Enable printing leaked allocations.
     Feature("leak_track", 0, 0, 0, LEAK_TRACK | TRACK_ALLOCS, nullptr, nullptr, false),
+
+    // Only record the backtrace for a sample of the allocations. Value is
+    // the average number of bytes allocated between two samples.
+    Feature("sample_bytes", 524288, 1, SIZE_MAX, BACKTRACE | TRACK_ALLOCS | SAMPLE_ALLOCS,
+            &this->sample_bytes, &this->backtrace_enabled, false),
+
+    // Record every allocation call to a file. Value is the number of
+    // entries each thread buffers before writing them out.
+    Feature("record_allocs", 4096, 1, 1048576, RECORD_ALLOCS, &this->record_allocs_num_entries,
+            nullptr, false),
+    // The file the allocation calls are recorded to.
+    Feature("record_allocs_file", PropertyParser::DEFAULT_RECORD_ALLOCS_FILE, 0,
+            &this->record_allocs_file),
+
+    // Write a snapshot of the live allocations to a file on a signal.
+    Feature("heap_snapshot", 0, 0, 0, BACKTRACE | TRACK_ALLOCS | HEAP_SNAPSHOT, nullptr,
+            &this->backtrace_enabled, false),
+    // The prefix of the snapshot files.
+    Feature("heap_snapshot_file", PropertyParser::DEFAULT_HEAP_SNAPSHOT_FILE, 0,
+            &this->heap_snapshot_file),
+    // The signal that triggers a snapshot.
+    Feature("heap_snapshot_signal", SIGRTMIN + 12, SIGRTMIN, SIGRTMAX, 0, &snapshot_signal,
+            nullptr, false),
   };
 
   // Process each property name we can find.
   std::string property;
   size_t value;
+  std::string str_value;
   bool value_set;
   PropertyParser parser(property_str);
+  for (size_t i = 0; i < sizeof(features)/sizeof(Feature); i++) {
+    if (features[i].str_value != nullptr) {
+      parser.AddStringOption(features[i].name);
+    }
+  }
   bool found = false;
   bool valid = true;
-  while (valid && parser.Get(&property, &value, &value_set)) {
+  while (valid && parser.Get(&property, &value, &str_value, &value_set)) {
     for (size_t i = 0; i < sizeof(features)/sizeof(Feature); i++) {
       if (property == features[i].name) {
         if (features[i].option == 0 && features[i].combo_option) {
           i++;
           for (; i < sizeof(features)/sizeof(Feature) && features[i].combo_option; i++) {
-            if (!SetFeature(property, features[i], value, value_set)) {
+            if (!SetFeature(property, features[i], value, str_value, value_set)) {
               valid = false;
               break;
             }
@@ -327,7 +426,7 @@ bool Config::SetFromProperties() {
             break;
           }
         } else {
-          if (!SetFeature(property, features[i], value, value_set)) {
+          if (!SetFeature(property, features[i], value, str_value, value_set)) {
             valid = false;
             break;
           }
@@ -359,6 +458,22 @@ bool Config::SetFromProperties() {
     if ((options & FILL_ON_FREE) && fill_on_free_bytes == 0) {
       fill_on_free_bytes = SIZE_MAX;
     }
+
+    // Use the default trace file if only record_allocs was specified.
+    if ((options & RECORD_ALLOCS) && record_allocs_file.empty()) {
+      record_allocs_file = PropertyParser::DEFAULT_RECORD_ALLOCS_FILE;
+    }
+
+    if ((options & HEAP_SNAPSHOT) && heap_snapshot_file.empty()) {
+      heap_snapshot_file = PropertyParser::DEFAULT_HEAP_SNAPSHOT_FILE;
+    }
+    heap_snapshot_signal = snapshot_signal;
+
+    // If sampling or snapshots are enabled without one of the backtrace
+    // options, use the default number of frames.
+    if ((options & (SAMPLE_ALLOCS | HEAP_SNAPSHOT)) && backtrace_frames == 0) {
+      backtrace_frames = 16;
+    }
   } else {
     parser.LogUsage();
   }
@@ -31,6 +31,8 @@
 
 #include <stdint.h>
 
+#include <string>
+
 constexpr uint64_t FRONT_GUARD = 0x1;
 constexpr uint64_t REAR_GUARD = 0x2;
 constexpr uint64_t BACKTRACE = 0x4;
@@ -40,6 +42,9 @@ constexpr uint64_t EXPAND_ALLOC = 0x20;
 constexpr uint64_t FREE_TRACK = 0x40;
 constexpr uint64_t TRACK_ALLOCS = 0x80;
 constexpr uint64_t LEAK_TRACK = 0x100;
+constexpr uint64_t SAMPLE_ALLOCS = 0x200;
+constexpr uint64_t RECORD_ALLOCS = 0x400;
+constexpr uint64_t HEAP_SNAPSHOT = 0x800;
 
 // In order to guarantee posix compliance, set the minimum alignment
 // to 8 bytes for 32 bit systems and 16 bytes for 64 bit systems.
@@ -49,8 +54,12 @@ constexpr size_t MINIMUM_ALIGNMENT_BYTES = 16;
 constexpr size_t MINIMUM_ALIGNMENT_BYTES = 8;
 #endif
 
+// The maximum number of frames that can be captured for a backtrace.
+constexpr size_t MAX_BACKTRACE_FRAMES = 256;
+
 // If only one or more of these options is set, then no special header is needed.
-constexpr uint64_t NO_HEADER_OPTIONS = FILL_ON_ALLOC | FILL_ON_FREE | EXPAND_ALLOC;
+constexpr uint64_t NO_HEADER_OPTIONS =
+    FILL_ON_ALLOC | FILL_ON_FREE | EXPAND_ALLOC | RECORD_ALLOCS;
 
 struct Config {
   bool SetFromProperties();
@@ -71,6 +80,15 @@ struct Config {
   size_t free_track_allocations = 0;
   size_t free_track_backtrace_num_frames = 0;
 
+  size_t sample_bytes = 0;
+  int sample_dump_signal = 0;
+
+  size_t record_allocs_num_entries = 0;
+  std::string record_allocs_file;
+
+  int heap_snapshot_signal = 0;
+  std::string heap_snapshot_file;
+
   uint64_t options = 0;
   uint8_t fill_alloc_value;
   uint8_t fill_free_value;
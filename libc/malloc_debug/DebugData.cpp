@@ -35,6 +35,9 @@
 #include "FreeTrackData.h"
 #include "GuardData.h"
 #include "malloc_debug.h"
+#include "RecordData.h"
+#include "SampleData.h"
+#include "SnapshotData.h"
 #include "TrackData.h"
 
 bool DebugData::Initialize() {
@@ -75,10 +78,28 @@ bool DebugData::Initialize() {
     if (config_.options & TRACK_ALLOCS) {
       track.reset(new TrackData());
     }
+
+    if (config_.options & SAMPLE_ALLOCS) {
+      sample.reset(new SampleData(config_));
+      if (!sample->Initialize(config_)) {
+        return false;
+      }
+    }
+
+    if (config_.options & HEAP_SNAPSHOT) {
+      snapshot.reset(new SnapshotData(config_));
+      if (!snapshot->Initialize(config_)) {
+        return false;
+      }
+    }
   }
 
   if (config_.options & EXPAND_ALLOC) {
     extra_bytes_ += config_.expand_alloc_bytes;
   }
+
+  if (config_.options & RECORD_ALLOCS) {
+    record.reset(new RecordData(config_));
+  }
   return true;
 }
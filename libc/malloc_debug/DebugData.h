@@ -41,6 +41,9 @@
 #include "FreeTrackData.h"
 #include "GuardData.h"
 #include "malloc_debug.h"
+#include "RecordData.h"
+#include "SampleData.h"
+#include "SnapshotData.h"
 #include "TrackData.h"
 
 class DebugData {
@@ -62,9 +65,9 @@ class DebugData {
     return reinterpret_cast<Header*>(value - pointer_offset_);
   }
 
-  BacktraceHeader* GetAllocBacktrace(const Header* header) {
+  uint32_t* GetAllocBacktraceId(const Header* header) {
     uintptr_t value = reinterpret_cast<uintptr_t>(header);
-    return reinterpret_cast<BacktraceHeader*>(value + backtrace->alloc_offset());
+    return reinterpret_cast<uint32_t*>(value + backtrace->alloc_offset());
   }
 
   uint8_t* GetFrontGuard(const Header* header) {
@@ -87,6 +90,9 @@ class DebugData {
   std::unique_ptr<FrontGuardData> front_guard;
   std::unique_ptr<RearGuardData> rear_guard;
   std::unique_ptr<FreeTrackData> free_track;
+  std::unique_ptr<SampleData> sample;
+  std::unique_ptr<RecordData> record;
+  std::unique_ptr<SnapshotData> snapshot;
 
  private:
   size_t extra_bytes_ = 0;
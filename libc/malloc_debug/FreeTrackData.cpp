@@ -26,7 +26,14 @@
  * SUCH DAMAGE.
  */
 
+#include <pthread.h>
 #include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <private/ScopedPthreadMutexLocker.h>
 
 #include "backtrace.h"
 #include "Config.h"
@@ -35,15 +42,117 @@
 #include "debug_log.h"
 #include "FreeTrackData.h"
 #include "malloc_debug.h"
+#include "ThreadData.h"
+
+extern DebugData* g_debug;
 
 FreeTrackData::FreeTrackData(const Config& config)
     : backtrace_num_frames_(config.free_track_backtrace_num_frames) {
-  cmp_mem_.resize(4096);
-  memset(cmp_mem_.data(), config.fill_free_value, cmp_mem_.size());
+  ring_allocations_ = config.free_track_allocations;
+  batch_allocations_ = std::max<size_t>(1, ring_allocations_ / 4);
+}
+
+FreeTrackData::~FreeTrackData() {
+  ScopedDisableDebugCalls disable;
+
+  for (auto ring : rings_) {
+    g_dispatch->free(ring);
+  }
+  rings_.clear();
+}
+
+FreeTrackData::Ring* FreeTrackData::GetRing() {
+  ThreadData* thread_data = ThreadDataGetOrCreate();
+  if (thread_data == nullptr) {
+    return nullptr;
+  }
+  Ring* ring = reinterpret_cast<Ring*>(thread_data->free_track_ring);
+  if (__predict_true(ring != nullptr)) {
+    return ring;
+  }
+
+  // Allocate the ring, its entries and the backtrace slab all at once.
+  size_t capacity = ring_allocations_ + batch_allocations_;
+  size_t ring_bytes = BIONIC_ALIGN(sizeof(Ring), sizeof(uintptr_t));
+  size_t headers_bytes = capacity * sizeof(const Header*);
+  size_t num_frames_bytes = capacity * sizeof(size_t);
+  size_t frames_bytes = capacity * backtrace_num_frames_ * sizeof(uintptr_t);
+  uint8_t* data = reinterpret_cast<uint8_t*>(
+      g_dispatch->malloc(ring_bytes + headers_bytes + num_frames_bytes + frames_bytes));
+  if (data == nullptr) {
+    return nullptr;
+  }
+  ring = reinterpret_cast<Ring*>(data);
+  pthread_mutex_init(&ring->mutex, nullptr);
+  ring->owner = this;
+  ring->head = 0;
+  ring->count = 0;
+  ring->headers = reinterpret_cast<const Header**>(&data[ring_bytes]);
+  ring->num_frames = reinterpret_cast<size_t*>(&data[ring_bytes + headers_bytes]);
+  ring->frames = reinterpret_cast<uintptr_t*>(
+      &data[ring_bytes + headers_bytes + num_frames_bytes]);
+
+  {
+    ScopedDisableDebugCalls disable;
+
+    ScopedPthreadMutexLocker scoped(&rings_mutex_);
+    rings_.push_back(ring);
+  }
+  thread_data->free_track_ring = ring;
+  return ring;
+}
+
+void FreeTrackData::DestroyRing(void* data) {
+  Ring* ring = reinterpret_cast<Ring*>(data);
+  FreeTrackData* free_track = ring->owner;
+
+  {
+    ScopedDisableDebugCalls disable;
+
+    ScopedPthreadMutexLocker scoped(&free_track->rings_mutex_);
+    auto it = std::find(free_track->rings_.begin(), free_track->rings_.end(), ring);
+    if (it != free_track->rings_.end()) {
+      free_track->rings_.erase(it);
+    }
+  }
+
+  // Nothing else can find the ring now, flush it without the lock.
+  free_track->VerifyOldest(*g_debug, ring, ring->count);
+  g_dispatch->free(ring);
+}
+
+// Returns true if all of the bytes are set to value, comparing a word
+// at a time.
+static bool IsFilled(const uint8_t* memory, size_t bytes, uint8_t value) {
+  while (bytes > 0 && (reinterpret_cast<uintptr_t>(memory) & (sizeof(uintptr_t) - 1)) != 0) {
+    if (*memory++ != value) {
+      return false;
+    }
+    bytes--;
+  }
+
+  uintptr_t pattern = value * (UINTPTR_MAX / 0xff);
+  const uintptr_t* words = reinterpret_cast<const uintptr_t*>(memory);
+  size_t num_words = bytes / sizeof(uintptr_t);
+  for (size_t i = 0; i < num_words; i++) {
+    if (words[i] != pattern) {
+      return false;
+    }
+  }
+
+  memory += num_words * sizeof(uintptr_t);
+  bytes -= num_words * sizeof(uintptr_t);
+  for (size_t i = 0; i < bytes; i++) {
+    if (memory[i] != value) {
+      return false;
+    }
+  }
+  return true;
 }
 
 void FreeTrackData::LogFreeError(DebugData& debug, const Header* header,
-                                 const uint8_t* pointer) {
+                                 const uint8_t* pointer, const uintptr_t* frames,
+                                 size_t num_frames) {
   ScopedDisableDebugCalls disable;
 
   error_log(LOG_DIVIDER);
@@ -54,82 +163,89 @@ void FreeTrackData::LogFreeError(DebugData& debug, const Header* header,
       error_log("  pointer[%zu] = 0x%02x (expected 0x%02x)", i, pointer[i], fill_free_value);
     }
   }
-  auto back_iter = backtraces_.find(header);
-  if (back_iter != backtraces_.end()) {
-    const BacktraceHeader* back_header = back_iter->second;
+  if (num_frames > 0) {
     error_log("Backtrace at time of free:");
-    backtrace_log(&back_header->frames[0], back_header->num_frames);
+    backtrace_log(frames, num_frames);
   }
   error_log(LOG_DIVIDER);
 }
 
 void FreeTrackData::VerifyAndFree(DebugData& debug, const Header* header,
-                                  const void* pointer) {
-  ScopedDisableDebugCalls disable;
-
+                                  const void* pointer, const uintptr_t* frames,
+                                  size_t num_frames) {
   const uint8_t* memory = reinterpret_cast<const uint8_t*>(pointer);
   size_t bytes = header->usable_size;
   bytes = (bytes < debug.config().fill_on_free_bytes) ? bytes : debug.config().fill_on_free_bytes;
-  while (bytes > 0) {
-    size_t bytes_to_cmp = (bytes < cmp_mem_.size()) ? bytes : cmp_mem_.size();
-    if (memcmp(memory, cmp_mem_.data(), bytes_to_cmp) != 0) {
-      LogFreeError(debug, header, reinterpret_cast<const uint8_t*>(pointer));
-      break;
-    }
-    bytes -= bytes_to_cmp;
-    memory = &memory[bytes_to_cmp];
-  }
-  auto back_iter = backtraces_.find(header);
-  if (back_iter != backtraces_.end()) {
-    g_dispatch->free(reinterpret_cast<void*>(back_iter->second));
-    backtraces_.erase(header);
+  if (!IsFilled(memory, bytes, debug.config().fill_free_value)) {
+    LogFreeError(debug, header, memory, frames, num_frames);
   }
   g_dispatch->free(header->orig_pointer);
 }
 
+void FreeTrackData::VerifyOldest(DebugData& debug, Ring* ring, size_t num) {
+  size_t capacity = ring_allocations_ + batch_allocations_;
+  for (size_t i = 0; i < num; i++) {
+    size_t index = ring->head;
+    const Header* header = ring->headers[index];
+    VerifyAndFree(debug, header, debug.GetPointer(header), GetFrames(ring, index),
+                  ring->num_frames[index]);
+    ring->head = (ring->head + 1) % capacity;
+  }
+  ring->count -= num;
+}
+
 void FreeTrackData::Add(DebugData& debug, const Header* header) {
-  // Make sure the stl calls below don't call the debug_XXX functions.
-  ScopedDisableDebugCalls disable;
+  Ring* ring = GetRing();
+  if (ring == nullptr) {
+    // No quarantine available for this thread, verify right away.
+    VerifyAndFree(debug, header, debug.GetPointer(header), nullptr, 0);
+    return;
+  }
 
-  pthread_mutex_lock(&mutex_);
-  if (list_.size() == debug.config().free_track_allocations) {
-    const Header* old_header = list_.back();
-    VerifyAndFree(debug, old_header, debug.GetPointer(old_header));
-    list_.pop_back();
+  ScopedPthreadMutexLocker scoped(&ring->mutex);
+  size_t capacity = ring_allocations_ + batch_allocations_;
+  if (ring->count == capacity) {
+    VerifyOldest(debug, ring, batch_allocations_);
   }
 
+  size_t index = (ring->head + ring->count) % capacity;
+  ring->headers[index] = header;
   // Only log the free backtrace if we are using the free track feature.
+  ring->num_frames[index] = 0;
   if (backtrace_num_frames_ > 0) {
-    BacktraceHeader* back_header = reinterpret_cast<BacktraceHeader*>(
-      g_dispatch->malloc(sizeof(BacktraceHeader) + backtrace_num_frames_ * sizeof(uintptr_t)));
-    if (back_header) {
-      back_header->num_frames = backtrace_get(&back_header->frames[0], backtrace_num_frames_);
-      backtraces_[header] = back_header;
-    }
+    uintptr_t* frames = &ring->frames[index * backtrace_num_frames_];
+    ring->num_frames[index] = backtrace_get(frames, backtrace_num_frames_);
   }
-  list_.push_front(header);
-
-  pthread_mutex_unlock(&mutex_);
+  ring->count++;
 }
 
 void FreeTrackData::VerifyAll(DebugData& debug) {
   // Make sure the stl calls below don't call the debug_XXX functions.
   ScopedDisableDebugCalls disable;
 
-  for (const auto& header : list_) {
-    VerifyAndFree(debug, header, debug.GetPointer(header));
+  ScopedPthreadMutexLocker scoped(&rings_mutex_);
+  for (auto ring : rings_) {
+    ScopedPthreadMutexLocker ring_scoped(&ring->mutex);
+    VerifyOldest(debug, ring, ring->count);
   }
-  list_.clear();
 }
 
 void FreeTrackData::LogBacktrace(const Header* header) {
   ScopedDisableDebugCalls disable;
 
-  auto back_iter = backtraces_.find(header);
-  if (back_iter == backtraces_.end()) {
-    return;
+  size_t capacity = ring_allocations_ + batch_allocations_;
+  ScopedPthreadMutexLocker scoped(&rings_mutex_);
+  for (auto ring : rings_) {
+    ScopedPthreadMutexLocker ring_scoped(&ring->mutex);
+    for (size_t i = 0; i < ring->count; i++) {
+      size_t index = (ring->head + i) % capacity;
+      if (ring->headers[index] == header) {
+        if (ring->num_frames[index] > 0) {
+          error_log("Backtrace of original free:");
+          backtrace_log(GetFrames(ring, index), ring->num_frames[index]);
+        }
+        return;
+      }
+    }
   }
-
-  error_log("Backtrace of original free:");
-  backtrace_log(&back_iter->second->frames[0], back_iter->second->num_frames);
 }
@@ -32,8 +32,6 @@
 #include <stdint.h>
 #include <pthread.h>
 
-#include <deque>
-#include <unordered_map>
 #include <vector>
 
 #include <private/bionic_macros.h>
@@ -42,12 +40,16 @@
 struct Header;
 class DebugData;
 struct Config;
-struct BacktraceHeader;
 
+// Freed allocations are kept in a per-thread quarantine ring, so the free
+// path only takes an uncontended lock. Once a ring holds more than
+// free_track_allocations entries, the oldest batch of entries is verified
+// and released at once. The free backtraces are kept in a slab that is
+// allocated along with the ring.
 class FreeTrackData {
  public:
   FreeTrackData(const Config& config);
-  virtual ~FreeTrackData() = default;
+  virtual ~FreeTrackData();
 
   void Add(DebugData& debug, const Header* header);
 
@@ -55,15 +57,39 @@ class FreeTrackData {
 
   void LogBacktrace(const Header* header);
 
+  // Called when the thread that owns the ring exits.
+  static void DestroyRing(void* data);
+
  private:
-  void LogFreeError(DebugData& debug, const Header* header, const uint8_t* pointer);
-  void VerifyAndFree(DebugData& debug, const Header* header, const void* pointer);
+  struct Ring {
+    pthread_mutex_t mutex;
+    FreeTrackData* owner;
+    // Index of the oldest entry, and number of entries.
+    size_t head;
+    size_t count;
+    const Header** headers;
+    size_t* num_frames;
+    uintptr_t* frames;
+  };
+
+  Ring* GetRing();
+  void VerifyOldest(DebugData& debug, Ring* ring, size_t num);
+  const uintptr_t* GetFrames(Ring* ring, size_t index) {
+    return &ring->frames[index * backtrace_num_frames_];
+  }
+
+  void LogFreeError(DebugData& debug, const Header* header, const uint8_t* pointer,
+                    const uintptr_t* frames, size_t num_frames);
+  void VerifyAndFree(DebugData& debug, const Header* header, const void* pointer,
+                     const uintptr_t* frames, size_t num_frames);
 
-  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
-  std::deque<const Header*> list_;
-  std::vector<uint8_t> cmp_mem_;
-  std::unordered_map<const Header*, BacktraceHeader*> backtraces_;
   size_t backtrace_num_frames_;
+  // Number of entries each ring keeps, and how many are verified at once.
+  size_t ring_allocations_;
+  size_t batch_allocations_;
+
+  pthread_mutex_t rings_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  std::vector<Ring*> rings_;
 
   DISALLOW_COPY_AND_ASSIGN(FreeTrackData);
 };
@@ -34,11 +34,17 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <vector>
 
+#include <private/ScopedPthreadMutexLocker.h>
+
 #include "debug_disable.h"
 #include "MapData.h"
 
+// Bounds the memory used to remember pcs that are not in any map.
+static constexpr size_t kMaxMisses = 4096;
+
 // Format of /proc/<PID>/maps:
 //   6f000000-6f01e000 rwxp 00000000 00:0c 16389419   /system/lib/libcomposer.so
 static MapEntry* parse_line(char* line) {
@@ -114,26 +120,71 @@ static void read_loadbase(MapEntry* entry) {
   }
 }
 
-bool MapData::Initialize() {
-  ScopedDisableDebugCalls disable;
+static int add_to_generation(struct dl_phdr_info* info, size_t, void* data) {
+  uintptr_t* generation = reinterpret_cast<uintptr_t*>(data);
+  *generation = *generation * 31 + info->dlpi_addr + 1;
+  return 0;
+}
 
+uintptr_t MapData::LoadGeneration() {
+  uintptr_t generation = 0;
+  dl_iterate_phdr(add_to_generation, &generation);
+  return generation;
+}
+
+bool MapData::ReadMaps() {
   FILE* fp = fopen("/proc/self/maps", "re");
   if (fp == nullptr) {
     return false;
   }
 
+  std::vector<MapEntry*> entries;
   std::vector<char> buffer(1024);
   while (fgets(buffer.data(), buffer.size(), fp) != nullptr) {
     MapEntry* entry = parse_line(buffer.data());
     if (entry == nullptr) {
+      for (auto* new_entry : entries) {
+        delete new_entry;
+      }
+      fclose(fp);
       return false;
     }
-    entries_.push_back(entry);
+    entries.push_back(entry);
   }
   fclose(fp);
+
+  std::sort(entries.begin(), entries.end(), [](MapEntry* a, MapEntry* b) {
+    return a->start < b->start;
+  });
+
+  // Keep the old entries that are unchanged, retire the rest.
+  std::vector<bool> kept(entries_.size(), false);
+  for (auto& entry : entries) {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), entry->start,
+                               [](MapEntry* a, uintptr_t start) { return a->start < start; });
+    if (it != entries_.end() && (*it)->start == entry->start && (*it)->end == entry->end &&
+        (*it)->offset == entry->offset && (*it)->name == entry->name) {
+      kept[it - entries_.begin()] = true;
+      delete entry;
+      entry = *it;
+    }
+  }
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (!kept[i]) {
+      retired_.push_back(entries_[i]);
+    }
+  }
+  entries_.swap(entries);
   return true;
 }
 
+bool MapData::Initialize() {
+  ScopedDisableDebugCalls disable;
+
+  load_generation_ = LoadGeneration();
+  return ReadMaps();
+}
+
 MapData* MapData::Create() {
   MapData* maps = new MapData();
   if (!maps->Initialize()) {
@@ -150,20 +201,57 @@ MapData::~MapData() {
     delete entry;
   }
   entries_.clear();
+  for (auto* entry : retired_) {
+    delete entry;
+  }
+  retired_.clear();
+}
+
+MapEntry* MapData::FindEntry(uintptr_t pc) {
+  // Find the last entry that starts at or before the pc.
+  auto it = std::upper_bound(entries_.begin(), entries_.end(), pc,
+                             [](uintptr_t pc, MapEntry* a) { return pc < a->start; });
+  if (it == entries_.begin()) {
+    return nullptr;
+  }
+  MapEntry* entry = *--it;
+  if (pc >= entry->end) {
+    return nullptr;
+  }
+  return entry;
 }
 
 // Find the containing map info for the PC.
 const MapEntry* MapData::find(uintptr_t pc, uintptr_t* rel_pc) {
-  for (auto* entry : entries_) {
-    if ((pc >= entry->start) && (pc < entry->end)) {
-      if (!entry->load_base_read) {
-        read_loadbase(entry);
-      }
-      if (rel_pc) {
-        *rel_pc = pc - entry->start + entry->load_base;
+  ScopedDisableDebugCalls disable;
+
+  ScopedPthreadMutexLocker scoped(&mutex_);
+  MapEntry* entry = FindEntry(pc);
+  if ((entry == nullptr || entry->name.empty()) && misses_.count(pc) == 0) {
+    // The pc might be in an object that was loaded after the maps were
+    // read, in which case it could also fall in an old anonymous map.
+    uintptr_t generation = LoadGeneration();
+    if (generation != load_generation_ && ReadMaps()) {
+      load_generation_ = generation;
+      misses_.clear();
+      entry = FindEntry(pc);
+    }
+    if (entry == nullptr || entry->name.empty()) {
+      if (misses_.size() >= kMaxMisses) {
+        misses_.clear();
       }
-      return entry;
+      misses_.insert(pc);
+    }
+  }
+
+  if (entry != nullptr) {
+    if (!entry->load_base_read) {
+      read_loadbase(entry);
+    }
+    if (rel_pc) {
+      *rel_pc = pc - entry->start + entry->load_base;
     }
+    return entry;
   }
   if (rel_pc) {
     *rel_pc = pc;
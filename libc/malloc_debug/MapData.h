@@ -29,10 +29,12 @@
 #ifndef DEBUG_MALLOC_MAPDATA_H
 #define DEBUG_MALLOC_MAPDATA_H
 
+#include <pthread.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <private/bionic_macros.h>
@@ -49,18 +51,36 @@ struct MapEntry {
   std::string name;
 };
 
+// The entries are kept sorted by start address. When a pc is not found,
+// and the set of objects loaded by the linker has changed since the maps
+// were read, the maps are read again. Entries that did not change are
+// kept, so their load base is not recomputed, and entries that went away
+// are retired rather than freed so that returned pointers stay valid.
+// A pc that is still not found after that is remembered, and looking it up
+// again does not walk the linker's list until another miss rereads the maps.
 class MapData {
  public:
   static MapData* Create();
-  ~MapData();
+  virtual ~MapData();
 
   const MapEntry* find(uintptr_t pc, uintptr_t* rel_pc = nullptr);
 
- private:
+ protected:
   MapData() = default;
   bool Initialize();
 
+  // Changes whenever an object is loaded or unloaded by the linker.
+  virtual uintptr_t LoadGeneration();
+
+ private:
+  bool ReadMaps();
+  MapEntry* FindEntry(uintptr_t pc);
+
+  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
   std::vector<MapEntry*> entries_;
+  std::vector<MapEntry*> retired_;
+  uintptr_t load_generation_ = 0;
+  std::unordered_set<uintptr_t> misses_;
 
   DISALLOW_COPY_AND_ASSIGN(MapData);
 };
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <private/ScopedPthreadMutexLocker.h>
+
+#include "Config.h"
+#include "debug_disable.h"
+#include "debug_log.h"
+#include "malloc_debug.h"
+#include "RecordData.h"
+#include "ThreadData.h"
+
+RecordData::RecordData(const Config& config)
+    : num_entries_(config.record_allocs_num_entries), file_(config.record_allocs_file),
+      next_sequence_(0) {
+}
+
+RecordData::~RecordData() {
+  ScopedDisableDebugCalls disable;
+
+  for (auto buffer : buffers_) {
+    g_dispatch->free(buffer);
+  }
+  buffers_.clear();
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+RecordData::Buffer* RecordData::GetBuffer() {
+  ThreadData* thread_data = ThreadDataGetOrCreate();
+  if (thread_data == nullptr) {
+    return nullptr;
+  }
+  Buffer* buffer = reinterpret_cast<Buffer*>(thread_data->record_buffer);
+  if (__predict_true(buffer != nullptr)) {
+    return buffer;
+  }
+
+  buffer = reinterpret_cast<Buffer*>(
+      g_dispatch->malloc(sizeof(Buffer) + num_entries_ * sizeof(RecordEntry)));
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+  pthread_mutex_init(&buffer->mutex, nullptr);
+  buffer->owner = this;
+  buffer->pid = getpid();
+  buffer->tid = gettid();
+  buffer->count = 0;
+
+  {
+    ScopedDisableDebugCalls disable;
+
+    ScopedPthreadMutexLocker scoped(&buffers_mutex_);
+    buffers_.push_back(buffer);
+  }
+  thread_data->record_buffer = buffer;
+  return buffer;
+}
+
+void RecordData::DestroyBuffer(void* data) {
+  Buffer* buffer = reinterpret_cast<Buffer*>(data);
+  RecordData* record = buffer->owner;
+
+  {
+    ScopedDisableDebugCalls disable;
+
+    ScopedPthreadMutexLocker scoped(&record->buffers_mutex_);
+    auto it = std::find(record->buffers_.begin(), record->buffers_.end(), buffer);
+    if (it != record->buffers_.end()) {
+      record->buffers_.erase(it);
+    }
+  }
+
+  // Nothing else can find the buffer now, flush it without the lock.
+  record->Flush(buffer);
+  g_dispatch->free(buffer);
+}
+
+void RecordData::AddEntry(RecordOp op, const void* pointer, size_t size, uint64_t extra) {
+  Buffer* buffer = GetBuffer();
+  if (buffer == nullptr) {
+    return;
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  ScopedPthreadMutexLocker scoped(&buffer->mutex);
+  pid_t pid = getpid();
+  if (__predict_false(buffer->pid != pid)) {
+    buffer->pid = pid;
+    buffer->tid = gettid();
+    buffer->count = 0;
+  }
+
+  RecordEntry* entry = &buffer->entries[buffer->count++];
+  entry->sequence = next_sequence_.fetch_add(1, std::memory_order_relaxed);
+  entry->timestamp_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  entry->pointer = reinterpret_cast<uintptr_t>(pointer);
+  entry->size = size;
+  entry->extra = extra;
+  entry->tid = buffer->tid;
+  entry->op = op;
+
+  if (buffer->count == num_entries_) {
+    Flush(buffer);
+  }
+}
+
+bool RecordData::OpenFile() {
+  pid_t pid = getpid();
+  if (fd_ != -1 && fd_pid_ == pid) {
+    return true;
+  }
+  if (fd_ != -1) {
+    // This is a forked child, start its own trace.
+    close(fd_);
+  }
+  fd_pid_ = pid;
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s.%d", file_.c_str(), pid);
+  fd_ = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ == -1) {
+    error_log("Cannot create record_allocs file %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  RecordFileHeader header;
+  memcpy(header.magic, RECORD_FILE_MAGIC, sizeof(header.magic));
+  header.version = RECORD_FILE_VERSION;
+  header.entry_size = sizeof(RecordEntry);
+  if (TEMP_FAILURE_RETRY(write(fd_, &header, sizeof(header))) != sizeof(header)) {
+    error_log("Cannot write record_allocs file %s: %s", path, strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+// The buffer mutex must be held, or the buffer must be unreachable.
+void RecordData::Flush(Buffer* buffer) {
+  if (buffer->count == 0) {
+    return;
+  }
+  if (buffer->pid != getpid()) {
+    buffer->count = 0;
+    return;
+  }
+
+  ScopedPthreadMutexLocker scoped(&file_mutex_);
+  if (OpenFile()) {
+    // The file is opened with O_APPEND, so the write of every buffer ends
+    // up in one piece.
+    size_t bytes = buffer->count * sizeof(RecordEntry);
+    if (TEMP_FAILURE_RETRY(write(fd_, buffer->entries, bytes)) != static_cast<ssize_t>(bytes)) {
+      error_log("Failed to write record_allocs entries: %s", strerror(errno));
+    }
+  }
+  buffer->count = 0;
+}
+
+void RecordData::FlushAll() {
+  ScopedDisableDebugCalls disable;
+
+  pid_t pid = getpid();
+  ScopedPthreadMutexLocker scoped(&buffers_mutex_);
+  for (auto buffer : buffers_) {
+    // After a fork, the buffers of the other threads belong to the parent.
+    if (buffer->pid != pid) {
+      continue;
+    }
+    ScopedPthreadMutexLocker buffer_scoped(&buffer->mutex);
+    Flush(buffer);
+  }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef DEBUG_MALLOC_RECORDDATA_H
+#define DEBUG_MALLOC_RECORDDATA_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <private/bionic_macros.h>
+
+#include "record_format.h"
+
+// Forward declarations.
+struct Config;
+
+// Records every allocation call into a per-thread buffer. A full buffer
+// is appended to the trace file with a single write, and so are the
+// buffers of exiting threads. The remaining buffers are written when the
+// program terminates.
+class RecordData {
+ public:
+  RecordData(const Config& config);
+  virtual ~RecordData();
+
+  void AddEntry(RecordOp op, const void* pointer, size_t size, uint64_t extra);
+
+  void FlushAll();
+
+  // Called when the thread that owns the buffer exits.
+  static void DestroyBuffer(void* data);
+
+ private:
+  struct Buffer {
+    pthread_mutex_t mutex;
+    RecordData* owner;
+    // The entries are dropped in a forked child, the parent writes them.
+    pid_t pid;
+    pid_t tid;
+    size_t count;
+    RecordEntry entries[0];
+  };
+
+  Buffer* GetBuffer();
+  void Flush(Buffer* buffer);
+  bool OpenFile();
+
+  size_t num_entries_;
+  std::string file_;
+
+  std::atomic<uint64_t> next_sequence_;
+
+  pthread_mutex_t buffers_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  std::vector<Buffer*> buffers_;
+
+  // The file is reopened when the process forks, so that every process
+  // writes its own trace.
+  pthread_mutex_t file_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  int fd_ = -1;
+  pid_t fd_pid_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordData);
+};
+
+#endif // DEBUG_MALLOC_RECORDDATA_H
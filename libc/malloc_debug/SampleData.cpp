@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "backtrace.h"
+#include "Config.h"
+#include "DebugData.h"
+#include "debug_disable.h"
+#include "debug_log.h"
+#include "malloc_debug.h"
+#include "SampleData.h"
+#include "TrackData.h"
+
+extern DebugData* g_debug;
+
+SampleData::SampleData(const Config& config) : sample_bytes_(config.sample_bytes) {
+}
+
+SampleData::~SampleData() {
+}
+
+static SampleData* g_sample_data = nullptr;
+
+static void DumpRequest(int, siginfo_t*, void*) {
+  g_sample_data->set_dump_requested(true);
+}
+
+bool SampleData::Initialize(const Config& config) {
+  g_sample_data = this;
+
+  struct sigaction dump_act;
+  memset(&dump_act, 0, sizeof(dump_act));
+
+  dump_act.sa_sigaction = DumpRequest;
+  dump_act.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&dump_act.sa_mask);
+  if (sigaction(config.sample_dump_signal, &dump_act, nullptr) != 0) {
+    error_log("Unable to set up sample dump signal function: %s", strerror(errno));
+    return false;
+  }
+  info_log("%s: Run: 'kill -%d %d' to dump the sampled heap profile.", getprogname(),
+           config.sample_dump_signal, getpid());
+  return true;
+}
+
+void SampleData::DestroyThreadState(void* data) {
+  g_dispatch->free(data);
+}
+
+size_t SampleData::NextSampleBytes(ThreadState* state) {
+  // xorshift64*, good enough for picking sample points and needs no locking.
+  uint64_t x = state->random_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  state->random_state = x;
+  x *= 0x2545f4914f6cdd1dULL;
+
+  // Uniform value in (0, 1], then an exponential variate with the
+  // requested mean.
+  double u = (static_cast<double>(x >> 11) + 1.0) / 9007199254740992.0;
+  double next = -log(u) * sample_bytes_;
+  if (next >= static_cast<double>(SIZE_MAX)) {
+    return SIZE_MAX;
+  }
+  return static_cast<size_t>(next) + 1;
+}
+
+bool SampleData::SampleSlow(size_t bytes) {
+  ThreadData* thread_data = ThreadDataGetOrCreate();
+  if (thread_data == nullptr) {
+    return false;
+  }
+  ThreadState* state = reinterpret_cast<ThreadState*>(thread_data->sample_state);
+  if (state == nullptr) {
+    // First allocation on this thread.
+    state = reinterpret_cast<ThreadState*>(g_dispatch->malloc(sizeof(ThreadState)));
+    if (state == nullptr) {
+      return false;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    state->random_state = (static_cast<uint64_t>(gettid()) << 32) ^
+        reinterpret_cast<uintptr_t>(state) ^ ts.tv_nsec;
+    if (state->random_state == 0) {
+      state->random_state = 1;
+    }
+    state->bytes_until_sample = NextSampleBytes(state);
+    thread_data->sample_state = state;
+
+    if (bytes < state->bytes_until_sample) {
+      state->bytes_until_sample -= bytes;
+      return false;
+    }
+  }
+
+  // This allocation crossed the sample point, start a new interval.
+  state->bytes_until_sample = NextSampleBytes(state);
+
+  // A dump requested by the signal handler is done here since this is
+  // the first place where it is safe to do so, and it keeps the cost off
+  // of the unsampled allocations.
+  if (dump_requested_) {
+    dump_requested_ = 0;
+    DisplaySamples(*g_debug);
+  }
+  return true;
+}
+
+double SampleData::EstimateCount(size_t size, size_t sample_bytes) {
+  double probability = -expm1(-static_cast<double>(size) / sample_bytes);
+  if (probability <= 0.0) {
+    return 0.0;
+  }
+  return 1.0 / probability;
+}
+
+double SampleData::EstimateBytes(size_t size, size_t sample_bytes) {
+  double probability = -expm1(-static_cast<double>(size) / sample_bytes);
+  if (probability <= 0.0) {
+    return 0.0;
+  }
+  return size / probability;
+}
+
+// The estimates are only rounded for display, rounding each sample would
+// bias the totals by up to half an allocation per sample.
+static size_t RoundEstimate(double estimate) {
+  return static_cast<size_t>(estimate + 0.5);
+}
+
+struct SampleTotals {
+  size_t samples = 0;
+  size_t bytes = 0;
+  double estimated_count = 0.0;
+  double estimated_bytes = 0.0;
+};
+
+void SampleData::DisplaySamples(DebugData& debug) {
+  ScopedDisableDebugCalls disable;
+
+  // Aggregate while holding the track lock, log after releasing it.
+  // Copy the frames out since the stacks could go away once the lock
+  // is released.
+  std::map<uint32_t, SampleTotals> stack_totals;
+  std::map<uint32_t, std::vector<uintptr_t>> stacks;
+  debug.track->ForEach([&](const Header* header) {
+    uint32_t backtrace_id = *debug.GetAllocBacktraceId(header);
+    if (backtrace_id == 0) {
+      return;
+    }
+    SampleTotals& totals = stack_totals[backtrace_id];
+    if (totals.samples == 0) {
+      size_t num_frames;
+      const uintptr_t* frames = debug.backtrace->GetFrames(backtrace_id, &num_frames);
+      stacks[backtrace_id].assign(frames, frames + num_frames);
+    }
+    size_t size = header->real_size();
+    totals.samples++;
+    totals.bytes += size;
+    totals.estimated_count += EstimateCount(size, sample_bytes_);
+    totals.estimated_bytes += EstimateBytes(size, sample_bytes_);
+  });
+
+  typedef std::pair<const std::vector<uintptr_t>*, SampleTotals> StackEntry;
+  std::vector<StackEntry> list;
+  SampleTotals all;
+  for (const auto& entry : stack_totals) {
+    list.push_back(std::make_pair(&stacks[entry.first], entry.second));
+    all.samples += entry.second.samples;
+    all.bytes += entry.second.bytes;
+    all.estimated_count += entry.second.estimated_count;
+    all.estimated_bytes += entry.second.estimated_bytes;
+  }
+  // Sort by the estimated number of live bytes.
+  std::sort(list.begin(), list.end(), [](const StackEntry& a, const StackEntry& b) {
+    return a.second.estimated_bytes > b.second.estimated_bytes;
+  });
+
+  info_log("+++ %s sampled heap profile: %zu samples of %zu bytes, sample_bytes %zu",
+           getprogname(), all.samples, all.bytes, sample_bytes_);
+  info_log("+++ %s estimated live heap: %zu allocations, %zu bytes", getprogname(),
+           RoundEstimate(all.estimated_count), RoundEstimate(all.estimated_bytes));
+  size_t stack_num = 0;
+  for (const auto& entry : list) {
+    info_log("+++ %s stack %zu of %zu: %zu samples of %zu bytes, estimated %zu allocations, "
+             "%zu bytes", getprogname(), ++stack_num, list.size(), entry.second.samples,
+             entry.second.bytes, RoundEstimate(entry.second.estimated_count),
+             RoundEstimate(entry.second.estimated_bytes));
+    info_log("Backtrace at time of allocation:");
+    backtrace_log(entry.first->data(), entry.first->size());
+  }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef DEBUG_MALLOC_SAMPLEDATA_H
+#define DEBUG_MALLOC_SAMPLEDATA_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+
+#include <private/bionic_macros.h>
+
+#include "ThreadData.h"
+
+// Forward declarations.
+struct Config;
+class DebugData;
+
+// Decides which allocations get a backtrace when sampling is enabled.
+// Samples are taken on average once every sample_bytes allocated bytes,
+// the distance between two samples is exponentially distributed so that
+// an allocation of size N is sampled with probability 1 - exp(-N / sample_bytes).
+class SampleData {
+ public:
+  SampleData(const Config& config);
+  virtual ~SampleData();
+
+  bool Initialize(const Config& config);
+
+  // Fast path: a single decrement of the calling thread's byte counter.
+  inline bool ShouldSample(size_t bytes) {
+    ThreadData* thread_data = ThreadDataGet();
+    if (__predict_true(thread_data != nullptr)) {
+      ThreadState* state = reinterpret_cast<ThreadState*>(thread_data->sample_state);
+      if (__predict_true(state != nullptr && bytes < state->bytes_until_sample)) {
+        state->bytes_until_sample -= bytes;
+        return false;
+      }
+    }
+    return SampleSlow(bytes);
+  }
+
+  void DisplaySamples(DebugData& debug);
+
+  void set_dump_requested(bool requested) { dump_requested_ = requested; }
+
+  // Expected number of allocations, and bytes, represented by one sample
+  // of an allocation of the given size. Sum these before rounding.
+  static double EstimateCount(size_t size, size_t sample_bytes);
+  static double EstimateBytes(size_t size, size_t sample_bytes);
+
+  // Called when the thread that owns the state exits.
+  static void DestroyThreadState(void* data);
+
+ private:
+  struct ThreadState {
+    size_t bytes_until_sample;
+    uint64_t random_state;
+  };
+
+  bool SampleSlow(size_t bytes);
+  size_t NextSampleBytes(ThreadState* state);
+
+  size_t sample_bytes_ = 0;
+
+  volatile sig_atomic_t dump_requested_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(SampleData);
+};
+
+#endif // DEBUG_MALLOC_SAMPLEDATA_H
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <private/ScopedPthreadMutexLocker.h>
+
+#include "BacktraceData.h"
+#include "Config.h"
+#include "DebugData.h"
+#include "debug_disable.h"
+#include "debug_log.h"
+#include "malloc_debug.h"
+#include "SnapshotData.h"
+#include "TrackData.h"
+
+SnapshotData::SnapshotData(const Config& config) : file_(config.heap_snapshot_file) {
+}
+
+static SnapshotData* g_snapshot_data = nullptr;
+
+static void WriteRequest(int, siginfo_t*, void*) {
+  g_snapshot_data->set_write_requested(true);
+}
+
+bool SnapshotData::Initialize(const Config& config) {
+  g_snapshot_data = this;
+
+  struct sigaction write_act;
+  memset(&write_act, 0, sizeof(write_act));
+
+  write_act.sa_sigaction = WriteRequest;
+  write_act.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&write_act.sa_mask);
+  if (sigaction(config.heap_snapshot_signal, &write_act, nullptr) != 0) {
+    error_log("Unable to set up heap snapshot signal function: %s", strerror(errno));
+    return false;
+  }
+  info_log("%s: Run: 'kill -%d %d' to write a heap snapshot.", getprogname(),
+           config.heap_snapshot_signal, getpid());
+  return true;
+}
+
+// Buffers the output of a snapshot so that it is written in large chunks.
+class SnapshotWriter {
+ public:
+  SnapshotWriter(int fd) : fd_(fd) {}
+  ~SnapshotWriter() { Flush(); }
+
+  void Printf(const char* fmt, ...) __attribute__((__format__(printf, 2, 3))) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(&buffer_[used_], sizeof(buffer_) - used_, fmt, args);
+    va_end(args);
+    if (len >= 0 && static_cast<size_t>(len) >= sizeof(buffer_) - used_) {
+      // Did not fit, flush and try again.
+      Flush();
+      va_start(args, fmt);
+      len = vsnprintf(&buffer_[used_], sizeof(buffer_) - used_, fmt, args);
+      va_end(args);
+    }
+    if (len > 0) {
+      used_ = std::min(used_ + len, sizeof(buffer_) - 1);
+    }
+  }
+
+  void Write(const char* data, size_t len) {
+    Flush();
+    WriteFd(data, len);
+  }
+
+  void Flush() {
+    WriteFd(buffer_, used_);
+    used_ = 0;
+  }
+
+  bool failed() { return failed_; }
+
+ private:
+  void WriteFd(const char* data, size_t len) {
+    while (!failed_ && len > 0) {
+      ssize_t written = TEMP_FAILURE_RETRY(write(fd_, data, len));
+      if (written <= 0) {
+        failed_ = true;
+        break;
+      }
+      data += written;
+      len -= written;
+    }
+  }
+
+  int fd_;
+  bool failed_ = false;
+  size_t used_ = 0;
+  char buffer_[4096];
+};
+
+void SnapshotData::WriteSnapshot(DebugData& debug) {
+  ScopedDisableDebugCalls disable;
+
+  ScopedPthreadMutexLocker scoped(&mutex_);
+  if (!write_requested_) {
+    // Another thread wrote the snapshot already.
+    return;
+  }
+  write_requested_ = 0;
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s.%d.%zu", file_.c_str(), getpid(), num_snapshots_++);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    error_log("Cannot create heap snapshot file %s: %s", path, strerror(errno));
+    return;
+  }
+
+  // Group the allocations by backtrace. Every backtrace seen gets a
+  // reference, so that it stays valid after the shard lock is dropped.
+  struct Totals {
+    size_t num_allocations;
+    size_t bytes;
+  };
+  std::unordered_map<uint32_t, Totals> totals;
+  size_t total_memory = 0;
+  size_t total_allocations = 0;
+  debug.track->ForEachByShard([&](const Header* header) {
+    uint32_t backtrace_id = *debug.GetAllocBacktraceId(header);
+    auto iter = totals.find(backtrace_id);
+    if (iter == totals.end()) {
+      iter = totals.emplace(backtrace_id, Totals{0, 0}).first;
+      if (backtrace_id != 0) {
+        debug.backtrace->AcquireStack(backtrace_id);
+      }
+    }
+    iter->second.num_allocations++;
+    iter->second.bytes += header->real_size();
+    total_memory += header->real_size();
+    total_allocations++;
+  });
+
+  // Largest users of memory first.
+  std::vector<std::pair<uint32_t, Totals>> entries(totals.begin(), totals.end());
+  totals.clear();
+  std::sort(entries.begin(), entries.end(), [](const std::pair<uint32_t, Totals>& a,
+                                               const std::pair<uint32_t, Totals>& b) {
+    if (a.second.bytes != b.second.bytes) return a.second.bytes > b.second.bytes;
+    return a.first < b.first;
+  });
+
+  {
+    SnapshotWriter writer(fd);
+    writer.Printf("Android Native Heap Snapshot v1.0\n\n");
+    writer.Printf("Total memory: %zu\n", total_memory);
+    writer.Printf("Total allocations: %zu\n", total_allocations);
+    writer.Printf("Backtrace records: %zu\n", entries.size());
+    writer.Printf("Backtrace size: %zu\n\n", debug.config().backtrace_frames);
+
+    for (const auto& entry : entries) {
+      writer.Printf("num %zu  bytes %zu  bt", entry.second.num_allocations, entry.second.bytes);
+      if (entry.first != 0) {
+        size_t num_frames;
+        const uintptr_t* frames = debug.backtrace->GetFrames(entry.first, &num_frames);
+        for (size_t i = 0; i < num_frames; i++) {
+          writer.Printf(" %" PRIxPTR, frames[i]);
+        }
+        debug.backtrace->RemoveStack(entry.first);
+      }
+      writer.Printf("\n");
+    }
+
+    // The maps are needed to symbolize the frames offline.
+    writer.Printf("MAPS\n");
+    int maps_fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps_fd != -1) {
+      char buffer[4096];
+      ssize_t bytes;
+      while ((bytes = TEMP_FAILURE_RETRY(read(maps_fd, buffer, sizeof(buffer)))) > 0) {
+        writer.Write(buffer, bytes);
+      }
+      close(maps_fd);
+    }
+    writer.Printf("END\n");
+    writer.Flush();
+    if (writer.failed()) {
+      error_log("Failed to write heap snapshot file %s: %s", path, strerror(errno));
+    }
+  }
+  close(fd);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef DEBUG_MALLOC_SNAPSHOTDATA_H
+#define DEBUG_MALLOC_SNAPSHOTDATA_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <private/bionic_macros.h>
+
+// Forward declarations.
+struct Config;
+class DebugData;
+
+// Writes the live allocations, grouped by backtrace, followed by the maps
+// of the process to a file when the snapshot signal is received. The
+// signal handler only sets a flag, the snapshot is written by the next
+// allocation. Only one entry per distinct backtrace is kept in memory,
+// the output is streamed through a fixed size buffer.
+class SnapshotData {
+ public:
+  SnapshotData(const Config& config);
+  virtual ~SnapshotData() = default;
+
+  bool Initialize(const Config& config);
+
+  inline void CheckWrite(DebugData& debug) {
+    if (__predict_false(write_requested_)) {
+      WriteSnapshot(debug);
+    }
+  }
+
+  void set_write_requested(bool requested) { write_requested_ = requested; }
+
+ private:
+  void WriteSnapshot(DebugData& debug);
+
+  std::string file_;
+  size_t num_snapshots_ = 0;
+
+  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
+
+  volatile sig_atomic_t write_requested_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotData);
+};
+
+#endif // DEBUG_MALLOC_SNAPSHOTDATA_H
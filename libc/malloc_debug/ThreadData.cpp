@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "debug_log.h"
+#include "FreeTrackData.h"
+#include "malloc_debug.h"
+#include "RecordData.h"
+#include "SampleData.h"
+#include "ThreadData.h"
+
+uint32_t g_thread_data_generation;
+
+static pthread_key_t g_thread_data_key;
+
+static void DestroyThreadData(void* value) {
+  ThreadData* data = reinterpret_cast<ThreadData*>(value);
+
+  // Anything the features free below that needs thread data gets a new
+  // one, which the next round of key destructors frees.
+  *DebugTlsSlot(TLS_SLOT_MALLOC_DEBUG) = nullptr;
+
+  if (data->generation == g_thread_data_generation) {
+    if (data->free_track_ring != nullptr) {
+      FreeTrackData::DestroyRing(data->free_track_ring);
+    }
+    if (data->record_buffer != nullptr) {
+      RecordData::DestroyBuffer(data->record_buffer);
+    }
+  }
+  if (data->sample_state != nullptr) {
+    SampleData::DestroyThreadState(data->sample_state);
+  }
+  g_dispatch->free(data);
+}
+
+bool ThreadDataInitialize() {
+  int error = pthread_key_create(&g_thread_data_key, DestroyThreadData);
+  if (error != 0) {
+    error_log("pthread_key_create failed: %s", strerror(error));
+    return false;
+  }
+  // Invalidates the data threads kept from a previous debug instance.
+  g_thread_data_generation++;
+  return true;
+}
+
+void ThreadDataFinalize() {
+  pthread_key_delete(g_thread_data_key);
+}
+
+ThreadData* ThreadDataCreate() {
+  void** slot = DebugTlsSlot(TLS_SLOT_MALLOC_DEBUG);
+  ThreadData* data = reinterpret_cast<ThreadData*>(*slot);
+  if (data == nullptr) {
+    data = reinterpret_cast<ThreadData*>(g_dispatch->malloc(sizeof(ThreadData)));
+    if (data == nullptr) {
+      return nullptr;
+    }
+    *slot = data;
+  } else if (data->sample_state != nullptr) {
+    // The ring and record buffer of a previous instance were freed along
+    // with it, but the sample state belongs to the thread.
+    SampleData::DestroyThreadState(data->sample_state);
+  }
+  data->generation = g_thread_data_generation;
+  data->free_track_ring = nullptr;
+  data->sample_state = nullptr;
+  data->record_buffer = nullptr;
+  pthread_setspecific(g_thread_data_key, data);
+  return data;
+}
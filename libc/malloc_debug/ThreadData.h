@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef DEBUG_MALLOC_THREADDATA_H
+#define DEBUG_MALLOC_THREADDATA_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include <private/bionic_tls.h>
+
+// Per-thread data of the debug features, found through a TLS slot that
+// bionic reserves for malloc debug so that no application pthread keys
+// are used. A single pthread key, also reserved by bionic, frees the data
+// when the thread exits.
+//
+// Data left over from a previous debug instance is reset the next time
+// the thread asks for it, since the previous instance already freed what
+// the pointers refer to.
+struct ThreadData {
+  uint32_t generation;
+  void* free_track_ring;
+  void* sample_state;
+  void* record_buffer;
+};
+
+#if defined(__BIONIC__)
+static inline void** DebugTlsSlot(int slot) {
+  return &__get_tls()[slot];
+}
+#else
+// The host C library doesn't reserve any slots for us.
+inline void** DebugTlsSlot(int slot) {
+  static thread_local void* slots[BIONIC_TLS_SLOTS];
+  return &slots[slot];
+}
+#endif
+
+extern uint32_t g_thread_data_generation;
+
+bool ThreadDataInitialize();
+void ThreadDataFinalize();
+
+// Returns the calling thread's data, or nullptr if it has none yet.
+static inline ThreadData* ThreadDataGet() {
+  ThreadData* data = reinterpret_cast<ThreadData*>(*DebugTlsSlot(TLS_SLOT_MALLOC_DEBUG));
+  if (__predict_false(data == nullptr || data->generation != g_thread_data_generation)) {
+    return nullptr;
+  }
+  return data;
+}
+
+ThreadData* ThreadDataCreate();
+
+// Returns the calling thread's data, allocating it if needed.
+static inline ThreadData* ThreadDataGetOrCreate() {
+  ThreadData* data = ThreadDataGet();
+  if (__predict_true(data != nullptr)) {
+    return data;
+  }
+  return ThreadDataCreate();
+}
+
+#endif  // DEBUG_MALLOC_THREADDATA_H
@@ -29,12 +29,13 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 
-#include <private/ScopedPthreadMutexLocker.h>
-
 #include "backtrace.h"
 #include "BacktraceData.h"
 #include "Config.h"
@@ -44,12 +45,26 @@
 #include "malloc_debug.h"
 #include "TrackData.h"
 
+void TrackData::LockAll() {
+  for (size_t i = 0; i < NUM_SHARDS; i++) {
+    pthread_mutex_lock(&shards_[i].mutex);
+  }
+}
+
+void TrackData::UnlockAll() {
+  for (size_t i = NUM_SHARDS; i > 0; i--) {
+    pthread_mutex_unlock(&shards_[i - 1].mutex);
+  }
+}
+
 void TrackData::GetList(std::vector<Header*>* list) {
   ScopedDisableDebugCalls disable;
 
-  for (const auto& header : headers_) {
-    list->push_back(header);
+  LockAll();
+  for (const auto& shard : shards_) {
+    list->insert(list->end(), shard.headers.begin(), shard.headers.end());
   }
+  UnlockAll();
 
   // Sort by the size of the allocation.
   std::sort(list->begin(), list->end(), [](Header* a, Header* b) {
@@ -58,26 +73,52 @@ void TrackData::GetList(std::vector<Header*>* list) {
   });
 }
 
+void TrackData::ForEach(std::function<void(const Header*)> func) {
+  ScopedDisableDebugCalls disable;
+
+  LockAll();
+  for (const auto& shard : shards_) {
+    for (const auto& header : shard.headers) {
+      func(header);
+    }
+  }
+  UnlockAll();
+}
+
+void TrackData::ForEachByShard(std::function<void(const Header*)> func) {
+  ScopedDisableDebugCalls disable;
+
+  for (auto& shard : shards_) {
+    pthread_mutex_lock(&shard.mutex);
+    for (const auto& header : shard.headers) {
+      func(header);
+    }
+    pthread_mutex_unlock(&shard.mutex);
+  }
+}
+
 void TrackData::Add(Header* header, bool backtrace_found) {
   ScopedDisableDebugCalls disable;
 
-  pthread_mutex_lock(&mutex_);
+  Shard& shard = GetShard(header);
+  pthread_mutex_lock(&shard.mutex);
   if (backtrace_found) {
-    total_backtrace_allocs_++;
+    shard.backtrace_allocs++;
   }
-  headers_.insert(header);
-  pthread_mutex_unlock(&mutex_);
+  shard.headers.insert(header);
+  pthread_mutex_unlock(&shard.mutex);
 }
 
 void TrackData::Remove(Header* header, bool backtrace_found) {
   ScopedDisableDebugCalls disable;
 
-  pthread_mutex_lock(&mutex_);
-  headers_.erase(header);
+  Shard& shard = GetShard(header);
+  pthread_mutex_lock(&shard.mutex);
+  shard.headers.erase(header);
   if (backtrace_found) {
-    total_backtrace_allocs_--;
+    shard.backtrace_allocs--;
   }
-  pthread_mutex_unlock(&mutex_);
+  pthread_mutex_unlock(&shard.mutex);
 }
 
 void TrackData::DisplayLeaks(DebugData& debug) {
@@ -91,10 +132,12 @@ void TrackData::DisplayLeaks(DebugData& debug) {
     error_log("+++ %s leaked block of size %zu at %p (leak %zu of %zu)", getprogname(),
               header->real_size(), debug.GetPointer(header), ++track_count, list.size());
     if (debug.config().options & BACKTRACE) {
-      BacktraceHeader* back_header = debug.GetAllocBacktrace(header);
-      if (back_header->num_frames > 0) {
+      uint32_t backtrace_id = *debug.GetAllocBacktraceId(header);
+      if (backtrace_id != 0) {
+        size_t num_frames;
+        const uintptr_t* frames = debug.backtrace->GetFrames(backtrace_id, &num_frames);
         error_log("Backtrace at time of allocation:");
-        backtrace_log(&back_header->frames[0], back_header->num_frames);
+        backtrace_log(frames, num_frames);
       }
     }
     g_dispatch->free(header->orig_pointer);
@@ -103,35 +146,72 @@ void TrackData::DisplayLeaks(DebugData& debug) {
 
 void TrackData::GetInfo(DebugData& debug, uint8_t** info, size_t* overall_size,
                         size_t* info_size, size_t* total_memory, size_t* backtrace_size) {
-  ScopedPthreadMutexLocker scoped(&mutex_);
+  ScopedDisableDebugCalls disable;
 
-  if (headers_.size() == 0 || total_backtrace_allocs_ == 0) {
+  // All of the locks are held until the frames have been copied, since
+  // a stack goes away when the last allocation that uses it is freed.
+  LockAll();
+
+  // Allocations with the same size and the same stack are reported as
+  // a single entry.
+  std::unordered_map<uint64_t, size_t> counts;
+  size_t memory = 0;
+  for (const auto& shard : shards_) {
+    if (shard.backtrace_allocs == 0) {
+      continue;
+    }
+    for (const auto& header : shard.headers) {
+      uint32_t backtrace_id = *debug.GetAllocBacktraceId(header);
+      if (backtrace_id != 0) {
+        counts[(static_cast<uint64_t>(header->size) << 32) | backtrace_id]++;
+        memory += header->real_size();
+      }
+    }
+  }
+
+  if (counts.empty()) {
+    UnlockAll();
     return;
   }
 
+  struct LeakEntry {
+    size_t size;
+    uint32_t backtrace_id;
+    size_t num_allocations;
+  };
+  std::vector<LeakEntry> entries;
+  entries.reserve(counts.size());
+  for (const auto& count : counts) {
+    entries.push_back(LeakEntry{ static_cast<size_t>(count.first >> 32),
+                                 static_cast<uint32_t>(count.first), count.second });
+  }
+
+  // Sort by the size of the allocation, then by the number of allocations.
+  std::sort(entries.begin(), entries.end(), [](const LeakEntry& a, const LeakEntry& b) {
+    if (a.size != b.size) return a.size > b.size;
+    if (a.num_allocations != b.num_allocations) return a.num_allocations > b.num_allocations;
+    return a.backtrace_id < b.backtrace_id;
+  });
+
   *backtrace_size = debug.config().backtrace_frames;
   *info_size = sizeof(size_t) * 2 + sizeof(uintptr_t) * *backtrace_size;
-  *info = reinterpret_cast<uint8_t*>(g_dispatch->calloc(*info_size, total_backtrace_allocs_));
+  *info = reinterpret_cast<uint8_t*>(g_dispatch->calloc(*info_size, entries.size()));
   if (*info == nullptr) {
+    UnlockAll();
     return;
   }
-  *overall_size = *info_size * total_backtrace_allocs_;
-
-  std::vector<Header*> list;
-  GetList(&list);
+  *overall_size = *info_size * entries.size();
+  *total_memory = memory;
 
   uint8_t* data = *info;
-  for (const auto& header : list) {
-    BacktraceHeader* back_header = debug.GetAllocBacktrace(header);
-    if (back_header->num_frames > 0) {
-      memcpy(data, &header->size, sizeof(size_t));
-      memcpy(&data[sizeof(size_t)], &back_header->num_frames, sizeof(size_t));
-      memcpy(&data[2 * sizeof(size_t)], &back_header->frames[0],
-            back_header->num_frames * sizeof(uintptr_t));
-
-      *total_memory += header->real_size();
-
-      data += *info_size;
-    }
+  for (const auto& entry : entries) {
+    size_t num_frames;
+    const uintptr_t* frames = debug.backtrace->GetFrames(entry.backtrace_id, &num_frames);
+    memcpy(data, &entry.size, sizeof(size_t));
+    memcpy(&data[sizeof(size_t)], &entry.num_allocations, sizeof(size_t));
+    memcpy(&data[2 * sizeof(size_t)], frames, num_frames * sizeof(uintptr_t));
+
+    data += *info_size;
   }
+  UnlockAll();
 }
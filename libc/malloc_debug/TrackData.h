@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <pthread.h>
 
+#include <functional>
 #include <vector>
 #include <unordered_set>
 
@@ -42,6 +43,10 @@ struct Header;
 struct Config;
 class DebugData;
 
+// The tracked allocations are split into shards by address, each with its
+// own lock, so that threads allocating at the same time rarely contend.
+// Operations that need the whole set take every shard lock, in order, to
+// get a consistent snapshot.
 class TrackData {
  public:
   TrackData() = default;
@@ -49,6 +54,13 @@ class TrackData {
 
   void GetList(std::vector<Header*>* list);
 
+  // Calls func for every tracked allocation while holding all of the locks.
+  void ForEach(std::function<void(const Header*)> func);
+
+  // Calls func for every tracked allocation while holding the lock of its
+  // shard only, so the other shards can be used in the meantime.
+  void ForEachByShard(std::function<void(const Header*)> func);
+
   void Add(Header* header, bool backtrace_found);
 
   void Remove(Header* header, bool backtrace_found);
@@ -59,9 +71,23 @@ class TrackData {
   void DisplayLeaks(DebugData& debug);
 
  private:
-  pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
-  std::unordered_set<Header*> headers_;
-  size_t total_backtrace_allocs_ = 0;
+  static constexpr size_t NUM_SHARDS = 16;
+
+  struct Shard {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::unordered_set<Header*> headers;
+    size_t backtrace_allocs = 0;
+  };
+
+  Shard& GetShard(const Header* header) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(header);
+    return shards_[((value >> 4) ^ (value >> 12)) % NUM_SHARDS];
+  }
+
+  void LockAll();
+  void UnlockAll();
+
+  Shard shards_[NUM_SHARDS];
 
   DISALLOW_COPY_AND_ASSIGN(TrackData);
 };
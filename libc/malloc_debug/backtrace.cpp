@@ -51,7 +51,8 @@ typedef struct _Unwind_Context __unwind_context;
 extern "C" char* __cxa_demangle(const char*, char*, size_t*, int*);
 
 static MapData* g_map_data = nullptr;
-static const MapEntry* g_current_code_map = nullptr;
+static uintptr_t g_current_code_start = 0;
+static uintptr_t g_current_code_end = 0;
 
 static _Unwind_Reason_Code find_current_map(__unwind_context* context, void*) {
   uintptr_t ip = _Unwind_GetIP(context);
@@ -59,7 +60,11 @@ static _Unwind_Reason_Code find_current_map(__unwind_context* context, void*) {
   if (ip == 0) {
     return _URC_END_OF_STACK;
   }
-  g_current_code_map = g_map_data->find(ip);
+  const MapEntry* entry = g_map_data->find(ip);
+  if (entry != nullptr) {
+    g_current_code_start = entry->start;
+    g_current_code_end = entry->end;
+  }
   return _URC_END_OF_STACK;
 }
 
@@ -125,7 +130,7 @@ static _Unwind_Reason_Code trace_function(__unwind_context* context, void* arg)
 #endif
 
     // Do not record the frames that fall in our own shared library.
-    if (g_current_code_map && (ip >= g_current_code_map->start) && ip < g_current_code_map->end) {
+    if (ip >= g_current_code_start && ip < g_current_code_end) {
       return _URC_NO_REASON;
     }
   }
@@ -44,6 +44,7 @@
 #include "debug_disable.h"
 #include "debug_log.h"
 #include "malloc_debug.h"
+#include "ThreadData.h"
 
 // ------------------------------------------------------------------------
 // Global Data
@@ -135,18 +136,28 @@ static void* InitHeader(Header* header, void* orig_pointer, size_t size) {
 
   bool backtrace_found = false;
   if (g_debug->config().options & BACKTRACE) {
-    BacktraceHeader* back_header = g_debug->GetAllocBacktrace(header);
-    if (g_debug->backtrace->enabled()) {
-      back_header->num_frames = backtrace_get(
-          &back_header->frames[0], g_debug->config().backtrace_frames);
-      backtrace_found = back_header->num_frames > 0;
-    } else {
-      back_header->num_frames = 0;
+    uint32_t* backtrace_id = g_debug->GetAllocBacktraceId(header);
+    *backtrace_id = 0;
+    if (g_debug->backtrace->enabled() && (!(g_debug->config().options & SAMPLE_ALLOCS) ||
+                                          g_debug->sample->ShouldSample(size))) {
+      uintptr_t frames[MAX_BACKTRACE_FRAMES];
+      size_t num_frames = backtrace_get(frames, g_debug->config().backtrace_frames);
+      if (num_frames > 0) {
+        *backtrace_id = g_debug->backtrace->AddStack(frames, num_frames);
+        backtrace_found = *backtrace_id != 0;
+      }
     }
   }
 
   if (g_debug->config().options & TRACK_ALLOCS) {
-    g_debug->track->Add(header, backtrace_found);
+    // When sampling, only the sampled allocations are tracked.
+    if (backtrace_found || !(g_debug->config().options & SAMPLE_ALLOCS)) {
+      g_debug->track->Add(header, backtrace_found);
+    }
+  }
+
+  if (g_debug->config().options & HEAP_SNAPSHOT) {
+    g_debug->snapshot->CheckWrite(*g_debug);
   }
 
   return g_debug->GetPointer(header);
@@ -164,9 +175,15 @@ bool debug_initialize(const MallocDispatch* malloc_dispatch, int* malloc_zygote_
     return false;
   }
 
+  if (!ThreadDataInitialize()) {
+    DebugDisableFinalize();
+    return false;
+  }
+
   DebugData* debug = new DebugData();
   if (!debug->Initialize()) {
     delete debug;
+    ThreadDataFinalize();
     DebugDisableFinalize();
     return false;
   }
@@ -192,6 +209,10 @@ void debug_finalize() {
     g_debug->track->DisplayLeaks(*g_debug);
   }
 
+  if (g_debug->config().options & RECORD_ALLOCS) {
+    g_debug->record->FlushAll();
+  }
+
   backtrace_shutdown();
 
   DebugDisableSet(true);
@@ -199,6 +220,7 @@ void debug_finalize() {
   delete g_debug;
   g_debug = nullptr;
 
+  ThreadDataFinalize();
   DebugDisableFinalize();
 }
 
@@ -246,11 +268,7 @@ size_t debug_malloc_usable_size(void* pointer) {
   return header->usable_size;
 }
 
-void* debug_malloc(size_t size) {
-  if (DebugCallsDisabled()) {
-    return g_dispatch->malloc(size);
-  }
-
+static void* InternalMalloc(size_t size) {
   size_t real_size = size + g_debug->extra_bytes();
   if (real_size < size) {
     // Overflow.
@@ -284,11 +302,7 @@ void* debug_malloc(size_t size) {
   return pointer;
 }
 
-void debug_free(void* pointer) {
-  if (DebugCallsDisabled() || pointer == nullptr) {
-    return g_dispatch->free(pointer);
-  }
-
+static void InternalFree(void* pointer) {
   void* free_pointer = pointer;
   size_t bytes;
   if (g_debug->need_header()) {
@@ -311,12 +325,17 @@ void debug_free(void* pointer) {
     }
 
     if (g_debug->config().options & TRACK_ALLOCS) {
-      bool backtrace_found = false;
+      uint32_t backtrace_id = 0;
       if (g_debug->config().options & BACKTRACE) {
-        BacktraceHeader* back_header = g_debug->GetAllocBacktrace(header);
-        backtrace_found = back_header->num_frames > 0;
+        backtrace_id = *g_debug->GetAllocBacktraceId(header);
+      }
+      bool backtrace_found = backtrace_id != 0;
+      if (backtrace_found || !(g_debug->config().options & SAMPLE_ALLOCS)) {
+        g_debug->track->Remove(header, backtrace_found);
+      }
+      if (backtrace_found) {
+        g_debug->backtrace->RemoveStack(backtrace_id);
       }
-      g_debug->track->Remove(header, backtrace_found);
     }
 
     if (g_debug->config().options & FREE_TRACK) {
@@ -341,11 +360,7 @@ void debug_free(void* pointer) {
   g_dispatch->free(free_pointer);
 }
 
-void* debug_memalign(size_t alignment, size_t bytes) {
-  if (DebugCallsDisabled()) {
-    return g_dispatch->memalign(alignment, bytes);
-  }
-
+static void* InternalMemalign(size_t alignment, size_t bytes) {
   void* pointer;
   if (g_debug->need_header()) {
     if (bytes > Header::max_size()) {
@@ -403,17 +418,13 @@ void* debug_memalign(size_t alignment, size_t bytes) {
   return pointer;
 }
 
-void* debug_realloc(void* pointer, size_t bytes) {
-  if (DebugCallsDisabled()) {
-    return g_dispatch->realloc(pointer, bytes);
-  }
-
+static void* InternalRealloc(void* pointer, size_t bytes) {
   if (pointer == nullptr) {
-    return debug_malloc(bytes);
+    return InternalMalloc(bytes);
   }
 
   if (bytes == 0) {
-    debug_free(pointer);
+    InternalFree(pointer);
     return nullptr;
   }
 
@@ -463,7 +474,7 @@ void* debug_realloc(void* pointer, size_t bytes) {
     }
 
     // Allocate the new size.
-    new_pointer = debug_malloc(bytes);
+    new_pointer = InternalMalloc(bytes);
     if (new_pointer == nullptr) {
       errno = ENOMEM;
       return nullptr;
@@ -471,7 +482,7 @@ void* debug_realloc(void* pointer, size_t bytes) {
 
     prev_size = header->usable_size;
     memcpy(new_pointer, pointer, prev_size);
-    debug_free(pointer);
+    InternalFree(pointer);
   } else {
     prev_size = g_dispatch->malloc_usable_size(pointer);
     new_pointer = g_dispatch->realloc(pointer, real_size);
@@ -494,11 +505,7 @@ void* debug_realloc(void* pointer, size_t bytes) {
   return new_pointer;
 }
 
-void* debug_calloc(size_t nmemb, size_t bytes) {
-  if (DebugCallsDisabled()) {
-    return g_dispatch->calloc(nmemb, bytes);
-  }
-
+static void* InternalCalloc(size_t nmemb, size_t bytes) {
   size_t real_size = nmemb * bytes + g_debug->extra_bytes();
   if (real_size < bytes || real_size < nmemb) {
     // Overflow.
@@ -526,6 +533,67 @@ void* debug_calloc(size_t nmemb, size_t bytes) {
   }
 }
 
+void* debug_malloc(size_t size) {
+  if (DebugCallsDisabled()) {
+    return g_dispatch->malloc(size);
+  }
+
+  void* pointer = InternalMalloc(size);
+  if (g_debug->config().options & RECORD_ALLOCS) {
+    g_debug->record->AddEntry(RECORD_OP_MALLOC, pointer, size, 0);
+  }
+  return pointer;
+}
+
+void debug_free(void* pointer) {
+  if (DebugCallsDisabled() || pointer == nullptr) {
+    return g_dispatch->free(pointer);
+  }
+
+  // Record the free before the pointer can be handed out again.
+  if (g_debug->config().options & RECORD_ALLOCS) {
+    g_debug->record->AddEntry(RECORD_OP_FREE, pointer, 0, 0);
+  }
+  InternalFree(pointer);
+}
+
+void* debug_memalign(size_t alignment, size_t bytes) {
+  if (DebugCallsDisabled()) {
+    return g_dispatch->memalign(alignment, bytes);
+  }
+
+  void* pointer = InternalMemalign(alignment, bytes);
+  if (g_debug->config().options & RECORD_ALLOCS) {
+    g_debug->record->AddEntry(RECORD_OP_MEMALIGN, pointer, bytes, alignment);
+  }
+  return pointer;
+}
+
+void* debug_realloc(void* pointer, size_t bytes) {
+  if (DebugCallsDisabled()) {
+    return g_dispatch->realloc(pointer, bytes);
+  }
+
+  void* new_pointer = InternalRealloc(pointer, bytes);
+  if (g_debug->config().options & RECORD_ALLOCS) {
+    g_debug->record->AddEntry(RECORD_OP_REALLOC, new_pointer, bytes,
+                              reinterpret_cast<uintptr_t>(pointer));
+  }
+  return new_pointer;
+}
+
+void* debug_calloc(size_t nmemb, size_t bytes) {
+  if (DebugCallsDisabled()) {
+    return g_dispatch->calloc(nmemb, bytes);
+  }
+
+  void* pointer = InternalCalloc(nmemb, bytes);
+  if (g_debug->config().options & RECORD_ALLOCS) {
+    g_debug->record->AddEntry(RECORD_OP_CALLOC, pointer, bytes, nmemb);
+  }
+  return pointer;
+}
+
 struct mallinfo debug_mallinfo() {
   return g_dispatch->mallinfo();
 }
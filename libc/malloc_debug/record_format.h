@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef DEBUG_MALLOC_RECORD_FORMAT_H
+#define DEBUG_MALLOC_RECORD_FORMAT_H
+
+#include <stdint.h>
+
+// Layout of the file written by the record_allocs option. The file starts
+// with a RecordFileHeader followed by RecordEntry structures. Each thread
+// appends its entries in blocks, so the entries are not in order in the
+// file; sorting them by sequence gives the order in which the calls
+// happened. This header is also used by the replay benchmark, so it must
+// only depend on standard headers.
+
+constexpr char RECORD_FILE_MAGIC[8] = { 'M', 'D', 'R', 'E', 'C', 'O', 'R', 'D' };
+constexpr uint32_t RECORD_FILE_VERSION = 1;
+
+enum RecordOp : uint32_t {
+  RECORD_OP_MALLOC = 1,
+  RECORD_OP_CALLOC = 2,
+  RECORD_OP_MEMALIGN = 3,
+  RECORD_OP_REALLOC = 4,
+  RECORD_OP_FREE = 5,
+};
+
+struct RecordFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+};
+
+struct RecordEntry {
+  // Global order of the call.
+  uint64_t sequence;
+  // CLOCK_MONOTONIC time of the call in nanoseconds.
+  uint64_t timestamp_ns;
+  // The pointer returned, or the pointer freed. Pointers are only used
+  // as ids to match an allocation with its free.
+  uint64_t pointer;
+  // The requested size. For calloc, the size of one element.
+  uint64_t size;
+  // realloc: the old pointer, calloc: the number of elements,
+  // memalign: the alignment.
+  uint64_t extra;
+  uint32_t tid;
+  uint32_t op;
+};
+
+#endif // DEBUG_MALLOC_RECORD_FORMAT_H
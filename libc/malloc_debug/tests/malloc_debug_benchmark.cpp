@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/cdefs.h>
+
+#include <vector>
+
+#include <benchmark/Benchmark.h>
+
+#include <private/bionic_malloc_dispatch.h>
+
+#include "log_fake.h"
+
+__BEGIN_DECLS
+
+int property_set(const char*, const char*);
+bool debug_initialize(const MallocDispatch*, int*);
+void debug_finalize();
+
+void* debug_malloc(size_t);
+void debug_free(void*);
+
+__END_DECLS
+
+static MallocDispatch g_dispatch_table = {
+  calloc,
+  free,
+  mallinfo,
+  malloc,
+  malloc_usable_size,
+  memalign,
+  posix_memalign,
+#if defined(HAVE_DEPRECATED_MALLOC_FUNCS)
+  nullptr,
+#endif
+  realloc,
+#if defined(HAVE_DEPRECATED_MALLOC_FUNCS)
+  nullptr,
+#endif
+};
+
+static int g_zygote = 0;
+
+// Number of allocations each thread keeps live, so that the tracked set
+// is not trivially small.
+constexpr size_t LIVE_ALLOCATIONS = 64;
+
+static void* AllocFreeThread(void* data) {
+  int iters = *reinterpret_cast<int*>(data);
+
+  void* live[LIVE_ALLOCATIONS] = {};
+  for (int i = 0; i < iters; i++) {
+    size_t index = i % LIVE_ALLOCATIONS;
+    debug_free(live[index]);
+    live[index] = debug_malloc(16 + (i % 8) * 16);
+  }
+  for (size_t i = 0; i < LIVE_ALLOCATIONS; i++) {
+    debug_free(live[i]);
+  }
+  return nullptr;
+}
+
+static void RunThreads(int iters, int num_threads) {
+  std::vector<pthread_t> threads(num_threads);
+  for (auto& thread : threads) {
+    pthread_create(&thread, nullptr, AllocFreeThread, &iters);
+  }
+  for (auto& thread : threads) {
+    pthread_join(thread, nullptr);
+  }
+}
+
+static void InitDebug(const char* options) {
+  property_set("libc.debug.malloc.options", options);
+  debug_initialize(&g_dispatch_table, &g_zygote);
+}
+
+static void FinalizeDebug() {
+  debug_finalize();
+  resetLogs();
+}
+
+// Every thread does iters malloc/free pairs, with allocation tracking
+// enabled, so the time per iteration should stay flat as the number of
+// threads grows if the tracking scales.
+BENCHMARK_WITH_ARG(BM_malloc_debug_leak_track_threads, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+void BM_malloc_debug_leak_track_threads::Run(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  InitDebug("leak_track");
+  StartBenchmarkTiming();
+
+  RunThreads(iters, num_threads);
+
+  StopBenchmarkTiming();
+  FinalizeDebug();
+}
+
+// Every free goes through the calling thread's quarantine.
+BENCHMARK_WITH_ARG(BM_malloc_debug_free_track_threads, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+void BM_malloc_debug_free_track_threads::Run(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  InitDebug("free_track");
+  StartBenchmarkTiming();
+
+  RunThreads(iters, num_threads);
+
+  StopBenchmarkTiming();
+  FinalizeDebug();
+}
+
+// Only guards and no tracking, as a baseline.
+BENCHMARK_WITH_ARG(BM_malloc_debug_guard_threads, int)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+void BM_malloc_debug_guard_threads::Run(int iters, int num_threads) {
+  StopBenchmarkTiming();
+  InitDebug("guard");
+  StartBenchmarkTiming();
+
+  RunThreads(iters, num_threads);
+
+  StopBenchmarkTiming();
+  FinalizeDebug();
+}
@@ -15,12 +15,15 @@
  */
 
 #include <limits.h>
+#include <signal.h>
 
 #include <memory>
 #include <string>
 
 #include <gtest/gtest.h>
 
+#include <android-base/stringprintf.h>
+
 #include "Config.h"
 
 #include "log_fake.h"
@@ -96,9 +99,10 @@ std::string usage_string(
   "6 malloc_debug \n"
   "6 malloc_debug   free_track[=XX]\n"
   "6 malloc_debug     When a pointer is freed, do not free the memory right away.\n"
-  "6 malloc_debug     Instead, keep XX of these allocations around and then verify\n"
-  "6 malloc_debug     that they have not been modified when the total number of freed\n"
-  "6 malloc_debug     allocations exceeds the XX amount. When the program terminates,\n"
+  "6 malloc_debug     Instead, each thread keeps XX of these allocations around and then\n"
+  "6 malloc_debug     verifies that they have not been modified when the number of\n"
+  "6 malloc_debug     allocations freed by the thread exceeds the XX amount. When a\n"
+  "6 malloc_debug     thread exits, its allocations are verified. When the program terminates,\n"
   "6 malloc_debug     the rest of these allocations are verified. When this option is\n"
   "6 malloc_debug     enabled, it automatically records the backtrace at the time of the free.\n"
   "6 malloc_debug     The default is to record 100 allocations.\n"
@@ -112,6 +116,42 @@ std::string usage_string(
   "6 malloc_debug \n"
   "6 malloc_debug   leak_track\n"
   "6 malloc_debug     Enable the leak tracking of memory allocations.\n"
+  "6 malloc_debug \n"
+  "6 malloc_debug   sample_bytes[=XX]\n"
+  "6 malloc_debug     Only capture the backtrace of, and track, a random sample of\n"
+  "6 malloc_debug     the allocations, on average one for every XX allocated bytes.\n"
+  "6 malloc_debug     Allocations that are not sampled only pay the cost of a counter\n"
+  "6 malloc_debug     update. The default is 524288 bytes. Sending the process the\n"
+  "6 malloc_debug     signal SIGRTMIN + 11 dumps the live sampled allocations to the log.\n"
+  "6 malloc_debug \n"
+  "6 malloc_debug   record_allocs[=XX]\n"
+  "6 malloc_debug     Record every malloc, calloc, realloc, memalign and free call in a\n"
+  "6 malloc_debug     binary trace that can be replayed offline. Each thread buffers XX\n"
+  "6 malloc_debug     entries before appending them to the trace file. The default is\n"
+  "6 malloc_debug     4096 entries.\n"
+  "6 malloc_debug \n"
+  "6 malloc_debug   record_allocs_file[=FILE]\n"
+  "6 malloc_debug     This option only has meaning if record_allocs is set. It is the\n"
+  "6 malloc_debug     name of the trace file, the pid of the process is appended to it.\n"
+  "6 malloc_debug     The default is /data/local/tmp/record_allocs.\n"
+  "6 malloc_debug \n"
+  "6 malloc_debug   heap_snapshot\n"
+  "6 malloc_debug     Enable capturing the backtrace at the point of allocation, and\n"
+  "6 malloc_debug     write the live allocations, grouped by backtrace, along with the\n"
+  "6 malloc_debug     maps of the process to a file when the process receives the\n"
+  "6 malloc_debug     heap_snapshot_signal. The snapshot is written using a bounded amount\n"
+  "6 malloc_debug     of memory, by the next thread that allocates.\n"
+  "6 malloc_debug \n"
+  "6 malloc_debug   heap_snapshot_signal[=XX]\n"
+  "6 malloc_debug     This option only has meaning if heap_snapshot is set. It is the\n"
+  "6 malloc_debug     number of the real-time signal that triggers a snapshot. The\n"
+  "6 malloc_debug     default is SIGRTMIN + 12.\n"
+  "6 malloc_debug \n"
+  "6 malloc_debug   heap_snapshot_file[=FILE]\n"
+  "6 malloc_debug     This option only has meaning if heap_snapshot is set. It is the\n"
+  "6 malloc_debug     name of the snapshot files, the pid of the process and the number\n"
+  "6 malloc_debug     of the snapshot are appended to it. The default is\n"
+  "6 malloc_debug     /data/local/tmp/heap_snapshot.\n"
 );
 
 TEST_F(MallocDebugConfigTest, unknown_option) {
@@ -435,6 +475,141 @@ TEST_F(MallocDebugConfigTest, leak_track_fail) {
   ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
 }
 
+TEST_F(MallocDebugConfigTest, sample_bytes) {
+  ASSERT_TRUE(InitConfig("sample_bytes=4096"));
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | SAMPLE_ALLOCS, config->options);
+  ASSERT_EQ(4096U, config->sample_bytes);
+  ASSERT_EQ(16U, config->backtrace_frames);
+  ASSERT_TRUE(config->backtrace_enabled);
+  ASSERT_EQ(SIGRTMIN + 11, config->sample_dump_signal);
+
+  ASSERT_TRUE(InitConfig("sample_bytes"));
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | SAMPLE_ALLOCS, config->options);
+  ASSERT_EQ(524288U, config->sample_bytes);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, sample_bytes_and_backtrace) {
+  ASSERT_TRUE(InitConfig("backtrace=64 sample_bytes=100"));
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | SAMPLE_ALLOCS, config->options);
+  ASSERT_EQ(100U, config->sample_bytes);
+  ASSERT_EQ(64U, config->backtrace_frames);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, sample_bytes_min_error) {
+  ASSERT_FALSE(InitConfig("sample_bytes=0"));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: bad value for option 'sample_bytes', "
+      "value must be >= 1: 0\n");
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, record_allocs) {
+  ASSERT_TRUE(InitConfig("record_allocs=1234"));
+  ASSERT_EQ(RECORD_ALLOCS, config->options);
+  ASSERT_EQ(1234U, config->record_allocs_num_entries);
+  ASSERT_STREQ("/data/local/tmp/record_allocs", config->record_allocs_file.c_str());
+
+  ASSERT_TRUE(InitConfig("record_allocs"));
+  ASSERT_EQ(RECORD_ALLOCS, config->options);
+  ASSERT_EQ(4096U, config->record_allocs_num_entries);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, record_allocs_file) {
+  ASSERT_TRUE(InitConfig("record_allocs record_allocs_file=/data/local/tmp/trace fill"));
+  ASSERT_EQ(RECORD_ALLOCS | FILL_ON_ALLOC | FILL_ON_FREE, config->options);
+  ASSERT_STREQ("/data/local/tmp/trace", config->record_allocs_file.c_str());
+
+  ASSERT_TRUE(InitConfig("record_allocs_file"));
+  ASSERT_EQ(0U, config->options);
+  ASSERT_STREQ("/data/local/tmp/record_allocs", config->record_allocs_file.c_str());
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, record_allocs_max_error) {
+  ASSERT_FALSE(InitConfig("record_allocs=1048577"));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: bad value for option 'record_allocs', "
+      "value must be <= 1048576: 1048577\n");
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, record_allocs_file_empty_error) {
+  ASSERT_FALSE(InitConfig("record_allocs record_allocs_file= "));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: bad value for option 'record_allocs_file'\n");
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, heap_snapshot) {
+  ASSERT_TRUE(InitConfig("heap_snapshot"));
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | HEAP_SNAPSHOT, config->options);
+  ASSERT_TRUE(config->backtrace_enabled);
+  ASSERT_EQ(16U, config->backtrace_frames);
+  ASSERT_EQ(SIGRTMIN + 12, config->heap_snapshot_signal);
+  ASSERT_STREQ("/data/local/tmp/heap_snapshot", config->heap_snapshot_file.c_str());
+
+  ASSERT_TRUE(InitConfig("backtrace=32 heap_snapshot heap_snapshot_file=/data/local/tmp/snap"));
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | HEAP_SNAPSHOT, config->options);
+  ASSERT_EQ(32U, config->backtrace_frames);
+  ASSERT_STREQ("/data/local/tmp/snap", config->heap_snapshot_file.c_str());
+
+  ASSERT_TRUE(InitConfig(android::base::StringPrintf("heap_snapshot heap_snapshot_signal=%d",
+                                                     SIGRTMIN + 3).c_str()));
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | HEAP_SNAPSHOT, config->options);
+  ASSERT_EQ(SIGRTMIN + 3, config->heap_snapshot_signal);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, heap_snapshot_signal_range_error) {
+  ASSERT_FALSE(InitConfig(android::base::StringPrintf("heap_snapshot heap_snapshot_signal=%d",
+                                                      SIGRTMIN - 1).c_str()));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(android::base::StringPrintf(
+      "6 malloc_debug malloc_testing: bad value for option 'heap_snapshot_signal', "
+      "value must be >= %d: %d\n", SIGRTMIN, SIGRTMIN - 1));
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+
+  resetLogs();
+  ASSERT_FALSE(InitConfig(android::base::StringPrintf("heap_snapshot heap_snapshot_signal=%d",
+                                                      SIGRTMAX + 1).c_str()));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  log_msg = android::base::StringPrintf(
+      "6 malloc_debug malloc_testing: bad value for option 'heap_snapshot_signal', "
+      "value must be <= %d: %d\n", SIGRTMAX, SIGRTMAX + 1);
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, heap_snapshot_value_error) {
+  ASSERT_FALSE(InitConfig("heap_snapshot=1"));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: value set for option 'heap_snapshot' "
+      "which does not take a value\n");
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugConfigTest, guard_min_error) {
   ASSERT_FALSE(InitConfig("guard=0"));
 
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <android-base/file.h>
+
+#include "MapData.h"
+
+// Lets the tests decide when the linker has loaded something new.
+class TestMapData : public MapData {
+ public:
+  static TestMapData* Create() {
+    TestMapData* maps = new TestMapData();
+    if (!maps->Initialize()) {
+      delete maps;
+      return nullptr;
+    }
+    return maps;
+  }
+
+  uintptr_t generation = 1;
+  size_t generation_calls = 0;
+
+ protected:
+  uintptr_t LoadGeneration() override {
+    generation_calls++;
+    return generation;
+  }
+};
+
+class MallocDebugMapDataTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    page_size = getpagesize();
+  }
+
+  void* MapFile(const TemporaryFile& tf, size_t pages) {
+    EXPECT_EQ(0, ftruncate(tf.fd, pages * page_size));
+    void* map = mmap(nullptr, pages * page_size, PROT_READ, MAP_PRIVATE, tf.fd, 0);
+    EXPECT_NE(MAP_FAILED, map);
+    return map;
+  }
+
+  size_t page_size;
+};
+
+TEST_F(MallocDebugMapDataTest, find_boundaries) {
+  TemporaryFile tf;
+  void* map = MapFile(tf, 3);
+  ASSERT_NE(MAP_FAILED, map);
+  uintptr_t start = reinterpret_cast<uintptr_t>(map);
+  uintptr_t end = start + 3 * page_size;
+
+  std::unique_ptr<MapData> maps(MapData::Create());
+  ASSERT_TRUE(maps != nullptr);
+
+  uintptr_t rel_pc;
+  const MapEntry* entry = maps->find(start, &rel_pc);
+  ASSERT_TRUE(entry != nullptr);
+  ASSERT_EQ(start, entry->start);
+  ASSERT_EQ(end, entry->end);
+  ASSERT_EQ(std::string(tf.path), entry->name);
+  // Not an elf file, so there is no load base.
+  ASSERT_EQ(0U, rel_pc);
+
+  ASSERT_EQ(entry, maps->find(start + page_size, &rel_pc));
+  ASSERT_EQ(page_size, rel_pc);
+  ASSERT_EQ(entry, maps->find(end - 1, &rel_pc));
+  ASSERT_EQ(3 * page_size - 1, rel_pc);
+
+  const MapEntry* next = maps->find(end, &rel_pc);
+  ASSERT_NE(entry, next);
+  if (next == nullptr) {
+    ASSERT_EQ(end, rel_pc);
+  } else {
+    ASSERT_EQ(end, next->start);
+  }
+
+  munmap(map, 3 * page_size);
+}
+
+TEST_F(MallocDebugMapDataTest, find_code_and_stack) {
+  std::unique_ptr<MapData> maps(MapData::Create());
+  ASSERT_TRUE(maps != nullptr);
+
+  uintptr_t code = reinterpret_cast<uintptr_t>(&MapData::Create);
+  const MapEntry* entry = maps->find(code);
+  ASSERT_TRUE(entry != nullptr);
+  ASSERT_LE(entry->start, code);
+  ASSERT_GT(entry->end, code);
+  ASSERT_FALSE(entry->name.empty());
+
+  int local;
+  uintptr_t stack = reinterpret_cast<uintptr_t>(&local);
+  entry = maps->find(stack);
+  ASSERT_TRUE(entry != nullptr);
+  ASSERT_LE(entry->start, stack);
+  ASSERT_GT(entry->end, stack);
+}
+
+TEST_F(MallocDebugMapDataTest, miss_is_cached) {
+  std::unique_ptr<TestMapData> maps(TestMapData::Create());
+  ASSERT_TRUE(maps != nullptr);
+  ASSERT_EQ(1U, maps->generation_calls);
+
+  uintptr_t rel_pc;
+  ASSERT_TRUE(maps->find(0, &rel_pc) == nullptr);
+  ASSERT_EQ(0U, rel_pc);
+  ASSERT_EQ(2U, maps->generation_calls);
+
+  // The same pc does not check the linker again.
+  for (size_t i = 0; i < 100; i++) {
+    ASSERT_TRUE(maps->find(0) == nullptr);
+  }
+  ASSERT_EQ(2U, maps->generation_calls);
+
+  // A different pc does.
+  ASSERT_TRUE(maps->find(1) == nullptr);
+  ASSERT_EQ(3U, maps->generation_calls);
+}
+
+TEST_F(MallocDebugMapDataTest, refresh_on_new_generation) {
+  std::unique_ptr<TestMapData> maps(TestMapData::Create());
+  ASSERT_TRUE(maps != nullptr);
+
+  uintptr_t code = reinterpret_cast<uintptr_t>(&MapData::Create);
+  const MapEntry* code_entry = maps->find(code);
+  ASSERT_TRUE(code_entry != nullptr);
+
+  TemporaryFile tf;
+  void* map = MapFile(tf, 1);
+  ASSERT_NE(MAP_FAILED, map);
+  uintptr_t pc = reinterpret_cast<uintptr_t>(map);
+
+  // Nothing was loaded, so the maps are not read again.
+  const MapEntry* entry = maps->find(pc);
+  ASSERT_TRUE(entry == nullptr || entry->name != tf.path);
+
+  // A remembered miss does not look at the linker again, but any other
+  // miss notices that something was loaded and reads the maps again.
+  maps->generation++;
+  ASSERT_TRUE(maps->find(0) == nullptr);
+  entry = maps->find(pc);
+  ASSERT_TRUE(entry != nullptr);
+  ASSERT_EQ(std::string(tf.path), entry->name);
+  ASSERT_EQ(pc, entry->start);
+
+  // Unchanged entries are kept.
+  ASSERT_EQ(code_entry, maps->find(code));
+
+  // Entries that went away stay valid until the maps are destroyed.
+  munmap(map, page_size);
+  maps->generation++;
+  ASSERT_TRUE(maps->find(1) == nullptr);
+  ASSERT_TRUE(maps->find(pc) != entry);
+  ASSERT_EQ(std::string(tf.path), entry->name);
+}
@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +31,7 @@
 
 #include <gtest/gtest.h>
 
+#include <android-base/file.h>
 #include <android-base/stringprintf.h>
 
 #include <private/bionic_macros.h>
@@ -36,6 +39,8 @@
 
 #include "Config.h"
 #include "malloc_debug.h"
+#include "record_format.h"
+#include "SampleData.h"
 
 #include "log_fake.h"
 #include "backtrace_fake.h"
@@ -70,10 +75,10 @@ constexpr char DIVIDER[] =
 
 constexpr uint32_t BACKTRACE_HEADER = 0x1;
 
-static size_t get_tag_offset(uint32_t flags = 0, size_t backtrace_frames = 0) {
+static size_t get_tag_offset(uint32_t flags = 0) {
   size_t offset = BIONIC_ALIGN(sizeof(Header), MINIMUM_ALIGNMENT_BYTES);
   if (flags & BACKTRACE_HEADER) {
-    offset += BIONIC_ALIGN(sizeof(BacktraceHeader) + sizeof(uintptr_t) * backtrace_frames, MINIMUM_ALIGNMENT_BYTES);
+    offset += BIONIC_ALIGN(sizeof(uint32_t), MINIMUM_ALIGNMENT_BYTES);
   }
   return offset;
 }
@@ -895,6 +900,35 @@ TEST_F(MallocDebugTest, free_track_use_after_free_call_free) {
   ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
 }
 
+static void* FreeTrackUseAfterFreeThread(void* data) {
+  uint8_t* pointer = reinterpret_cast<uint8_t*>(debug_malloc(100));
+  if (pointer != nullptr) {
+    memset(pointer, 0, 100);
+    debug_free(pointer);
+    pointer[10] = 0x45;
+  }
+  *reinterpret_cast<uint8_t**>(data) = pointer;
+  return nullptr;
+}
+
+TEST_F(MallocDebugTest, free_track_use_after_free_thread_exit) {
+  Init("free_track=100 free_track_backtrace_num_frames=0");
+
+  // The thread's quarantine is verified when the thread exits.
+  uint8_t* pointer;
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, nullptr, FreeTrackUseAfterFreeThread, &pointer));
+  ASSERT_EQ(0, pthread_join(thread, nullptr));
+  ASSERT_TRUE(pointer != nullptr);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string expected_log(DIVIDER);
+  expected_log += android::base::StringPrintf("6 malloc_debug +++ ALLOCATION %p USED AFTER FREE\n", pointer);
+  expected_log += "6 malloc_debug   pointer[10] = 0x45 (expected 0xef)\n";
+  expected_log += DIVIDER;
+  ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugTest, get_malloc_leak_info_invalid) {
   Init("fill");
 
@@ -945,7 +979,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_not_enabled) {
 
 struct InfoEntry {
   size_t size;
-  size_t num_frames;
+  size_t num_allocations;
   uintptr_t frames[0];
 } __attribute__((packed));
 
@@ -979,7 +1013,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_single) {
 
   InfoEntry* entry = reinterpret_cast<InfoEntry*>(expected_info.data());
   entry->size = 200;
-  entry->num_frames = 3;
+  entry->num_allocations = 1;
   entry->frames[0] = 0xf;
   entry->frames[1] = 0xe;
   entry->frames[2] = 0xd;
@@ -1028,7 +1062,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_multi) {
 
   // These values will be in the reverse order that we create.
   entry2->size = 500;
-  entry2->num_frames = 4;
+  entry2->num_allocations = 1;
   entry2->frames[0] = 0xf;
   entry2->frames[1] = 0xe;
   entry2->frames[2] = 0xd;
@@ -1043,7 +1077,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_multi) {
   memset(pointers[0], 0, entry2->size);
 
   entry1->size = 4100;
-  entry1->num_frames = 16;
+  entry1->num_allocations = 1;
   for (size_t i = 0; i < 16; i++) {
     entry1->frames[i] = 0xbc000 + i;
   }
@@ -1058,7 +1092,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_multi) {
   memset(pointers[1], 0, entry1->size);
 
   entry0->size = 9000;
-  entry0->num_frames = 1;
+  entry0->num_allocations = 1;
 
   entry0->frames[0] = 0x104;
   backtrace_fake_add(std::vector<uintptr_t> {0x104});
@@ -1105,7 +1139,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_multi_skip_empty_backtrace) {
 
   // These values will be in the reverse order that we create.
   entry1->size = 500;
-  entry1->num_frames = 4;
+  entry1->num_allocations = 1;
   entry1->frames[0] = 0xf;
   entry1->frames[1] = 0xe;
   entry1->frames[2] = 0xd;
@@ -1120,7 +1154,7 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_multi_skip_empty_backtrace) {
   memset(pointers[0], 0, entry1->size);
 
   entry0->size = 4100;
-  entry0->num_frames = 16;
+  entry0->num_allocations = 1;
   for (size_t i = 0; i < 16; i++) {
     entry0->frames[i] = 0xbc000 + i;
   }
@@ -1162,6 +1196,79 @@ TEST_F(MallocDebugTest, get_malloc_leak_info_multi_skip_empty_backtrace) {
   ASSERT_STREQ("", getFakeLogPrint().c_str());
 }
 
+TEST_F(MallocDebugTest, get_malloc_leak_info_same_backtrace) {
+  Init("backtrace=16");
+
+  // Create the expected info buffer.
+  size_t individual_size = 2 * sizeof(size_t) + 16 * sizeof(uintptr_t);
+  std::vector<uint8_t> expected_info(individual_size * 2);
+  memset(expected_info.data(), 0, individual_size * 2);
+
+  InfoEntry* entry0 = reinterpret_cast<InfoEntry*>(expected_info.data());
+  InfoEntry* entry1 = reinterpret_cast<InfoEntry*>(
+      reinterpret_cast<uintptr_t>(entry0) + individual_size);
+
+  // Allocations with the same size and backtrace share an entry.
+  entry0->size = 300;
+  entry0->num_allocations = 3;
+  entry0->frames[0] = 0xf;
+  entry0->frames[1] = 0xe;
+  entry0->frames[2] = 0xd;
+
+  // The same backtrace with a different size is a different entry.
+  entry1->size = 200;
+  entry1->num_allocations = 1;
+  entry1->frames[0] = 0xf;
+  entry1->frames[1] = 0xe;
+  entry1->frames[2] = 0xd;
+
+  std::vector<uint8_t*> pointers;
+  for (size_t i = 0; i < 3; i++) {
+    backtrace_fake_add(std::vector<uintptr_t> {0xf, 0xe, 0xd});
+    pointers.push_back(reinterpret_cast<uint8_t*>(debug_malloc(300)));
+    ASSERT_TRUE(pointers.back() != nullptr);
+  }
+  backtrace_fake_add(std::vector<uintptr_t> {0xf, 0xe, 0xd});
+  pointers.push_back(reinterpret_cast<uint8_t*>(debug_malloc(200)));
+  ASSERT_TRUE(pointers.back() != nullptr);
+
+  uint8_t* info;
+  size_t overall_size;
+  size_t info_size;
+  size_t total_memory;
+  size_t backtrace_size;
+
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(individual_size * 2, overall_size);
+  ASSERT_EQ(individual_size, info_size);
+  ASSERT_EQ(3 * 300U + 200U, total_memory);
+  ASSERT_EQ(16U, backtrace_size);
+  ASSERT_TRUE(memcmp(expected_info.data(), info, overall_size) == 0);
+
+  debug_free_malloc_leak_info(info);
+
+  // Free all but one of the shared allocations, the backtrace must
+  // still be intact.
+  debug_free(pointers[0]);
+  debug_free(pointers[1]);
+  debug_free(pointers[3]);
+
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(individual_size, overall_size);
+  ASSERT_EQ(300U, total_memory);
+  entry0->num_allocations = 1;
+  ASSERT_TRUE(memcmp(expected_info.data(), info, overall_size) == 0);
+
+  debug_free_malloc_leak_info(info);
+
+  debug_free(pointers[2]);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugTest, realloc_usable_size) {
   Init("front_guard");
 
@@ -1264,6 +1371,374 @@ TEST_F(MallocDebugTest, backtrace_enable_on_signal) {
   ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
 }
 
+TEST_F(MallocDebugTest, sample_bytes_small_not_sampled) {
+  Init("sample_bytes=1073741824");
+
+  backtrace_fake_add(std::vector<uintptr_t> {0xbc000, 0xecd00, 0x12000});
+
+  std::vector<void*> pointers;
+  for (size_t i = 0; i < 100; i++) {
+    void* pointer = debug_malloc(16);
+    ASSERT_TRUE(pointer != nullptr);
+    pointers.push_back(pointer);
+  }
+
+  uint8_t* info;
+  size_t overall_size;
+  size_t info_size;
+  size_t total_memory;
+  size_t backtrace_size;
+
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info == nullptr);
+  ASSERT_EQ(0U, overall_size);
+  ASSERT_EQ(0U, info_size);
+  ASSERT_EQ(0U, total_memory);
+  ASSERT_EQ(0U, backtrace_size);
+
+  for (auto pointer : pointers) {
+    debug_free(pointer);
+  }
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string expected_log = android::base::StringPrintf(
+      "4 malloc_debug malloc_testing: Run: 'kill -%d %d' to dump the sampled heap profile.\n",
+      SIGRTMIN + 11, getpid());
+  ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugTest, sample_bytes_large_sampled) {
+  Init("sample_bytes=1");
+
+  size_t individual_size = 2 * sizeof(size_t) + 16 * sizeof(uintptr_t);
+
+  backtrace_fake_add(std::vector<uintptr_t> {0xbc000, 0xecd00, 0x12000});
+
+  void* pointer = debug_malloc(4096);
+  ASSERT_TRUE(pointer != nullptr);
+
+  uint8_t* info;
+  size_t overall_size;
+  size_t info_size;
+  size_t total_memory;
+  size_t backtrace_size;
+
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(individual_size, overall_size);
+  ASSERT_EQ(individual_size, info_size);
+  ASSERT_EQ(4096U, total_memory);
+  ASSERT_EQ(16U, backtrace_size);
+  uintptr_t* ips = reinterpret_cast<uintptr_t*>(&info[2 * sizeof(size_t)]);
+  ASSERT_EQ(0xbc000U, ips[0]);
+  ASSERT_EQ(0xecd00U, ips[1]);
+  ASSERT_EQ(0x12000U, ips[2]);
+
+  debug_free_malloc_leak_info(info);
+
+  debug_free(pointer);
+
+  // Once freed, the allocation is no longer tracked.
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info == nullptr);
+  ASSERT_EQ(0U, total_memory);
+}
+
+TEST_F(MallocDebugTest, sample_bytes_dump_on_signal) {
+  Init("sample_bytes=1");
+
+  backtrace_fake_add(std::vector<uintptr_t> {0x1000, 0x2000});
+  void* pointer1 = debug_malloc(1000);
+  ASSERT_TRUE(pointer1 != nullptr);
+
+  backtrace_fake_add(std::vector<uintptr_t> {0x1000, 0x2000});
+  void* pointer2 = debug_malloc(1000);
+  ASSERT_TRUE(pointer2 != nullptr);
+
+  backtrace_fake_add(std::vector<uintptr_t> {0xa000, 0xb000, 0xc000});
+  void* pointer3 = debug_malloc(3000);
+  ASSERT_TRUE(pointer3 != nullptr);
+
+  ASSERT_TRUE(kill(getpid(), SIGRTMIN + 11) == 0);
+  sleep(1);
+
+  // The dump is done by the next sampled allocation.
+  void* pointer4 = debug_malloc(100);
+  ASSERT_TRUE(pointer4 != nullptr);
+
+  debug_free(pointer1);
+  debug_free(pointer2);
+  debug_free(pointer3);
+  debug_free(pointer4);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string expected_log = android::base::StringPrintf(
+      "4 malloc_debug malloc_testing: Run: 'kill -%d %d' to dump the sampled heap profile.\n",
+      SIGRTMIN + 11, getpid());
+  expected_log += "4 malloc_debug +++ malloc_testing sampled heap profile: 3 samples of "
+      "5000 bytes, sample_bytes 1\n";
+  expected_log += "4 malloc_debug +++ malloc_testing estimated live heap: 3 allocations, "
+      "5000 bytes\n";
+  expected_log += "4 malloc_debug +++ malloc_testing stack 1 of 2: 1 samples of 3000 bytes, "
+      "estimated 1 allocations, 3000 bytes\n";
+  expected_log += "4 malloc_debug Backtrace at time of allocation:\n";
+  expected_log += "6 malloc_debug   #00 pc 0xa000\n";
+  expected_log += "6 malloc_debug   #01 pc 0xb000\n";
+  expected_log += "6 malloc_debug   #02 pc 0xc000\n";
+  expected_log += "4 malloc_debug +++ malloc_testing stack 2 of 2: 2 samples of 2000 bytes, "
+      "estimated 2 allocations, 2000 bytes\n";
+  expected_log += "4 malloc_debug Backtrace at time of allocation:\n";
+  expected_log += "6 malloc_debug   #00 pc 0x1000\n";
+  expected_log += "6 malloc_debug   #01 pc 0x2000\n";
+  ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugTest, sample_bytes_estimates) {
+  // A sample of an allocation as large as the sample interval stands for
+  // 1 / (1 - exp(-1)) allocations.
+  ASSERT_NEAR(1.582, SampleData::EstimateCount(1024, 1024), 0.001);
+  ASSERT_NEAR(1619.95, SampleData::EstimateBytes(1024, 1024), 0.01);
+
+  // Allocations much larger than the interval are always sampled.
+  ASSERT_DOUBLE_EQ(1.0, SampleData::EstimateCount(1024 * 1024, 1024));
+  ASSERT_DOUBLE_EQ(1024.0 * 1024.0, SampleData::EstimateBytes(1024 * 1024, 1024));
+
+  // Small allocations are scaled up to about one sample interval.
+  ASSERT_NEAR(1024.5, SampleData::EstimateCount(1, 1024), 0.01);
+  ASSERT_NEAR(1024.5, SampleData::EstimateBytes(1, 1024), 0.01);
+
+  // The estimates are summed before rounding: three samples of 1024 bytes
+  // stand for about 4.75 allocations, not 3 * 2.
+  double total = 0.0;
+  for (size_t i = 0; i < 3; i++) {
+    total += SampleData::EstimateCount(1024, 1024);
+  }
+  ASSERT_EQ(5U, static_cast<size_t>(total + 0.5));
+}
+
+#if defined(__BIONIC__)
+static constexpr char RECORD_ALLOCS_FILE[] = "/data/local/tmp/malloc_debug_record_allocs";
+#else
+static constexpr char RECORD_ALLOCS_FILE[] = "/tmp/malloc_debug_record_allocs";
+#endif
+
+static void ReadRecordEntries(std::vector<RecordEntry>* entries) {
+  std::string path = android::base::StringPrintf("%s.%d", RECORD_ALLOCS_FILE, getpid());
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  ASSERT_NE(-1, fd);
+
+  RecordFileHeader header;
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(header)), read(fd, &header, sizeof(header)));
+  ASSERT_EQ(0, memcmp(RECORD_FILE_MAGIC, header.magic, sizeof(header.magic)));
+  ASSERT_EQ(RECORD_FILE_VERSION, header.version);
+  ASSERT_EQ(sizeof(RecordEntry), header.entry_size);
+
+  RecordEntry entry;
+  while (read(fd, &entry, sizeof(entry)) == static_cast<ssize_t>(sizeof(entry))) {
+    entries->push_back(entry);
+  }
+  close(fd);
+  unlink(path.c_str());
+
+  std::sort(entries->begin(), entries->end(),
+            [](const RecordEntry& a, const RecordEntry& b) { return a.sequence < b.sequence; });
+}
+
+TEST_F(MallocDebugTest, record_allocs) {
+  Init(android::base::StringPrintf("record_allocs=4 record_allocs_file=%s",
+                                   RECORD_ALLOCS_FILE).c_str());
+
+  void* malloc_pointer = debug_malloc(100);
+  ASSERT_TRUE(malloc_pointer != nullptr);
+  void* calloc_pointer = debug_calloc(10, 20);
+  ASSERT_TRUE(calloc_pointer != nullptr);
+  void* memalign_pointer = debug_memalign(64, 300);
+  ASSERT_TRUE(memalign_pointer != nullptr);
+  void* realloc_pointer = debug_realloc(malloc_pointer, 4000);
+  ASSERT_TRUE(realloc_pointer != nullptr);
+  debug_free(calloc_pointer);
+  debug_free(memalign_pointer);
+  debug_free(realloc_pointer);
+
+  // Flush the rest of the entries.
+  debug_finalize();
+  initialized = false;
+
+  std::vector<RecordEntry> entries;
+  ASSERT_NO_FATAL_FAILURE(ReadRecordEntries(&entries));
+  ASSERT_EQ(7U, entries.size());
+
+  uint32_t tid = gettid();
+  for (size_t i = 0; i < entries.size(); i++) {
+    ASSERT_EQ(i, entries[i].sequence);
+    ASSERT_EQ(tid, entries[i].tid);
+    if (i > 0) {
+      ASSERT_LE(entries[i - 1].timestamp_ns, entries[i].timestamp_ns);
+    }
+  }
+
+  ASSERT_EQ(RECORD_OP_MALLOC, entries[0].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(malloc_pointer), entries[0].pointer);
+  ASSERT_EQ(100U, entries[0].size);
+
+  ASSERT_EQ(RECORD_OP_CALLOC, entries[1].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(calloc_pointer), entries[1].pointer);
+  ASSERT_EQ(20U, entries[1].size);
+  ASSERT_EQ(10U, entries[1].extra);
+
+  ASSERT_EQ(RECORD_OP_MEMALIGN, entries[2].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(memalign_pointer), entries[2].pointer);
+  ASSERT_EQ(300U, entries[2].size);
+  ASSERT_EQ(64U, entries[2].extra);
+
+  ASSERT_EQ(RECORD_OP_REALLOC, entries[3].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(realloc_pointer), entries[3].pointer);
+  ASSERT_EQ(4000U, entries[3].size);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(malloc_pointer), entries[3].extra);
+
+  ASSERT_EQ(RECORD_OP_FREE, entries[4].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(calloc_pointer), entries[4].pointer);
+  ASSERT_EQ(RECORD_OP_FREE, entries[5].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(memalign_pointer), entries[5].pointer);
+  ASSERT_EQ(RECORD_OP_FREE, entries[6].op);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(realloc_pointer), entries[6].pointer);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+static void* RecordAllocsThread(void* data) {
+  uint32_t* tid = reinterpret_cast<uint32_t*>(data);
+  *tid = gettid();
+  for (size_t i = 0; i < 3; i++) {
+    debug_free(debug_malloc(32));
+  }
+  return nullptr;
+}
+
+TEST_F(MallocDebugTest, record_allocs_thread_exit) {
+  Init(android::base::StringPrintf("record_allocs=100 record_allocs_file=%s",
+                                   RECORD_ALLOCS_FILE).c_str());
+
+  // The buffer of the thread is written out when it exits.
+  uint32_t thread_tid;
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, nullptr, RecordAllocsThread, &thread_tid));
+  ASSERT_EQ(0, pthread_join(thread, nullptr));
+
+  std::vector<RecordEntry> entries;
+  ASSERT_NO_FATAL_FAILURE(ReadRecordEntries(&entries));
+  ASSERT_EQ(6U, entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    ASSERT_EQ(thread_tid, entries[i].tid);
+    ASSERT_EQ((i % 2 == 0) ? RECORD_OP_MALLOC : RECORD_OP_FREE, entries[i].op);
+  }
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+#if defined(__BIONIC__)
+static constexpr char HEAP_SNAPSHOT_FILE[] = "/data/local/tmp/malloc_debug_heap_snapshot";
+#else
+static constexpr char HEAP_SNAPSHOT_FILE[] = "/tmp/malloc_debug_heap_snapshot";
+#endif
+
+TEST_F(MallocDebugTest, heap_snapshot_on_signal) {
+  Init(android::base::StringPrintf("heap_snapshot heap_snapshot_file=%s",
+                                   HEAP_SNAPSHOT_FILE).c_str());
+
+  backtrace_fake_add(std::vector<uintptr_t> {0x1000, 0x2000});
+  void* pointer1 = debug_malloc(1000);
+  ASSERT_TRUE(pointer1 != nullptr);
+
+  backtrace_fake_add(std::vector<uintptr_t> {0x1000, 0x2000});
+  void* pointer2 = debug_malloc(1000);
+  ASSERT_TRUE(pointer2 != nullptr);
+
+  backtrace_fake_add(std::vector<uintptr_t> {0xa000, 0xb000, 0xc000});
+  void* pointer3 = debug_malloc(3000);
+  ASSERT_TRUE(pointer3 != nullptr);
+
+  ASSERT_TRUE(kill(getpid(), SIGRTMIN + 12) == 0);
+  sleep(1);
+
+  // The snapshot is written by the next allocation, which has no backtrace.
+  void* pointer4 = debug_malloc(100);
+  ASSERT_TRUE(pointer4 != nullptr);
+
+  std::string path = android::base::StringPrintf("%s.%d.0", HEAP_SNAPSHOT_FILE, getpid());
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &contents));
+  unlink(path.c_str());
+
+  std::string expected =
+      "Android Native Heap Snapshot v1.0\n\n"
+      "Total memory: 5100\n"
+      "Total allocations: 4\n"
+      "Backtrace records: 3\n"
+      "Backtrace size: 16\n\n"
+      "num 1  bytes 3000  bt a000 b000 c000\n"
+      "num 2  bytes 2000  bt 1000 2000\n"
+      "num 1  bytes 100  bt\n"
+      "MAPS\n";
+  ASSERT_EQ(expected, contents.substr(0, expected.size()));
+  ASSERT_NE(std::string::npos, contents.find("[stack]"));
+  ASSERT_EQ("END\n", contents.substr(contents.size() - 4));
+
+  // The stacks are still valid after the snapshot.
+  uint8_t* info;
+  size_t overall_size;
+  size_t info_size;
+  size_t total_memory;
+  size_t backtrace_size;
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(2 * info_size, overall_size);
+  debug_free_malloc_leak_info(info);
+
+  debug_free(pointer1);
+  debug_free(pointer2);
+  debug_free(pointer3);
+  debug_free(pointer4);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string expected_log = android::base::StringPrintf(
+      "4 malloc_debug malloc_testing: Run: 'kill -%d %d' to write a heap snapshot.\n",
+      SIGRTMIN + 12, getpid());
+  ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugTest, heap_snapshot_signal) {
+  Init(android::base::StringPrintf("heap_snapshot heap_snapshot_file=%s heap_snapshot_signal=%d",
+                                   HEAP_SNAPSHOT_FILE, SIGRTMIN + 3).c_str());
+
+  backtrace_fake_add(std::vector<uintptr_t> {0x1000, 0x2000});
+  void* pointer1 = debug_malloc(1000);
+  ASSERT_TRUE(pointer1 != nullptr);
+
+  ASSERT_TRUE(kill(getpid(), SIGRTMIN + 3) == 0);
+  sleep(1);
+
+  void* pointer2 = debug_malloc(100);
+  ASSERT_TRUE(pointer2 != nullptr);
+
+  std::string path = android::base::StringPrintf("%s.%d.0", HEAP_SNAPSHOT_FILE, getpid());
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &contents));
+  unlink(path.c_str());
+  ASSERT_EQ(0U, contents.find("Android Native Heap Snapshot v1.0\n"));
+
+  debug_free(pointer1);
+  debug_free(pointer2);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string expected_log = android::base::StringPrintf(
+      "4 malloc_debug malloc_testing: Run: 'kill -%d %d' to write a heap snapshot.\n",
+      SIGRTMIN + 3, getpid());
+  ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugTest, overflow) {
   Init("guard fill_on_free");
 
@@ -1313,7 +1788,7 @@ static void VerifyZygoteSet(size_t memory_bytes) {
   memset(expected_info.data(), 0, expected_info_size);
   InfoEntry* entry = reinterpret_cast<InfoEntry*>(expected_info.data());
   entry->size = memory_bytes | (1U << 31);
-  entry->num_frames = 1;
+  entry->num_allocations = 1;
   entry->frames[0] = 0x1;
 
   uint8_t* info;
@@ -67,6 +67,31 @@ static inline int __futex_wait_ex(volatile void* ftx, bool shared, int value, co
   return __futex(ftx, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, value, timeout);
 }
 
+// Wakes up to wake_count waiters on ftx and moves up to requeue_count more of them to wait on
+// ftx2 instead, if ftx still holds expected_value. Returns -EAGAIN if it doesn't.
+static inline int __futex_cmp_requeue_ex(volatile void* ftx, bool shared, int wake_count,
+                                         int requeue_count, volatile void* ftx2,
+                                         int expected_value) {
+  int saved_errno = errno;
+  int result = syscall(__NR_futex, ftx, shared ? FUTEX_CMP_REQUEUE : FUTEX_CMP_REQUEUE_PRIVATE,
+                       wake_count, requeue_count, ftx2, expected_value);
+  if (__predict_false(result == -1)) {
+    result = -errno;
+    errno = saved_errno;
+  }
+  return result;
+}
+
+// Priority inheritance futexes hold the owner's tid. The kernel boosts
+// the owner to the priority of the highest priority waiter.
+static inline int __futex_pi_lock_ex(volatile void* ftx, bool shared, const struct timespec* abs_realtime_timeout) {
+  return __futex(ftx, shared ? FUTEX_LOCK_PI : FUTEX_LOCK_PI_PRIVATE, 0, abs_realtime_timeout);
+}
+
+static inline int __futex_pi_unlock(volatile void* ftx, bool shared) {
+  return __futex(ftx, shared ? FUTEX_UNLOCK_PI : FUTEX_UNLOCK_PI_PRIVATE, 0, NULL);
+}
+
 __END_DECLS
 
 #endif /* _BIONIC_FUTEX_H */
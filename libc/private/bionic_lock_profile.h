@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BIONIC_LOCK_PROFILE_H
+#define _BIONIC_LOCK_PROFILE_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include "bionic_macros.h"
+
+// Lock contention profiling. When enabled with LIBC_LOCK_PROFILE=1 in the environment, or
+// with the libc.debug.lock_profile property, every wait for a contended lock is recorded
+// against the lock and a short backtrace of the waiter. SIGRTMIN + 13 wakes a dedicated thread
+// that dumps the table to the log.
+//
+// To profile the wait for a lock, put one of these in a scope around the futex wait:
+//   ScopedLockProfile profile(lock);
+// When profiling is off, this costs a load and a branch.
+
+__LIBC_HIDDEN__ extern bool __lock_profile_enabled;
+
+__LIBC_HIDDEN__ void __lock_profile_init();
+__LIBC_HIDDEN__ uint64_t __lock_profile_start();
+__LIBC_HIDDEN__ void __lock_profile_record(const volatile void* lock, uint64_t start_ns);
+
+class __LIBC_HIDDEN__ ScopedLockProfile {
+ public:
+  explicit ScopedLockProfile(const volatile void* lock) : lock_(lock), start_ns_(0) {
+    if (__predict_false(__lock_profile_enabled)) {
+      start_ns_ = __lock_profile_start();
+    }
+  }
+
+  ~ScopedLockProfile() {
+    if (__predict_false(start_ns_ != 0)) {
+      __lock_profile_record(lock_, start_ns_);
+    }
+  }
+
+ private:
+  const volatile void* lock_;
+  uint64_t start_ns_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedLockProfile);
+};
+
+#endif  // _BIONIC_LOCK_PROFILE_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BIONIC_PERCPU_H
+#define _BIONIC_PERCPU_H
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bionic/pthread_internal.h>
+
+#include "private/bionic_lock.h"
+#include "private/bionic_macros.h"
+
+// Per-cpu sharded data. Threads pick a shard from the cpu their rseq area says they're on,
+// so threads on different cpus touch different cache lines. A thread can migrate between
+// picking a shard and using it, so each shard is still updated atomically or under its own
+// lock; migration just makes that rarely contended rather than wrong.
+//
+// Zero-initialized memory is a valid empty PerCpuCounter or PerCpuFreeList, so either can
+// be a global without a constructor.
+
+#define BIONIC_PERCPU_SHARD_COUNT 32  // Must be a power of two.
+#define BIONIC_PERCPU_SHARD_SIZE  64  // A cache line.
+
+static inline size_t __percpu_shard() {
+  int cpu = __rseq_cpu_id(&__get_thread()->rseq);
+  if (__predict_false(cpu < 0)) {
+    cpu = sched_getcpu();
+    if (cpu < 0) {
+      cpu = 0;
+    }
+  }
+  return static_cast<size_t>(cpu) & (BIONIC_PERCPU_SHARD_COUNT - 1);
+}
+
+class PerCpuCounter {
+ public:
+  void add(uint64_t n) {
+    atomic_fetch_add_explicit(&shards_[__percpu_shard()].value, n, memory_order_relaxed);
+  }
+
+  // The sum is only exact if no one is adding concurrently.
+  uint64_t read() {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BIONIC_PERCPU_SHARD_COUNT; ++i) {
+      sum += atomic_load_explicit(&shards_[i].value, memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  struct shard_t {
+    _Atomic(uint64_t) value;
+    char __pad[BIONIC_PERCPU_SHARD_SIZE - sizeof(_Atomic(uint64_t))];
+  };
+  shard_t shards_[BIONIC_PERCPU_SHARD_COUNT];
+};
+
+// A free list of caller-owned nodes. Nodes go back on the current cpu's shard, and pop()
+// only looks at other cpus' shards when the current one is empty.
+struct PerCpuFreeListNode {
+  PerCpuFreeListNode* next;
+};
+
+class PerCpuFreeList {
+ public:
+  void push(PerCpuFreeListNode* node) {
+    shard_t& shard = shards_[__percpu_shard()];
+    shard.lock.lock();
+    node->next = shard.head;
+    shard.head = node;
+    shard.lock.unlock();
+  }
+
+  PerCpuFreeListNode* pop() {
+    size_t first = __percpu_shard();
+    for (size_t i = 0; i < BIONIC_PERCPU_SHARD_COUNT; ++i) {
+      shard_t& shard = shards_[(first + i) & (BIONIC_PERCPU_SHARD_COUNT - 1)];
+      // Skip empty shards without taking their locks.
+      if (*reinterpret_cast<PerCpuFreeListNode* volatile*>(&shard.head) == NULL) {
+        continue;
+      }
+      shard.lock.lock();
+      PerCpuFreeListNode* node = shard.head;
+      if (node != NULL) {
+        shard.head = node->next;
+      }
+      shard.lock.unlock();
+      if (node != NULL) {
+        return node;
+      }
+    }
+    return NULL;
+  }
+
+ private:
+  struct shard_t {
+    Lock lock;
+    PerCpuFreeListNode* head;
+    char __pad[BIONIC_PERCPU_SHARD_SIZE - sizeof(Lock) - sizeof(PerCpuFreeListNode*)];
+  };
+  shard_t shards_[BIONIC_PERCPU_SHARD_COUNT];
+};
+
+#endif  // _BIONIC_PERCPU_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BIONIC_RSEQ_H
+#define _BIONIC_RSEQ_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/syscall.h>
+
+// Restartable sequences. Each thread registers a bionic_rseq with the kernel, which keeps its
+// cpu_id field up to date whenever the thread is scheduled. That makes the current cpu a plain
+// load rather than a system call. Setting LIBC_RSEQ=0 in the environment turns this off, for
+// programs that register rseq areas of their own; others can share libc's through __rseq_offset.
+//
+// Our kernel headers predate rseq, so the ABI is spelled out here.
+
+#if !defined(__NR_rseq)
+#if defined(__aarch64__)
+#define __NR_rseq 293
+#elif defined(__arm__)
+#define __NR_rseq (__NR_SYSCALL_BASE + 398)
+#elif defined(__i386__)
+#define __NR_rseq 386
+#elif defined(__x86_64__)
+#define __NR_rseq 334
+#elif defined(__mips__) && defined(__LP64__)
+#define __NR_rseq (__NR_Linux + 327)
+#elif defined(__mips__)
+#define __NR_rseq (__NR_Linux + 367)
+#endif
+#endif
+
+// The signature the kernel checks before jumping to an abort handler. These are the values
+// other C libraries use, so tools that recognize them keep working.
+#if defined(__aarch64__)
+#define BIONIC_RSEQ_SIG 0xd428bc00
+#elif defined(__arm__)
+#define BIONIC_RSEQ_SIG 0xe7f5def3
+#elif defined(__i386__) || defined(__x86_64__)
+#define BIONIC_RSEQ_SIG 0x53053053
+#elif defined(__mips__)
+#define BIONIC_RSEQ_SIG 0x0350000d
+#endif
+
+#define BIONIC_RSEQ_FLAG_UNREGISTER 1
+
+// Values of cpu_id before registration, and if the kernel refused it.
+#define BIONIC_RSEQ_CPU_ID_UNINITIALIZED (-1)
+#define BIONIC_RSEQ_CPU_ID_REGISTRATION_FAILED (-2)
+
+// Matches the kernel's struct rseq.
+struct bionic_rseq {
+  uint32_t cpu_id_start;
+  int32_t cpu_id;
+  uint64_t rseq_cs;
+  uint32_t flags;
+} __attribute__((aligned(32)));
+
+__LIBC_HIDDEN__ void __rseq_init();
+__LIBC_HIDDEN__ void __rseq_register(bionic_rseq* rseq);
+__LIBC_HIDDEN__ void __rseq_unregister(bionic_rseq* rseq);
+
+// Returns the cpu the calling thread is running on, or a negative value if its area isn't
+// registered. The answer may be stale as soon as it's returned, so only use it as a hint.
+static inline int __rseq_cpu_id(const bionic_rseq* rseq) {
+  return *reinterpret_cast<const volatile int32_t*>(&rseq->cpu_id);
+}
+
+#endif  // _BIONIC_RSEQ_H
@@ -37,6 +37,7 @@ __BEGIN_DECLS
 __LIBC_HIDDEN__ void __unsafe_stack_main_thread_init();
 __LIBC_HIDDEN__ int __unsafe_stack_alloc(pthread_internal_t* thr,
                                           size_t stack_size, size_t guard);
+__LIBC_HIDDEN__ int __unsafe_stack_reuse(pthread_internal_t* thr);
 __LIBC_HIDDEN__ void __unsafe_stack_free(pthread_internal_t* thr);
 __LIBC_HIDDEN__ void __unsafe_stack_set_vma_name(pthread_internal_t* thr,
                                                  size_t guard, char* buf,
@@ -46,6 +47,9 @@ static inline void __unsafe_stack_main_thread_init() {}
 static inline int __unsafe_stack_alloc(pthread_internal_t*, size_t, size_t) {
   return 0;
 }
+static inline int __unsafe_stack_reuse(pthread_internal_t*) {
+  return 0;
+}
 static inline void __unsafe_stack_free(pthread_internal_t*) {}
 static inline void __unsafe_stack_set_vma_name(pthread_internal_t*, size_t,
                                                char*, size_t) {}
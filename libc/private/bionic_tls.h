@@ -67,6 +67,11 @@ enum {
   TLS_SLOT_STACK_GUARD = 5, // GCC requires this specific slot for x86.
   TLS_SLOT_DLERROR,
 
+  // Used by libc_malloc_debug for its per-thread data, so that enabling
+  // malloc debug doesn't take any of the application's pthread keys.
+  TLS_SLOT_MALLOC_DEBUG_DISABLE = 7,
+  TLS_SLOT_MALLOC_DEBUG = 8,
+
   // Unsafe stack pointer. See http://clang.llvm.org/docs/SafeStack.html.
   // This slot is accessed directly from the compiled code. Don't move.
   TLS_SLOT_SAFESTACK = 9,
@@ -100,12 +105,15 @@ enum {
 
 #define LIBC_PTHREAD_KEY_RESERVED_COUNT 12
 
+/* libc_malloc_debug uses a single key to free its per thread data. */
+#define MALLOC_DEBUG_PTHREAD_KEY_RESERVED_COUNT 1
+
 #if defined(USE_JEMALLOC)
 /* Internally, jemalloc uses a single key for per thread data. */
 #define JEMALLOC_PTHREAD_KEY_RESERVED_COUNT 1
-#define BIONIC_PTHREAD_KEY_RESERVED_COUNT (LIBC_PTHREAD_KEY_RESERVED_COUNT + JEMALLOC_PTHREAD_KEY_RESERVED_COUNT)
+#define BIONIC_PTHREAD_KEY_RESERVED_COUNT (LIBC_PTHREAD_KEY_RESERVED_COUNT + MALLOC_DEBUG_PTHREAD_KEY_RESERVED_COUNT + JEMALLOC_PTHREAD_KEY_RESERVED_COUNT)
 #else
-#define BIONIC_PTHREAD_KEY_RESERVED_COUNT LIBC_PTHREAD_KEY_RESERVED_COUNT
+#define BIONIC_PTHREAD_KEY_RESERVED_COUNT (LIBC_PTHREAD_KEY_RESERVED_COUNT + MALLOC_DEBUG_PTHREAD_KEY_RESERVED_COUNT)
 #endif
 
 /*
@@ -30,16 +30,25 @@
 
 #include <time.h>
 
+// A NULL name means this architecture's vdso never has the function.
 #if defined(__aarch64__)
 #define VDSO_CLOCK_GETTIME_SYMBOL "__kernel_clock_gettime"
 #define VDSO_GETTIMEOFDAY_SYMBOL  "__kernel_gettimeofday"
+#define VDSO_CLOCK_GETRES_SYMBOL  "__kernel_clock_getres"
+#define VDSO_TIME_SYMBOL          NULL
+#define VDSO_GETCPU_SYMBOL        NULL
 #elif defined(__x86_64__) || defined(__i386__)
 #define VDSO_CLOCK_GETTIME_SYMBOL "__vdso_clock_gettime"
 #define VDSO_GETTIMEOFDAY_SYMBOL  "__vdso_gettimeofday"
+#define VDSO_CLOCK_GETRES_SYMBOL  "__vdso_clock_getres"
+#define VDSO_TIME_SYMBOL          "__vdso_time"
+#define VDSO_GETCPU_SYMBOL        "__vdso_getcpu"
 #endif
 
 extern "C" int __clock_gettime(int, timespec*);
 extern "C" int __gettimeofday(timeval*, struct timezone*);
+extern "C" int __clock_getres(int, timespec*);
+extern "C" int __getcpu(unsigned*, unsigned*, void*);
 
 struct vdso_entry {
   const char* name;
@@ -49,6 +58,9 @@ struct vdso_entry {
 enum {
   VDSO_CLOCK_GETTIME = 0,
   VDSO_GETTIMEOFDAY,
+  VDSO_CLOCK_GETRES,
+  VDSO_TIME,
+  VDSO_GETCPU,
   VDSO_END
 };
 
@@ -15,6 +15,8 @@
 
 #include "tzfile.h"
 #include "fcntl.h"
+#include <stdatomic.h>
+#include <stddef.h>
 
 #if THREAD_SAFE
 # include <pthread.h>
@@ -160,23 +162,51 @@ static bool typesequiv(struct state const *, int, int);
 static bool tzparse(char const *, struct state *, bool);
 
 #ifdef ALL_STATE
-static struct state * lclptr;
 static struct state * gmtptr;
 #endif /* defined ALL_STATE */
 
 #ifndef ALL_STATE
-static struct state lclmem;
 static struct state gmtmem;
-#define lclptr      (&lclmem)
 #define gmtptr      (&gmtmem)
 #endif /* State Farm */
 
+/*
+** The local time zone. Each zone is loaded into a struct lclzone of its
+** own that is never changed or freed once it has been published in
+** lclzone, so localtime_r and mktime can use it without taking locallock.
+** tzname points into it too. Up to LCLZONES_MAX zones are kept on lclzones
+** so that switching back to one doesn't allocate another. Any other zone,
+** and any zone that fails to load, goes in lcloverflow, which is rewritten
+** in place like upstream's lclmem and so is only used under locallock.
+*/
+struct lclzone {
+  struct lclzone *next;
+  struct state    state;
+  bool            reused;	/* lcloverflow */
+  int             lcl;		/* as for tzset: -1 for a null TZ, 1 if NAME
+				   is TZ, 0 if TZ didn't fit in lcloverflow */
+  char            name[];
+};
+
+#define LCLZONES_MAX 8
+
 #ifndef TZ_STRLEN_MAX
 #define TZ_STRLEN_MAX 255
 #endif /* !defined TZ_STRLEN_MAX */
 
-static char lcl_TZname[TZ_STRLEN_MAX + 1];
-static int  lcl_is_set;
+static struct lclzone *         lclzones;	/* guarded by locallock */
+static int                      lclzones_count;	/* guarded by locallock */
+static struct lclzone *         lcloverflow;	/* guarded by locallock */
+static _Atomic(struct lclzone *) lclzone;
+
+/*
+** What lclzone was loaded for when TZ is unset: the serial of the
+** persist.sys.timezone property that named it, or one of these.
+*/
+#define LCLKEY_TZ           (-1)	/* TZ was set, or tzsetwall */
+#define LCLKEY_NO_PROPERTY  (-2)	/* the property didn't exist */
+
+static _Atomic(int_fast64_t)    lclkey = ATOMIC_VAR_INIT(LCLKEY_TZ);
 
 char * tzname[2] = {
     (char *) wildabbr,
@@ -259,13 +289,19 @@ detzcode64(const char *const codep)
 	return result;
 }
 
+/*
+** tzname and timezone are only set under locallock, but mktime reads them
+** without it to see whether it needs to set them, so they're stored
+** atomically.
+*/
 static void
 update_tzname_etc(struct state const *sp, struct ttinfo const *ttisp)
 {
-  tzname[ttisp->tt_isdst] = (char *) &sp->chars[ttisp->tt_abbrind];
+  __atomic_store_n(&tzname[ttisp->tt_isdst],
+		   (char *) &sp->chars[ttisp->tt_abbrind], __ATOMIC_RELAXED);
 #ifdef USG_COMPAT
   if (!ttisp->tt_isdst)
-    timezone = - ttisp->tt_gmtoff;
+    __atomic_store_n(&timezone, - ttisp->tt_gmtoff, __ATOMIC_RELAXED);
 #endif
 #ifdef ALTZONE
   if (ttisp->tt_isdst)
@@ -274,21 +310,22 @@ update_tzname_etc(struct state const *sp, struct ttinfo const *ttisp)
 }
 
 static void
-settzname(void)
+settzname(struct state const *sp)
 {
-	register struct state * const	sp = lclptr;
 	register int			i;
 
-	tzname[0] = tzname[1] = (char *) wildabbr;
+	__atomic_store_n(&tzname[0], (char *) wildabbr, __ATOMIC_RELAXED);
+	__atomic_store_n(&tzname[1], (char *) wildabbr, __ATOMIC_RELAXED);
 #ifdef USG_COMPAT
 	daylight = 0;
-	timezone = 0;
+	__atomic_store_n(&timezone, 0, __ATOMIC_RELAXED);
 #endif /* defined USG_COMPAT */
 #ifdef ALTZONE
 	altzone = 0;
 #endif /* defined ALTZONE */
 	if (sp == NULL) {
-		tzname[0] = tzname[1] = (char *) gmt;
+		__atomic_store_n(&tzname[0], (char *) gmt, __ATOMIC_RELAXED);
+		__atomic_store_n(&tzname[1], (char *) gmt, __ATOMIC_RELAXED);
 		return;
 	}
 	/*
@@ -1273,27 +1310,88 @@ zoneinit(struct state *sp, char const *name)
   }
 }
 
+static bool
+lclzone_is(struct lclzone const *zone, char const *name)
+{
+  return name ? 0 < zone->lcl && strcmp(zone->name, name) == 0 : zone->lcl < 0;
+}
+
+/* The current local time zone, for callers holding locallock. */
+static struct state *
+lclstate(void)
+{
+  struct lclzone *zone = atomic_load_explicit(&lclzone, memory_order_relaxed);
+  return zone ? &zone->state : NULL;
+}
+
+/*
+** Load the zone for NAME into lcloverflow. Return NULL if out of memory.
+*/
+static struct lclzone *
+lclzone_overflow(char const *name)
+{
+  struct lclzone *zone = lcloverflow;
+  if (! zone) {
+    zone = malloc(offsetof(struct lclzone, name) + TZ_STRLEN_MAX + 1);
+    if (! zone)
+      return NULL;
+    zone->next = NULL;
+    zone->reused = true;
+    lcloverflow = zone;
+  }
+  if (zoneinit(&zone->state, name) != 0)
+    zoneinit(&zone->state, "");
+  zone->lcl = name ? strlen(name) <= TZ_STRLEN_MAX : -1;
+  if (0 < zone->lcl)
+    strcpy(zone->name, name);
+  return zone;
+}
+
+/*
+** Return the zone for NAME, loading it if need be, or NULL if out of memory.
+*/
+static struct lclzone *
+lclzone_load(char const *name)
+{
+  struct lclzone *zone;
+  size_t namesize;
+
+  for (zone = lclzones; zone; zone = zone->next)
+    if (lclzone_is(zone, name))
+      return zone;
+  if (lclzones_count == LCLZONES_MAX)
+    return lclzone_overflow(name);
+
+  namesize = name ? strlen(name) + 1 : 1;
+  zone = malloc(offsetof(struct lclzone, name) + namesize);
+  if (! zone)
+    return lclzone_overflow(name);
+  if (zoneinit(&zone->state, name) != 0) {
+    /* Try again next time rather than keep the failure. */
+    free(zone);
+    return lclzone_overflow(name);
+  }
+  zone->reused = false;
+  zone->lcl = name ? 1 : -1;
+  memcpy(zone->name, name ? name : "", namesize);
+  zone->next = lclzones;
+  lclzones = zone;
+  lclzones_count++;
+  return zone;
+}
+
 static void
-tzsetlcl(char const *name)
+tzsetlcl(char const *name, int_fast64_t key)
 {
-  struct state *sp = lclptr;
-  int lcl = name ? strlen(name) < sizeof lcl_TZname : -1;
-  if (lcl < 0
-      ? lcl_is_set < 0
-      : 0 < lcl_is_set && strcmp(lcl_TZname, name) == 0)
-    return;
-#ifdef ALL_STATE
-  if (! sp)
-    lclptr = sp = malloc(sizeof *lclptr);
-#endif /* defined ALL_STATE */
-  if (sp) {
-    if (zoneinit(sp, name) != 0)
-      zoneinit(sp, "");
-    if (0 < lcl)
-      strcpy(lcl_TZname, name);
+  struct lclzone *zone = atomic_load_explicit(&lclzone, memory_order_relaxed);
+  if (! (zone && lclzone_is(zone, name))) {
+    zone = lclzone_load(name);
+    /* If we're out of memory, this leaves no zone loaded, and so GMT. */
+    atomic_store_explicit(&lclzone, zone, memory_order_release);
+    settzname(zone ? &zone->state : NULL);
   }
-  settzname();
-  lcl_is_set = lcl;
+  /* After lclzone, so that a reader that sees the new key sees the new zone. */
+  atomic_store_explicit(&lclkey, key, memory_order_release);
 }
 
 #ifdef STD_INSPIRED
@@ -1302,7 +1400,7 @@ tzsetwall(void)
 {
   if (lock() != 0)
     return;
-  tzsetlcl(NULL);
+  tzsetlcl(NULL, LCLKEY_TZ);
   unlock();
 }
 #endif
@@ -1310,6 +1408,26 @@ tzsetwall(void)
 #if defined(__ANDROID__)
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h> // For __system_property_serial.
+
+// Returns the serial of the "persist.sys.timezone" system property, or LCLKEY_NO_PROPERTY.
+static int_fast64_t
+tz_property_serial(const prop_info **pip)
+{
+  static _Atomic(const prop_info *) tz_property;
+
+  const prop_info *pi = atomic_load_explicit(&tz_property, memory_order_acquire);
+  if (!pi) {
+    pi = __system_property_find("persist.sys.timezone");
+    if (!pi) {
+      return LCLKEY_NO_PROPERTY;
+    }
+    atomic_store_explicit(&tz_property, pi, memory_order_release);
+  }
+  if (pip) {
+    *pip = pi;
+  }
+  return __system_property_serial(pi);
+}
 #endif
 
 static void
@@ -1317,19 +1435,18 @@ tzset_unlocked(void)
 {
 #if defined(__ANDROID__)
   const char * name = getenv("TZ");
+  int_fast64_t key = LCLKEY_TZ;
 
   // Try the "persist.sys.timezone" system property.
   if (name == NULL) {
-    static const prop_info *pi;
+    const prop_info *pi;
 
-    if (!pi) {
-      pi = __system_property_find("persist.sys.timezone");
-    }
-    if (pi) {
+    key = tz_property_serial(&pi);
+    if (key != LCLKEY_NO_PROPERTY) {
       static char buf[PROP_VALUE_MAX];
       static uint32_t s = -1;
       static bool ok = false;
-      uint32_t serial = __system_property_serial(pi);
+      uint32_t serial = key;
       if (serial != s) {
         ok = __system_property_read(pi, 0, buf) > 0;
         s = serial;
@@ -1340,10 +1457,38 @@ tzset_unlocked(void)
     }
   }
 
-  tzsetlcl(name);
+  tzsetlcl(name, key);
+#else
+  const char * name = getenv("TZ");
+  tzsetlcl(name, name ? LCLKEY_TZ : LCLKEY_NO_PROPERTY);
+#endif
+}
+
+/*
+** Returns the zone tzset would pick without taking locallock, or NULL if
+** tzset has to run first because no zone is loaded yet, or TZ or the
+** persist.sys.timezone property has changed since.
+*/
+static struct lclzone *
+lclzone_current(void)
+{
+  const char * name = getenv("TZ");
+  int_fast64_t key = LCLKEY_TZ;
+  struct lclzone *zone;
+
+  if (name == NULL) {
+#if defined(__ANDROID__)
+    key = tz_property_serial(NULL);
 #else
-  tzsetlcl(getenv("TZ"));
+    key = LCLKEY_NO_PROPERTY;
 #endif
+  }
+  if (atomic_load_explicit(&lclkey, memory_order_acquire) != key)
+    return NULL;
+  zone = atomic_load_explicit(&lclzone, memory_order_acquire);
+  if (zone && (zone->reused || (name && !lclzone_is(zone, name))))
+    return NULL;
+  return zone;
 }
 
 void
@@ -1421,6 +1566,30 @@ tzfree(timezone_t sp)
 ** but it is actually a boolean and its value should be 0 or 1.
 */
 
+/*
+** Return the index in SP->ttis of the type in effect at T, for a T within
+** the range SP's transitions cover.
+*/
+static int
+localtype(struct state const *sp, time_t t)
+{
+	if (sp->timecnt == 0 || t < sp->ats[0]) {
+		return sp->defaulttype;
+	} else {
+		register int	lo = 1;
+		register int	hi = sp->timecnt;
+
+		while (lo < hi) {
+			register int	mid = (lo + hi) >> 1;
+
+			if (t < sp->ats[mid])
+				hi = mid;
+			else	lo = mid + 1;
+		}
+		return (int) sp->types[lo - 1];
+	}
+}
+
 /*ARGSUSED*/
 static struct tm *
 localsub(struct state const *sp, time_t const *timep, int_fast32_t setname,
@@ -1467,21 +1636,7 @@ localsub(struct state const *sp, time_t const *timep, int_fast32_t setname,
 			}
 			return result;
 	}
-	if (sp->timecnt == 0 || t < sp->ats[0]) {
-		i = sp->defaulttype;
-	} else {
-		register int	lo = 1;
-		register int	hi = sp->timecnt;
-
-		while (lo < hi) {
-			register int	mid = (lo + hi) >> 1;
-
-			if (t < sp->ats[mid])
-				hi = mid;
-			else	lo = mid + 1;
-		}
-		i = (int) sp->types[lo - 1];
-	}
+	i = localtype(sp, t);
 	ttisp = &sp->ttis[i];
 	/*
 	** To get (wrong) behavior that's compatible with System V Release 2.0
@@ -1514,14 +1669,24 @@ localtime_rz(struct state *sp, time_t const *timep, struct tm *tmp)
 static struct tm *
 localtime_tzset(time_t const *timep, struct tm *tmp, bool setname)
 {
-  int err = lock();
+  int err;
+  /*
+  ** localtime_r only loads a zone if none has been loaded yet, so once one
+  ** has, it can use it without locallock. Setting tzname is left to localtime.
+  */
+  if (!setname) {
+    struct lclzone *zone = atomic_load_explicit(&lclzone, memory_order_acquire);
+    if (zone && !zone->reused)
+      return localsub(&zone->state, timep, false, tmp);
+  }
+  err = lock();
   if (err) {
     errno = err;
     return NULL;
   }
-  if (setname || !lcl_is_set)
+  if (setname || !atomic_load_explicit(&lclzone, memory_order_relaxed))
     tzset_unlocked();
-  tmp = localsub(lclptr, timep, setname, tmp);
+  tmp = localsub(lclstate(), timep, setname, tmp);
   unlock();
   return tmp;
 }
@@ -2156,17 +2321,68 @@ mktime_z(struct state *sp, struct tm *tmp)
 
 #endif
 
+/*
+** Return true if localsub(SP, &T, true, ...) would leave tzname and timezone
+** as they are. Called without locallock.
+*/
+static bool
+tzname_is_set(struct state const *sp, time_t t)
+{
+  struct ttinfo const *ttisp;
+
+  /* Times that localsub maps onto another cycle of the rules are rare. */
+  if ((sp->goback && t < sp->ats[0]) ||
+      (sp->goahead && t > sp->ats[sp->timecnt - 1]))
+    return false;
+  ttisp = &sp->ttis[localtype(sp, t)];
+  if (__atomic_load_n(&tzname[ttisp->tt_isdst], __ATOMIC_RELAXED)
+      != &sp->chars[ttisp->tt_abbrind])
+    return false;
+#ifdef USG_COMPAT
+  if (!ttisp->tt_isdst
+      && __atomic_load_n(&timezone, __ATOMIC_RELAXED) != - ttisp->tt_gmtoff)
+    return false;
+#endif
+#ifdef ALTZONE
+  if (ttisp->tt_isdst && altzone != - ttisp->tt_gmtoff)
+    return false;
+#endif
+  return true;
+}
+
 time_t
 mktime(struct tm *tmp)
 {
   time_t t;
-  int err = lock();
+  int err;
+  struct lclzone *zone = lclzone_current();
+  if (zone) {
+    /*
+    ** Search without locallock, then take it just to set tzname for the
+    ** result, unless tzname already has the result's abbreviation, which
+    ** is the common case, or tzset has loaded another zone in the meantime.
+    */
+    struct tm result;
+    t = mktime_tzname(&zone->state, tmp, false);
+    if (tzname_is_set(&zone->state, t))
+      return t;
+    err = lock();
+    if (err) {
+      errno = err;
+      return -1;
+    }
+    if (atomic_load_explicit(&lclzone, memory_order_relaxed) == zone)
+      localsub(&zone->state, &t, true, &result);
+    unlock();
+    return t;
+  }
+  err = lock();
   if (err) {
     errno = err;
     return -1;
   }
   tzset_unlocked();
-  t = mktime_tzname(lclptr, tmp, true);
+  t = mktime_tzname(lclstate(), tmp, true);
   unlock();
   return t;
 }
@@ -2241,10 +2457,10 @@ time2posix(time_t t)
     errno = err;
     return -1;
   }
-  if (!lcl_is_set)
+  if (!atomic_load_explicit(&lclzone, memory_order_relaxed))
     tzset_unlocked();
-  if (lclptr)
-    t = time2posix_z(lclptr, t);
+  if (lclstate())
+    t = time2posix_z(lclstate(), t);
   unlock();
   return t;
 }
@@ -2286,10 +2502,10 @@ posix2time(time_t t)
     errno = err;
     return -1;
   }
-  if (!lcl_is_set)
+  if (!atomic_load_explicit(&lclzone, memory_order_relaxed))
     tzset_unlocked();
-  if (lclptr)
-    t = posix2time_z(lclptr, t);
+  if (lclstate())
+    t = posix2time_z(lclstate(), t);
   unlock();
   return t;
 }
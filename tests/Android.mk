@@ -69,10 +69,12 @@ libBionicStandardTests_src_files := \
     libgen_basename_test.cpp \
     libgen_test.cpp \
     locale_test.cpp \
+    lock_profile_test.cpp \
     malloc_test.cpp \
     math_test.cpp \
     mntent_test.cpp \
     netdb_test.cpp \
+    percpu_test.cpp \
     pthread_test.cpp \
     pty_test.cpp \
     regex_test.cpp \
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <base/stringprintf.h>
+
+#include "ScopedSignalHandler.h"
+
+#if defined(__BIONIC__)
+#include "../libc/bionic/bionic_lock_profile.cpp"
+#include "private/bionic_futex.h"
+
+static std::string g_dump;
+
+static void AppendDumpLine(const char* line) {
+  g_dump += line;
+  g_dump += '\n';
+}
+
+static void* LockProfileWaiterFn(void* arg) {
+  volatile int* lock = reinterpret_cast<volatile int*>(arg);
+  while (*lock != 0) {
+    ScopedLockProfile profile(lock);
+    __futex_wait(lock, 1, NULL);
+  }
+  return NULL;
+}
+
+// Makes a thread wait for lock, and lets it go after a while.
+static void ContendedWait(volatile int* lock) {
+  *lock = 1;
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, LockProfileWaiterFn, const_cast<int*>(lock)));
+  usleep(10000);
+  *lock = 0;
+  __futex_wake(lock, 1);
+  ASSERT_EQ(0, pthread_join(t, NULL));
+}
+
+static void* DumpOnRequestFn(void*) {
+  __lock_profile_dump_on_request(AppendDumpLine);
+  return NULL;
+}
+
+static void* MutexLockFn(void* arg) {
+  pthread_mutex_t* mutex = reinterpret_cast<pthread_mutex_t*>(arg);
+  pthread_mutex_lock(mutex);
+  pthread_mutex_unlock(mutex);
+  return NULL;
+}
+
+static int MutexUnlock(void* arg) {
+  return pthread_mutex_unlock(reinterpret_cast<pthread_mutex_t*>(arg));
+}
+
+static void* RwlockRdlockFn(void* arg) {
+  pthread_rwlock_t* rwlock = reinterpret_cast<pthread_rwlock_t*>(arg);
+  pthread_rwlock_rdlock(rwlock);
+  pthread_rwlock_unlock(rwlock);
+  return NULL;
+}
+
+static void* RwlockWrlockFn(void* arg) {
+  pthread_rwlock_t* rwlock = reinterpret_cast<pthread_rwlock_t*>(arg);
+  pthread_rwlock_wrlock(rwlock);
+  pthread_rwlock_unlock(rwlock);
+  return NULL;
+}
+
+static int RwlockUnlock(void* arg) {
+  return pthread_rwlock_unlock(reinterpret_cast<pthread_rwlock_t*>(arg));
+}
+
+// Runs fn on another thread while this one holds the lock, and lets it go after a while.
+static void ContendedLock(void* (*fn)(void*), void* lock, int (*unlock)(void*)) {
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, fn, lock));
+  usleep(10000);
+  ASSERT_EQ(0, unlock(lock));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+}
+
+// libc's locks only record into this copy of the profiler when they're linked into the same
+// executable, which is when dladdr is the static stub that always fails.
+static bool LibcUsesThisProfiler() {
+  Dl_info info;
+  return dladdr(reinterpret_cast<void*>(pthread_mutex_lock), &info) == 0;
+}
+
+static lock_profile_entry_t* FindEntry(const volatile void* lock) {
+  for (size_t i = 0; i < LOCK_PROFILE_ENTRIES; ++i) {
+    lock_profile_entry_t* entry = &g_lock_profile_table[i];
+    if (atomic_load(&entry->ready) && entry->lock == reinterpret_cast<uintptr_t>(lock)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+// Waits on the same lock from different call sites go in different entries.
+static uint64_t WaitCount(const volatile void* lock) {
+  uint64_t wait_count = 0;
+  for (size_t i = 0; i < LOCK_PROFILE_ENTRIES; ++i) {
+    lock_profile_entry_t* entry = &g_lock_profile_table[i];
+    if (atomic_load(&entry->ready) && entry->lock == reinterpret_cast<uintptr_t>(lock)) {
+      wait_count += atomic_load(&entry->wait_count);
+    }
+  }
+  return wait_count;
+}
+
+// Turns profiling on for this test binary's copy of the profiler.
+class ScopedLockProfileTable {
+ public:
+  ScopedLockProfileTable() {
+    size_ = LOCK_PROFILE_ENTRIES * sizeof(lock_profile_entry_t);
+    void* table = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    g_lock_profile_table = reinterpret_cast<lock_profile_entry_t*>(table);
+    __lock_profile_enabled = (table != MAP_FAILED);
+    g_dump.clear();
+  }
+
+  ~ScopedLockProfileTable() {
+    if (__lock_profile_enabled) {
+      __lock_profile_enabled = false;
+      munmap(g_lock_profile_table, size_);
+    }
+    g_lock_profile_table = NULL;
+  }
+
+ private:
+  size_t size_;
+};
+#endif
+
+TEST(lock_profile, contended_wait_is_recorded_and_dumped) {
+#if defined(__BIONIC__)
+  ScopedLockProfileTable table;
+  ASSERT_TRUE(__lock_profile_enabled);
+
+  volatile int lock = 0;
+  ContendedWait(&lock);
+
+  lock_profile_entry_t* entry = FindEntry(&lock);
+  ASSERT_TRUE(entry != NULL);
+  ASSERT_LE(1U, atomic_load(&entry->wait_count));
+  ASSERT_LT(0U, atomic_load(&entry->total_wait_ns));
+  ASSERT_LE(atomic_load(&entry->max_wait_ns), atomic_load(&entry->total_wait_ns));
+  ASSERT_NE(0U, entry->frames[0]);
+
+  __lock_profile_dump(AppendDumpLine);
+  ASSERT_EQ(0U, g_dump.find("lock contention profile (0 waits dropped):\n"));
+  std::string expected = android::base::StringPrintf(
+      "lock %p: %llu waits, ", &lock,
+      static_cast<unsigned long long>(atomic_load(&entry->wait_count)));
+  ASSERT_NE(std::string::npos, g_dump.find(expected)) << g_dump;
+  expected = android::base::StringPrintf("  #00 pc %p\n",
+                                         reinterpret_cast<void*>(entry->frames[0]));
+  ASSERT_NE(std::string::npos, g_dump.find(expected)) << g_dump;
+#else // __BIONIC__
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif // __BIONIC__
+}
+
+TEST(lock_profile, dump_signal_wakes_dump_thread) {
+#if defined(__BIONIC__)
+  ScopedLockProfileTable table;
+  ASSERT_TRUE(__lock_profile_enabled);
+
+  volatile int lock = 0;
+  ContendedWait(&lock);
+
+  // Nothing waits for a lock after the signal, so only the dump thread can write the dump.
+  ScopedSignalHandler ssh(LOCK_PROFILE_DUMP_SIGNAL, __lock_profile_request_dump);
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, DumpOnRequestFn, NULL));
+  usleep(10000);
+  ASSERT_EQ(0, raise(LOCK_PROFILE_DUMP_SIGNAL));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+
+  ASSERT_FALSE(atomic_load(&g_lock_profile_dump_requested));
+  ASSERT_EQ(0U, g_dump.find("lock contention profile (0 waits dropped):\n"));
+  std::string expected = android::base::StringPrintf("lock %p: ", &lock);
+  ASSERT_NE(std::string::npos, g_dump.find(expected)) << g_dump;
+#else // __BIONIC__
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif // __BIONIC__
+}
+
+TEST(lock_profile, dump_signal_without_dump_thread_is_handled_by_next_wait) {
+#if defined(__BIONIC__)
+  ScopedLockProfileTable table;
+  ASSERT_TRUE(__lock_profile_enabled);
+
+  // Like in a forked child, this process has no dump thread. The handler only asks for a dump.
+  __lock_profile_request_dump(LOCK_PROFILE_DUMP_SIGNAL);
+  ASSERT_TRUE(atomic_load(&g_lock_profile_dump_requested));
+
+  volatile int lock = 0;
+  ContendedWait(&lock);
+  ASSERT_FALSE(atomic_load(&g_lock_profile_dump_requested));
+#else // __BIONIC__
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif // __BIONIC__
+}
+
+TEST(lock_profile, contended_pthread_mutex_is_recorded) {
+#if defined(__BIONIC__)
+  if (!LibcUsesThisProfiler()) {
+    GTEST_LOG_(INFO) << "This test needs libc linked statically.";
+    return;
+  }
+  ScopedLockProfileTable table;
+  ASSERT_TRUE(__lock_profile_enabled);
+
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  ASSERT_EQ(0, pthread_mutex_lock(&mutex));
+  ContendedLock(MutexLockFn, &mutex, MutexUnlock);
+
+  lock_profile_entry_t* entry = FindEntry(&mutex);
+  ASSERT_TRUE(entry != NULL);
+  ASSERT_LE(1U, atomic_load(&entry->wait_count));
+  ASSERT_LT(0U, atomic_load(&entry->total_wait_ns));
+  ASSERT_NE(0U, entry->frames[0]);
+#else // __BIONIC__
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif // __BIONIC__
+}
+
+TEST(lock_profile, contended_pthread_rwlock_is_recorded) {
+#if defined(__BIONIC__)
+  if (!LibcUsesThisProfiler()) {
+    GTEST_LOG_(INFO) << "This test needs libc linked statically.";
+    return;
+  }
+  ScopedLockProfileTable table;
+  ASSERT_TRUE(__lock_profile_enabled);
+
+  pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+  // A reader waits for a writer.
+  ASSERT_EQ(0, pthread_rwlock_wrlock(&rwlock));
+  ContendedLock(RwlockRdlockFn, &rwlock, RwlockUnlock);
+  ASSERT_LE(1U, WaitCount(&rwlock));
+
+  // A writer waits for a reader.
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&rwlock));
+  ContendedLock(RwlockWrlockFn, &rwlock, RwlockUnlock);
+  ASSERT_LE(2U, WaitCount(&rwlock));
+
+  lock_profile_entry_t* entry = FindEntry(&rwlock);
+  ASSERT_TRUE(entry != NULL);
+  ASSERT_LT(0U, atomic_load(&entry->total_wait_ns));
+  ASSERT_NE(0U, entry->frames[0]);
+#else // __BIONIC__
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif // __BIONIC__
+}
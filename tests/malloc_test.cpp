@@ -16,12 +16,17 @@
 
 #include <gtest/gtest.h>
 
+#include <errno.h>
 #include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <malloc.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 #include <tinyxml2.h>
 
 #include "private/bionic_config.h"
@@ -325,54 +330,137 @@ TEST(malloc, valloc_overflow) {
 }
 #endif
 
-TEST(malloc, malloc_info) {
 #ifdef __BIONIC__
-  char* buf;
-  size_t bufsize;
-  FILE* memstream = open_memstream(&buf, &bufsize);
-  ASSERT_NE(nullptr, memstream);
-  ASSERT_EQ(0, malloc_info(0, memstream));
-  ASSERT_EQ(0, fclose(memstream));
-
+static void CheckMallocInfo(char* buf, size_t* bins_current) {
   tinyxml2::XMLDocument doc;
   ASSERT_EQ(tinyxml2::XML_SUCCESS, doc.Parse(buf));
 
   auto root = doc.FirstChildElement();
   ASSERT_NE(nullptr, root);
   ASSERT_STREQ("malloc", root->Name());
-  ASSERT_STREQ("jemalloc-1", root->Attribute("version"));
+  std::string version(root->Attribute("version"));
+  bool has_counters;
+  if (version == "jemalloc-2") {
+    has_counters = true;
+  } else {
+    ASSERT_EQ("dlmalloc-2", version);
+    has_counters = false;
+  }
 
-  auto arena = root->FirstChildElement();
-  for (; arena != nullptr; arena = arena->NextSiblingElement()) {
-    int val;
+  auto total = root->FirstChildElement("total");
+  ASSERT_NE(nullptr, total);
+  int ival;
+  for (const char* name : { "allocated", "active", "resident", "mapped" }) {
+    ASSERT_NE(nullptr, total->FirstChildElement(name)) << name;
+    ASSERT_EQ(tinyxml2::XML_SUCCESS, total->FirstChildElement(name)->QueryIntText(&ival));
+  }
 
-    ASSERT_STREQ("heap", arena->Name());
-    ASSERT_EQ(tinyxml2::XML_SUCCESS, arena->QueryIntAttribute("nr", &val));
-    ASSERT_EQ(tinyxml2::XML_SUCCESS,
-              arena->FirstChildElement("allocated-large")->QueryIntText(&val));
-    ASSERT_EQ(tinyxml2::XML_SUCCESS,
-              arena->FirstChildElement("allocated-huge")->QueryIntText(&val));
+  auto thread = root->FirstChildElement("thread");
+  if (has_counters) {
+    ASSERT_NE(nullptr, thread);
     ASSERT_EQ(tinyxml2::XML_SUCCESS,
-              arena->FirstChildElement("allocated-bins")->QueryIntText(&val));
-    ASSERT_EQ(tinyxml2::XML_SUCCESS,
-              arena->FirstChildElement("bins-total")->QueryIntText(&val));
+              thread->FirstChildElement("tcache-enabled")->QueryIntText(&ival));
+    ASSERT_NE(nullptr, thread->FirstChildElement("allocated"));
+    ASSERT_NE(nullptr, thread->FirstChildElement("deallocated"));
+  } else {
+    ASSERT_EQ(nullptr, thread);
+  }
+
+  auto huge_pages = root->FirstChildElement("huge-pages");
+  ASSERT_NE(nullptr, huge_pages);
+  ASSERT_EQ(tinyxml2::XML_SUCCESS, huge_pages->QueryIntAttribute("enabled", &ival));
+  for (const char* name : { "resident", "huge" }) {
+    ASSERT_NE(nullptr, huge_pages->FirstChildElement(name)) << name;
+    ASSERT_EQ(tinyxml2::XML_SUCCESS, huge_pages->FirstChildElement(name)->QueryIntText(&ival));
+  }
+
+  *bins_current = 0;
+  auto arena = root->FirstChildElement("heap");
+  for (; arena != nullptr; arena = arena->NextSiblingElement("heap")) {
+    ASSERT_EQ(tinyxml2::XML_SUCCESS, arena->QueryIntAttribute("nr", &ival));
+    for (const char* name : { "allocated-large", "allocated-huge", "allocated-bins",
+                              "active", "dirty", "mapped", "bins-total" }) {
+      ASSERT_NE(nullptr, arena->FirstChildElement(name)) << name;
+      ASSERT_EQ(tinyxml2::XML_SUCCESS, arena->FirstChildElement(name)->QueryIntText(&ival));
+    }
+    for (const char* name : { "large", "huge" }) {
+      auto elem = arena->FirstChildElement(name);
+      if (has_counters) {
+        ASSERT_NE(nullptr, elem) << name;
+        ASSERT_NE(nullptr, elem->FirstChildElement("nmalloc"));
+        ASSERT_NE(nullptr, elem->FirstChildElement("ndalloc"));
+      } else {
+        ASSERT_EQ(nullptr, elem) << name;
+      }
+    }
 
     auto bin = arena->FirstChildElement("bin");
-    for (; bin != nullptr; bin = bin ->NextSiblingElement()) {
-      if (strcmp(bin->Name(), "bin") == 0) {
-        ASSERT_EQ(tinyxml2::XML_SUCCESS, bin->QueryIntAttribute("nr", &val));
-        ASSERT_EQ(tinyxml2::XML_SUCCESS,
-                  bin->FirstChildElement("allocated")->QueryIntText(&val));
-        ASSERT_EQ(tinyxml2::XML_SUCCESS,
-                  bin->FirstChildElement("nmalloc")->QueryIntText(&val));
-        ASSERT_EQ(tinyxml2::XML_SUCCESS,
-                  bin->FirstChildElement("ndalloc")->QueryIntText(&val));
+    for (; bin != nullptr; bin = bin->NextSiblingElement("bin")) {
+      ASSERT_EQ(tinyxml2::XML_SUCCESS, bin->QueryIntAttribute("nr", &ival));
+      ASSERT_EQ(tinyxml2::XML_SUCCESS, bin->FirstChildElement("size")->QueryIntText(&ival));
+      ASSERT_EQ(tinyxml2::XML_SUCCESS,
+                bin->FirstChildElement("allocated")->QueryIntText(&ival));
+      ASSERT_EQ(tinyxml2::XML_SUCCESS, bin->FirstChildElement("current")->QueryIntText(&ival));
+      *bins_current += ival;
+      for (const char* name : { "nmalloc", "ndalloc", "nrequests", "nfills", "nflushes" }) {
+        if (has_counters) {
+          ASSERT_NE(nullptr, bin->FirstChildElement(name)) << name;
+        } else {
+          ASSERT_EQ(nullptr, bin->FirstChildElement(name)) << name;
+        }
       }
     }
   }
+}
+#endif
+
+TEST(malloc, malloc_info) {
+#ifdef __BIONIC__
+  char* buf;
+  size_t bufsize;
+  FILE* memstream = open_memstream(&buf, &bufsize);
+  ASSERT_NE(nullptr, memstream);
+  ASSERT_EQ(0, malloc_info(0, memstream));
+  ASSERT_EQ(0, fclose(memstream));
+
+  size_t bins_current;
+  CheckMallocInfo(buf, &bins_current);
+  free(buf);
+#endif
+}
+
+TEST(malloc, malloc_info_bins_track_allocations) {
+#ifdef __BIONIC__
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < 1000; i++) {
+    ptrs.push_back(malloc(48));
+    ASSERT_TRUE(ptrs.back() != nullptr);
+  }
+
+  char* buf;
+  size_t bufsize;
+  FILE* memstream = open_memstream(&buf, &bufsize);
+  ASSERT_NE(nullptr, memstream);
+  ASSERT_EQ(0, malloc_info(0, memstream));
+  ASSERT_EQ(0, fclose(memstream));
+
+  size_t bins_current;
+  CheckMallocInfo(buf, &bins_current);
+  free(buf);
+  ASSERT_LE(ptrs.size(), bins_current);
+
+  for (void* ptr : ptrs) {
+    free(ptr);
+  }
 #endif
 }
 
+TEST(malloc, malloc_info_bad_options) {
+  errno = 0;
+  ASSERT_EQ(-1, malloc_info(1, stdout));
+  ASSERT_EQ(EINVAL, errno);
+}
+
 TEST(malloc, calloc_usable_size) {
   for (size_t size = 1; size <= 2048; size++) {
     void* pointer = malloc(size);
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#if defined(__BIONIC__)
+#include "private/bionic_percpu.h"
+
+// Zero-initialized globals, as libc would use them.
+static PerCpuCounter g_counter;
+static PerCpuFreeList g_free_list;
+
+struct TestNode : PerCpuFreeListNode {
+  std::atomic<bool> popped;
+};
+
+// Returns the cpus this thread may run on.
+static std::vector<int> AllowedCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  return cpus;
+}
+
+static bool AllowCpus(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+static bool PinToCpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+static void* CounterAddFn(void* arg) {
+  PerCpuCounter* counter = reinterpret_cast<PerCpuCounter*>(arg);
+  for (size_t i = 0; i < 100000; ++i) {
+    counter->add(3);
+  }
+  return NULL;
+}
+
+// Pops a node, checks no one else has it, and pushes it back, many times over.
+static void* FreeListCycleFn(void* arg) {
+  PerCpuFreeList* free_list = reinterpret_cast<PerCpuFreeList*>(arg);
+  for (size_t i = 0; i < 100000; ++i) {
+    TestNode* node = static_cast<TestNode*>(free_list->pop());
+    if (node == NULL) {
+      continue;
+    }
+    if (node->popped.exchange(true)) {
+      return arg;
+    }
+    node->popped = false;
+    free_list->push(node);
+  }
+  return NULL;
+}
+#endif
+
+TEST(percpu, PerCpuCounter_starts_at_zero) {
+#if defined(__BIONIC__)
+  ASSERT_EQ(0U, g_counter.read());
+  g_counter.add(7);
+  ASSERT_EQ(7U, g_counter.read());
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+TEST(percpu, PerCpuCounter_add_on_every_cpu) {
+#if defined(__BIONIC__)
+  std::unique_ptr<PerCpuCounter> counter(new PerCpuCounter());
+  std::vector<int> cpus = AllowedCpus();
+  ASSERT_FALSE(cpus.empty());
+  for (int cpu : cpus) {
+    ASSERT_TRUE(PinToCpu(cpu));
+    counter->add(cpu + 1);
+  }
+  uint64_t expected = 0;
+  for (int cpu : cpus) {
+    expected += cpu + 1;
+  }
+  ASSERT_EQ(expected, counter->read());
+  ASSERT_TRUE(AllowCpus(cpus));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+TEST(percpu, PerCpuCounter_many_threads) {
+#if defined(__BIONIC__)
+  std::unique_ptr<PerCpuCounter> counter(new PerCpuCounter());
+  std::vector<pthread_t> threads(8);
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, NULL, CounterAddFn, counter.get()));
+  }
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+  }
+  ASSERT_EQ(8U * 100000 * 3, counter->read());
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+TEST(percpu, PerCpuFreeList_push_pop) {
+#if defined(__BIONIC__)
+  ASSERT_TRUE(g_free_list.pop() == NULL);
+
+  TestNode nodes[3];
+  for (auto& node : nodes) {
+    g_free_list.push(&node);
+  }
+  bool seen[3] = {};
+  for (size_t i = 0; i < 3; ++i) {
+    TestNode* node = static_cast<TestNode*>(g_free_list.pop());
+    ASSERT_TRUE(node != NULL);
+    size_t index = node - nodes;
+    ASSERT_LT(index, 3U);
+    ASSERT_FALSE(seen[index]);
+    seen[index] = true;
+  }
+  ASSERT_TRUE(g_free_list.pop() == NULL);
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+TEST(percpu, PerCpuFreeList_pop_from_another_cpu) {
+#if defined(__BIONIC__)
+  std::vector<int> cpus = AllowedCpus();
+  if (cpus.size() < 2) {
+    GTEST_LOG_(INFO) << "This test needs two cpus.";
+    return;
+  }
+  std::unique_ptr<PerCpuFreeList> free_list(new PerCpuFreeList());
+  TestNode node;
+  ASSERT_TRUE(PinToCpu(cpus[0]));
+  free_list->push(&node);
+  ASSERT_TRUE(PinToCpu(cpus[1]));
+  ASSERT_EQ(&node, free_list->pop());
+  ASSERT_TRUE(free_list->pop() == NULL);
+  ASSERT_TRUE(AllowCpus(cpus));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+TEST(percpu, PerCpuFreeList_many_threads) {
+#if defined(__BIONIC__)
+  std::unique_ptr<PerCpuFreeList> free_list(new PerCpuFreeList());
+  std::vector<TestNode> nodes(16);
+  for (auto& node : nodes) {
+    node.popped = false;
+    free_list->push(&node);
+  }
+
+  std::vector<pthread_t> threads(8);
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, NULL, FreeListCycleFn, free_list.get()));
+  }
+  for (auto& thread : threads) {
+    void* result;
+    ASSERT_EQ(0, pthread_join(thread, &result));
+    ASSERT_EQ(NULL, result);
+  }
+
+  // Every node is still there exactly once.
+  size_t count = 0;
+  while (TestNode* node = static_cast<TestNode*>(free_list->pop())) {
+    ASSERT_FALSE(node->popped.exchange(true));
+    ++count;
+  }
+  ASSERT_EQ(nodes.size(), count);
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
@@ -21,6 +21,7 @@
 #include <limits.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sys/mman.h>
@@ -182,6 +183,58 @@ TEST(pthread, pthread_key_dirty) {
   ASSERT_EQ(0, pthread_key_delete(key));
 }
 
+static std::atomic<int> key_destructor_calls;
+static pthread_key_t resetting_key;
+
+static void CountingKeyDestructor(void*) {
+  ++key_destructor_calls;
+}
+
+static void ResettingKeyDestructor(void* value) {
+  ++key_destructor_calls;
+  // Setting the key again from its destructor means it gets destroyed again in the next round.
+  if (value == reinterpret_cast<void*>(1)) {
+    pthread_setspecific(resetting_key, reinterpret_cast<void*>(2));
+  }
+}
+
+static void* SetKeysFn(void* arg) {
+  std::vector<pthread_key_t>* keys = reinterpret_cast<std::vector<pthread_key_t>*>(arg);
+  // Only set every other key, and leave one NULL value, so exit has to skip the unset slots.
+  for (size_t i = 0; i < keys->size(); i += 2) {
+    pthread_setspecific((*keys)[i], reinterpret_cast<void*>(i + 1));
+  }
+  pthread_setspecific(keys->back(), nullptr);
+  pthread_setspecific(resetting_key, reinterpret_cast<void*>(1));
+  return nullptr;
+}
+
+TEST(pthread, pthread_key_destructors_at_exit) {
+  std::vector<pthread_key_t> keys;
+  auto scope_guard = make_scope_guard([&keys]{
+    for (auto key : keys) {
+      EXPECT_EQ(0, pthread_key_delete(key));
+    }
+  });
+
+  // An odd number of keys, so the last one is among those SetKeysFn() sets, then resets to NULL.
+  for (int i = 0; i < PTHREAD_KEYS_MAX / 2 + 1; ++i) {
+    pthread_key_t key;
+    ASSERT_EQ(0, pthread_key_create(&key, CountingKeyDestructor));
+    keys.push_back(key);
+  }
+  ASSERT_EQ(0, pthread_key_create(&resetting_key, ResettingKeyDestructor));
+
+  key_destructor_calls = 0;
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, SetKeysFn, &keys));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+  // keys.size() / 2 counted keys, plus the resetting key twice.
+  ASSERT_EQ(static_cast<int>(keys.size() / 2) + 2, key_destructor_calls);
+
+  ASSERT_EQ(0, pthread_key_delete(resetting_key));
+}
+
 TEST(pthread, static_pthread_key_used_before_creation) {
 #if defined(__BIONIC__)
   // See http://b/19625804. The bug is about a static/global pthread key being used before creation.
@@ -266,6 +319,124 @@ TEST(pthread, pthread_create_EAGAIN) {
   ASSERT_EQ(EAGAIN, pthread_create(&t, &attributes, IdFn, NULL));
 }
 
+static void* GetStackBaseFn(void*) {
+  pthread_attr_t attributes;
+  pthread_getattr_np(pthread_self(), &attributes);
+  void* stack_base;
+  size_t stack_size;
+  pthread_attr_getstack(&attributes, &stack_base, &stack_size);
+  pthread_attr_destroy(&attributes);
+  return stack_base;
+}
+
+TEST(pthread, pthread_create_reuses_joined_thread_stack) {
+#if defined(__BIONIC__)
+  pthread_t t;
+  void* first_stack;
+  ASSERT_EQ(0, pthread_create(&t, NULL, GetStackBaseFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, &first_stack));
+  void* second_stack;
+  ASSERT_EQ(0, pthread_create(&t, NULL, GetStackBaseFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, &second_stack));
+  ASSERT_EQ(first_stack, second_stack);
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+static void* WaitForGoFn(void* arg) {
+  std::atomic<bool>* go = reinterpret_cast<std::atomic<bool>*>(arg);
+  while (!*go) {
+    usleep(1000);
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_create_custom_stack_size_threads_not_cached) {
+#if defined(__BIONIC__)
+  // Enough running threads with a non-default stack size to fill the stack cache if they were
+  // cached when they're joined.
+  pthread_attr_t attributes;
+  ASSERT_EQ(0, pthread_attr_init(&attributes));
+  ASSERT_EQ(0, pthread_attr_setstacksize(&attributes, 256 * 1024));
+  std::atomic<bool> go(false);
+  std::vector<pthread_t> threads(32);
+  for (auto& t : threads) {
+    ASSERT_EQ(0, pthread_create(&t, &attributes, WaitForGoFn, &go));
+  }
+  go = true;
+  for (auto t : threads) {
+    ASSERT_EQ(0, pthread_join(t, NULL));
+  }
+  ASSERT_EQ(0, pthread_attr_destroy(&attributes));
+
+  // Threads with the default stack size are still cached.
+  pthread_t t;
+  void* first_stack;
+  ASSERT_EQ(0, pthread_create(&t, NULL, GetStackBaseFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, &first_stack));
+  void* second_stack;
+  ASSERT_EQ(0, pthread_create(&t, NULL, GetStackBaseFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, &second_stack));
+  ASSERT_EQ(first_stack, second_stack);
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+static volatile bool reused_thread_signal_on_altstack;
+
+static void ReusedThreadSignalHandler(int) {
+  stack_t ss;
+  sigaltstack(NULL, &ss);
+  reused_thread_signal_on_altstack = (ss.ss_flags & SS_ONSTACK) != 0;
+}
+
+static void* RaiseSignalFn(void*) {
+  reused_thread_signal_on_altstack = false;
+  raise(SIGUSR1);
+  return reinterpret_cast<void*>(reused_thread_signal_on_altstack);
+}
+
+TEST(pthread, pthread_create_reused_thread_has_signal_stack) {
+#if defined(__BIONIC__)
+  ScopedSignalHandler handler(SIGUSR1, ReusedThreadSignalHandler, SA_ONSTACK);
+  // The second thread gets the first one's mapped space from the stack cache.
+  for (size_t i = 0; i < 2; ++i) {
+    pthread_t t;
+    void* on_altstack;
+    ASSERT_EQ(0, pthread_create(&t, NULL, RaiseSignalFn, NULL));
+    ASSERT_EQ(0, pthread_join(t, &on_altstack));
+    ASSERT_TRUE(on_altstack != NULL);
+  }
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+static void* DetachedIdFn(void* arg) {
+  std::atomic<int>* count = reinterpret_cast<std::atomic<int>*>(arg);
+  ++*count;
+  return NULL;
+}
+
+TEST(pthread, pthread_create_many_detached) {
+  // Detached threads put their own mapped space in the stack cache as they exit, so
+  // this churns through cached threads that may not have finished exiting yet.
+  std::atomic<int> count(0);
+  pthread_attr_t attributes;
+  ASSERT_EQ(0, pthread_attr_init(&attributes));
+  ASSERT_EQ(0, pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED));
+  for (int i = 0; i < 1000; ++i) {
+    pthread_t t;
+    ASSERT_EQ(0, pthread_create(&t, &attributes, DetachedIdFn, &count));
+  }
+  while (count < 1000) {
+    usleep(1000);
+  }
+  ASSERT_EQ(0, pthread_attr_destroy(&attributes));
+}
+
 TEST(pthread, pthread_no_join_after_detach) {
   SpinFunctionHelper spinhelper;
 
@@ -459,6 +630,97 @@ TEST(pthread, pthread_detach__no_such_thread) {
   ASSERT_EQ(ESRCH, pthread_detach(dead_thread));
 }
 
+static int FirstAllowedCpu() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return -1;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      return cpu;
+    }
+  }
+  return -1;
+}
+
+TEST(pthread, pthread_setaffinity_np_getaffinity_np) {
+  int cpu = FirstAllowedCpu();
+  ASSERT_NE(-1, cpu);
+
+  cpu_set_t original;
+  ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(original), &original));
+  ASSERT_TRUE(CPU_ISSET(cpu, &original));
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  ASSERT_EQ(0, pthread_setaffinity_np(pthread_self(), sizeof(set), &set));
+  cpu_set_t actual;
+  ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(actual), &actual));
+  ASSERT_TRUE(CPU_EQUAL(&set, &actual));
+  ASSERT_EQ(cpu, sched_getcpu());
+
+  ASSERT_EQ(0, pthread_setaffinity_np(pthread_self(), sizeof(original), &original));
+}
+
+TEST(pthread, pthread_setaffinity_np__no_such_thread) {
+  pthread_t dead_thread;
+  MakeDeadThread(dead_thread);
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(0, &set);
+  ASSERT_EQ(ESRCH, pthread_setaffinity_np(dead_thread, sizeof(set), &set));
+  ASSERT_EQ(ESRCH, pthread_getaffinity_np(dead_thread, sizeof(set), &set));
+}
+
+static void* GetAffinityFn(void* arg) {
+  cpu_set_t* set = reinterpret_cast<cpu_set_t*>(arg);
+  CPU_ZERO(set);
+  pthread_getaffinity_np(pthread_self(), sizeof(*set), set);
+  return reinterpret_cast<void*>(sched_getcpu());
+}
+
+TEST(pthread, pthread_attr_setaffinity_np) {
+  pthread_attr_t attr;
+  ASSERT_EQ(0, pthread_attr_init(&attr));
+
+  // Without a mask, any cpu will do.
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  ASSERT_EQ(0, pthread_attr_getaffinity_np(&attr, sizeof(set), &set));
+  ASSERT_EQ(CPU_SETSIZE, CPU_COUNT(&set));
+
+  int cpu = FirstAllowedCpu();
+  ASSERT_NE(-1, cpu);
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+#if defined(__BIONIC__) && !defined(__LP64__)
+  ASSERT_EQ(ENOTSUP, pthread_attr_setaffinity_np(&attr, sizeof(set), &set));
+#else
+  ASSERT_EQ(0, pthread_attr_setaffinity_np(&attr, sizeof(set), &set));
+  cpu_set_t actual;
+  ASSERT_EQ(0, pthread_attr_getaffinity_np(&attr, sizeof(actual), &actual));
+  ASSERT_TRUE(CPU_EQUAL(&set, &actual));
+
+  // The thread is on the requested cpu from the start.
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, &attr, GetAffinityFn, &actual));
+  void* result;
+  ASSERT_EQ(0, pthread_join(t, &result));
+  ASSERT_EQ(cpu, reinterpret_cast<intptr_t>(result));
+  ASSERT_TRUE(CPU_EQUAL(&set, &actual));
+
+  // An empty mask clears it again.
+  ASSERT_EQ(0, pthread_attr_setaffinity_np(&attr, 0, &set));
+  ASSERT_EQ(0, pthread_attr_getaffinity_np(&attr, sizeof(actual), &actual));
+  ASSERT_EQ(CPU_SETSIZE, CPU_COUNT(&actual));
+#endif
+
+  ASSERT_EQ(0, pthread_attr_destroy(&attr));
+}
+
 TEST(pthread, pthread_getcpuclockid__clock_gettime) {
   SpinFunctionHelper spinhelper;
 
@@ -653,7 +915,11 @@ TEST(pthread, pthread_rwlockattr_smoke) {
   }
 
   int kind_array[] = {PTHREAD_RWLOCK_PREFER_READER_NP,
-                      PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP};
+                      PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP,
+#if defined(__BIONIC__)
+                      PTHREAD_RWLOCK_READER_MOSTLY_NP,
+#endif
+                     };
   for (size_t i = 0; i < sizeof(kind_array) / sizeof(kind_array[0]); ++i) {
     ASSERT_EQ(0, pthread_rwlockattr_setkind_np(&attr, kind_array[i]));
     int kind;
@@ -671,10 +937,7 @@ TEST(pthread, pthread_rwlock_init_same_as_PTHREAD_RWLOCK_INITIALIZER) {
   ASSERT_EQ(0, memcmp(&lock1, &lock2, sizeof(lock1)));
 }
 
-TEST(pthread, pthread_rwlock_smoke) {
-  pthread_rwlock_t l;
-  ASSERT_EQ(0, pthread_rwlock_init(&l, NULL));
-
+static void RwlockSmokeTest(pthread_rwlock_t& l) {
   // Single read lock
   ASSERT_EQ(0, pthread_rwlock_rdlock(&l));
   ASSERT_EQ(0, pthread_rwlock_unlock(&l));
@@ -715,10 +978,154 @@ TEST(pthread, pthread_rwlock_smoke) {
   ASSERT_EQ(0, pthread_rwlock_wrlock(&l));
   ASSERT_EQ(EDEADLK, pthread_rwlock_wrlock(&l));
   ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+}
 
+TEST(pthread, pthread_rwlock_smoke) {
+  pthread_rwlock_t l;
+  ASSERT_EQ(0, pthread_rwlock_init(&l, NULL));
+  RwlockSmokeTest(l);
   ASSERT_EQ(0, pthread_rwlock_destroy(&l));
 }
 
+TEST(pthread, pthread_rwlock_reader_mostly_smoke) {
+#if defined(__BIONIC__)
+  pthread_rwlockattr_t attr;
+  ASSERT_EQ(0, pthread_rwlockattr_init(&attr));
+  ASSERT_EQ(0, pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_READER_MOSTLY_NP));
+  pthread_rwlock_t l;
+  ASSERT_EQ(0, pthread_rwlock_init(&l, &attr));
+  RwlockSmokeTest(l);
+
+  // Unlock without a lock
+  ASSERT_EQ(EPERM, pthread_rwlock_unlock(&l));
+
+  // Destroy while read-locked
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&l));
+  ASSERT_EQ(EBUSY, pthread_rwlock_destroy(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_destroy(&l));
+
+  // The reader slots can't be shared between processes.
+  ASSERT_EQ(0, pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED));
+  ASSERT_EQ(EINVAL, pthread_rwlock_init(&l, &attr));
+  ASSERT_EQ(0, pthread_rwlockattr_destroy(&attr));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+static void* RwlockUnlockThread(void* arg) {
+  return reinterpret_cast<void*>(pthread_rwlock_unlock(reinterpret_cast<pthread_rwlock_t*>(arg)));
+}
+
+TEST(pthread, pthread_rwlock_reader_mostly_unlock_by_other_thread) {
+#if defined(__BIONIC__)
+  pthread_rwlockattr_t attr;
+  ASSERT_EQ(0, pthread_rwlockattr_init(&attr));
+  ASSERT_EQ(0, pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_READER_MOSTLY_NP));
+  pthread_rwlock_t l;
+  ASSERT_EQ(0, pthread_rwlock_init(&l, &attr));
+  ASSERT_EQ(0, pthread_rwlockattr_destroy(&attr));
+
+  // The other thread holds no read lock, even if it shares a reader slot with this one.
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&l));
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, RwlockUnlockThread, &l));
+  void* result;
+  ASSERT_EQ(0, pthread_join(thread, &result));
+  ASSERT_EQ(EPERM, reinterpret_cast<intptr_t>(result));
+  ASSERT_EQ(EBUSY, pthread_rwlock_trywrlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_destroy(&l));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+TEST(pthread, pthread_rwlock_reader_mostly_many_locks) {
+#if defined(__BIONIC__)
+  pthread_rwlockattr_t attr;
+  ASSERT_EQ(0, pthread_rwlockattr_init(&attr));
+  ASSERT_EQ(0, pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_READER_MOSTLY_NP));
+
+  // More rwlocks than there are reader slots to go around, all read-locked by this thread at
+  // once, which is also more than it can track through the reader slots.
+  std::vector<pthread_rwlock_t> locks(1000);
+  for (auto& l : locks) {
+    ASSERT_EQ(0, pthread_rwlock_init(&l, &attr));
+    ASSERT_EQ(0, pthread_rwlock_rdlock(&l));
+    ASSERT_EQ(EBUSY, pthread_rwlock_trywrlock(&l));
+  }
+  for (auto& l : locks) {
+    ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+    ASSERT_EQ(EPERM, pthread_rwlock_unlock(&l));
+    ASSERT_EQ(0, pthread_rwlock_trywrlock(&l));
+    ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+    ASSERT_EQ(0, pthread_rwlock_destroy(&l));
+  }
+  ASSERT_EQ(0, pthread_rwlockattr_destroy(&attr));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
+struct RwlockReaderMostlyArg {
+  pthread_rwlock_t lock;
+  int values[2];
+  int iterations;
+};
+
+// Writers keep values[0] and values[1] equal, so a reader that sees them differ got in while a
+// writer was in.
+static void* RwlockReaderMostlyThread(void* arg) {
+  RwlockReaderMostlyArg* args = reinterpret_cast<RwlockReaderMostlyArg*>(arg);
+  for (int i = 0; i < args->iterations; ++i) {
+    if (i % 64 == 0) {
+      if (pthread_rwlock_wrlock(&args->lock) != 0) return arg;
+      ++args->values[0];
+      sched_yield();
+      ++args->values[1];
+    } else {
+      if (pthread_rwlock_rdlock(&args->lock) != 0) return arg;
+      volatile int* values = args->values;
+      if (values[0] != values[1]) {
+        pthread_rwlock_unlock(&args->lock);
+        return arg;
+      }
+    }
+    if (pthread_rwlock_unlock(&args->lock) != 0) return arg;
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_rwlock_reader_mostly_many_threads) {
+#if defined(__BIONIC__)
+  RwlockReaderMostlyArg args;
+  pthread_rwlockattr_t attr;
+  ASSERT_EQ(0, pthread_rwlockattr_init(&attr));
+  ASSERT_EQ(0, pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_READER_MOSTLY_NP));
+  ASSERT_EQ(0, pthread_rwlock_init(&args.lock, &attr));
+  ASSERT_EQ(0, pthread_rwlockattr_destroy(&attr));
+  args.values[0] = args.values[1] = 0;
+  args.iterations = 6400;
+
+  std::vector<pthread_t> threads(16);
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, NULL, RwlockReaderMostlyThread, &args));
+  }
+  for (auto& thread : threads) {
+    void* result;
+    ASSERT_EQ(0, pthread_join(thread, &result));
+    ASSERT_EQ(NULL, result);
+  }
+  ASSERT_EQ(16 * 100, args.values[0]);
+  ASSERT_EQ(16 * 100, args.values[1]);
+  ASSERT_EQ(0, pthread_rwlock_destroy(&args.lock));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
 static void WaitUntilThreadSleep(std::atomic<pid_t>& pid) {
   while (pid == 0) {
     usleep(1000);
@@ -921,6 +1328,30 @@ TEST(pthread, pthread_rwlock_kind_PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)
   ASSERT_EQ(0, pthread_join(reader_thread, NULL));
 }
 
+TEST(pthread, pthread_rwlock_kind_PTHREAD_RWLOCK_READER_MOSTLY_NP) {
+#if defined(__BIONIC__)
+  RwlockKindTestHelper helper(PTHREAD_RWLOCK_READER_MOSTLY_NP);
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&helper.lock));
+
+  pthread_t writer_thread;
+  std::atomic<pid_t> writer_tid;
+  helper.CreateWriterThread(writer_thread, writer_tid);
+  WaitUntilThreadSleep(writer_tid);
+
+  // Writers are preferred, so this reader waits behind the writer.
+  pthread_t reader_thread;
+  std::atomic<pid_t> reader_tid;
+  helper.CreateReaderThread(reader_thread, reader_tid);
+  WaitUntilThreadSleep(reader_tid);
+
+  ASSERT_EQ(0, pthread_rwlock_unlock(&helper.lock));
+  ASSERT_EQ(0, pthread_join(writer_thread, NULL));
+  ASSERT_EQ(0, pthread_join(reader_thread, NULL));
+#else
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+#endif
+}
+
 static int g_once_fn_call_count = 0;
 static void OnceFn() {
   ++g_once_fn_call_count;
@@ -1335,14 +1766,33 @@ TEST(pthread, pthread_mutexattr_gettype) {
   ASSERT_EQ(0, pthread_mutexattr_gettype(&attr, &attr_type));
   ASSERT_EQ(PTHREAD_MUTEX_RECURSIVE, attr_type);
 
+  ASSERT_EQ(0, pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP));
+  ASSERT_EQ(0, pthread_mutexattr_gettype(&attr, &attr_type));
+  ASSERT_EQ(PTHREAD_MUTEX_ADAPTIVE_NP, attr_type);
+
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
+TEST(pthread, pthread_mutexattr_protocol) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+
+  int protocol;
+  ASSERT_EQ(0, pthread_mutexattr_getprotocol(&attr, &protocol));
+  ASSERT_EQ(PTHREAD_PRIO_NONE, protocol);
+  ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT));
+  ASSERT_EQ(0, pthread_mutexattr_getprotocol(&attr, &protocol));
+  ASSERT_EQ(PTHREAD_PRIO_INHERIT, protocol);
+  ASSERT_EQ(EINVAL, pthread_mutexattr_setprotocol(&attr, 123));
+
   ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
 }
 
 struct PthreadMutex {
   pthread_mutex_t lock;
 
-  PthreadMutex(int mutex_type) {
-    init(mutex_type);
+  PthreadMutex(int mutex_type, int protocol = PTHREAD_PRIO_NONE) {
+    init(mutex_type, protocol);
   }
 
   ~PthreadMutex() {
@@ -1350,10 +1800,11 @@ struct PthreadMutex {
   }
 
  private:
-  void init(int mutex_type) {
+  void init(int mutex_type, int protocol) {
     pthread_mutexattr_t attr;
     ASSERT_EQ(0, pthread_mutexattr_init(&attr));
     ASSERT_EQ(0, pthread_mutexattr_settype(&attr, mutex_type));
+    ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, protocol));
     ASSERT_EQ(0, pthread_mutex_init(&lock, &attr));
     ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
   }
@@ -1396,6 +1847,149 @@ TEST(pthread, pthread_mutex_lock_RECURSIVE) {
   ASSERT_EQ(EPERM, pthread_mutex_unlock(&m.lock));
 }
 
+TEST(pthread, pthread_mutex_lock_ADAPTIVE) {
+  PthreadMutex m(PTHREAD_MUTEX_ADAPTIVE_NP);
+
+  ASSERT_EQ(0, pthread_mutex_lock(&m.lock));
+  ASSERT_EQ(EBUSY, pthread_mutex_trylock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_trylock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+}
+
+static void* MutexIncrementThread(void* arg) {
+  auto data = reinterpret_cast<std::pair<pthread_mutex_t*, int*>*>(arg);
+  for (int i = 0; i < 10000; ++i) {
+    pthread_mutex_lock(data->first);
+    ++*data->second;
+    pthread_mutex_unlock(data->first);
+  }
+  return nullptr;
+}
+
+TEST(pthread, pthread_mutex_ADAPTIVE_contended) {
+  PthreadMutex m(PTHREAD_MUTEX_ADAPTIVE_NP);
+  int counter = 0;
+  std::pair<pthread_mutex_t*, int*> data(&m.lock, &counter);
+
+  pthread_t threads[4];
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, nullptr, MutexIncrementThread, &data));
+  }
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_join(thread, nullptr));
+  }
+  ASSERT_EQ(40000, counter);
+}
+
+TEST(pthread, pthread_mutex_lock_NORMAL_PI) {
+  PthreadMutex m(PTHREAD_MUTEX_NORMAL, PTHREAD_PRIO_INHERIT);
+
+  ASSERT_EQ(0, pthread_mutex_lock(&m.lock));
+  ASSERT_EQ(EBUSY, pthread_mutex_trylock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_trylock(&m.lock));
+  ASSERT_EQ(EBUSY, pthread_mutex_destroy(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+}
+
+TEST(pthread, pthread_mutex_lock_ERRORCHECK_PI) {
+  PthreadMutex m(PTHREAD_MUTEX_ERRORCHECK, PTHREAD_PRIO_INHERIT);
+
+  ASSERT_EQ(0, pthread_mutex_lock(&m.lock));
+  ASSERT_EQ(EDEADLK, pthread_mutex_lock(&m.lock));
+  ASSERT_EQ(EBUSY, pthread_mutex_trylock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+  ASSERT_EQ(EPERM, pthread_mutex_unlock(&m.lock));
+}
+
+TEST(pthread, pthread_mutex_lock_RECURSIVE_PI) {
+  PthreadMutex m(PTHREAD_MUTEX_RECURSIVE, PTHREAD_PRIO_INHERIT);
+
+  ASSERT_EQ(0, pthread_mutex_lock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_lock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_trylock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+  ASSERT_EQ(EPERM, pthread_mutex_unlock(&m.lock));
+}
+
+static void* PIMutexTimedLockThread(void* arg) {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 10000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  return reinterpret_cast<void*>(pthread_mutex_timedlock(reinterpret_cast<pthread_mutex_t*>(arg),
+                                                         &ts));
+}
+
+TEST(pthread, pthread_mutex_timedlock_PI) {
+  PthreadMutex m(PTHREAD_MUTEX_NORMAL, PTHREAD_PRIO_INHERIT);
+  ASSERT_EQ(0, pthread_mutex_lock(&m.lock));
+
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, nullptr, PIMutexTimedLockThread, &m.lock));
+  void* result;
+  ASSERT_EQ(0, pthread_join(thread, &result));
+  ASSERT_EQ(ETIMEDOUT, reinterpret_cast<intptr_t>(result));
+  ASSERT_EQ(0, pthread_mutex_unlock(&m.lock));
+}
+
+TEST(pthread, pthread_mutex_PI_contended) {
+  PthreadMutex m(PTHREAD_MUTEX_NORMAL, PTHREAD_PRIO_INHERIT);
+  int counter = 0;
+  std::pair<pthread_mutex_t*, int*> data(&m.lock, &counter);
+
+  pthread_t threads[4];
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, nullptr, MutexIncrementThread, &data));
+  }
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_join(thread, nullptr));
+  }
+  ASSERT_EQ(40000, counter);
+}
+
+TEST(pthread, pthread_mutex_PI_init_destroy_many) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT));
+
+  // More PI mutexes in total than can exist at once on LP32.
+  for (size_t i = 0; i < 100000; ++i) {
+    pthread_mutex_t m;
+    ASSERT_EQ(0, pthread_mutex_init(&m, &attr));
+    ASSERT_EQ(0, pthread_mutex_lock(&m));
+    ASSERT_EQ(0, pthread_mutex_unlock(&m));
+    ASSERT_EQ(0, pthread_mutex_destroy(&m));
+  }
+
+#if defined(__BIONIC__) && !defined(__LP64__)
+  // LP32 PI mutexes live in a table with room for 65535, and destroying
+  // them makes room again.
+  std::vector<pthread_mutex_t> mutexes(65536);
+  size_t count = 0;
+  int result;
+  while ((result = pthread_mutex_init(&mutexes[count], &attr)) == 0) {
+    ASSERT_LT(++count, mutexes.size());
+  }
+  ASSERT_EQ(ENOMEM, result);
+  for (size_t i = 0; i < count; ++i) {
+    ASSERT_EQ(0, pthread_mutex_destroy(&mutexes[i]));
+  }
+  ASSERT_EQ(0, pthread_mutex_init(&mutexes[0], &attr));
+  ASSERT_EQ(0, pthread_mutex_lock(&mutexes[0]));
+  ASSERT_EQ(0, pthread_mutex_unlock(&mutexes[0]));
+  ASSERT_EQ(0, pthread_mutex_destroy(&mutexes[0]));
+#endif
+
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
 TEST(pthread, pthread_mutex_init_same_as_static_initializers) {
   pthread_mutex_t lock_normal = PTHREAD_MUTEX_INITIALIZER;
   PthreadMutex m1(PTHREAD_MUTEX_NORMAL);
@@ -1411,6 +2005,11 @@ TEST(pthread, pthread_mutex_init_same_as_static_initializers) {
   PthreadMutex m3(PTHREAD_MUTEX_RECURSIVE);
   ASSERT_EQ(0, memcmp(&lock_recursive, &m3.lock, sizeof(pthread_mutex_t)));
   ASSERT_EQ(0, pthread_mutex_destroy(&lock_recursive));
+
+  pthread_mutex_t lock_adaptive = PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP;
+  PthreadMutex m4(PTHREAD_MUTEX_ADAPTIVE_NP);
+  ASSERT_EQ(0, memcmp(&lock_adaptive, &m4.lock, sizeof(pthread_mutex_t)));
+  ASSERT_EQ(0, pthread_mutex_destroy(&lock_adaptive));
 }
 class MutexWakeupHelper {
  private:
@@ -1437,7 +2036,7 @@ class MutexWakeupHelper {
   }
 
  public:
-  MutexWakeupHelper(int mutex_type) : m(mutex_type) {
+  MutexWakeupHelper(int mutex_type, int protocol = PTHREAD_PRIO_NONE) : m(mutex_type, protocol) {
   }
 
   void test() {
@@ -1475,6 +2074,85 @@ TEST(pthread, pthread_mutex_RECURSIVE_wakeup) {
   helper.test();
 }
 
+TEST(pthread, pthread_mutex_ADAPTIVE_wakeup) {
+  MutexWakeupHelper helper(PTHREAD_MUTEX_ADAPTIVE_NP);
+  helper.test();
+}
+
+TEST(pthread, pthread_mutex_PI_wakeup) {
+  MutexWakeupHelper helper(PTHREAD_MUTEX_NORMAL, PTHREAD_PRIO_INHERIT);
+  helper.test();
+}
+
+struct CondBroadcastHelper {
+  pthread_mutex_t* mutex;
+  pthread_cond_t* cond;
+  int generation;
+  int waiting;
+};
+
+static void* CondBroadcastWaitThread(void* arg) {
+  CondBroadcastHelper* helper = reinterpret_cast<CondBroadcastHelper*>(arg);
+  pthread_mutex_lock(helper->mutex);
+  int generation = helper->generation;
+  ++helper->waiting;
+  while (helper->generation == generation) {
+    pthread_cond_wait(helper->cond, helper->mutex);
+  }
+  pthread_mutex_unlock(helper->mutex);
+  return NULL;
+}
+
+// Broadcasts to a crowd of waiters a few times, and checks that they all wake up.
+static void RunCondBroadcastTest(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+  CondBroadcastHelper helper = { mutex, cond, 0, 0 };
+  for (size_t round = 0; round < 10; ++round) {
+    std::vector<pthread_t> threads(16);
+    helper.waiting = 0;
+    for (auto& thread : threads) {
+      ASSERT_EQ(0, pthread_create(&thread, NULL, CondBroadcastWaitThread, &helper));
+    }
+    while (true) {
+      pthread_mutex_lock(mutex);
+      bool all_waiting = (helper.waiting == static_cast<int>(threads.size()));
+      if (all_waiting) {
+        ++helper.generation;
+        ASSERT_EQ(0, pthread_cond_broadcast(cond));
+      }
+      pthread_mutex_unlock(mutex);
+      if (all_waiting) {
+        break;
+      }
+      usleep(1000);
+    }
+    for (auto& thread : threads) {
+      ASSERT_EQ(0, pthread_join(thread, NULL));
+    }
+  }
+}
+
+TEST(pthread, pthread_cond_broadcast_many_waiters) {
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  for (int type : { PTHREAD_MUTEX_NORMAL, PTHREAD_MUTEX_ERRORCHECK, PTHREAD_MUTEX_RECURSIVE,
+                    PTHREAD_MUTEX_ADAPTIVE_NP }) {
+    // Each mutex is a different one for the same condition variable, used one after another.
+    PthreadMutex m(type);
+    RunCondBroadcastTest(&cond, &m.lock);
+  }
+  ASSERT_EQ(0, pthread_cond_destroy(&cond));
+}
+
+TEST(pthread, pthread_cond_broadcast_many_waiters_shared) {
+  pthread_condattr_t attr;
+  ASSERT_EQ(0, pthread_condattr_init(&attr));
+  ASSERT_EQ(0, pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED));
+  pthread_cond_t cond;
+  ASSERT_EQ(0, pthread_cond_init(&cond, &attr));
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  RunCondBroadcastTest(&cond, &mutex);
+  ASSERT_EQ(0, pthread_cond_destroy(&cond));
+}
+
 TEST(pthread, pthread_mutex_owner_tid_limit) {
 #if defined(__BIONIC__) && !defined(__LP64__)
   FILE* fp = fopen("/proc/sys/kernel/pid_max", "r");
@@ -1489,6 +2167,131 @@ TEST(pthread, pthread_mutex_owner_tid_limit) {
 #endif
 }
 
+TEST(pthread, pthread_barrierattr_pshared) {
+  pthread_barrierattr_t attr;
+  ASSERT_EQ(0, pthread_barrierattr_init(&attr));
+  int pshared;
+  ASSERT_EQ(0, pthread_barrierattr_getpshared(&attr, &pshared));
+  ASSERT_EQ(PTHREAD_PROCESS_PRIVATE, pshared);
+  ASSERT_EQ(0, pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED));
+  ASSERT_EQ(0, pthread_barrierattr_getpshared(&attr, &pshared));
+  ASSERT_EQ(PTHREAD_PROCESS_SHARED, pshared);
+  ASSERT_EQ(EINVAL, pthread_barrierattr_setpshared(&attr, 3));
+  ASSERT_EQ(0, pthread_barrierattr_destroy(&attr));
+}
+
+TEST(pthread, pthread_barrier_init_zero_count) {
+  pthread_barrier_t barrier;
+  ASSERT_EQ(EINVAL, pthread_barrier_init(&barrier, NULL, 0));
+}
+
+TEST(pthread, pthread_barrier_single_thread) {
+  pthread_barrier_t barrier;
+  ASSERT_EQ(0, pthread_barrier_init(&barrier, NULL, 1));
+  ASSERT_EQ(PTHREAD_BARRIER_SERIAL_THREAD, pthread_barrier_wait(&barrier));
+  ASSERT_EQ(PTHREAD_BARRIER_SERIAL_THREAD, pthread_barrier_wait(&barrier));
+  ASSERT_EQ(0, pthread_barrier_destroy(&barrier));
+}
+
+struct BarrierTestHelper {
+  pthread_barrier_t barrier;
+  std::atomic<int> serial_count;
+  std::atomic<int> arrived;
+  size_t thread_count;
+  size_t rounds;
+  bool failed;
+};
+
+static void* BarrierTestThread(void* arg) {
+  BarrierTestHelper* helper = reinterpret_cast<BarrierTestHelper*>(arg);
+  for (size_t i = 0; i < helper->rounds; ++i) {
+    helper->arrived++;
+    int result = pthread_barrier_wait(&helper->barrier);
+    if (result == PTHREAD_BARRIER_SERIAL_THREAD) {
+      helper->serial_count++;
+    } else if (result != 0) {
+      helper->failed = true;
+    }
+    // Nobody can leave round i before everyone arrived at it.
+    if (static_cast<size_t>(helper->arrived) < (i + 1) * helper->thread_count) {
+      helper->failed = true;
+    }
+    // Keep everyone in step, so that nobody arrives at round i + 1 before
+    // everyone checked round i.
+    result = pthread_barrier_wait(&helper->barrier);
+    if (result == PTHREAD_BARRIER_SERIAL_THREAD) {
+      helper->serial_count++;
+    } else if (result != 0) {
+      helper->failed = true;
+    }
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_barrier_smoke) {
+  BarrierTestHelper helper;
+  helper.thread_count = 8;
+  helper.rounds = 100;
+  helper.serial_count = 0;
+  helper.arrived = 0;
+  helper.failed = false;
+  ASSERT_EQ(0, pthread_barrier_init(&helper.barrier, NULL, helper.thread_count));
+
+  std::vector<pthread_t> threads(helper.thread_count);
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, NULL, BarrierTestThread, &helper));
+  }
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+  }
+  ASSERT_FALSE(helper.failed);
+  // Exactly one thread per round gets PTHREAD_BARRIER_SERIAL_THREAD.
+  ASSERT_EQ(static_cast<int>(helper.rounds * 2), helper.serial_count);
+  ASSERT_EQ(0, pthread_barrier_destroy(&helper.barrier));
+}
+
+TEST(pthread, pthread_spinlock_smoke) {
+  pthread_spinlock_t lock;
+  ASSERT_EQ(EINVAL, pthread_spin_init(&lock, 3));
+  ASSERT_EQ(0, pthread_spin_init(&lock, PTHREAD_PROCESS_PRIVATE));
+  ASSERT_EQ(0, pthread_spin_trylock(&lock));
+  ASSERT_EQ(EBUSY, pthread_spin_trylock(&lock));
+  ASSERT_EQ(0, pthread_spin_unlock(&lock));
+  ASSERT_EQ(0, pthread_spin_lock(&lock));
+  ASSERT_EQ(0, pthread_spin_unlock(&lock));
+  ASSERT_EQ(0, pthread_spin_destroy(&lock));
+}
+
+struct SpinlockTestHelper {
+  pthread_spinlock_t lock;
+  int counter;
+};
+
+static void* SpinlockIncrementThread(void* arg) {
+  SpinlockTestHelper* helper = reinterpret_cast<SpinlockTestHelper*>(arg);
+  for (int i = 0; i < 10000; ++i) {
+    pthread_spin_lock(&helper->lock);
+    helper->counter++;
+    pthread_spin_unlock(&helper->lock);
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_spinlock_contended) {
+  SpinlockTestHelper helper;
+  helper.counter = 0;
+  ASSERT_EQ(0, pthread_spin_init(&helper.lock, PTHREAD_PROCESS_PRIVATE));
+  pthread_t threads[4];
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, NULL, SpinlockIncrementThread, &helper));
+  }
+  for (auto& thread : threads) {
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+  }
+  ASSERT_EQ(40000, helper.counter);
+  ASSERT_EQ(0, pthread_spin_destroy(&helper.lock));
+}
+
 class StrictAlignmentAllocator {
  public:
   void* allocate(size_t size, size_t alignment) {
@@ -1541,6 +2344,19 @@ TEST(pthread, pthread_types_allow_four_bytes_alignment) {
   ASSERT_EQ(0, pthread_rwlock_unlock(rwlock));
   ASSERT_EQ(0, pthread_rwlock_destroy(rwlock));
 
+  pthread_barrier_t* barrier = reinterpret_cast<pthread_barrier_t*>(
+                                 allocator.allocate(sizeof(pthread_barrier_t), 4));
+  ASSERT_EQ(0, pthread_barrier_init(barrier, NULL, 1));
+  ASSERT_EQ(PTHREAD_BARRIER_SERIAL_THREAD, pthread_barrier_wait(barrier));
+  ASSERT_EQ(0, pthread_barrier_destroy(barrier));
+
+  pthread_spinlock_t* spinlock = reinterpret_cast<pthread_spinlock_t*>(
+                                   allocator.allocate(sizeof(pthread_spinlock_t), 4));
+  ASSERT_EQ(0, pthread_spin_init(spinlock, PTHREAD_PROCESS_PRIVATE));
+  ASSERT_EQ(0, pthread_spin_lock(spinlock));
+  ASSERT_EQ(0, pthread_spin_unlock(spinlock));
+  ASSERT_EQ(0, pthread_spin_destroy(spinlock));
+
 #else
   GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
 #endif
@@ -17,9 +17,17 @@
 #include <gtest/gtest.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <sched.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__BIONIC__)
+#include "private/__get_tls.h"
+#include "private/bionic_rseq.h"
+#endif
 
 static int child_fn(void* i_ptr) {
   *reinterpret_cast<int*>(i_ptr) = 42;
@@ -270,3 +278,151 @@ TEST(sched, cpu_equal_s) {
   CPU_FREE(set1);
   CPU_FREE(set2);
 }
+
+static void* CheckSchedGetcpuFn(void*) {
+  cpu_set_t original;
+  CPU_ZERO(&original);
+  EXPECT_EQ(0, sched_getaffinity(0, sizeof(original), &original));
+
+  // Pinned to one cpu at a time, sched_getcpu has to report that cpu.
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &original)) {
+      continue;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    EXPECT_EQ(0, sched_setaffinity(0, sizeof(set), &set));
+    EXPECT_EQ(cpu, sched_getcpu());
+  }
+
+  EXPECT_EQ(0, sched_setaffinity(0, sizeof(original), &original));
+  return NULL;
+}
+
+TEST(sched, sched_getcpu) {
+  CheckSchedGetcpuFn(NULL);
+
+  // New threads get the same answer.
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, CheckSchedGetcpuFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+}
+
+#if defined(__BIONIC__)
+extern "C" const ptrdiff_t __rseq_offset;
+extern "C" const unsigned int __rseq_size;
+extern "C" const unsigned int __rseq_flags;
+
+// Returns cpu_id from the calling thread's rseq area, as code sharing it through the glibc ABI
+// would see it.
+static int RseqCpuId() {
+  char* rseq = reinterpret_cast<char*>(__get_tls()) + __rseq_offset;
+  return *reinterpret_cast<volatile int32_t*>(rseq + 4);
+}
+
+static void* CheckRseqCpuIdFn(void*) {
+  cpu_set_t original;
+  CPU_ZERO(&original);
+  EXPECT_EQ(0, sched_getaffinity(0, sizeof(original), &original));
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &original)) {
+      continue;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    EXPECT_EQ(0, sched_setaffinity(0, sizeof(set), &set));
+    EXPECT_EQ(cpu, RseqCpuId());
+  }
+
+  EXPECT_EQ(0, sched_setaffinity(0, sizeof(original), &original));
+  return NULL;
+}
+
+TEST(sched, rseq_abi) {
+  if (__rseq_size == 0) {
+    GTEST_LOG_(INFO) << "This kernel doesn't have rseq, or LIBC_RSEQ=0 is set.";
+    return;
+  }
+  ASSERT_EQ(20U, __rseq_size);
+  ASSERT_EQ(0U, __rseq_flags);
+  CheckRseqCpuIdFn(NULL);
+
+  // The same offset finds a new thread's area.
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, CheckRseqCpuIdFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+
+  // The kernel only takes one area per thread, which is why the offset is exported.
+  bionic_rseq other = {};
+  errno = 0;
+  ASSERT_EQ(-1, syscall(__NR_rseq, &other, sizeof(other), 0, BIONIC_RSEQ_SIG));
+  ASSERT_EQ(EBUSY, errno);
+}
+
+// Moves through the given cpus, asking for the cpu on each. Returns how many it couldn't move to.
+static int SchedGetcpuOnEachCpuFn(void* arg) {
+  const cpu_set_t* cpus = reinterpret_cast<const cpu_set_t*>(arg);
+  int failures = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, cpus)) {
+      continue;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      ++failures;
+    }
+    // This reads our parent's rseq area, so it's only a hint here.
+    sched_getcpu();
+  }
+  return failures;
+}
+
+TEST(sched, sched_getcpu_clone_child) {
+  cpu_set_t original;
+  CPU_ZERO(&original);
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(original), &original));
+
+  int first_cpu = 0;
+  while (!CPU_ISSET(first_cpu, &original)) {
+    ++first_cpu;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(first_cpu, &set);
+  ASSERT_EQ(0, sched_setaffinity(0, sizeof(set), &set));
+  ASSERT_EQ(first_cpu, sched_getcpu());
+
+  // A child that shares our memory but not our pthread_internal_t.
+  void* child_stack[4096];
+  pid_t tid = clone(SchedGetcpuOnEachCpuFn, &child_stack[4096], CLONE_VM, &original);
+  ASSERT_NE(-1, tid);
+  int status;
+  ASSERT_EQ(tid, TEMP_FAILURE_RETRY(waitpid(tid, &status, __WCLONE)));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+
+  // Our rseq area is still registered.
+  if (__rseq_size != 0) {
+    ASSERT_EQ(first_cpu, RseqCpuId());
+  }
+  ASSERT_EQ(0, sched_setaffinity(0, sizeof(original), &original));
+  CheckSchedGetcpuFn(NULL);
+  if (__rseq_size != 0) {
+    CheckRseqCpuIdFn(NULL);
+  }
+}
+#else
+TEST(sched, rseq_abi) {
+  GTEST_LOG_(INFO) << "This test tests bionic implementation details.";
+}
+
+TEST(sched, sched_getcpu_clone_child) {
+  // glibc's pthread functions misbehave after clone with CLONE_VM, see sched.clone.
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+}
+#endif
@@ -20,12 +20,15 @@
 #include <gtest/gtest.h>
 #include <pthread.h>
 #include <signal.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <atomic>
 
+#include "BionicDeathTest.h"
 #include "ScopedSignalHandler.h"
 
 #include "private/bionic_constants.h"
@@ -121,6 +124,180 @@ TEST(time, mktime_10310929) {
 #endif
 }
 
+TEST(time, localtime_r_after_setenv_TZ) {
+  time_t t = 1451606400; // 2016-01-01 00:00:00 UTC.
+  struct tm tm;
+
+  setenv("TZ", "UTC", 1);
+  tzset();
+  ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+  ASSERT_EQ(0, tm.tm_hour);
+
+  // localtime_r isn't required to call tzset, and doesn't.
+  setenv("TZ", "America/Los_Angeles", 1);
+  ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+  ASSERT_EQ(0, tm.tm_hour);
+
+  tzset();
+  ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+  ASSERT_EQ(16, tm.tm_hour);
+  ASSERT_EQ(-8 * 60 * 60, tm.tm_gmtoff);
+}
+
+TEST(time, localtime_r_switching_zones) {
+  struct zone {
+    const char* name;
+    const char* abbr;
+    int hour;
+    long gmtoff;
+  };
+  const zone zones[] = {
+    { "America/Los_Angeles", "PST", 16, -8 * 60 * 60 },
+    { "UTC", "UTC", 0, 0 },
+    { "Asia/Tokyo", "JST", 9, 9 * 60 * 60 },
+  };
+  time_t t = 1451606400; // 2016-01-01 00:00:00 UTC.
+
+  // Switching back to a zone must give the same results as the first time.
+  for (size_t i = 0; i < 3 * (sizeof(zones) / sizeof(zones[0])); ++i) {
+    const zone& z = zones[i % (sizeof(zones) / sizeof(zones[0]))];
+    setenv("TZ", z.name, 1);
+    tzset();
+    ASSERT_STREQ(z.abbr, tzname[0]) << z.name;
+
+    struct tm tm;
+    ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+    ASSERT_EQ(z.hour, tm.tm_hour) << z.name;
+    ASSERT_EQ(z.gmtoff, tm.tm_gmtoff) << z.name;
+    ASSERT_EQ(t, mktime(&tm)) << z.name;
+    ASSERT_STREQ(z.abbr, tzname[0]) << z.name;
+  }
+}
+
+TEST(time, localtime_r_more_zones_than_are_kept) {
+  const char* names[] = {
+    "Africa/Cairo", "America/Anchorage", "America/Chicago", "America/Denver",
+    "America/Los_Angeles", "America/New_York", "America/Sao_Paulo", "Asia/Kolkata",
+    "Asia/Shanghai", "Asia/Tokyo", "Australia/Sydney", "Europe/Berlin",
+    "Europe/London", "Europe/Moscow", "Pacific/Auckland", "UTC",
+  };
+  const size_t count = sizeof(names) / sizeof(names[0]);
+  long gmtoffs[count];
+  time_t t = 1451606400; // 2016-01-01 00:00:00 UTC.
+
+  // Every zone gives the same answers when we come back to it.
+  for (size_t i = 0; i < 3 * count; ++i) {
+    setenv("TZ", names[i % count], 1);
+    tzset();
+    struct tm tm;
+    ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+    if (i < count) {
+      gmtoffs[i] = tm.tm_gmtoff;
+    } else {
+      ASSERT_EQ(gmtoffs[i % count], tm.tm_gmtoff) << names[i % count];
+    }
+    ASSERT_EQ(t, mktime(&tm)) << names[i % count];
+  }
+
+  // A zone that can't be loaded is GMT, and doesn't stop us going back to one that can.
+  setenv("TZ", "Nowhere/Special", 1);
+  tzset();
+  struct tm tm;
+  ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+  ASSERT_EQ(0, tm.tm_gmtoff);
+  setenv("TZ", "Asia/Tokyo", 1);
+  tzset();
+  ASSERT_TRUE(localtime_r(&t, &tm) != NULL);
+  ASSERT_EQ(9 * 60 * 60, tm.tm_gmtoff);
+
+  unsetenv("TZ");
+  tzset();
+}
+
+TEST(time, mktime_sets_tzname_for_the_result) {
+  setenv("TZ", "Europe/London", 1);
+  tzset();
+
+  // Between 1968 and 1971, the UK stayed on British Standard Time all year.
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = 70;
+  tm.tm_mday = 1;
+  tm.tm_isdst = -1;
+  ASSERT_EQ(-60 * 60, mktime(&tm));
+  ASSERT_EQ(0, tm.tm_isdst);
+  ASSERT_STREQ("BST", tzname[0]);
+
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = 116;
+  tm.tm_mday = 1;
+  tm.tm_isdst = -1;
+  ASSERT_EQ(1451606400, mktime(&tm));
+  ASSERT_STREQ("GMT", tzname[0]);
+
+  // Once tzname is right, mktime leaves it alone.
+  ASSERT_EQ(1451606400, mktime(&tm));
+  ASSERT_STREQ("GMT", tzname[0]);
+
+  unsetenv("TZ");
+  tzset();
+}
+
+struct LocaltimeRaceData {
+  std::atomic<bool> done;
+  std::atomic<int> errors;
+};
+
+static void* LocaltimeRMktimeFn(void* arg) {
+  LocaltimeRaceData* data = reinterpret_cast<LocaltimeRaceData*>(arg);
+  const time_t t = 1451606400; // 2016-01-01 00:00:00 UTC.
+  while (!data->done) {
+    // Each call sees UTC or Los Angeles, but not necessarily the same one.
+    struct tm tm;
+    if (localtime_r(&t, &tm) == NULL ||
+        !((tm.tm_hour == 0 && tm.tm_gmtoff == 0) ||
+          (tm.tm_hour == 16 && tm.tm_gmtoff == -8 * 60 * 60))) {
+      ++data->errors;
+      continue;
+    }
+    time_t result = mktime(&tm);
+    if (result != t && result != t - 8 * 60 * 60 && result != t + 8 * 60 * 60) {
+      ++data->errors;
+    }
+  }
+  return NULL;
+}
+
+TEST(time, localtime_r_and_mktime_while_TZ_changes) {
+  // Unlike setenv, putenv swaps the pointer in TZ's slot, so the readers never see a value
+  // that's being rewritten in place.
+  static char utc[] = "TZ=UTC";
+  static char los_angeles[] = "TZ=America/Los_Angeles";
+  setenv("TZ", "UTC", 1);
+  ASSERT_EQ(0, putenv(utc));
+  tzset();
+
+  LocaltimeRaceData data;
+  data.done = false;
+  data.errors = 0;
+  pthread_t threads[4];
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, LocaltimeRMktimeFn, &data));
+  }
+  for (size_t i = 0; i < 1000; ++i) {
+    putenv((i % 2 == 0) ? los_angeles : utc);
+    tzset();
+  }
+  data.done = true;
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_EQ(0, data.errors);
+
+  unsetenv("TZ");
+  tzset();
+}
+
 TEST(time, strftime) {
   setenv("TZ", "UTC", 1);
 
@@ -513,6 +690,218 @@ TEST(time, timer_delete_from_timer_thread) {
 #endif
 }
 
+#if defined(__BIONIC__)
+// With LIBC_TIMER_THREADS=1, SIGEV_THREAD timers share a single dispatcher thread. The variable
+// is read when the first SIGEV_THREAD timer is created, so each of these tests runs in a new
+// process, sets it and exits 0 if nothing failed.
+static void RunWithTimerDispatcher(void (*test)()) {
+  setenv("LIBC_TIMER_THREADS", "1", 1);
+  test();
+  exit(::testing::Test::HasFailure() ? 1 : 0);
+}
+
+static timer_t CreateThreadTimer(void (*fn)(sigval_t), void* arg) {
+  sigevent_t se;
+  memset(&se, 0, sizeof(se));
+  se.sigev_notify = SIGEV_THREAD;
+  se.sigev_notify_function = fn;
+  se.sigev_value.sival_ptr = arg;
+  timer_t timer_id;
+  EXPECT_EQ(0, timer_create(CLOCK_MONOTONIC, &se, &timer_id));
+  return timer_id;
+}
+
+struct DispatchedTimer {
+  timer_t timer_id;
+  std::atomic<int> count;
+  std::atomic<pid_t> tid;
+  std::atomic<int> overrun;
+  std::atomic<int> delete_result;
+};
+
+static void DispatchedCallback(sigval_t value) {
+  DispatchedTimer* timer = reinterpret_cast<DispatchedTimer*>(value.sival_ptr);
+  timer->tid = gettid();
+  ++timer->count;
+}
+
+static void WaitForCount(DispatchedTimer& timer, int count) {
+  for (int i = 0; i < 5000 && timer.count < count; ++i) {
+    usleep(1000);
+  }
+  ASSERT_LE(count, timer.count);
+}
+
+static void TimerDispatcherCallbacks() {
+  DispatchedTimer timers[2] = {};
+  for (auto& timer : timers) {
+    timer.timer_id = CreateThreadTimer(DispatchedCallback, &timer);
+    SetTime(timer.timer_id, 0, 1, 0, 0);
+  }
+  for (auto& timer : timers) {
+    WaitForCount(timer, 1);
+  }
+
+  // Both callbacks ran on the same thread, which isn't this one.
+  ASSERT_NE(gettid(), timers[0].tid);
+  ASSERT_EQ(timers[0].tid, timers[1].tid);
+
+  for (auto& timer : timers) {
+    ASSERT_EQ(0, timer_delete(timer.timer_id));
+  }
+}
+
+class time_DeathTest : public BionicDeathTest {};
+
+TEST_F(time_DeathTest, timer_dispatcher_callbacks) {
+  ASSERT_EXIT(RunWithTimerDispatcher(TimerDispatcherCallbacks), ::testing::ExitedWithCode(0), "");
+}
+
+static void DeleteDispatchedTimerCallback(sigval_t value) {
+  DispatchedTimer* timer = reinterpret_cast<DispatchedTimer*>(value.sival_ptr);
+  if (timer->count++ == 0) {
+    timer->delete_result = timer_delete(timer->timer_id);
+  }
+}
+
+static void TimerDispatcherDeleteFromCallback() {
+  // A busy timer keeps expirations queued on the dispatcher behind the deleted one's.
+  DispatchedTimer busy = {};
+  busy.timer_id = CreateThreadTimer(DispatchedCallback, &busy);
+  SetTime(busy.timer_id, 0, 100000, 0, 100000);
+
+  for (int i = 0; i < 100; ++i) {
+    DispatchedTimer timer = {};
+    timer.delete_result = -1;
+    timer.timer_id = CreateThreadTimer(DeleteDispatchedTimerCallback, &timer);
+    SetTime(timer.timer_id, 0, 100000, 0, 100000);
+    WaitForCount(timer, 1);
+    // The dispatcher handles the busy timer at least once more after freeing the deleted one.
+    int busy_count = busy.count;
+    WaitForCount(busy, busy_count + 2);
+    ASSERT_EQ(1, timer.count);
+    ASSERT_EQ(0, timer.delete_result);
+  }
+
+  ASSERT_EQ(0, timer_delete(busy.timer_id));
+}
+
+TEST_F(time_DeathTest, timer_dispatcher_delete_from_callback) {
+  ASSERT_EXIT(RunWithTimerDispatcher(TimerDispatcherDeleteFromCallback),
+              ::testing::ExitedWithCode(0), "");
+}
+
+static void SlowDispatchedCallback(sigval_t value) {
+  DispatchedTimer* timer = reinterpret_cast<DispatchedTimer*>(value.sival_ptr);
+  if (timer->count == 0) {
+    usleep(100000);
+  } else if (timer->count == 1) {
+    timer->overrun = timer_getoverrun(timer->timer_id);
+  }
+  ++timer->count;
+}
+
+static void TimerDispatcherGetoverrun() {
+  DispatchedTimer timer = {};
+  timer.overrun = -1;
+  timer.timer_id = CreateThreadTimer(SlowDispatchedCallback, &timer);
+
+  // The first callback takes 100ms, so the 1ms timer overruns while it runs.
+  SetTime(timer.timer_id, 0, 1000000, 0, 1000000);
+  WaitForCount(timer, 2);
+  ASSERT_EQ(0, timer_delete(timer.timer_id));
+  ASSERT_LT(10, timer.overrun);
+}
+
+TEST_F(time_DeathTest, timer_dispatcher_getoverrun) {
+  ASSERT_EXIT(RunWithTimerDispatcher(TimerDispatcherGetoverrun), ::testing::ExitedWithCode(0), "");
+}
+
+// Queues a message like the one timer_delete sends the thread that serves a deleted timer.
+static void QueueTimerMessage(pid_t tid, void* ptr) {
+  siginfo_t info;
+  memset(&info, 0, sizeof(info));
+  info.si_signo = __SIGRTMIN;  // The signal bionic uses for SIGEV_THREAD timers.
+  info.si_code = SI_QUEUE;
+  info.si_pid = getpid();
+  info.si_uid = getuid();
+  info.si_value.sival_ptr = ptr;
+  ASSERT_EQ(0, syscall(__NR_rt_tgsigqueueinfo, getpid(), tid, __SIGRTMIN, &info));
+}
+
+static void TimerDispatcherIgnoresStrayMessages() {
+  DispatchedTimer timer = {};
+  timer.timer_id = CreateThreadTimer(DispatchedCallback, &timer);
+  SetTime(timer.timer_id, 0, 1000000, 0, 1000000);
+  WaitForCount(timer, 1);
+
+  // Only timers that timer_delete handed over get freed, so neither of these is.
+  int not_a_timer = 0;
+  QueueTimerMessage(timer.tid, &not_a_timer);
+  QueueTimerMessage(timer.tid, timer.timer_id);
+  int count = timer.count;
+  WaitForCount(timer, count + 2);
+  ASSERT_EQ(0, timer_delete(timer.timer_id));
+}
+
+TEST_F(time_DeathTest, timer_dispatcher_ignores_stray_messages) {
+  ASSERT_EXIT(RunWithTimerDispatcher(TimerDispatcherIgnoresStrayMessages),
+              ::testing::ExitedWithCode(0), "");
+}
+
+// Makes every attempt to queue a signal fail with EAGAIN. Timer expirations still get through.
+static void FillSignalQueue() {
+  rlimit limit = { 0, 0 };
+  ASSERT_EQ(0, setrlimit(RLIMIT_SIGPENDING, &limit));
+}
+
+static void TimerDispatcherDeleteWithFullSignalQueue() {
+  DispatchedTimer busy = {};
+  busy.timer_id = CreateThreadTimer(DispatchedCallback, &busy);
+  SetTime(busy.timer_id, 0, 1000000, 0, 1000000);
+  DispatchedTimer timer = {};
+  timer.timer_id = CreateThreadTimer(DispatchedCallback, &timer);
+  SetTime(timer.timer_id, 0, 100000, 0, 100000);
+  WaitForCount(timer, 1);
+
+  // timer_delete doesn't wait for room in the queue, and the dispatcher carries on.
+  FillSignalQueue();
+  ASSERT_EQ(0, timer_delete(timer.timer_id));
+  int busy_count = busy.count;
+  WaitForCount(busy, busy_count + 2);
+  ASSERT_EQ(0, timer_delete(busy.timer_id));
+}
+
+TEST_F(time_DeathTest, timer_dispatcher_delete_with_full_signal_queue) {
+  ASSERT_EXIT(RunWithTimerDispatcher(TimerDispatcherDeleteWithFullSignalQueue),
+              ::testing::ExitedWithCode(0), "");
+}
+
+static void TimerDeleteWithFullSignalQueue() {
+  // Each SIGEV_THREAD timer gets a thread of its own.
+  unsetenv("LIBC_TIMER_THREADS");
+  DispatchedTimer timer = {};
+  timer.timer_id = CreateThreadTimer(DispatchedCallback, &timer);
+  SetTime(timer.timer_id, 0, 100000, 0, 100000);
+  WaitForCount(timer, 1);
+  pid_t tid = timer.tid;
+
+  // timer_delete can't signal the timer's thread, but the thread still exits.
+  FillSignalQueue();
+  ASSERT_EQ(0, timer_delete(timer.timer_id));
+  for (int i = 0; i < 5000 && syscall(__NR_tgkill, getpid(), tid, 0) == 0; ++i) {
+    usleep(1000);
+  }
+  ASSERT_EQ(-1, syscall(__NR_tgkill, getpid(), tid, 0));
+  ASSERT_EQ(ESRCH, errno);
+  exit(::testing::Test::HasFailure() ? 1 : 0);
+}
+
+TEST_F(time_DeathTest, timer_delete_with_full_signal_queue) {
+  ASSERT_EXIT(TimerDeleteWithFullSignalQueue(), ::testing::ExitedWithCode(0), "");
+}
+#endif
+
 TEST(time, clock_gettime) {
   // Try to ensure that our vdso clock_gettime is working.
   timespec ts1;
@@ -533,6 +922,32 @@ TEST(time, clock_gettime) {
   ASSERT_LT(ts2.tv_nsec, 1000000);
 }
 
+TEST(time, clock_getres) {
+  // Try to ensure that our vdso clock_getres agrees with the kernel.
+  timespec ts1;
+  ASSERT_EQ(0, clock_getres(CLOCK_MONOTONIC, &ts1));
+  timespec ts2;
+  ASSERT_EQ(0, syscall(__NR_clock_getres, CLOCK_MONOTONIC, &ts2));
+  ASSERT_EQ(ts2.tv_sec, ts1.tv_sec);
+  ASSERT_EQ(ts2.tv_nsec, ts1.tv_nsec);
+
+  errno = 0;
+  ASSERT_EQ(-1, clock_getres(-1, &ts1));
+  ASSERT_EQ(EINVAL, errno);
+}
+
+TEST(time, time) {
+  // Try to ensure that our vdso time is working.
+  timeval tv;
+  ASSERT_EQ(0, gettimeofday(&tv, NULL));
+  time_t t2;
+  time_t t1 = time(&t2);
+  ASSERT_EQ(t1, t2);
+  // A generous second, in case we crossed a second boundary.
+  ASSERT_LE(tv.tv_sec, t1);
+  ASSERT_LE(t1, tv.tv_sec + 1);
+}
+
 TEST(time, clock) {
   // clock(3) is hard to test, but a 1s sleep should cost less than 1ms.
   clock_t t0 = clock();